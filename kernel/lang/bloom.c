@@ -30,13 +30,12 @@
 static bool
 bloom_src(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 	uint32_t fold, addr;
 	__be32 mask;
 	char *mem;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -56,13 +55,12 @@ bloom_src(arguments_t args, struct qbuff * buff)
 static bool
 bloom_dst(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 	uint32_t fold, addr;
 	__be32 mask;
 	char *mem;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -81,13 +79,12 @@ bloom_dst(arguments_t args, struct qbuff * buff)
 static bool
 bloom(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 	uint32_t fold, addr;
 	__be32 mask;
 	char *mem;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
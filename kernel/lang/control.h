@@ -75,12 +75,14 @@ shift(arguments_t args, struct qbuff * b)
 	b->monad->shift++;
 	b->monad->ipoff = 0;
 	b->monad->ipproto = IPPROTO_NONE;
+	b->monad->parse.flags = 0;
 
 	ret = EVAL_FUNCTION(fun_, b);
 
 	b->monad->shift--;
 	b->monad->ipoff = 0;
 	b->monad->ipproto = IPPROTO_NONE;
+	b->monad->parse.flags = 0;
 
 	return ret;
 }
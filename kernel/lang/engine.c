@@ -30,6 +30,14 @@
 #include <pfq/global.h>
 #include <pfq/printk.h>
 
+#include <linux/percpu.h>
+#include <linux/timex.h>
+
+
+/* enabled while at least a group profiles its computation */
+
+static PFQ_DEFINE_STATIC_KEY_FALSE(pfq_lang_profile_key);
+
 
 const char *
 pfq_lang_signature_by_user_symbol(const char __user *symb)
@@ -139,32 +147,155 @@ strdup_user(const char __user *str)
 }
 
 
-static inline ActionQbuff
-pfq_lang_bind(struct qbuff * buff, struct pfq_lang_functional_node *node)
+static noinline ActionQbuff
+pfq_lang_run_profile(struct qbuff * buff, struct pfq_lang_computation_tree *prg, unsigned int sample)
 {
-	return EVAL_FUNCTION((function_t){&node->fun}, buff);
+	struct pfq_lang_profile *prof = this_cpu_ptr(prg->profile);
+	struct pfq_lang_instr const *ins = prg->prog, *end = prg->prog + prg->prog_size;
+	struct pfq_lang_node_profile *node = prof->node;
+	bool timed = (prof->count++ % sample) == 0;
+
+	for(; ins != end; ins++, node++)
+	{
+		cycles_t start = 0;
+
+		node->hit++;
+
+		if (timed)
+			start = get_cycles();
+
+		buff = ins->run(ins->fun, buff).qbuff;
+
+		if (timed) {
+			node->cycles += (unsigned long)(get_cycles() - start);
+			node->samples++;
+		}
+
+		if (buff == NULL || is_drop(buff->monad->fanout)) {
+			node->drop++;
+			break;
+		}
+
+		node->pass++;
+	}
+
+	return Pass(buff);
 }
 
 
 ActionQbuff
 pfq_lang_run(struct qbuff * buff, struct pfq_lang_computation_tree *prg)
 {
-	return pfq_lang_bind(buff, prg->entry_point);
+	struct pfq_lang_instr const *ins = prg->prog, *end = prg->prog + prg->prog_size;
+
+	if (pfq_static_branch_unlikely(&pfq_lang_profile_key)) {
+		int sample = buff->monad->group->lang_profile;
+		if (sample > 0)
+			return pfq_lang_run_profile(buff, prg, (unsigned int)sample);
+	}
+
+	for(; ins != end; ins++)
+	{
+		buff = ins->run(ins->fun, buff).qbuff;
+		if (buff == NULL || is_drop(buff->monad->fanout))
+			break;
+	}
+
+	return Pass(buff);
 }
 
 
 struct pfq_lang_computation_tree *
 pfq_lang_computation_alloc (struct pfq_lang_computation_descr const *descr)
 {
-        struct pfq_lang_computation_tree * c = kzalloc(sizeof(size_t) + descr->size * sizeof(struct pfq_lang_functional_node),
-						  GFP_KERNEL);
-	if (c)
-		c->size = descr->size;
+        struct pfq_lang_computation_tree * c = kzalloc(sizeof(struct pfq_lang_computation_tree) +
+						       descr->size * (sizeof(struct pfq_lang_functional_node) + sizeof(struct pfq_lang_instr)),
+						       GFP_KERNEL);
+	if (c == NULL)
+		return NULL;
+
+	c->profile = __alloc_percpu(sizeof(struct pfq_lang_profile) + descr->size * sizeof(struct pfq_lang_node_profile),
+				    __alignof__(struct pfq_lang_profile));
+	if (c->profile == NULL) {
+		kfree(c);
+		return NULL;
+	}
 
+	c->size = descr->size;
+	c->prog = (struct pfq_lang_instr *)&c->node[descr->size];
         return c;
 }
 
 
+void
+pfq_lang_computation_free(struct pfq_lang_computation_tree *comp)
+{
+	if (comp == NULL)
+		return;
+
+	free_percpu(comp->profile);
+	kfree(comp);
+}
+
+
+void
+pfq_lang_profile_enable(bool value)
+{
+	if (value)
+		pfq_static_branch_inc(&pfq_lang_profile_key);
+	else
+		pfq_static_branch_dec(&pfq_lang_profile_key);
+}
+
+
+/*
+ * Profile of the n-th instruction of the program, summed over the cpus.
+ * Returns the index of its function in the computation descriptor.
+ */
+
+size_t
+pfq_lang_profile_get(struct pfq_lang_computation_tree const *comp, size_t n, struct pfq_lang_node_profile *ret)
+{
+	int cpu;
+
+	memset(ret, 0, sizeof(*ret));
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_lang_node_profile const *node = &per_cpu_ptr(comp->profile, cpu)->node[n];
+
+		ret->hit     += node->hit;
+		ret->pass    += node->pass;
+		ret->drop    += node->drop;
+		ret->samples += node->samples;
+		ret->cycles  += node->cycles;
+	}
+
+	return comp->prog[n].index;
+}
+
+
+/*
+ * Profile of the computation, indexed as the functions of its descriptor
+ * (comp->size entries).
+ */
+
+void
+pfq_lang_profile_read(struct pfq_lang_computation_tree const *comp, struct pfq_lang_node_profile *node)
+{
+	size_t n;
+
+	memset(node, 0, comp->size * sizeof(*node));
+
+	for(n = 0; n < comp->prog_size; n++)
+	{
+		struct pfq_lang_node_profile prof;
+		size_t index = pfq_lang_profile_get(comp, n, &prof);
+		node[index] = prof;
+	}
+}
+
+
 void *
 pfq_lang_context_alloc(struct pfq_lang_computation_descr const *descr)
 {
@@ -464,10 +595,11 @@ pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp)
 
 
 static struct pfq_lang_functional_node *
-get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp, int index)
+get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp,
+			     int const *pos, int index)
 {
         if (index >= 0 && index < (int)descr->size) {
-                return &comp->node[index];
+                return &comp->node[pos[index]];
         }
 
 	return NULL;
@@ -475,34 +607,719 @@ get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, str
 
 
 /*
- * Prerequisite: valid computation (check by means of pfq_lang_validate_computation_descr)
+ * Node layout: the kleisli chain of the entry point is packed at the beginning
+ * of the tree in execution order, the remaining nodes (function arguments)
+ * follow in descriptor order. Returns the length of the chain.
  */
 
-int
-pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp, void *context)
+static size_t
+computation_layout(struct pfq_lang_computation_descr const *descr, int *pos)
+{
+	ptrdiff_t i = (ptrdiff_t)descr->entry_point;
+	size_t n, k = 0, chain;
+
+	for(n = 0; n < descr->size; n++)
+		pos[n] = -1;
+
+	for(; i >= 0 && i < (ptrdiff_t)descr->size && pos[i] == -1; i = descr->fun[i].next)
+		pos[i] = (int)k++;
+
+	chain = k;
+
+	for(n = 0; n < descr->size; n++)
+	{
+		if (pos[n] == -1)
+			pos[n] = (int)k++;
+	}
+
+	return chain;
+}
+
+
+/*
+ * Superinstructions: pairs of functions computed by a single one, that takes
+ * the arguments of the second.
+ */
+
+static const struct
+{
+	const char *first;
+	const char *second;
+	const char *fused;
+
+} fusion_table[] =
+{
+	{ "ip",	"steer_flow",		"steer_flow"		},
+	{ "ip",	"steer_p2p",		"steer_p2p"		},
+	{ "ip",	"steer_local_ip",	"steer_local_ip"	},
+	{ "ip",	"double_steer_ip",	"double_steer_ip"	},
+};
+
+
+static void *
+function_by_symbol(const char *symbol)
+{
+	struct symtable_entry *entry = pfq_lang_symtable_search(&global->functions, symbol);
+	return entry ? entry->function : NULL;
+}
+
+
+static function_ptr_t
+fuse_functions(void *first, void *second)
 {
 	size_t n;
 
-        /* size */
+	for(n = 0; n < ARRAY_SIZE(fusion_table); n++)
+	{
+		if (first  == function_by_symbol(fusion_table[n].first) &&
+		    second == function_by_symbol(fusion_table[n].second))
+			return (function_ptr_t)function_by_symbol(fusion_table[n].fused);
+	}
+
+	return NULL;
+}
 
-        comp->size = descr->size;
 
-        /* entry point */
+/*
+ * Optimizer: rewrites of the linked computation, before it is linearized.
+ *
+ * Predicates are pure, so the operands of and/or can be evaluated in any order
+ * and a predicate can be replaced by an equivalent one. The same holds for a
+ * run of filters in the kleisli chain: they pass or drop the packet, nothing
+ * else. Costs are static estimates, in arbitrary units.
+ */
+
+#define FUNCTION_COST_DEFAULT	4
+
+static const struct
+{
+	const char *symbol;
+	int	    cost;
+	bool	    filter;	/* pure filter, can be moved within the kleisli chain */
 
-        comp->entry_point = &comp->node[descr->entry_point];
+} optimizer_table[] =
+{
+	/* combinators: the cost of their arguments */
+
+	{ "unit",		0, true  },
+	{ "filter",		0, true  },
+	{ "not",		0, false },
+	{ "and",		0, false },
+	{ "or",			0, false },
+	{ "xor",		0, false },
+
+	{ "less",		1, false },
+	{ "less_eq",		1, false },
+	{ "greater",		1, false },
+	{ "greater_eq",		1, false },
+	{ "equal",		1, false },
+	{ "not_equal",		1, false },
+	{ "any_bit",		1, false },
+	{ "all_bit",		1, false },
+
+	/* link layer, mark and state */
+
+	{ "ip",			1, true  },
+	{ "vlan",		1, true  },
+	{ "l3_proto",		1, true  },
+	{ "mac_broadcast",	1, true  },
+	{ "mac_multicast",	1, true  },
+	{ "is_ip",		1, false },
+	{ "has_vlan",		1, false },
+	{ "has_vid",		1, false },
+	{ "has_mark",		1, false },
+	{ "has_state",		1, false },
+	{ "is_l3_proto",	1, false },
+	{ "is_broadcast",	1, false },
+	{ "is_multicast",	1, false },
+	{ "get_mark",		1, false },
+	{ "get_state",		1, false },
+
+	/* ip header */
+
+	{ "udp",		2, true  },
+	{ "tcp",		2, true  },
+	{ "icmp",		2, true  },
+	{ "flow",		2, true  },
+	{ "l4_proto",		2, true  },
+	{ "no_frag",		2, true  },
+	{ "no_more_frag",	2, true  },
+	{ "ip_broadcast",	2, true  },
+	{ "ip_multicast",	2, true  },
+	{ "is_udp",		2, false },
+	{ "is_tcp",		2, false },
+	{ "is_icmp",		2, false },
+	{ "is_flow",		2, false },
+	{ "is_l4_proto",	2, false },
+	{ "is_frag",		2, false },
+	{ "is_first_frag",	2, false },
+	{ "is_more_frag",	2, false },
+	{ "is_ip_broadcast",	2, false },
+	{ "is_ip_multicast",	2, false },
+	{ "ip_tos",		2, false },
+	{ "ip_tot_len",		2, false },
+	{ "ip_id",		2, false },
+	{ "ip_frag",		2, false },
+	{ "ip_ttl",		2, false },
+
+	/* transport header, addresses */
+
+	{ "port",		3, true  },
+	{ "src_port",		3, true  },
+	{ "dst_port",		3, true  },
+	{ "addr",		3, true  },
+	{ "src_addr",		3, true  },
+	{ "dst_addr",		3, true  },
+	{ "has_port",		3, false },
+	{ "has_src_port",	3, false },
+	{ "has_dst_port",	3, false },
+	{ "has_addr",		3, false },
+	{ "has_src_addr",	3, false },
+	{ "has_dst_addr",	3, false },
+	{ "tcp_source",		3, false },
+	{ "tcp_dest",		3, false },
+	{ "tcp_hdrlen",		3, false },
+	{ "udp_source",		3, false },
+	{ "udp_dest",		3, false },
+	{ "udp_len",		3, false },
+	{ "icmp_type",		3, false },
+	{ "icmp_code",		3, false },
+
+	/* lookups */
+
+	{ "vlan_id_filter",	4, true  },
+	{ "vlan_id",		4, false },
+	{ "incoming_host",	6, true  },
+	{ "ip_host",		6, true  },
+	{ "is_incoming_host",	6, false },
+	{ "is_ip_host",		6, false },
+	{ "flow_state",		6, false },
+	{ "bloom_filter",	8, true  },
+	{ "bloom_src_filter",	8, true  },
+	{ "bloom_dst_filter",	8, true  },
+	{ "bloom",		8, false },
+	{ "bloom_src",		8, false },
+	{ "bloom_dst",		8, false },
+};
+
+
+/*
+ * Predicates with a filter counterpart that takes the same arguments (and the
+ * same init/fini): filter p is computed by the counterpart on the arguments of p.
+ */
+
+static const struct
+{
+	const char *predicate;
+	const char *filter;
+
+} filter_fold_table[] =
+{
+	{ "is_ip",		"ip"			},
+	{ "is_udp",		"udp"			},
+	{ "is_tcp",		"tcp"			},
+	{ "is_icmp",		"icmp"			},
+	{ "is_flow",		"flow"			},
+	{ "has_vlan",		"vlan"			},
+	{ "is_l3_proto",	"l3_proto"		},
+	{ "is_l4_proto",	"l4_proto"		},
+	{ "has_port",		"port"			},
+	{ "has_src_port",	"src_port"		},
+	{ "has_dst_port",	"dst_port"		},
+	{ "has_addr",		"addr"			},
+	{ "has_src_addr",	"src_addr"		},
+	{ "has_dst_addr",	"dst_addr"		},
+	{ "vlan_id",		"vlan_id_filter"	},
+	{ "bloom",		"bloom_filter"		},
+	{ "bloom_src",		"bloom_src_filter"	},
+	{ "bloom_dst",		"bloom_dst_filter"	},
+};
+
+
+struct optimizer_symbols
+{
+	void *unit;
+	void *not_;
+	void *and_;
+	void *or_;
+	void *xor_;
+	void *when;
+	void *unless;
+	void *conditional;
+};
+
+
+static struct pfq_lang_functional_descr const *
+functional_descr(struct pfq_lang_computation_descr const *descr, struct pfq_lang_functional const *fun)
+{
+	return &descr->fun[container_of(fun, struct pfq_lang_functional_node, fun)->index];
+}
+
+
+static int
+optimizer_entry(void *run)
+{
+	struct symtable_entry *entry = pfq_lang_symtable_search_by_function(&global->functions, run);
+	size_t n;
+
+	if (entry == NULL)
+		return -1;
+
+	for(n = 0; n < ARRAY_SIZE(optimizer_table); n++)
+	{
+		if (strcmp(optimizer_table[n].symbol, entry->symbol) == 0)
+			return (int)n;
+	}
+
+	return -1;
+}
+
+
+static bool
+is_pure_filter(struct pfq_lang_functional const *fun)
+{
+	int e = optimizer_entry(fun->run);
+	return e >= 0 && optimizer_table[e].filter;
+}
+
+
+static function_ptr_t
+filter_counterpart(struct pfq_lang_functional const *fun)
+{
+	struct pfq_lang_functional const *pred;
+	struct symtable_entry *entry;
+	size_t n;
+
+	if (fun->run != function_by_symbol("filter"))
+		return NULL;
+
+	pred = (struct pfq_lang_functional const *)fun->arg[0].value;
+
+	entry = pfq_lang_symtable_search_by_function(&global->functions, pred->run);
+	if (entry == NULL)
+		return NULL;
+
+	for(n = 0; n < ARRAY_SIZE(filter_fold_table); n++)
+	{
+		if (strcmp(filter_fold_table[n].predicate, entry->symbol) == 0)
+			return (function_ptr_t)function_by_symbol(filter_fold_table[n].filter);
+	}
+
+	return NULL;
+}
+
+
+static int
+function_cost(struct pfq_lang_computation_descr const *descr, struct pfq_lang_functional const *fun, size_t depth)
+{
+	struct pfq_lang_functional_descr const *d;
+	int e, cost;
+	size_t i;
+
+	if (fun == NULL || depth > descr->size)
+		return 0;
+
+	e = optimizer_entry(fun->run);
+	cost = e < 0 ? FUNCTION_COST_DEFAULT : optimizer_table[e].cost;
+
+	d = functional_descr(descr, fun);
+
+	for(i = 0; i < ARRAY_SIZE(fun->arg); i++)
+	{
+		if (is_arg_function(&d->arg[i]))
+			cost += function_cost(descr, (struct pfq_lang_functional const *)fun->arg[i].value, depth + 1);
+	}
+
+	return cost;
+}
+
+
+static bool
+functional_equal(struct pfq_lang_computation_descr const *descr,
+		 struct pfq_lang_functional const *a, struct pfq_lang_functional const *b, size_t depth);
+
+
+static bool
+functional_args_equal(struct pfq_lang_computation_descr const *descr,
+		      struct pfq_lang_functional const *a, struct pfq_lang_functional const *b, size_t depth)
+{
+	struct pfq_lang_functional_descr const *da, *db;
+	size_t i;
+
+	if (a->run != b->run)
+		return false;
+
+	da = functional_descr(descr, a);
+	db = functional_descr(descr, b);
+
+	for(i = 0; i < ARRAY_SIZE(a->arg); i++)
+	{
+		struct pfq_lang_functional_arg_descr const *x = &da->arg[i], *y = &db->arg[i];
+		ptrdiff_t u = a->arg[i].value, v = b->arg[i].value;
+		ptrdiff_t j;
+
+		if (is_arg_function(x) || is_arg_function(y)) {
+			if (!is_arg_function(x) || !is_arg_function(y) ||
+			    !functional_equal(descr, (struct pfq_lang_functional const *)u,
+						     (struct pfq_lang_functional const *)v, depth + 1))
+				return false;
+			continue;
+		}
+
+		if (is_arg_null(x) != is_arg_null(y) || x->size != y->size || x->nelem != y->nelem)
+			return false;
+
+		if (is_arg_string(x)) {
+			if (strcmp((const char *)u, (const char *)v) != 0)
+				return false;
+		}
+		else if (is_arg_vector_str(x)) {
+			for(j = 0; j < x->nelem; j++)
+				if (strcmp(((char **)u)[j], ((char **)v)[j]) != 0)
+					return false;
+		}
+		else if (is_arg_data(x)) {
+			if (x->size > 8 ? memcmp((void *)u, (void *)v, x->size) != 0 : u != v)
+				return false;
+		}
+		else if (is_arg_vector(x) && x->nelem > 0) {
+			if (memcmp((void *)u, (void *)v, x->size * (size_t)x->nelem) != 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+static bool
+functional_equal(struct pfq_lang_computation_descr const *descr,
+		 struct pfq_lang_functional const *a, struct pfq_lang_functional const *b, size_t depth)
+{
+	if (a == b)
+		return true;
+
+	if (a == NULL || b == NULL || depth > descr->size)
+		return false;
+
+	return functional_args_equal(descr, a, b, depth) &&
+	       functional_equal(descr, a->next, b->next, depth + 1);
+}
+
+
+static bool
+is_unit_chain(struct pfq_lang_computation_descr const *descr, struct pfq_lang_functional const *fun, void *unit)
+{
+	size_t n;
+
+	for(n = 0; fun != NULL && n <= descr->size; fun = fun->next, n++)
+	{
+		if (fun->run != unit)
+			return false;
+	}
+
+	return fun == NULL;
+}
+
+
+static struct pfq_lang_functional *
+optimize_predicate(struct pfq_lang_computation_descr const *descr, struct optimizer_symbols const *sym,
+		   struct pfq_lang_functional *fun, size_t depth)
+{
+	struct pfq_lang_functional_descr const *d;
+	struct pfq_lang_functional *p, *q;
+	size_t i;
+
+	if (fun == NULL || depth > descr->size)
+		return fun;
+
+	if (fun->run != sym->not_ && fun->run != sym->and_ &&
+	    fun->run != sym->or_  && fun->run != sym->xor_)
+		return fun;
+
+	d = functional_descr(descr, fun);
+
+	for(i = 0; i < ARRAY_SIZE(fun->arg); i++)
+	{
+		if (is_arg_function(&d->arg[i]))
+			fun->arg[i].value = (ptrdiff_t)optimize_predicate(descr, sym, (struct pfq_lang_functional *)fun->arg[i].value, depth + 1);
+	}
+
+	p = (struct pfq_lang_functional *)fun->arg[0].value;
+	q = (struct pfq_lang_functional *)fun->arg[1].value;
+
+	if (fun->run == sym->not_) {
+
+		/* not (not p) = p */
+
+		if (p->run == sym->not_) {
+			pr_devel("[PFQ] rtlink: not (not %pF) simplified\n", ((struct pfq_lang_functional *)p->arg[0].value)->run);
+			return (struct pfq_lang_functional *)p->arg[0].value;
+		}
+		return fun;
+	}
+
+	if (fun->run == sym->xor_)
+		return fun;
+
+	/* p && p = p || p = p */
+
+	if (functional_equal(descr, p, q, depth + 1)) {
+		pr_devel("[PFQ] rtlink: %pF with equal operands simplified\n", fun->run);
+		return p;
+	}
+
+	/* short-circuit: the cheaper operand first */
+
+	if (function_cost(descr, q, depth + 1) < function_cost(descr, p, depth + 1)) {
+		pr_devel("[PFQ] rtlink: %pF operands swapped\n", fun->run);
+		fun->arg[0].value = (ptrdiff_t)q;
+		fun->arg[1].value = (ptrdiff_t)p;
+	}
+
+	return fun;
+}
+
+
+static void
+optimize_node(struct pfq_lang_computation_descr const *descr, struct optimizer_symbols const *sym,
+	      struct pfq_lang_functional *fun)
+{
+	struct pfq_lang_functional_descr const *d = functional_descr(descr, fun);
+	struct pfq_lang_functional *p;
+	bool then_, else_;
+	size_t i;
+
+	for(i = 0; i < ARRAY_SIZE(fun->arg); i++)
+	{
+		if (is_arg_function(&d->arg[i]))
+			fun->arg[i].value = (ptrdiff_t)optimize_predicate(descr, sym, (struct pfq_lang_functional *)fun->arg[i].value, 0);
+	}
+
+	if (fun->run != sym->when && fun->run != sym->unless && fun->run != sym->conditional)
+		return;
+
+	/* when (not p) f = unless p f, conditional (not p) f g = conditional p g f */
+
+	p = (struct pfq_lang_functional *)fun->arg[0].value;
+	if (p->run == sym->not_) {
+
+		fun->arg[0].value = p->arg[0].value;
+
+		if (fun->run == sym->conditional)
+			swap(fun->arg[1].value, fun->arg[2].value);
+		else
+			fun->run = fun->run == sym->when ? sym->unless : sym->when;
+	}
+
+	/* dead branches: unit does nothing */
+
+	if (fun->run != sym->conditional) {
+		if (is_unit_chain(descr, (struct pfq_lang_functional *)fun->arg[1].value, sym->unit))
+			fun->run = sym->unit;
+		return;
+	}
+
+	/* arg 2 is not cleared: when/unless ignore it, but the descriptor still
+	 * marks it as a function, walked by the passes that follow */
+
+	then_ = is_unit_chain(descr, (struct pfq_lang_functional *)fun->arg[1].value, sym->unit);
+	else_ = is_unit_chain(descr, (struct pfq_lang_functional *)fun->arg[2].value, sym->unit);
+
+	if (then_ && else_) {
+		fun->run = sym->unit;
+	}
+	else if (else_) {
+		fun->run = sym->when;
+	}
+	else if (then_) {
+		fun->run = sym->unless;
+		swap(fun->arg[1].value, fun->arg[2].value);
+	}
+}
+
+
+static bool
+is_chain_node(struct pfq_lang_computation_tree const *comp, size_t chain, struct pfq_lang_functional const *fun)
+{
+	return fun != NULL &&
+	       container_of(fun, struct pfq_lang_functional_node, fun) >= comp->node &&
+	       container_of(fun, struct pfq_lang_functional_node, fun) <  comp->node + chain;
+}
+
+
+/*
+ * Nodes of the chain can be moved unless they are also referenced from
+ * elsewhere (shared as function argument, or cyclic).
+ */
+
+static bool
+chain_is_shared(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree const *comp, size_t chain)
+{
+	size_t n, i;
+
+	if (chain == 0 || comp->node[chain-1].fun.next != NULL)
+		return true;
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_lang_functional const *fun = &comp->node[n].fun;
+		struct pfq_lang_functional_descr const *d = functional_descr(descr, fun);
+
+		if (n >= chain && is_chain_node(comp, chain, fun->next))
+			return true;
+
+		for(i = 0; i < ARRAY_SIZE(fun->arg); i++)
+		{
+			if (is_arg_function(&d->arg[i]) &&
+			    is_chain_node(comp, chain, (struct pfq_lang_functional const *)fun->arg[i].value))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * Runs of pure filters in the chain: the cheaper first (stable), duplicates
+ * elided.
+ */
+
+static void
+optimize_chain(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp,
+	       size_t chain, void *unit)
+{
+	size_t s, e, i, j;
+
+	for(s = 0; s < chain; s = e + 1)
+	{
+		for(e = s; e < chain && is_pure_filter(&comp->node[e].fun); e++)
+		{ }
+
+		for(i = s + 1; i < e; i++)
+		{
+			struct pfq_lang_functional_node tmp = comp->node[i];
+			int cost = function_cost(descr, &tmp.fun, 0);
+
+			for(j = i; j > s && function_cost(descr, &comp->node[j-1].fun, 0) > cost; j--)
+				comp->node[j] = comp->node[j-1];
+
+			if (j != i)
+				pr_devel("[PFQ] rtlink: %pF moved %zu -> %zu\n", tmp.fun.run, i, j);
+
+			comp->node[j] = tmp;
+		}
+
+		for(i = s + 1; i < e; i++)
+		{
+			for(j = s; j < i; j++)
+			{
+				if (comp->node[j].fun.run != unit &&
+				    functional_args_equal(descr, &comp->node[j].fun, &comp->node[i].fun, 0)) {
+					pr_devel("[PFQ] rtlink: %zu: duplicate %pF elided\n", i, comp->node[i].fun.run);
+					comp->node[i].fun.run = unit;
+					break;
+				}
+			}
+		}
+	}
+
+	for(i = 0; i + 1 < chain; i++)
+		comp->node[i].fun.next = &comp->node[i+1].fun;
+
+	comp->node[chain-1].fun.next = NULL;
+}
+
+
+static void
+computation_optimize(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp, size_t chain)
+{
+	struct optimizer_symbols sym =
+	{
+		.unit		= function_by_symbol("unit"),
+		.not_		= function_by_symbol("not"),
+		.and_		= function_by_symbol("and"),
+		.or_		= function_by_symbol("or"),
+		.xor_		= function_by_symbol("xor"),
+		.when		= function_by_symbol("when"),
+		.unless		= function_by_symbol("unless"),
+		.conditional	= function_by_symbol("conditional"),
+	};
+	bool shared = chain_is_shared(descr, comp, chain);
+	size_t n;
+
+	for(n = 0; n < comp->size; n++)
+		optimize_node(descr, &sym, &comp->node[n].fun);
+
+	if (!shared)
+		optimize_chain(descr, comp, chain, sym.unit);
+}
+
+
+/*
+ * Emit the program of the computation: the chain of functions in execution
+ * order, with unit elided, filters folded and known pairs fused.
+ */
+
+static size_t
+computation_linearize(struct pfq_lang_computation_tree *comp, size_t chain)
+{
+	struct pfq_lang_instr *ins = comp->prog;
+	void *unit = function_by_symbol("unit");
+	size_t n, size = 0;
+
+	for(n = 0; n < chain; n++)
+	{
+		struct pfq_lang_functional *fun = &comp->node[n].fun;
+		function_ptr_t run = (function_ptr_t)fun->run, fused, folded;
+
+		if (fun->run == unit)
+			continue;
+
+		if (global->lang_opt && (folded = filter_counterpart(fun)) != NULL) {
+			pr_devel("[PFQ] %zu: rtlink: filter folded into %pF\n", n, folded);
+			run = folded;
+			fun = (struct pfq_lang_functional *)fun->arg[0].value;
+		}
+
+		if (size > 0 && (fused = fuse_functions((void *)ins[size-1].run, (void *)run)) != NULL) {
+			pr_devel("[PFQ] %zu: rtlink: %pF fused into %pF\n", n, ins[size-1].run, fused);
+			ins[size-1].run   = fused;
+			ins[size-1].fun   = fun;
+			ins[size-1].index = comp->node[n].index;
+			continue;
+		}
+
+		ins[size].run   = run;
+		ins[size].fun   = fun;
+		ins[size].index = comp->node[n].index;
+		size++;
+	}
+
+	return size;
+}
+
+
+static int
+computation_link(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp,
+		 void *context, int const *pos)
+{
+	size_t n;
 
 	/* link functions */
 
         for(n = 0; n < descr->size; n++)
         {
 		struct pfq_lang_functional_descr const *fun;
-		struct pfq_lang_functional_node *next;
+		struct pfq_lang_functional_node *node, *next;
 		const char *signature;
 		init_ptr_t init, fini;
 		void *addr;
                 size_t i;
 
                 fun = &descr->fun[n];
+		node = &comp->node[pos[n]];
 
 		addr = resolve_user_symbol(&global->functions, fun->symbol, &signature, &init, &fini);
 		if (addr == NULL) {
@@ -510,18 +1327,19 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 			return -EPERM;
 		}
 
-		next = get_functional_node_by_index(descr, comp, (int)descr->fun[n].next);
+		next = get_functional_node_by_index(descr, comp, pos, (int)descr->fun[n].next);
 
-		comp->node[n].init = init;
-		comp->node[n].fini = fini;
+		node->init  = init;
+		node->fini  = fini;
+		node->index = n;
 
-		comp->node[n].fun.run  = addr;
-                comp->node[n].fun.next = next ? &next->fun : NULL;
+		node->fun.run  = addr;
+                node->fun.next = next ? &next->fun : NULL;
 
-		for(i = 0; i < sizeof(comp->node[n].fun.arg)/sizeof(comp->node[n].fun.arg[0]); i++)
+		for(i = 0; i < sizeof(node->fun.arg)/sizeof(node->fun.arg[0]); i++)
 		{
-			comp->node[n].fun.arg[i].value = 0;
-			comp->node[n].fun.arg[i].nelem = 0;
+			node->fun.arg[i].value = 0;
+			node->fun.arg[i].nelem = 0;
 		}
 
 		for(i = 0; i < sizeof(fun->arg)/sizeof(fun->arg[0]); i++)
@@ -534,8 +1352,8 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 					return -EPERM;
 				}
 
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)str;
-				comp->node[n].fun.arg[i].nelem = -1ULL;
+				node->fun.arg[i].value = (ptrdiff_t)str;
+				node->fun.arg[i].nelem = -1ULL;
 			}
 			else if (is_arg_vector_str(&fun->arg[i])) {
 
@@ -560,8 +1378,8 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 					}
 				}
 
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)base_ptr;
-				comp->node[n].fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
+				node->fun.arg[i].value = (ptrdiff_t)base_ptr;
+				node->fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
 			}
 			else if (is_arg_data(&fun->arg[i])) {
 
@@ -573,8 +1391,8 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 						return -EPERM;
 					}
 
-					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
-					comp->node[n].fun.arg[i].nelem = -1ULL;
+					node->fun.arg[i].value = (ptrdiff_t)ptr;
+					node->fun.arg[i].nelem = -1ULL;
 				}
 				else {
 					ptrdiff_t arg = 0;
@@ -584,8 +1402,8 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 						return -EPERM;
 					}
 
-					comp->node[n].fun.arg[i].value = arg;
-					comp->node[n].fun.arg[i].nelem = -1ULL;
+					node->fun.arg[i].value = arg;
+					node->fun.arg[i].nelem = -1ULL;
 				}
 
 			}
@@ -600,19 +1418,19 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 						return -EPERM;
 					}
 
-					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
-					comp->node[n].fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
+					node->fun.arg[i].value = (ptrdiff_t)ptr;
+					node->fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
 				}
 				else {  /* empty vector */
 
-					comp->node[n].fun.arg[i].value = 0xdeadbeef;
-					comp->node[n].fun.arg[i].nelem = 0;
+					node->fun.arg[i].value = 0xdeadbeef;
+					node->fun.arg[i].nelem = 0;
 				}
 			}
 			else if (is_arg_function(&fun->arg[i])) {
 
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)get_functional_node_by_index(descr, comp, (int)fun->arg[i].size);
-				comp->node[n].fun.arg[i].nelem = -1ULL;
+				node->fun.arg[i].value = (ptrdiff_t)get_functional_node_by_index(descr, comp, pos, (int)fun->arg[i].size);
+				node->fun.arg[i].nelem = -1ULL;
 			}
 			else if (!is_arg_null(&fun->arg[i])) {
 
@@ -627,3 +1445,37 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 }
 
 
+/*
+ * Prerequisite: valid computation (check by means of pfq_lang_validate_computation_descr)
+ */
+
+int
+pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp, void *context)
+{
+	size_t chain;
+	int *pos, err;
+
+	pos = kmalloc_array(descr->size, sizeof(int), GFP_KERNEL);
+	if (pos == NULL) {
+		printk(KERN_INFO "[PFQ] rtlink: could not allocate memory!\n");
+		return -ENOMEM;
+	}
+
+	chain = computation_layout(descr, pos);
+
+        /* size and entry point */
+
+        comp->size = descr->size;
+        comp->entry_point = &comp->node[pos[descr->entry_point]];
+
+	err = computation_link(descr, comp, context, pos);
+	if (err == 0) {
+		if (global->lang_opt)
+			computation_optimize(descr, comp, chain);
+		comp->prog_size = computation_linearize(comp, chain);
+	}
+
+	kfree(pos);
+	return err;
+}
+
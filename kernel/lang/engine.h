@@ -70,6 +70,7 @@ extern int pfq_lang_computation_init(struct pfq_lang_computation_tree *comp);
 extern int pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp);
 
 extern struct pfq_lang_computation_tree * pfq_lang_computation_alloc(struct pfq_lang_computation_descr const *);
+extern void pfq_lang_computation_free(struct pfq_lang_computation_tree *comp);
 extern void * pfq_lang_context_alloc(struct pfq_lang_computation_descr const *);
 extern const char *pfq_lang_signature_by_user_symbol(const char __user *symb);
 extern size_t pfq_lang_number_of_arguments(struct pfq_lang_functional_descr const *fun);
@@ -78,5 +79,9 @@ extern char * strdup_user(const char __user *str);
 
 extern ActionQbuff pfq_lang_run(struct qbuff *, struct pfq_lang_computation_tree *prg);
 
+extern void   pfq_lang_profile_enable(bool value);
+extern size_t pfq_lang_profile_get(struct pfq_lang_computation_tree const *comp, size_t n, struct pfq_lang_node_profile *ret);
+extern void   pfq_lang_profile_read(struct pfq_lang_computation_tree const *comp, struct pfq_lang_node_profile *node);
+
 
 #endif /* PFQ_LANG_ENGINE_H */
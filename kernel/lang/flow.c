@@ -0,0 +1,191 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/flow_table.h>
+#include <pfq/nethdr.h>
+
+
+/****************************************************************
+ * 	flow table of the group (see struct pfq_shared_flow_table)
+ ****************************************************************/
+
+/* the flow of the packet: IPv4 addresses and protocol, with the ports of tcp, udp and
+ * sctp. The fragments but the first one are not tracked. */
+
+static bool
+flow_tuple(struct qbuff * buff, struct pfq_flow_tuple *t, bool *closing)
+{
+	const struct iphdr *ip;
+
+	ip = qbuff_ip_hdr(buff);
+	if (ip == NULL || (qbuff_ip_frag(buff) & __constant_htons(IP_OFFSET)))
+		return false;
+
+	t->saddr = ip->saddr;
+	t->daddr = ip->daddr;
+	t->sport = 0;
+	t->dport = 0;
+	t->proto = ip->protocol;
+	*closing = false;
+
+	switch(ip->protocol)
+	{
+	case IPPROTO_TCP: {
+		struct tcphdr _tcp;
+		const struct tcphdr *tcp;
+
+		tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
+		if (tcp == NULL)
+			return false;
+
+		t->sport = tcp->source;
+		t->dport = tcp->dest;
+		*closing = tcp->fin || tcp->rst;
+	} break;
+
+	case IPPROTO_UDP:
+	case IPPROTO_SCTP: {
+		__be16 _ports[2];
+		const __be16 *ports;
+
+		ports = qbuff_l4_header_pointer(buff, 0, sizeof(_ports), _ports);
+		if (ports == NULL)
+			return false;
+
+		t->sport = ports[0];
+		t->dport = ports[1];
+	} break;
+	}
+
+	return true;
+}
+
+
+static inline struct pfq_flow_table *
+flow_table(struct qbuff * buff)
+{
+	return (struct pfq_flow_table *)atomic_long_read(&buff->monad->group->flow);
+}
+
+
+/* the packet is accounted to its flow once, no matter how many flow functions are evaluated */
+
+static struct pfq_flow_entry *
+flow_account(struct qbuff * buff)
+{
+	struct pfq_lang_parse *p = &buff->monad->parse;
+
+	if (!(p->flags & Q_PARSE_FLOW_ACCT))
+	{
+		struct pfq_flow_table *table = flow_table(buff);
+		struct pfq_flow_tuple t;
+		bool closing;
+
+		p->flow = NULL;
+		p->flow_packets = 0;
+
+		if (unlikely(table == NULL)) {
+			if (printk_ratelimit())
+				printk(KERN_INFO "[pfq-lang] flow: the group has no flow table!\n");
+		}
+		else if (flow_tuple(buff, &t, &closing)) {
+			p->flow = pfq_flow_table_update(table, &t, qbuff_len(buff), closing, &p->flow_packets);
+		}
+
+		p->flags |= Q_PARSE_FLOW | Q_PARSE_FLOW_ACCT;
+	}
+
+	return p->flow;
+}
+
+
+static struct pfq_flow_entry *
+flow_lookup(struct qbuff * buff)
+{
+	struct pfq_lang_parse *p = &buff->monad->parse;
+
+	if (!(p->flags & Q_PARSE_FLOW))
+	{
+		struct pfq_flow_table *table = flow_table(buff);
+		struct pfq_flow_tuple t;
+		bool closing;
+
+		p->flow = NULL;
+		if (table && flow_tuple(buff, &t, &closing))
+			p->flow = pfq_flow_table_find(table, &t);
+
+		p->flags |= Q_PARSE_FLOW;
+	}
+
+	return p->flow;
+}
+
+
+static ActionQbuff
+flow_count(arguments_t args, struct qbuff * buff)
+{
+	flow_account(buff);
+	return Pass(buff);
+}
+
+
+/* the packets that are not tracked pass: a full table does not hide new flows */
+
+static ActionQbuff
+flow_first(arguments_t args, struct qbuff * buff)
+{
+	const int num = GET_ARG(int,args);
+
+	if (flow_account(buff) == NULL)
+		return Pass(buff);
+
+	if (num > 0 && buff->monad->parse.flow_packets <= (uint64_t)num)
+		return Pass(buff);
+
+	return Drop(buff);
+}
+
+
+static uint64_t
+flow_state(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_flow_entry *e = flow_lookup(buff);
+
+	if (e == NULL)
+		return NOTHING;
+
+	return (uint64_t)JUST(__atomic_load_n(&e->state, __ATOMIC_RELAXED));
+}
+
+
+struct pfq_lang_function_descr flow_functions[] = {
+
+	{ "flow_count",	"Qbuff -> Action Qbuff",		flow_count , NULL, NULL },
+	{ "flow_first",	"CInt  -> Qbuff -> Action Qbuff",	flow_first , NULL, NULL },
+	{ "flow_state",	"Qbuff -> Word64",			flow_state , NULL, NULL },
+
+	{ NULL }};
+
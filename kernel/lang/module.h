@@ -155,13 +155,36 @@ struct pfq_lang_functional_node
 	init_ptr_t	      init;
 	fini_ptr_t	      fini;
 
+	size_t		      index;		/* index in the computation descriptor */
 	bool		      initialized;
 };
 
 
+/* linearized program: the kleisli chain of the entry point, in execution order */
+
+struct pfq_lang_instr
+{
+	function_ptr_t	       run;
+	struct pfq_lang_functional *fun;		/* arguments */
+	size_t		       index;			/* function in the computation descriptor */
+};
+
+
+/* per-cpu profile of the program (one node per instruction) */
+
+struct pfq_lang_profile
+{
+	unsigned long count;				/* packets, for sampling */
+	struct pfq_lang_node_profile node[];
+};
+
+
 struct pfq_lang_computation_tree
 {
 	size_t size;
+	size_t prog_size;
+	struct pfq_lang_instr *prog;
+	struct pfq_lang_profile __percpu *profile;
 	struct pfq_lang_functional_node *entry_point;
 	struct pfq_lang_functional_node node[];
 };
@@ -32,6 +32,8 @@
 #include <pfq/kcompat.h>
 #include <pfq/qbuff.h>
 
+#include <linux/ip.h>
+
 /* The Action monad */
 
 typedef struct
@@ -66,6 +68,26 @@ typedef struct
 #define EPOINT_SRC	(1<<0)
 #define EPOINT_DST	(1<<1)
 
+/* parse cache: filled lazily by qbuff_ip_hdr and qbuff_l4_header_pointer
+ * (and by the flow functions, see lang/flow.c) */
+
+#define Q_PARSE_IP	(1<<0)
+#define Q_PARSE_L4	(1<<1)
+#define Q_PARSE_FLOW	(1<<2)		/* flow looked up */
+#define Q_PARSE_FLOW_ACCT (1<<3)	/* packet accounted to the flow */
+
+struct pfq_lang_parse
+{
+	unsigned int		flags;		/* Q_PARSE_ */
+	const struct iphdr	*ip;		/* IPv4 header (linear data or ip_buf), NULL if none */
+	__be16			frag;		/* frag_off & (IP_MF|IP_OFFSET) */
+	int			l4off;		/* L4 offset from the mac header, -1 if none */
+	int			l4proto;
+	struct iphdr		ip_buf;
+	struct pfq_flow_entry	*flow;		/* flow of the packet, NULL if not tracked */
+	uint64_t		flow_packets;	/* packets of the flow, this one included */
+};
+
 /* Action monad */
 
 struct pfq_lang_monad
@@ -77,6 +99,7 @@ struct pfq_lang_monad
 	int			ipoff;
         int			ipproto;
         int			ep_ctx;		/* endpoint context */
+	struct pfq_lang_parse	parse;
 };
 
 /* Fanout constructors */
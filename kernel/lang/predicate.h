@@ -168,63 +168,59 @@ is_ip(struct qbuff * buff)
 static inline bool
 is_udp(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
                 return false;
 
 	if (ip->protocol != IPPROTO_UDP)
                 return false;
 
-        return qbuff_header_available(buff, (int)qbuff_maclen(buff)  + (ip->ihl<<2), sizeof(struct udphdr));
+        return qbuff_l4_header_available(buff, sizeof(struct udphdr));
 }
 
 
 static inline bool
 is_tcp(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
                 return false;
 
 	if (ip->protocol != IPPROTO_TCP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct tcphdr));
+	return qbuff_l4_header_available(buff, sizeof(struct tcphdr));
 }
 
 
 static inline bool
 is_icmp(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
                 return false;
 
 	if (ip->protocol != IPPROTO_ICMP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct icmphdr));
+	return qbuff_l4_header_available(buff, sizeof(struct icmphdr));
 }
 
 
 static inline bool
 has_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
         bool ctx = buff->monad->ep_ctx;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -236,10 +232,9 @@ has_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 static inline bool
 has_src_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -249,10 +244,9 @@ has_src_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 static inline bool
 has_dst_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -263,10 +257,9 @@ has_dst_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 static inline bool
 is_flow(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -274,7 +267,7 @@ is_flow(struct qbuff * buff)
 	    ip->protocol != IPPROTO_TCP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), ip->protocol == IPPROTO_UDP ?
+	return qbuff_l4_header_available(buff, ip->protocol == IPPROTO_UDP ?
 				    sizeof(struct udphdr) : sizeof(struct tcphdr));
 }
 
@@ -289,10 +282,9 @@ is_l3_proto(struct qbuff * buff, uint16_t type)
 static inline bool
 is_l4_proto(struct qbuff * buff, uint8_t protocol)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -303,49 +295,27 @@ is_l4_proto(struct qbuff * buff, uint8_t protocol)
 static inline bool
 is_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-        return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) != 0;
+	return qbuff_ip_frag(buff) != 0;
 }
 
 static inline bool
 is_first_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-        return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) == __constant_htons(IP_MF);
+	return qbuff_ip_frag(buff) == __constant_htons(IP_MF);
 }
 
 static inline bool
 is_more_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-	return (ip->frag_off & __constant_htons(IP_OFFSET)) != 0;
+	return (qbuff_ip_frag(buff) & __constant_htons(IP_OFFSET)) != 0;
 }
 
 static inline bool
 has_src_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -353,7 +323,7 @@ has_src_port(struct qbuff * buff, uint16_t port)
 	{
 	case IPPROTO_UDP: {
 		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(struct udphdr), &_udph);
 		if (udp == NULL)
 			return false;
 
@@ -361,7 +331,7 @@ has_src_port(struct qbuff * buff, uint16_t port)
 	}
 	case IPPROTO_TCP: {
 		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+		tcp = qbuff_l4_header_pointer(buff, 0, sizeof(struct tcphdr), &_tcph);
 		if (tcp == NULL)
 			return false;
 
@@ -375,10 +345,9 @@ has_src_port(struct qbuff * buff, uint16_t port)
 static inline bool
 has_dst_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -386,7 +355,7 @@ has_dst_port(struct qbuff * buff, uint16_t port)
 	{
 	case IPPROTO_UDP: {
 		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(struct udphdr), &_udph);
 		if (udp == NULL)
 			return false;
 
@@ -394,7 +363,7 @@ has_dst_port(struct qbuff * buff, uint16_t port)
 	}
 	case IPPROTO_TCP: {
 		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+		tcp = qbuff_l4_header_pointer(buff, 0, sizeof(struct tcphdr), &_tcph);
 		if (tcp == NULL)
 			return false;
 
@@ -453,11 +422,10 @@ is_multicast(struct qbuff * buff)
 static inline bool
 is_ip_broadcast(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
         bool ctx = buff->monad->ep_ctx;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -469,11 +437,10 @@ is_ip_broadcast(struct qbuff * buff)
 static inline bool
 is_ip_multicast(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
         bool ctx = buff->monad->ep_ctx;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -485,10 +452,9 @@ is_ip_multicast(struct qbuff * buff)
 static inline bool
 is_ip_host(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -499,14 +465,13 @@ is_ip_host(struct qbuff * buff)
 static inline bool
 is_incoming_host(struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 	struct ethhdr *eth = qbuff_eth_hdr(buff);
 
 	if (is_broadcast_ether_addr(eth->h_dest) || is_multicast_ether_addr(eth->h_dest))
 		return true;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return false;
 
@@ -33,10 +33,9 @@
 static uint64_t
 ip_tos(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
@@ -47,10 +46,9 @@ ip_tos(arguments_t args, struct qbuff * buff)
 static uint64_t
 ip_tot_len(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
@@ -61,10 +59,9 @@ ip_tot_len(arguments_t args, struct qbuff * buff)
 static uint64_t
 ip_id(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
@@ -75,10 +72,9 @@ ip_id(arguments_t args, struct qbuff * buff)
 static uint64_t
 ip_ttl(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
@@ -88,10 +84,9 @@ ip_ttl(arguments_t args, struct qbuff * buff)
 static uint64_t
 ip_frag(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
@@ -106,20 +101,19 @@ ip_frag(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -130,20 +124,19 @@ tcp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -153,20 +146,19 @@ tcp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -180,20 +172,19 @@ tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -204,20 +195,19 @@ udp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -227,20 +217,19 @@ udp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_len(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -251,20 +240,19 @@ udp_len(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_type(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_ICMP)
 		return NOTHING;
 
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -275,20 +263,19 @@ icmp_type(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_code(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return NOTHING;
 
 	if (ip->protocol != IPPROTO_ICMP)
 		return NOTHING;
 
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -141,21 +141,78 @@ qbuff_ip_version(struct qbuff * buff)
 }
 
 
+/* parse cache: headers are parsed once per packet (and per shift level) */
+
+static inline const struct iphdr *
+qbuff_ip_hdr(struct qbuff * buff)
+{
+	struct pfq_lang_parse *p = &buff->monad->parse;
+
+	if (unlikely(!(p->flags & Q_PARSE_IP)))
+	{
+		p->ip = qbuff_ip_header_pointer(buff, 0, sizeof(struct iphdr), &p->ip_buf);
+		p->frag = p->ip ? p->ip->frag_off & __constant_htons(IP_MF|IP_OFFSET) : 0;
+		p->flags |= Q_PARSE_IP;
+	}
+
+	return p->ip;
+}
+
+
+static inline __be16
+qbuff_ip_frag(struct qbuff * buff)
+{
+	return qbuff_ip_hdr(buff) ? buff->monad->parse.frag : 0;
+}
+
+
 static inline int
 qbuff_ip_protocol(struct qbuff * buff)
 {
-	switch(qbuff_ip_version(buff))
+	const struct iphdr *ip = qbuff_ip_hdr(buff);
+	return ip ? ip->protocol : IPPROTO_NONE;
+}
+
+
+static inline int
+qbuff_l4_offset(struct qbuff * buff)
+{
+	struct pfq_lang_parse *p = &buff->monad->parse;
+
+	if (unlikely(!(p->flags & Q_PARSE_L4)))
 	{
-	case 4: {
-		struct iphdr _iph;
-		const struct iphdr *ip;
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-		if (ip)
-			return ip->protocol;
-	} break;
+		const struct iphdr *ip = qbuff_ip_hdr(buff);
+		if (ip) {
+			p->l4off   = buff->monad->ipoff + (ip->ihl<<2);
+			p->l4proto = ip->protocol;
+		}
+		else {
+			p->l4off   = -1;
+			p->l4proto = IPPROTO_NONE;
+		}
+		p->flags |= Q_PARSE_L4;
 	}
 
-	return IPPROTO_NONE;
+	return p->l4off;
+}
+
+
+static inline bool
+qbuff_l4_header_available(struct qbuff * buff, int len)
+{
+	int off = qbuff_l4_offset(buff);
+	return off >= 0 && off + len <= (int)qbuff_len(buff);
+}
+
+
+static inline const void *
+qbuff_l4_header_pointer(struct qbuff * buff, int offset, int len, void *buffer)
+{
+	int off = qbuff_l4_offset(buff);
+	if (off < 0)
+		return NULL;
+
+	return qbuff_header_pointer(buff, off + offset, len, buffer);
 }
 
 
@@ -43,7 +43,7 @@ steering_key(arguments_t args, struct qbuff * buff)
         uint32_t hash, src_hash, dst_hash;
 	uint64_t field;
 
-	struct iphdr   _ip;    struct iphdr const *ip;
+	struct iphdr const *ip;
 	struct udphdr  _udp;   struct udphdr const *udp;
 	struct icmphdr _icmp;  struct icmphdr const *icmp;
 
@@ -51,7 +51,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 	{
 	case Q_KEY_IP_SRC|Q_KEY_IP_DST|Q_KEY_IP_PROTO: {
 
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+		ip = qbuff_ip_hdr(buff);
 		if (ip == NULL)
 			return Drop(buff);
 
@@ -60,7 +60,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 	}
 	case Q_KEY_IP_SRC|Q_KEY_IP_DST|Q_KEY_SRC_PORT|Q_KEY_DST_PORT|Q_KEY_IP_PROTO: {
 
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+		ip = qbuff_ip_hdr(buff);
 		if (ip == NULL)
 			return Drop(buff);
 
@@ -69,7 +69,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 		    	return Drop(buff);
 		}
 
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 		if (udp == NULL)
 			return Drop(buff);  /* broken */
 
@@ -111,7 +111,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_IP_SRC:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+                        ip = qbuff_ip_hdr(buff);
                         if (ip == NULL)
                                 return Drop(buff);
 	                src_hash = ((src_hash << 5) + src_hash) + ip->saddr;
@@ -120,7 +120,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_IP_DST:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+                        ip = qbuff_ip_hdr(buff);
                         if (ip == NULL)
                                 return Drop(buff);
 	                dst_hash = ((dst_hash << 5) + dst_hash) + ip->daddr;
@@ -128,7 +128,7 @@ steering_key(arguments_t args, struct qbuff * buff)
                 } break;
                 case Q_KEY_IP_PROTO:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+                        ip = qbuff_ip_hdr(buff);
                         if (ip == NULL)
                                 return Drop(buff);
 	                hash = ((hash << 5) + hash) + ip->protocol;
@@ -136,7 +136,7 @@ steering_key(arguments_t args, struct qbuff * buff)
                 } break;
                 case Q_KEY_IP_ECN:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+                        ip = qbuff_ip_hdr(buff);
                         if (ip == NULL)
                                 return Drop(buff);
 	                hash = ((hash << 5) + hash) + (ip->tos & IP_TOS_MASK);
@@ -145,7 +145,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_IP_DSCP:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
+                        ip = qbuff_ip_hdr(buff);
                         if (ip == NULL)
                                 return Drop(buff);
 	                hash = ((hash << 5) + hash) + (ip->tos & IP_DSCP_MASK);
@@ -154,7 +154,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_SRC_PORT:
                 {
-                        udp = qbuff_ip_header_pointer(buff, 0, sizeof(_udp), &_udp);
+                        udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
                         if (udp == NULL)
                                 return Drop(buff);
 
@@ -164,7 +164,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_DST_PORT:
                 {
-                        udp = qbuff_ip_header_pointer(buff, 0, sizeof(_udp), &_udp);
+                        udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
                         if (udp == NULL)
                                 return Drop(buff);
 
@@ -174,7 +174,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_ICMP_TYPE:
                 {
-                        icmp = qbuff_ip_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
+                        icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
                         if (icmp == NULL)
                                 return Drop(buff);
 
@@ -184,7 +184,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_ICMP_CODE:
                 {
-                        icmp = qbuff_ip_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
+                        icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
                         if (icmp == NULL)
                                 return Drop(buff);
 
@@ -377,10 +377,9 @@ steering_vlan_id(arguments_t args, struct qbuff * buff)
 static ActionQbuff
 steering_p2p(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return Drop(buff);
 
@@ -395,10 +394,9 @@ steering_p2p(arguments_t args, struct qbuff * buff)
 static ActionQbuff
 double_steering_ip(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return Drop(buff);
 
@@ -420,10 +418,9 @@ static ActionQbuff
 steering_local_ip(arguments_t args, struct qbuff * buff)
 {
 	struct CIDR_ *data = GET_PTR_0(struct CIDR_, args);
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return Drop(buff);
 
@@ -474,11 +471,10 @@ steering_local_net(arguments_t args, struct qbuff * buff)
 	__be32 mask    = GET_ARG_1(__be32, args);
 	__be32 submask = GET_ARG_2(__be32, args);
 
-	struct iphdr _iph;
 	const struct iphdr *ip;
 	bool src_net, dst_net;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return Drop(buff);
 
@@ -505,14 +501,13 @@ steering_local_net(arguments_t args, struct qbuff * buff)
 static ActionQbuff
 steering_flow(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
 	const struct iphdr *ip;
 
 	struct udphdr _udp;
 	const struct udphdr *udp;
 	__be32 hash;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	ip = qbuff_ip_hdr(buff);
 	if (ip == NULL)
 		return Drop(buff);
 
@@ -521,7 +516,7 @@ steering_flow(arguments_t args, struct qbuff * buff)
 		return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
 	}
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return Drop(buff);  /* broken */
 
@@ -39,6 +39,7 @@ extern struct pfq_lang_function_descr  steering_functions[];
 extern struct pfq_lang_function_descr  predicate_functions[];
 extern struct pfq_lang_function_descr  combinator_functions[];
 extern struct pfq_lang_function_descr  property_functions[];
+extern struct pfq_lang_function_descr  flow_functions[];
 extern struct pfq_lang_function_descr  control_functions[];
 extern struct pfq_lang_function_descr  misc_functions[];
 extern struct pfq_lang_function_descr  dummy_functions[];
@@ -76,6 +77,22 @@ __pfq_lang_symtable_search(struct symtable *table, const char *symbol)
 }
 
 
+static struct symtable_entry *
+__pfq_lang_symtable_search_by_function(struct symtable *table, const void *function)
+{
+        size_t n = 0;
+        if (function != NULL)
+	{
+		for(; n < table->size; ++n)
+		{
+			if (table->entry[n].function == function)
+				return &table->entry[n];
+		}
+	}
+	return NULL;
+}
+
+
 static struct symtable_entry *
 __pfq_lang_get_free_entry(struct symtable *table)
 {
@@ -228,6 +245,7 @@ pfq_lang_symtable_init(void)
         pfq_lang_symtable_register_functions(NULL, &global->functions, predicate_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, combinator_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, property_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, flow_functions);
 
 	numfun = pfq_lang_symtable_pr_devel("pfq-lang functions",   &global->functions);
 
@@ -260,6 +278,19 @@ pfq_lang_symtable_search(struct symtable *table, const char *symbol)
 }
 
 
+struct symtable_entry *
+pfq_lang_symtable_search_by_function(struct symtable *table, const void *function)
+{
+	void *ptr;
+
+        down_read(&global->symtable_sem);
+	ptr = __pfq_lang_symtable_search_by_function(table, function);
+	up_read(&global->symtable_sem);
+
+        return ptr;
+}
+
+
 int
 pfq_lang_symtable_register_function(const char *module, struct symtable *table, const char *symbol, void *fun,
 				    init_ptr_t init, fini_ptr_t fini, const char *signature)
@@ -65,6 +65,7 @@ extern int  pfq_lang_symtable_register_functions(const char *module, struct symt
 extern int  pfq_lang_symtable_unregister_function(const char *module, struct symtable *table, const char *symbol);
 extern void pfq_lang_symtable_unregister_functions(const char *module, struct symtable *table, struct pfq_lang_function_descr *fun);
 extern struct symtable_entry *pfq_lang_symtable_search(struct symtable *table, const char *symbol);
+extern struct symtable_entry *pfq_lang_symtable_search_by_function(struct symtable *table, const void *function);
 
 
 #endif /* PFQ_LANG_SYMTABLE_H */
@@ -26,11 +26,16 @@
 
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/version.h>
 
 extern  int pfq_netif_rx(struct sk_buff *);
 extern  int pfq_netif_receive_skb(struct sk_buff *);
 extern  gro_result_t pfq_gro_receive(struct napi_struct *, struct sk_buff *);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+extern  bool pfq_napi_complete_done(struct napi_struct *, int);
+#endif
+
 extern struct sk_buff * __pfq_alloc_skb(unsigned int len, gfp_t priority, int fclone, int node);
 extern struct sk_buff * pfq_dev_alloc_skb(unsigned int length);
 extern struct sk_buff * __pfq_netdev_alloc_skb(struct net_device *dev, unsigned int length, gfp_t gfp);
@@ -81,6 +86,11 @@ pfq_alloc_skb_fclone(unsigned int len, gfp_t priority)
 #define netif_rx(_skb)                                  pfq_netif_rx(_skb)
 #define napi_gro_receive(_napi, _skb)                   pfq_gro_receive(_napi, _skb)
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+#define napi_complete_done(_napi, _work)                pfq_napi_complete_done(_napi, _work)
+#define napi_complete(_napi)                            pfq_napi_complete_done(_napi, 0)
+#endif
+
 #define __alloc_skb(len,mask,fclone,node)               __pfq_alloc_skb(len,mask,fclone,node)
 #define alloc_skb(len, mask)				pfq_alloc_skb(len, mask)
 #define alloc_skb_fclone(len,mask)			pfq_alloc_skb_fclone(len, mask)
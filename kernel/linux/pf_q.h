@@ -104,6 +104,7 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_SET_TX_LEN			6
 #define Q_SO_SET_TX_SLOTS		7
 #define Q_SO_SET_WEIGHT			8
+#define Q_SO_SET_RX_LANES		9
 
 #define Q_SO_GROUP_BIND			10
 #define Q_SO_GROUP_UNBIND		11
@@ -131,11 +132,29 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_GET_GROUP_STATS		31
 #define Q_SO_GET_GROUP_COUNTERS		32
 #define Q_SO_GET_WEIGHT			33
+#define Q_SO_GET_RX_LANES		34
+#define Q_SO_GET_GROUP_RING		35	/* struct pfq_so_group_ring */
+#define Q_SO_GET_RX_LATENCY		36
+#define Q_SO_GET_TX_PACING		37	/* struct pfq_tx_pacing_stats */
+#define Q_SO_GET_MEM_NODE		38	/* NUMA node of the socket queues (requested, or landed once enabled) */
+#define Q_SO_GET_GROUP_LANG_PROFILE	39	/* struct pfq_so_lang_profile */
 
 #define Q_SO_TX_BIND			40
 #define Q_SO_TX_UNBIND			41
 #define Q_SO_TX_QUEUE_XMIT	        42
 
+#define Q_SO_GROUP_RING_CREATE		43
+#define Q_SO_GROUP_RING_ATTACH		44
+#define Q_SO_GROUP_RING_DETACH		45
+
+#define Q_SO_SET_RX_LATENCY		46	/* Rx latency bound (usec, 0 = module default) */
+#define Q_SO_SET_MEM_NODE		47	/* NUMA node of the socket queues (node, Q_NODE_ANY or Q_NODE_DEVICE) */
+#define Q_SO_GROUP_LANG_PROFILE		48	/* struct pfq_so_lang_profile_toggle */
+#define Q_SO_GROUP_FLOW_TABLE		49	/* struct pfq_so_group_flow_table */
+#define Q_SO_GET_GROUP_FLOW_TABLE	50	/* struct pfq_so_group_flow_table */
+
+#define Q_MAX_RX_LATENCY		1000000	/* usec */
+
 /* general placeholders */
 
 #define Q_ANY_DEVICE			-1
@@ -144,6 +163,20 @@ typedef uint8_t  pfq_qver_t;
 #define Q_ANY_KTHREAD			0xbadbee
 #define Q_NO_KTHREAD			-1
 
+/* NUMA placement of the socket queues */
+
+#define Q_NODE_ANY			-1	/* default: node of the allocating cpu */
+#define Q_NODE_DEVICE			-2	/* node of the device the socket is bound to */
+
+/* enable flags */
+
+#define Q_ENABLE_RX_ZEROCOPY		(1U << 0)	/* Rx slots reference the skb pool memory */
+#define Q_ENABLE_RX_PACKED		(1U << 1)	/* variable-length Rx slots */
+#define Q_ENABLE_RX_COMPACT		(1U << 2)	/* packed Rx slots with pfq_pkthdr_compact headers */
+#define Q_ENABLE_RX_STREAM		(1U << 3)	/* streaming Rx ring with producer/consumer indexes */
+#define Q_ENABLE_TX_ZEROCOPY		(1U << 4)	/* Tx skbs reference the slots of the shared queue */
+#define Q_ENABLE_TX_PACKED		(1U << 5)	/* variable-length Tx slots */
+
 /* timestamp */
 
 #define Q_TSTAMP_OFF			0	/*default*/
@@ -166,6 +199,11 @@ typedef uint8_t  pfq_qver_t;
 #define Q_POLICY_GROUP_RESTRICTED	2
 #define Q_POLICY_GROUP_SHARED		3
 
+/* group ring policies */
+
+#define Q_RING_POLICY_BLOCK		0	/* the slowest reader holds the ring: packets are lost when it is full */
+#define Q_RING_POLICY_DROP		1	/* slow readers are overrun and lose packets */
+
 /* group class type */
 
 #define Q_CLASS(n)			(1UL<<(n))
@@ -183,6 +221,7 @@ typedef uint8_t  pfq_qver_t;
 #define Q_MAX_COUNTERS			64
 #define Q_MAX_TX_QUEUES			4
 #define Q_MAX_RX_NAPI			4
+#define Q_MAX_RX_LANES			64
 
 
 /* default flow key constants */
@@ -212,10 +251,163 @@ struct pfq_shared_rx_queue
         unsigned int            len;        /* queue length in slots */
         unsigned int            size;       /* queue size in bytes */
         unsigned int            slot_size;  /* sizeof(pfq_pkthdr) + caplen  */
+        unsigned int            lanes;      /* number of per-cpu lanes (0 or 1 = single queue) */
+
+} ____pfq_cacheline_aligned;
+
+
+/*
+ * Per-cpu Rx lanes (Q_SO_SET_RX_LANES):
+ *
+ * the Rx queue is split into 'lanes' independent double-buffered queues of len/lanes slots
+ * each, laid out one after the other. CPU n produces into the lane n % lanes, so that
+ * producers do not share the shinfo cache line. The consumer swaps all the lanes at each
+ * read, hence their versions are always the same.
+ */
+
+struct pfq_shared_rx_lane
+{
+        unsigned long		shinfo;	    /* atomic */
+
+} ____pfq_cacheline_aligned;
+
+
+/*
+ * Streaming Rx (Q_ENABLE_RX_STREAM):
+ *
+ * the memory of the Rx queue is a single ring of 2 x len slots. The slot of the index i
+ * is (i % (2 x len)) and it is committed with PFQ_STREAM_COMMIT(i, 2 x len). Producers
+ * advance prod.index, the consumer advances cons.index as it releases the slots.
+ */
+
+struct pfq_shared_rx_ring
+{
+	struct
+	{
+		unsigned long		index;	    /* atomic */
+
+	} prod ____pfq_cacheline_aligned;
+
+	struct
+	{
+		unsigned long		index;	    /* atomic */
+
+	} cons ____pfq_cacheline_aligned;
 
 } ____pfq_cacheline_aligned;
 
 
+#define PFQ_STREAM_COMMIT(index, cap)		((uint32_t)((index) / (cap)) + 1)
+
+
+/*
+ * Group ring (Q_SO_GROUP_RING_CREATE):
+ *
+ * a single-copy ring owned by a group, where packets broadcast to the sockets
+ * attached to it are written once. Slots are laid out and committed as in the
+ * streaming Rx ring (PFQ_STREAM_COMMIT(i, slots)), each reader has its own index
+ * and slots are reclaimed when the slowest reader releases them.
+ * The ring is mapped at the offset PFQ_GROUP_RING_PGOFF(gid) (in pages) of the socket.
+ */
+
+#define Q_MAX_RING_READERS		64	/* one reader per group member (slot) */
+
+#define PFQ_GROUP_RING_PGOFF(gid)	((1UL << 24) + (unsigned long)(gid))
+
+
+struct pfq_shared_ring_reader
+{
+	unsigned long		index;	    /* atomic: released by the reader, advanced by the kernel on overrun */
+	unsigned long		lost;	    /* atomic: packets lost because of overruns (Q_RING_POLICY_DROP) */
+
+} ____pfq_cacheline_aligned;
+
+
+struct pfq_shared_ring
+{
+	struct
+	{
+		unsigned long		index;	    /* atomic */
+
+	} prod ____pfq_cacheline_aligned;
+
+	struct
+	{
+		size_t			slots;
+		size_t			slot_size;
+		size_t			caplen;
+		int			policy;
+
+	} info ____pfq_cacheline_aligned;
+
+	struct pfq_shared_ring_reader reader[Q_MAX_RING_READERS];
+};
+
+
+/*
+ * Group flow table (Q_SO_GROUP_FLOW_TABLE):
+ *
+ * a table of bidirectional IPv4 flows owned by a group, updated without locks by the
+ * pfq-lang functions flow_count and flow_first (and read by flow_state). Entries are
+ * grouped in sets of Q_FLOW_WAYS; a new flow takes a free entry of its set, or one idle
+ * for longer than the timeout, and it is not tracked if none is available. The initiator
+ * of a flow is the sender of its first packet. Timestamps are the lower 32 bits of the
+ * jiffies (info.hz per second). Entries and stats are updated with atomic operations.
+ * The table is mapped (read-only) at the offset PFQ_GROUP_FLOW_PGOFF(gid) (in pages) of the socket.
+ */
+
+#define Q_FLOW_WAYS			4
+#define Q_MAX_FLOW_TABLE_ENTRIES	(1 << 22)
+#define Q_MAX_FLOW_TIMEOUT		3600000		/* msec */
+
+#define Q_FLOW_STATE_NEW		1	/* packets from the initiator only */
+#define Q_FLOW_STATE_ESTABLISHED	2	/* packets in both directions */
+#define Q_FLOW_STATE_CLOSED		3	/* tcp: FIN or RST seen */
+
+#define PFQ_GROUP_FLOW_PGOFF(gid)	((1UL << 25) + (unsigned long)(gid))
+
+
+struct pfq_flow_entry
+{
+	uint64_t		key;	    /* atomic: hash of the flow, 0 = free */
+	uint32_t		saddr;	    /* initiator address (network order) */
+	uint32_t		daddr;	    /* responder address (network order) */
+	uint16_t		sport;	    /* initiator port (network order), 0 if none */
+	uint16_t		dport;	    /* responder port (network order), 0 if none */
+	uint8_t			proto;
+	uint8_t			reserved[3];
+	uint32_t		state;	    /* atomic: Q_FLOW_STATE_* */
+	uint32_t		first;	    /* jiffies of the first packet */
+	uint32_t		last;	    /* atomic: jiffies of the last packet */
+	uint32_t		reserved2;
+	uint64_t		packets;    /* atomic: packets in both directions */
+	uint64_t		bytes;	    /* atomic */
+	uint64_t		replies;    /* atomic: packets from the responder */
+
+} ____pfq_cacheline_aligned;
+
+
+struct pfq_shared_flow_table
+{
+	struct
+	{
+		size_t			entries;
+		unsigned int		timeout;    /* msec */
+		unsigned int		hz;
+
+	} info ____pfq_cacheline_aligned;
+
+	struct
+	{
+		unsigned long		full;	    /* atomic: packets of flows not tracked (set full) */
+		unsigned long		evicted;    /* atomic: idle flows replaced by new ones */
+
+	} stats ____pfq_cacheline_aligned;
+
+	struct pfq_flow_entry	entry[];
+};
+
+
 
 struct pfq_shared_tx_queue
 {
@@ -233,9 +425,16 @@ struct pfq_shared_tx_queue
 	{
 		unsigned int		index;
 		ptrdiff_t		off;
+		unsigned int		wait;	    /* the Tx kthread sleeps: ring the doorbell (see pfq_sync_queue) */
 
 	} cons ____pfq_cacheline_aligned;
 
+	struct
+	{
+		unsigned int		pending[2];	/* zero-copy Tx: skbs still referencing each half */
+
+	} done ____pfq_cacheline_aligned;
+
 } ____pfq_cacheline_aligned;
 
 
@@ -244,6 +443,8 @@ struct pfq_shared_queue
         struct pfq_shared_rx_queue rx;
         struct pfq_shared_tx_queue tx;
         struct pfq_shared_tx_queue tx_async[Q_MAX_TX_QUEUES];
+        struct pfq_shared_rx_lane  rx_lane[Q_MAX_RX_LANES];
+        struct pfq_shared_rx_ring  rx_ring;
 };
 
 
@@ -316,6 +517,96 @@ struct pfq_pkthdr
    */
 
 
+/*
+ * Packed Rx (Q_ENABLE_RX_PACKED):
+ *
+ * slots are variable-length and stored back to back; the length of the shared queue
+ * counts bytes instead of slots. The size of a slot is implicitly recorded by the caplen
+ * of its header (see PFQ_PACKED_SLOT_SIZE). A record with len == 0 is padding and carries
+ * no packet. With Q_ENABLE_RX_COMPACT the slots start with a pfq_pkthdr_compact, whose caplen
+ * and len fields are at the same offsets of the ones of pfq_pkthdr.
+ */
+
+struct pfq_pkthdr_compact
+{
+        union
+        {
+                uint64_t	    tv64;
+                struct {
+                        uint32_t    sec;
+                        uint32_t    nsec;
+                } tv;				/* note: compact timespec */
+
+        } tstamp;
+
+        uint16_t    caplen;			/* bytes captured */
+        uint16_t    len;			/* length of the packet (off wire), 0 for padding */
+        uint32_t    commit;			/* commit round */
+};
+
+
+#define PFQ_COMPACT_SLOT_ALIGNMENT		16
+#define PFQ_PACKED_PAD_MAX			32768
+
+#define PFQ_COMPACT_SLOT_SIZE(x)		ALIGN(sizeof(struct pfq_pkthdr_compact) + x, PFQ_COMPACT_SLOT_ALIGNMENT)
+#define PFQ_PACKED_SLOT_SIZE(flags, x)		(((flags) & Q_ENABLE_RX_COMPACT) ? PFQ_COMPACT_SLOT_SIZE(x) : PFQ_SHARED_QUEUE_SLOT_SIZE(x))
+#define PFQ_PACKED_SLOT_ALIGNMENT(flags)	(((flags) & Q_ENABLE_RX_COMPACT) ? PFQ_COMPACT_SLOT_ALIGNMENT : PFQ_SLOT_ALIGNMENT)
+#define PFQ_PACKED_COMMIT(flags, hdr)		(((flags) & Q_ENABLE_RX_COMPACT) ? &((struct pfq_pkthdr_compact *)(hdr))->commit \
+										 : &((struct pfq_pkthdr *)(hdr))->info.commit)
+
+
+/*
+ * Zero-copy Rx (Q_ENABLE_RX_ZEROCOPY):
+ *
+ * the payload of each Rx slot starts with a pfq_pkt_ref. The packet data is either stored
+ * in the zero-copy area (the per-cpu skb pools, mapped read-only at the offset
+ * Q_SO_GET_SHMEM_SIZE of the socket) or, when the skb is not eligible, copied inline right
+ * after the reference. A referenced buffer is not given back to the pool when it is
+ * read: it stays held until the same slot of the same half of the double-buffered queue
+ * is written again, that is after the next swap of the queue (or until the socket is
+ * disabled). A socket could thus pin up to 2 x rx_queue_len skbs of the pools, which
+ * would drain them for the other sockets of the cpus: the skbs held at once are capped
+ * to max_pool_size / 2, past that packets are copied inline.
+ *
+ * The pools are shared by all the sockets, groups and the kernel: the area exposes the
+ * packets received by the cpus, not only those steered to the socket. Hence zero-copy Rx
+ * requires the rx_zerocopy module parameter (disabled by default) and CAP_NET_ADMIN.
+ */
+
+#define PFQ_PKT_REF_INLINE		((uint64_t)-1)
+
+struct pfq_pkt_ref
+{
+	uint64_t	off;			/* offset in the zero-copy area or PFQ_PKT_REF_INLINE */
+};
+
+
+/*
+ * Zero-copy Tx (Q_ENABLE_TX_ZEROCOPY):
+ *
+ * the payload of Tx slots larger than Q_TX_ZC_HEADER_LEN is not copied: the kernel copies
+ * the first Q_TX_ZC_HEADER_LEN bytes and attaches the rest of the slot to the skb as page
+ * fragments. done.pending[n] counts the skbs that still reference the half n of the queue,
+ * and is decremented upon the Tx completion of the driver. A half can be reused by the
+ * producer only when its pending counter drops to zero.
+ *
+ * Disabling (or closing) the socket waits up to one second for the pending skbs; those
+ * still held by a device or qdisc past that are orphaned: the shared queue is released
+ * and their pages stay referenced by the skbs until they are freed.
+ */
+
+#define Q_TX_ZC_HEADER_LEN		128
+
+
+/*
+ * Packed Tx (Q_ENABLE_TX_PACKED):
+ *
+ * Tx slots are stored back to back, each one taking PFQ_SHARED_QUEUE_SLOT_SIZE(caplen)
+ * bytes instead of the fixed slot size derived from xmitlen. The offsets published by the
+ * producer still count bytes, and a header with caplen == 0 still terminates the queue.
+ */
+
+
 struct pfq_pcap_pkthdr {
 
     struct timeval ts;			/* time stamp */
@@ -375,6 +666,8 @@ struct pfq_so_enable
 	unsigned long	user_addr;
 	size_t		user_size;
 	size_t		hugepage_size;
+	unsigned int	flags;		/* Q_ENABLE_* */
+	size_t		zc_size;	/* (out) size of the zero-copy Rx area */
 };
 
 
@@ -404,6 +697,26 @@ struct pfq_so_group_join
         unsigned long class_mask;
 };
 
+struct pfq_so_group_ring
+{
+	int	gid;
+	int	policy;		/* Q_RING_POLICY_* */
+	size_t	slots;
+	size_t	caplen;
+	size_t	size;		/* (out) Q_SO_GET_GROUP_RING: size of the shared memory */
+	int	reader;		/* (out) Q_SO_GET_GROUP_RING: index of the reader of this socket */
+};
+
+
+struct pfq_so_group_flow_table
+{
+	int		gid;
+	unsigned int	timeout;	/* msec of inactivity after which an entry can be reused */
+	size_t		entries;	/* power of 2, at least Q_FLOW_WAYS */
+	size_t		size;		/* (out) Q_SO_GET_GROUP_FLOW_TABLE: size of the shared memory */
+};
+
+
 struct pfq_so_group_computation
 {
         int gid;
@@ -411,6 +724,42 @@ struct pfq_so_group_computation
 };
 
 
+/*
+ * pfq-lang profiling (Q_SO_GROUP_LANG_PROFILE):
+ *
+ * While enabled for a group, each function of the computation run by the engine
+ * counts the packets it evaluates, passes and drops; one packet every 'sample'
+ * (per cpu) is also timed in cycles. Counters are indexed as the functions of
+ * the computation descriptor and restart when the computation is replaced.
+ * Functions evaluated as arguments of other functions are not accounted, and
+ * a fused pair is accounted to the second function.
+ */
+
+struct pfq_so_lang_profile_toggle
+{
+	int	gid;
+	int	sample;		/* time one packet every sample, 0 = disable profiling */
+};
+
+
+struct pfq_lang_node_profile
+{
+	unsigned long int hit;		/* packets evaluated */
+	unsigned long int pass;		/* passed on to the next function */
+	unsigned long int drop;		/* dropped */
+	unsigned long int samples;	/* timed evaluations */
+	unsigned long int cycles;	/* cycles spent in the timed evaluations */
+};
+
+
+struct pfq_so_lang_profile
+{
+	int	gid;
+	size_t	size;				/* (in) entries of node, (out) functions of the computation */
+	struct pfq_lang_node_profile __user *node;
+};
+
+
 struct pfq_so_group_context
 {
         void __user *context;
@@ -446,6 +795,19 @@ struct pfq_stats
 };
 
 
+/* Tx pacing statistics: timestamped packets transmitted by the Tx kthreads */
+
+#define Q_TX_PACING_BUCKETS		16
+
+struct pfq_tx_pacing_stats
+{
+	unsigned long int paced;			/* timestamped packets transmitted */
+	unsigned long int late;				/* transmitted more than tx_pace_window nsec after their timestamp */
+	unsigned long int lag;				/* total lateness (nsec) */
+	unsigned long int hist[Q_TX_PACING_BUCKETS];	/* lateness: [0] < 1 usec, [n] < 2^n usec, the last one collects the rest */
+};
+
+
 /* pfq counters for groups */
 
 struct pfq_counters
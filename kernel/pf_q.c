@@ -43,6 +43,7 @@
 #include <linux/vmalloc.h>
 #include <linux/percpu.h>
 #include <linux/bug.h>
+#include <linux/rcupdate.h>
 
 #include <net/sock.h>
 #ifdef CONFIG_INET
@@ -57,6 +58,7 @@
 #include <pfq/devmap.h>
 #include <pfq/percpu.h>
 #include <pfq/group.h>
+#include <pfq/group_ring.h>
 #include <pfq/sock.h>
 #include <pfq/stats.h>
 #include <pfq/queue.h>
@@ -119,9 +121,10 @@ pfq_release(struct socket *sock)
 	/* release the socket id */
 
 	pr_devel("[PFQ|%d] releasing id...\n", so->id);
-	msleep(Q_GRACE_PERIOD);
 	pfq_sock_release_id(so->id);
 
+	pfq_sock_rx_latency_update();
+
 #if 0
 	/* reset the GC at the last socket closed */
         if (pfq_sock_counter() == 0) {
@@ -135,6 +138,10 @@ pfq_release(struct socket *sock)
 	if (numb)
 		printk(KERN_INFO "[PFQ|%d] cleanup: %d skb recovered from GC.\n", id, numb);
 
+	/* Rx paths look up sockets by id under RCU */
+
+	synchronize_rcu();
+
         sock_orphan(sk);
 	sock->sk = NULL;
 	sock_put(sk);
@@ -155,6 +162,9 @@ pfq_poll(struct file *file, struct socket *sock, poll_table * wait)
 
 	poll_wait(file, &so->waitqueue, wait);
 
+        if (pfq_group_ring_avail(so) > 0)
+                mask |= POLLIN | POLLRDNORM;
+
         if(!pfq_sock_rx_shared_queue(so))
                 return mask;
 
@@ -176,7 +186,7 @@ static int pfq_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 		}
 
 		if (likely(arg == 0)) { /* transmit Tx queue */
-			tx_response_t tx = pfq_sk_queue_xmit(so, -1, Q_NO_KTHREAD);
+			tx_response_t tx = pfq_sk_queue_xmit(so, -1, Q_NO_KTHREAD, NULL);
 
 			sparse_add(so->stats, sent, tx.ok);
 			sparse_add(so->stats, fail, tx.fail);
@@ -185,6 +195,11 @@ static int pfq_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 			return 0;
 		}
 
+		if (arg <= Q_MAX_TX_QUEUES) { /* doorbell of an async Tx queue */
+			pfq_tx_thread_doorbell(so, (int)arg - 1);
+			return 0;
+		}
+
 		printk(KERN_INFO "[PFQ|%d] QIOCTX queue: bad argument %lu!\n", so->id, arg);
 		return -EINVAL;
 	}
@@ -416,12 +431,38 @@ static int __init pfq_init_module(void)
 
 	/* check options */
 
-        if (global->capt_batch_len <= 0 || global->capt_batch_len >= Q_BUFF_BATCH_LEN) {
-                printk(KERN_INFO "[PFQ] capt_batch_len=%d not allowed: valid range (0,%d)!\n",
+        if (global->capt_batch_len <= 0 || global->capt_batch_len > Q_BUFF_BATCH_LEN) {
+                printk(KERN_INFO "[PFQ] capt_batch_len=%d not allowed: valid range (0,%d]!\n",
                        global->capt_batch_len, Q_BUFF_BATCH_LEN);
                 return -EFAULT;
         }
 
+        if (global->capt_latency < 0 || global->capt_latency > Q_MAX_RX_LATENCY) {
+                printk(KERN_INFO "[PFQ] capt_latency=%d not allowed: valid range [0,%d] usec!\n",
+                       global->capt_latency, Q_MAX_RX_LATENCY);
+                return -EFAULT;
+        }
+
+        global->rx_latency = global->capt_latency;
+
+        if (global->tx_pace_spin < 0 || global->tx_pace_window < 0) {
+                printk(KERN_INFO "[PFQ] tx_pace_spin=%d tx_pace_window=%d not allowed: must be >= 0 nsec!\n",
+                       global->tx_pace_spin, global->tx_pace_window);
+                return -EFAULT;
+        }
+
+        if (global->tx_quantum <= 0 || global->tx_idle < 0) {
+                printk(KERN_INFO "[PFQ] tx_quantum=%d tx_idle=%d not allowed: must be > 0 bytes and >= 0 usec!\n",
+                       global->tx_quantum, global->tx_idle);
+                return -EFAULT;
+        }
+
+        if (global->tx_aggr < 1 || global->tx_aggr > Q_TX_AGGR_MAX) {
+                printk(KERN_INFO "[PFQ] tx_aggr=%d not allowed: valid range [1,%d]!\n",
+                       global->tx_aggr, Q_TX_AGGR_MAX);
+                return -EFAULT;
+        }
+
         if (global->xmit_batch_len <= 0 || global->xmit_batch_len >= Q_BUFF_BATCH_LEN) {
                 printk(KERN_INFO "[PFQ] xmit_batch_len=%d not allowed: valid range (0,%d)!\n",
                        global->xmit_batch_len, Q_BUFF_BATCH_LEN);
@@ -441,6 +482,10 @@ static int __init pfq_init_module(void)
 
 	/* initialize data structures ... */
 
+	err = pfq_devmap_init();
+	if (err < 0)
+		return err;
+
 	err = pfq_groups_init();
 	if (err < 0)
 		goto err1;
@@ -455,6 +500,8 @@ static int __init pfq_init_module(void)
 	if (err < 0)
 		goto err2;
 
+	pfq_flush_timer_init();
+
         /* register PFQ sniffer protocol */
 
         err = proto_register(&pfq_proto, 0);
@@ -510,7 +557,14 @@ static int __init pfq_init_module(void)
 
         printk(KERN_INFO "[PFQ] max_slot_size   : %d\n", global->max_slot_size);
         printk(KERN_INFO "[PFQ] capt_batch_len  : %d\n", global->capt_batch_len);
+        printk(KERN_INFO "[PFQ] capt_latency    : %d usec\n", global->capt_latency);
         printk(KERN_INFO "[PFQ] xmit_batch_len  : %d\n", global->xmit_batch_len);
+        printk(KERN_INFO "[PFQ] tx_pace_spin    : %d nsec\n", global->tx_pace_spin);
+        printk(KERN_INFO "[PFQ] tx_pace_window  : %d nsec\n", global->tx_pace_window);
+        printk(KERN_INFO "[PFQ] tx_quantum      : %d bytes\n", global->tx_quantum);
+        printk(KERN_INFO "[PFQ] tx_idle         : %d usec\n", global->tx_idle);
+        printk(KERN_INFO "[PFQ] tx_aggr         : %d\n", global->tx_aggr);
+        printk(KERN_INFO "[PFQ] max_groups      : %d\n", global->max_groups);
         printk(KERN_INFO "[PFQ] vlan_untag      : %d\n", global->vlan_untag);
         printk(KERN_INFO "[PFQ] skb_tx_pool_size: %d\n", global->skb_tx_pool_size);
         printk(KERN_INFO "[PFQ] skb_rx_pool_size: %d\n", global->skb_rx_pool_size);
@@ -533,10 +587,12 @@ err5:
 err4:
         proto_unregister(&pfq_proto);
 err3:
+	pfq_flush_timer_fini();
 	pfq_percpu_destruct();
 err2:
 	pfq_percpu_free();
 err1:
+	pfq_devmap_destruct();
 	return err < 0 ? err : -EFAULT;
 }
 
@@ -570,8 +626,12 @@ static void __exit pfq_exit_module(void)
         /* disable direct capture */
         pfq_devmap_toggle_reset();
 
-        /* wait grace period */
-        msleep(Q_GRACE_PERIOD);
+        /* wait for the Rx paths in flight and the pending group releases */
+        synchronize_rcu();
+        pfq_group_release_barrier();
+
+        /* stop the flush timers, no Rx path can arm them anymore */
+        pfq_flush_timer_fini();
 
         /* free per CPU data */
         total += pfq_percpu_destruct();
@@ -590,6 +650,8 @@ static void __exit pfq_exit_module(void)
 
 	pfq_groups_destruct();
 
+	pfq_devmap_destruct();
+
         printk(KERN_INFO "[PFQ] unloaded.\n");
 }
 
@@ -701,6 +763,18 @@ pfq_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 }
 
 
+/* end of NAPI poll: flush the per-cpu batch, then complete */
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+bool
+pfq_napi_complete_done(struct napi_struct *napi, int work_done)
+{
+	pfq_receive_flush(Q_FLUSH_NAPI);
+	return napi_complete_done(napi, work_done);
+}
+#endif
+
+
 int
 pfq_lang_register_functions(const char *module, struct pfq_lang_function_descr *fun)
 {
@@ -718,6 +792,9 @@ pfq_lang_unregister_functions(const char *module, struct pfq_lang_function_descr
 EXPORT_SYMBOL_GPL(pfq_netif_rx);
 EXPORT_SYMBOL_GPL(pfq_netif_receive_skb);
 EXPORT_SYMBOL_GPL(pfq_gro_receive);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+EXPORT_SYMBOL_GPL(pfq_napi_complete_done);
+#endif
 
 EXPORT_SYMBOL(pfq_lang_register_functions);
 EXPORT_SYMBOL(pfq_lang_unregister_functions);
@@ -26,6 +26,8 @@
 #define PFQ_ALLOC_H
 
 #include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/numa.h>
 
 inline static
 void *pfq_malloc_pages(size_t size, gfp_t gfp_flags)
@@ -39,6 +41,26 @@ void *pfq_malloc_pages(size_t size, gfp_t gfp_flags)
 }
 
 
+/* as pfq_malloc_pages, on the given NUMA node (NUMA_NO_NODE = any) */
+
+inline static
+void *pfq_malloc_pages_node(size_t size, gfp_t gfp_flags, int node)
+{
+	struct page *page;
+	if (WARN_ON(!size))
+		return NULL;
+	page = alloc_pages_node(node, gfp_flags | __GFP_COMP, get_order(size));
+	return page ? page_address(page) : NULL;
+}
+
+
+inline static
+int pfq_pages_node(const void *addr)
+{
+	return addr ? page_to_nid(virt_to_page(addr)) : NUMA_NO_NODE;
+}
+
+
 inline static
 void pfq_free_pages(void *addr, size_t size)
 {
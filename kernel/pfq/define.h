@@ -26,14 +26,19 @@
 
 #include <pfq/types.h>
 
-#define Q_MAX_ID			((int)sizeof(long)<<3)
-#define Q_MAX_GID			((int)sizeof(long)<<3)
-#define Q_BUFF_BATCH_LEN		((int)sizeof(__int128)<<3)
+#define Q_MAX_ID			1024
+#define Q_MAX_GID			256
+#define Q_MAX_GROUP_SOCK		((int)sizeof(long)<<3)	/* members of a group (slots) */
+
+#define Q_SOCK_MASK_WORDS		(Q_MAX_ID/((int)sizeof(long)<<3))
 
 #define Q_BUFF_LOG_LEN			16
 #define Q_BUFF_QUEUE_LEN		512
+#define Q_BUFF_BATCH_LEN		Q_BUFF_QUEUE_LEN
+#define Q_BUFF_FWD_TABLE_LEN		(Q_BUFF_BATCH_LEN * Q_BUFF_LOG_LEN)	/* fwd-to-device annotations per batch: never full */
 
 #define Q_MAX_STEERING_MASK	        512
+#define Q_STEERING_TABLE_LEN		4093	/* prime, see pfq_steering_table */
 
 #define Q_MAX_DEVICE			4096
 #define Q_MAX_DEVICE_MASK		(Q_MAX_DEVICE-1)
@@ -41,8 +46,8 @@
 #define Q_MAX_QUEUE_MASK		(Q_MAX_QUEUE-1)
 
 #define Q_MAX_TX_SKB_COPY		256
+#define Q_TX_ZC_WAIT			(HZ)	/* socket disable: wait for the zero-copy Tx skbs (jiffies) */
 
-#define Q_GRACE_PERIOD			200 /* msec */
 
 #define Q_FUN_SYMB_LEN			256
 #define Q_FUN_SIGN_LEN			1024
@@ -51,9 +56,6 @@
 #define Q_MAX_CPU			256
 #define Q_MAX_CPU_MASK			(Q_MAX_CPU-1)
 
-#define Q_GROUP_PERSIST_MEM		64
-#define Q_GROUP_PERSIST_DATA		1024
-
 #define Q_MAX_SOCKQUEUE_LEN		262144
 
 #define Q_INVALID_ID			(__force pfq_id_t)-1
@@ -19,8 +19,6 @@
  *
  * The full GNU General Public License is included in this distribution in
  * the file called "COPYING".
- *
- ****************************************************************/
 
 #include <pfq/devmap.h>
 #include <pfq/group.h>
@@ -28,70 +26,386 @@
 #include <pfq/printk.h>
 #include <pfq/thread.h>
 
+#include <linux/err.h>
+#include <linux/slab.h>
+
+
+int pfq_devmap_init(void)
+{
+    if (global->max_groups <= 0 || global->max_groups > Q_MAX_GID) {
+        printk(KERN_INFO "[PFQ] max_groups=%d not allowed: valid range (0,%d]!\n",
+               global->max_groups, Q_MAX_GID);
+        return -EINVAL;
+    }
+
+    global->devmap_words = BITS_TO_LONGS(global->max_groups);
+    return 0;
+}
+
+
+void pfq_devmap_destruct(void)
+{
+    pfq_devmap_toggle_reset();
+    rcu_barrier();
+}
+
+
+/* mask of the queue (-1 = any queue) */
+
+static inline
+unsigned long *pfq_devmap_entry_mask(struct pfq_devmap_entry *entry, int queue)
+{
+    return entry->mask + (1 + queue) * global->devmap_words;
+}
+
+
+static inline
+bool pfq_devmap_entry_test(struct pfq_devmap_entry *entry, int queue, int word, unsigned long bit)
+{
+    return (pfq_devmap_entry_mask(entry, queue)[word] & bit) != 0;
+}
+
+
+/* a copy of the entry with the bit set or reset for the queue (-1 = any); NULL
+ * if no group is left */
+
+static struct pfq_devmap_entry *
+pfq_devmap_entry_update(struct pfq_devmap_entry *old, int action, int queue, int word, unsigned long bit, bool *changed)
+{
+    const int words = global->devmap_words;
+    struct pfq_devmap_entry *entry;
+    int queues = old ? old->queues : 0, q, w;
+
+    if (action == Q_DEVMAP_SET && queue >= queues)
+        queues = queue + 1;
+
+    /* a queue unbound from an any-queue binding: the binding is spread over the single queues */
+
+    if (action == Q_DEVMAP_RESET && queue != -1 && old && pfq_devmap_entry_test(old, -1, word, bit))
+        queues = Q_MAX_QUEUE;
+
+    entry = kzalloc(sizeof(struct pfq_devmap_entry) + sizeof(unsigned long) * (size_t)((1 + queues) * words), GFP_KERNEL);
+    if (!entry)
+        return ERR_PTR(-ENOMEM);
+
+    entry->queues = queues;
+    if (old)
+        memcpy(entry->mask, old->mask, sizeof(unsigned long) * (size_t)((1 + old->queues) * words));
+
+    if (action == Q_DEVMAP_SET) {
+        if (!pfq_devmap_entry_test(entry, queue, word, bit)) {
+            pfq_devmap_entry_mask(entry, queue)[word] |= bit;
+            *changed = true;
+        }
+    }
+    else {
+        if (queue != -1 && pfq_devmap_entry_test(entry, -1, word, bit)) {
+            for(q = 0; q < queues; q++)
+                pfq_devmap_entry_mask(entry, q)[word] |= bit;
+            entry->mask[word] &= ~bit;
+        }
+
+        for(q = -1; q < queues; q++)
+        {
+            if ((queue == -1 || queue == q) && pfq_devmap_entry_test(entry, q, word, bit)) {
+                pfq_devmap_entry_mask(entry, q)[word] &= ~bit;
+                *changed = true;
+            }
+        }
+    }
+
+    /* trim the queue vector, release an empty entry */
 
-void pfq_devmap_toggle_update(void)
+    for(; entry->queues > 0; entry->queues--)
+    {
+        unsigned long *mask = pfq_devmap_entry_mask(entry, entry->queues - 1);
+        for(w = 0; w < words && !mask[w]; w++);
+        if (w < words)
+            break;
+    }
+
+    for(w = 0; w < words && !entry->mask[w]; w++);
+
+    if (w == words && entry->queues == 0) {
+        kfree(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/* staged updates (devmap_lock held): the new entries of the slots are
+ * prepared first and published only if all the allocations succeed, so that a
+ * failed update leaves the devmap untouched. The slot Q_MAX_DEVICE is the
+ * any-device one. */
+
+static struct pfq_devmap_entry *pfq_devmap_staged[Q_MAX_DEVICE + 1];
+static DECLARE_BITMAP(pfq_devmap_dirty, Q_MAX_DEVICE + 1);
+
+
+static inline
+struct pfq_devmap_entry __rcu **pfq_devmap_slot(int i)
+{
+    return i == Q_MAX_DEVICE ? &global->devmap_any : &global->devmap[i];
+}
+
+
+static inline
+struct pfq_devmap_entry *pfq_devmap_slot_get(int i)
+{
+    return rcu_dereference_protected(*pfq_devmap_slot(i), lockdep_is_held(&global->devmap_lock));
+}
+
+
+static inline
+struct pfq_devmap_entry *pfq_devmap_staged_get(int i)
 {
-    int i,j;
-    for(i=0; i < Q_MAX_DEVICE; ++i)
+    return test_bit(i, pfq_devmap_dirty) ? pfq_devmap_staged[i] : pfq_devmap_slot_get(i);
+}
+
+
+static int
+pfq_devmap_stage(int i, int action, int queue, int word, unsigned long bit)
+{
+    struct pfq_devmap_entry *cur = pfq_devmap_staged_get(i);
+    struct pfq_devmap_entry *entry;
+    bool changed = false;
+
+    if (!cur && action == Q_DEVMAP_RESET)
+        return 0;
+
+    entry = pfq_devmap_entry_update(cur, action, queue, word, bit, &changed);
+    if (IS_ERR(entry))
+        return (int)PTR_ERR(entry);
+
+    if (!changed) {
+        kfree(entry);
+        return 0;
+    }
+
+    if (test_bit(i, pfq_devmap_dirty))
+        kfree(cur);
+
+    pfq_devmap_staged[i] = entry;
+    set_bit(i, pfq_devmap_dirty);
+    return 0;
+}
+
+
+/* publish the staged entries (or drop them, on error): returns the number of
+ * slots changed */
+
+static int
+pfq_devmap_commit(bool publish)
+{
+    struct pfq_devmap_entry *old;
+    int i, n = 0;
+
+    for_each_set_bit(i, pfq_devmap_dirty, Q_MAX_DEVICE + 1)
     {
-        unsigned long val = 0;
-        for(j=0; j < Q_MAX_QUEUE; ++j)
+        if (publish) {
+            old = pfq_devmap_slot_get(i);
+            rcu_assign_pointer(*pfq_devmap_slot(i), pfq_devmap_staged[i]);
+            if (old)
+                kfree_rcu(old, rcu);
+            n++;
+        }
+        else {
+            kfree(pfq_devmap_staged[i]);
+        }
+
+        pfq_devmap_staged[i] = NULL;
+    }
+
+    bitmap_zero(pfq_devmap_dirty, Q_MAX_DEVICE + 1);
+    return n;
+}
+
+
+/* devmap_lock held: a device unbound from an any-device binding, the binding
+ * of the group is spread over the single devices */
+
+static int
+pfq_devmap_spread_any(int word, unsigned long bit)
+{
+    struct pfq_devmap_entry *any = pfq_devmap_staged_get(Q_MAX_DEVICE);
+    int i, q, err;
+
+    if (!any)
+        return 0;
+
+    for(q = -1; q < any->queues; q++)
+        if (pfq_devmap_entry_test(any, q, word, bit))
+            break;
+
+    if (q == any->queues)
+        return 0;
+
+    for(i = 0; i < Q_MAX_DEVICE; i++)
+    {
+        for(q = -1; q < any->queues; q++)
         {
-            val |= (unsigned long)atomic_long_read(&global->devmap[i][j]);
+            if (!pfq_devmap_entry_test(any, q, word, bit))
+                continue;
+
+            err = pfq_devmap_stage(i, Q_DEVMAP_SET, q, word, bit);
+            if (err < 0)
+                return err;
         }
+    }
 
-        atomic_set(&global->devmap_toggle[i], val ? 1 : 0);
+    return pfq_devmap_stage(Q_MAX_DEVICE, Q_DEVMAP_RESET, -1, word, bit);
+}
+
+
+/* devmap_lock held: the bit of the group is cleared in place in every queue of
+ * the slot, without allocations (readers see either value of the word); the
+ * entry is released when no group is left. Returns 1 if the slot changed. */
+
+static int
+pfq_devmap_clear(int i, int word, unsigned long bit)
+{
+    struct pfq_devmap_entry *entry = pfq_devmap_slot_get(i);
+    bool changed = false, empty = true;
+    int q, w;
+
+    if (!entry)
+        return 0;
+
+    for(q = -1; q < entry->queues; q++)
+    {
+        unsigned long *mask = pfq_devmap_entry_mask(entry, q);
+
+        if (mask[word] & bit) {
+            WRITE_ONCE(mask[word], mask[word] & ~bit);
+            changed = true;
+        }
+
+        for(w = 0; w < global->devmap_words; w++)
+            if (mask[w])
+                empty = false;
     }
+
+    if (empty) {
+        RCU_INIT_POINTER(*pfq_devmap_slot(i), NULL);
+        kfree_rcu(entry, rcu);
+    }
+
+    return changed;
 }
 
 
 int pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid)
 {
-    int n = 0, i,q;
+    const int word = (__force int)gid / BITS_PER_LONG;
+    const unsigned long bit = 1UL << ((__force int)gid % BITS_PER_LONG);
+    int n = 0, i, ret = 0;
 
-    if (unlikely((__force int)gid >= Q_MAX_GID ||
+    if (unlikely((__force int)gid >= global->max_groups ||
 		 (__force int)gid < 0)) {
         pr_devel("[PF_Q] devmap_update: bad gid (%u)\n",gid);
         return 0;
     }
 
+    if (index < Q_ANY_DEVICE || index >= Q_MAX_DEVICE ||
+        queue < Q_ANY_QUEUE  || queue >= Q_MAX_QUEUE) {
+        pr_devel("[PF_Q] devmap_update: bad index/queue (%d/%d)\n", index, queue);
+        return 0;
+    }
+
     mutex_lock(&global->devmap_lock);
 
-    for(i=0; i < Q_MAX_DEVICE; ++i)
-    {
-        for(q=0; q < Q_MAX_QUEUE; ++q)
-        {
-            long tmp;
+    /* unbinding from any device and any queue (e.g. a group released) only
+     * clears bits: it never allocates and cannot fail */
 
-            if (!pfq_devmap_equal(i, q, index, queue))
-                continue;
+    if (action == Q_DEVMAP_RESET && index == Q_ANY_DEVICE && queue == Q_ANY_QUEUE) {
 
-            /* map_set... */
-            if (action == Q_DEVMAP_SET) {
+        for(i = 0; i <= Q_MAX_DEVICE; i++)
+            n += pfq_devmap_clear(i, word, bit);
 
-                tmp = atomic_long_read(&global->devmap[i][q]);
-                tmp |= 1L << (__force int)gid;
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
-            }
+        mutex_unlock(&global->devmap_lock);
+        return n;
+    }
 
-            /* map_reset */
-            tmp = atomic_long_read(&global->devmap[i][q]);
-            if (tmp & (1L << (__force int)gid)) {
-                tmp &= ~(1L << (__force int)gid);
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
-            }
+    if (index == Q_ANY_DEVICE) {
+
+        ret = pfq_devmap_stage(Q_MAX_DEVICE, action, queue, word, bit);
+
+        /* unbinding from any device covers the single devices too */
+
+        if (action == Q_DEVMAP_RESET) {
+            for(i = 0; i < Q_MAX_DEVICE && ret >= 0; i++)
+                ret = pfq_devmap_stage(i, action, queue, word, bit);
         }
     }
+    else {
+        ret = action == Q_DEVMAP_RESET ? pfq_devmap_spread_any(word, bit) : 0;
+        if (ret >= 0)
+            ret = pfq_devmap_stage(index, action, queue, word, bit);
+    }
 
-    /* update capture toggle filter... */
-
-    pfq_devmap_toggle_update();
+    n = pfq_devmap_commit(ret >= 0);
 
     mutex_unlock(&global->devmap_lock);
+
+    if (ret < 0) {
+        printk(KERN_WARNING "[PFQ] devmap: out of memory (gid=%d)!\n", (__force int)gid);
+        return ret;
+    }
+
     return n;
 }
 
+
+/* first device bound to one of the groups (-1 if none) */
+
+int pfq_devmap_first_device(unsigned long const *groups)
+{
+    int i, q, w, ret = -1;
+
+    rcu_read_lock();
+
+    for(i = 0; i < Q_MAX_DEVICE && ret == -1; i++)
+    {
+        struct pfq_devmap_entry *entry = rcu_dereference(global->devmap[i]);
+        if (!entry)
+            continue;
+
+        for(q = -1; q < entry->queues && ret == -1; q++)
+            for(w = 0; w < global->devmap_words; w++)
+                if (pfq_devmap_entry_mask(entry, q)[w] & groups[w]) {
+                    ret = i;
+                    break;
+                }
+    }
+
+    rcu_read_unlock();
+    return ret;
+}
+
+
+/* disable the capture of all the devices */
+
+void pfq_devmap_toggle_reset(void)
+{
+    struct pfq_devmap_entry *old;
+    int i;
+
+    mutex_lock(&global->devmap_lock);
+
+    for(i = 0; i < Q_MAX_DEVICE; i++)
+    {
+        old = rcu_dereference_protected(global->devmap[i], lockdep_is_held(&global->devmap_lock));
+        RCU_INIT_POINTER(global->devmap[i], NULL);
+        if (old)
+            kfree_rcu(old, rcu);
+    }
+
+    old = rcu_dereference_protected(global->devmap_any, lockdep_is_held(&global->devmap_lock));
+    RCU_INIT_POINTER(global->devmap_any, NULL);
+    if (old)
+        kfree_rcu(old, rcu);
+
+    mutex_unlock(&global->devmap_lock);
+}
@@ -30,6 +30,8 @@
 #include <pfq/define.h>
 #include <pfq/kcompat.h>
 
+#include <linux/rcupdate.h>
+
 
 /* pfq devmap */
 
@@ -39,10 +41,36 @@ enum
 };
 
 
+/*
+ * The groups bound to a device: a mask for the bindings to any queue, followed
+ * by a dense vector of masks for the queues bound one by one (up to the highest
+ * one). Each mask is devmap_words long: a single word, unless the module is
+ * loaded with max_groups > 64.
+ *
+ * Entries are immutable: an update publishes a new copy (RCU) and the entry of
+ * a device with no groups is released, so that a non-NULL entry is the capture
+ * toggle of the device. The only exception is the unbinding of a group from
+ * any device and queue, which clears its bits in place and never allocates.
+ * Bindings to any device live in devmap_any.
+ */
+
+struct pfq_devmap_entry
+{
+	struct rcu_head	rcu;
+	int		queues;		/* length of the queue vector */
+	unsigned long	mask[];		/* [1 + queues][devmap_words]: any queue, queue 0, 1... */
+};
+
+
 /* called from u-context
 */
 
 extern int  pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid);
+extern int  pfq_devmap_first_device(unsigned long const *groups);
+extern void pfq_devmap_toggle_reset(void);
+
+extern int  pfq_devmap_init(void);
+extern void pfq_devmap_destruct(void);
 
 
 static inline
@@ -56,29 +84,35 @@ int pfq_devmap_equal(int i1, int q1, int i2, int q2)
 
 
 static inline
-unsigned long pfq_devmap_get_groups(int dev, int queue)
+unsigned long pfq_devmap_entry_groups(struct pfq_devmap_entry const *entry, int queue, int word)
 {
-        return (long unsigned)atomic_long_read(&global->devmap[dev & Q_MAX_DEVICE_MASK][queue & Q_MAX_QUEUE_MASK]);
+	unsigned long ret;
+
+	if (!entry)
+		return 0;
+
+	ret = entry->mask[word];
+	if (queue < entry->queues)
+		ret |= entry->mask[(1 + queue) * global->devmap_words + word];
+	return ret;
 }
 
 
-extern void pfq_devmap_toggle_update(void);
+/* RCU read-side */
 
 static inline
-int pfq_devmap_toggle_get(int index)
+unsigned long pfq_devmap_get_groups(int dev, int queue, int word)
 {
-        return atomic_read(&global->devmap_toggle[index & Q_MAX_DEVICE_MASK]);
+        return pfq_devmap_entry_groups(rcu_dereference(global->devmap[dev & Q_MAX_DEVICE_MASK]), queue & Q_MAX_QUEUE_MASK, word) |
+               pfq_devmap_entry_groups(rcu_dereference(global->devmap_any), queue & Q_MAX_QUEUE_MASK, word);
 }
 
 
 static inline
-void pfq_devmap_toggle_reset(void)
+int pfq_devmap_toggle_get(int index)
 {
-        int n;
-        for(n = 0; n < Q_MAX_DEVICE; n++)
-        {
-                atomic_set(&global->devmap_toggle[n],0);
-        }
+        return rcu_access_pointer(global->devmap[index & Q_MAX_DEVICE_MASK]) != NULL ||
+               rcu_access_pointer(global->devmap_any) != NULL;
 }
 
 #endif /* PFQ_DEVMAP_H */
@@ -23,6 +23,8 @@
 
 #include <pfq/bitops.h>
 #include <pfq/endpoint.h>
+#include <pfq/group.h>
+#include <pfq/group_ring.h>
 #include <pfq/io.h>
 #include <pfq/kcompat.h>
 #include <pfq/netdev.h>
@@ -36,15 +38,18 @@ void
 pfq_get_lazy_endpoints( struct pfq_qbuff_queue *qb
 		      , struct pfq_endpoint_info *ts)
 {
-	size_t n, i;
+	struct net_device *dev;
+	uint16_t i;
+	size_t n;
+
 	ts->num = 0;
         ts->cnt_total = 0;
 
 	for(n = 0; n < qb->len; ++n)
 	{
-		for(i = 0; i < qb->queue[n].fwd_dev_num; i++)
+		for_each_qbuff_fwd_dev(&qb->queue[n], dev, i)
 		{
-			pfq_add_dev_to_endpoints(qb->queue[n].fwd_dev[i], ts);
+			pfq_add_dev_to_endpoints(dev, ts);
 		}
 	}
 }
@@ -79,10 +84,10 @@ pfq_add_dev_to_endpoints( struct net_device *dev
 static inline
 size_t copy_to_user_qbuffs( struct pfq_sock *so
 			  , struct pfq_qbuff_queue *buffs
-			  , unsigned __int128 mask
+			  , unsigned long const *mask
 			  , int cpu)
 {
-        size_t cpy, len = pfq_popcount(mask);
+        size_t cpy, len = qbuff_mask_weight(mask, buffs);
 
 	__sparse_add(so->stats, recv, len, cpu);
 
@@ -106,7 +111,7 @@ size_t copy_to_user_qbuffs( struct pfq_sock *so
 static inline
 size_t copy_to_dev_qbuffs( struct pfq_sock *so
 			 , struct pfq_qbuff_queue *buffs
-			 , unsigned __int128 mask
+			 , unsigned long const *mask
 			 , int cpu)
 {
 	struct net_device *dev;
@@ -134,7 +139,7 @@ size_t copy_to_dev_qbuffs( struct pfq_sock *so
 size_t
 pfq_copy_to_endpoint_qbuffs( struct pfq_sock *so
 			   , struct pfq_qbuff_queue *buffs
-			   , unsigned __int128 mask
+			   , unsigned long const *mask
 			   , int cpu)
 {
 	switch(so->egress_type)
@@ -149,3 +154,49 @@ pfq_copy_to_endpoint_qbuffs( struct pfq_sock *so
 	return false;
 }
 
+
+size_t
+pfq_copy_to_group_ring( pfq_gid_t gid
+		      , struct pfq_qbuff_queue *buffs
+		      , unsigned long const *mask
+		      , int cpu)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_group_ring *ring;
+	size_t cpy, len = qbuff_mask_weight(mask, buffs);
+	unsigned long readers, bit;
+
+	if (unlikely(group == NULL))
+		return 0;
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	if (unlikely(ring == NULL)) {
+		__sparse_add(group->stats, lost, len, cpu);
+		return 0;
+	}
+
+	cpy = pfq_group_ring_recv(ring, buffs, mask, (int)len);
+	if (len > cpy)
+		__sparse_add(group->stats, lost, len - cpy, cpu);
+
+	/* account the packets to the readers and wake them up */
+
+	readers = (unsigned long)atomic_long_read(&ring->readers);
+
+	pfq_bitwise_foreach(readers, bit,
+	{
+		int id = READ_ONCE(group->member[pfq_ctz(bit)]);
+		struct pfq_sock *so = id < 0 ? NULL : pfq_sock_get_by_id((__force pfq_id_t)id);
+		if (likely(so)) {
+			__sparse_add(so->stats, recv, len, cpu);
+			if (len > cpy)
+				__sparse_add(so->stats, lost, len - cpy, cpu);
+#ifdef PFQ_USE_POLL
+			if (cpy && waitqueue_active(&so->waitqueue))
+				wake_up_interruptible(&so->waitqueue);
+#endif
+		}
+	});
+
+	return cpy;
+}
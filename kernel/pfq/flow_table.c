@@ -0,0 +1,313 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/flow_table.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/shmem.h>
+#include <pfq/sock.h>
+
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+
+static size_t
+__pfq_flow_table_mem(size_t entries)
+{
+	return PAGE_ALIGN(sizeof(struct pfq_shared_flow_table) + entries * sizeof(struct pfq_flow_entry));
+}
+
+
+int
+pfq_flow_table_create(pfq_gid_t gid, pfq_id_t id, size_t entries, unsigned int timeout)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_shared_flow_table *sft;
+	struct pfq_flow_table *table;
+
+	if (group == NULL)
+		return -EINVAL;
+
+	if (atomic_long_read(&group->flow)) {
+		printk(KERN_INFO "[PFQ|%d] flow table: gid=%d has already a flow table!\n", id, gid);
+		return -EBUSY;
+	}
+
+	table = kzalloc(sizeof(struct pfq_flow_table), GFP_KERNEL);
+	if (table == NULL) {
+		printk(KERN_WARNING "[PFQ|%d] flow table: out of memory!\n", id);
+		return -ENOMEM;
+	}
+
+	table->sets = entries / Q_FLOW_WAYS;
+	table->timeout = (uint32_t)msecs_to_jiffies(timeout);
+	get_random_bytes(table->seed, sizeof(table->seed));
+
+	if (pfq_vmalloc_user(id, &table->shmem, __pfq_flow_table_mem(entries), NUMA_NO_NODE) < 0) {
+		kfree(table);
+		return -ENOMEM;
+	}
+
+	/* vmalloc_user memory is zeroed: all the entries are free */
+
+	sft = pfq_flow_table_shared(table);
+	sft->info.entries = entries;
+	sft->info.timeout = timeout;
+	sft->info.hz = HZ;
+
+	if (atomic_long_cmpxchg(&group->flow, 0L, (long)table) != 0L) {
+		pfq_shared_memory_free(&table->shmem);
+		kfree(table);
+		return -EBUSY;
+	}
+
+	printk(KERN_INFO "[PFQ|%d] flow table: gid=%d entries=%zu timeout=%u msec (%zu bytes)\n",
+	       id, gid, entries, timeout, table->shmem.size);
+	return 0;
+}
+
+
+/* called by the group, once the table is no longer reachable by the Rx path */
+
+void
+pfq_flow_table_destroy(struct pfq_flow_table *table)
+{
+	if (table == NULL)
+		return;
+
+	pfq_shared_memory_free(&table->shmem);
+	kfree(table);
+}
+
+
+/* both the directions of a flow have the same hash (the endpoints are ordered);
+ * the lower bit of the key tells whether the sender is the first endpoint, bit 1
+ * keeps the key non-zero */
+
+static inline void
+__pfq_flow_hash(struct pfq_flow_table *table, struct pfq_flow_tuple const *t, uint64_t *key, size_t *set)
+{
+	u32 a = (__force u32)t->saddr, b = (__force u32)t->daddr;
+	u32 pa = (__force u16)t->sport, pb = (__force u16)t->dport;
+	u32 h0, h1, dir;
+
+	dir = a < b || (a == b && pa <= pb);
+	if (!dir) {
+		swap(a, b);
+		swap(pa, pb);
+	}
+
+	h0 = jhash_3words(a, b, pa << 16 | pb, table->seed[0] ^ t->proto);
+	h1 = jhash_3words(a, b, pa << 16 | pb, table->seed[1] ^ t->proto);
+
+	*set = h0 & (table->sets - 1);
+	*key = ((((uint64_t)h0 << 32) | h1) & ~3ULL) | 2 | dir;
+}
+
+
+static inline bool
+__pfq_flow_expired(struct pfq_flow_table *table, struct pfq_flow_entry *e, uint32_t now)
+{
+	return (uint32_t)(now - __atomic_load_n(&e->last, __ATOMIC_RELAXED)) > table->timeout;
+}
+
+
+static inline struct pfq_flow_entry *
+__pfq_flow_find(struct pfq_flow_table *table, struct pfq_flow_entry *set, uint64_t key, uint32_t now)
+{
+	int n;
+
+	for(n = 0; n < Q_FLOW_WAYS; n++)
+	{
+		uint64_t cur = __atomic_load_n(&set[n].key, __ATOMIC_ACQUIRE);
+		if ((cur | 1) == (key | 1) && !__pfq_flow_expired(table, &set[n], now))
+			return &set[n];
+	}
+
+	return NULL;
+}
+
+
+/* take a free entry of the set, or the one idle for the longest time (beyond the timeout).
+ * The entry is initialized after the key is published: a packet of the same flow racing
+ * on another cpu may be lost by the counters, or accounted to a second entry. */
+
+static struct pfq_flow_entry *
+__pfq_flow_claim(struct pfq_flow_table *table, struct pfq_flow_entry *set, uint64_t key,
+		 struct pfq_flow_tuple const *t, uint32_t now)
+{
+	struct pfq_flow_entry *e = NULL;
+	uint64_t old = 0;
+	uint32_t idle = 0;
+	int n;
+
+	for(n = 0; n < Q_FLOW_WAYS; n++)
+	{
+		uint64_t cur = __atomic_load_n(&set[n].key, __ATOMIC_RELAXED);
+		uint32_t i;
+
+		if (cur == 0) {
+			e = &set[n];
+			old = 0;
+			break;
+		}
+
+		i = now - __atomic_load_n(&set[n].last, __ATOMIC_RELAXED);
+		if (i > table->timeout && i >= idle) {
+			e = &set[n];
+			old = cur;
+			idle = i;
+		}
+	}
+
+	if (e == NULL ||
+	    !__atomic_compare_exchange_n(&e->key, &old, key, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return NULL;
+
+	__atomic_store_n(&e->last, now, __ATOMIC_RELAXED);
+
+	e->saddr = (__force uint32_t)t->saddr;
+	e->daddr = (__force uint32_t)t->daddr;
+	e->sport = (__force uint16_t)t->sport;
+	e->dport = (__force uint16_t)t->dport;
+	e->proto = t->proto;
+	e->first = now;
+
+	__atomic_store_n(&e->packets, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->replies, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->state, Q_FLOW_STATE_NEW, __ATOMIC_RELEASE);
+
+	if (old)
+		__atomic_add_fetch(&pfq_flow_table_shared(table)->stats.evicted, 1, __ATOMIC_RELAXED);
+
+	return e;
+}
+
+
+struct pfq_flow_entry *
+pfq_flow_table_find(struct pfq_flow_table *table, struct pfq_flow_tuple const *tuple)
+{
+	uint64_t key;
+	size_t set;
+
+	__pfq_flow_hash(table, tuple, &key, &set);
+	return __pfq_flow_find(table, &pfq_flow_table_shared(table)->entry[set * Q_FLOW_WAYS], key, (uint32_t)jiffies);
+}
+
+
+/* account a packet to its flow (the flow is added if not present): return the entry
+ * and the number of packets of the flow so far, or NULL if the flow is not tracked */
+
+struct pfq_flow_entry *
+pfq_flow_table_update(struct pfq_flow_table *table, struct pfq_flow_tuple const *tuple,
+		      size_t len, bool closing, uint64_t *packets)
+{
+	struct pfq_shared_flow_table *sft = pfq_flow_table_shared(table);
+	struct pfq_flow_entry *e = NULL;
+	uint32_t now = (uint32_t)jiffies, state;
+	uint64_t key;
+	size_t set;
+	int retry;
+
+	__pfq_flow_hash(table, tuple, &key, &set);
+
+	/* the claim is retried once, the entry might have been taken by the same flow */
+
+	for(retry = 0; retry < 2 && e == NULL; retry++)
+	{
+		e = __pfq_flow_find(table, &sft->entry[set * Q_FLOW_WAYS], key, now);
+		if (e == NULL)
+			e = __pfq_flow_claim(table, &sft->entry[set * Q_FLOW_WAYS], key, tuple, now);
+	}
+
+	if (e == NULL) {
+		__atomic_add_fetch(&sft->stats.full, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	*packets = __atomic_add_fetch(&e->packets, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&e->bytes, len, __ATOMIC_RELAXED);
+
+	/* packet from the responder */
+
+	if ((__atomic_load_n(&e->key, __ATOMIC_RELAXED) ^ key) & 1) {
+		__atomic_add_fetch(&e->replies, 1, __ATOMIC_RELAXED);
+		state = Q_FLOW_STATE_NEW;
+		__atomic_compare_exchange_n(&e->state, &state, Q_FLOW_STATE_ESTABLISHED, false,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	if (closing)
+		__atomic_store_n(&e->state, Q_FLOW_STATE_CLOSED, __ATOMIC_RELAXED);
+
+	if (__atomic_load_n(&e->last, __ATOMIC_RELAXED) != now)
+		__atomic_store_n(&e->last, now, __ATOMIC_RELAXED);
+
+	return e;
+}
+
+
+int
+pfq_flow_table_mmap(struct pfq_sock *so, pfq_gid_t gid, struct vm_area_struct *vma)
+{
+	unsigned long size = (unsigned long)(vma->vm_end - vma->vm_start);
+	struct pfq_flow_table *table;
+	struct pfq_group *group;
+
+	group = pfq_group_get(gid);
+	if (group == NULL || !pfq_group_has_joined(gid, so->id)) {
+		printk(KERN_WARNING "[PFQ|%d] error: flow table mmap: gid=%d not joined!\n", so->id, gid);
+		return -EACCES;
+	}
+
+	table = (struct pfq_flow_table *)atomic_long_read(&group->flow);
+	if (table == NULL) {
+		printk(KERN_WARNING "[PFQ|%d] error: flow table mmap: gid=%d has no flow table!\n", so->id, gid);
+		return -EINVAL;
+	}
+
+	if (size > table->shmem.size) {
+		printk(KERN_WARNING "[PFQ|%d] error: flow table mmap: area too large!\n", so->id);
+		return -EINVAL;
+	}
+
+	if (vma->vm_flags & VM_WRITE) {
+		printk(KERN_WARNING "[PFQ|%d] error: flow table mmap: the table is read-only!\n", so->id);
+		return -EPERM;
+	}
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_LOCKED;
+
+	if (remap_vmalloc_range(vma, table->shmem.addr, 0) != 0) {
+		printk(KERN_WARNING "[PFQ|%d] error: flow table mmap: remap_vmalloc_range failed!\n", so->id);
+		return -EAGAIN;
+	}
+
+	printk(KERN_INFO "[PFQ|%d] flow table: gid=%d, %lu bytes mapped.\n", so->id, gid, size);
+	return 0;
+}
@@ -0,0 +1,77 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_FLOW_TABLE_H
+#define PFQ_FLOW_TABLE_H
+
+#include <pfq/group.h>
+#include <pfq/shmem.h>
+#include <pfq/sock.h>
+#include <pfq/types.h>
+
+#include <linux/pf_q.h>
+
+
+/* flow table owned by a group (see struct pfq_shared_flow_table) */
+
+struct pfq_flow_table
+{
+	struct pfq_shmem_descr	shmem;		/* struct pfq_shared_flow_table + entries */
+
+	size_t			sets;		/* entries / Q_FLOW_WAYS (power of 2) */
+	uint32_t		timeout;	/* jiffies */
+	uint32_t		seed[2];
+};
+
+
+/* IPv4 flow of a packet, as seen by its sender */
+
+struct pfq_flow_tuple
+{
+	__be32			saddr;
+	__be32			daddr;
+	__be16			sport;
+	__be16			dport;
+	u8			proto;
+};
+
+
+static inline
+struct pfq_shared_flow_table *
+pfq_flow_table_shared(struct pfq_flow_table *table)
+{
+	return (struct pfq_shared_flow_table *)table->shmem.addr;
+}
+
+
+extern int  pfq_flow_table_create(pfq_gid_t gid, pfq_id_t id, size_t entries, unsigned int timeout);
+extern void pfq_flow_table_destroy(struct pfq_flow_table *table);
+
+extern struct pfq_flow_entry *pfq_flow_table_find(struct pfq_flow_table *table, struct pfq_flow_tuple const *tuple);
+extern struct pfq_flow_entry *pfq_flow_table_update(struct pfq_flow_table *table, struct pfq_flow_tuple const *tuple,
+						    size_t len, bool closing, uint64_t *packets);
+
+extern int  pfq_flow_table_mmap(struct pfq_sock *so, pfq_gid_t gid, struct vm_area_struct *vma);
+
+
+#endif /* PFQ_FLOW_TABLE_H */
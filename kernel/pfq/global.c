@@ -32,6 +32,8 @@ struct pfq_global_data default_global =
 
 	.xmit_batch_len		= 1,
 	.capt_batch_len		= 1,
+	.capt_latency		= 1000,
+	.rx_latency		= 1000,
 
 	.vlan_untag		= 0,
 
@@ -41,13 +43,25 @@ struct pfq_global_data default_global =
 	.tx_cpu			= {0},
 	.tx_cpu_nr		= 0,
 	.tx_retry		= 1,
+	.tx_pace_spin		= 100000,
+	.tx_pace_window		= 1000,
+	.tx_quantum		= 65536,
+	.tx_idle		= 1000,
+	.tx_aggr		= 16,
+
+	.lang_opt		= 1,
+
+	.rx_zerocopy		= 0,
+
+	.max_groups		= 64,
 
 	.socket_ptr		= {{0}},
 	.socket_count		= {0},
      // .socket_lock		= {{0}},
 
-	.devmap			= {{{0}}},
-	.devmap_toggle		= {{0}},
+	.devmap			= {NULL},
+	.devmap_any		= NULL,
+	.devmap_words		= 0,
      // .devmap_lock		= {{0}},
 
 	.pool_enabled		= {0},
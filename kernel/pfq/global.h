@@ -35,6 +35,7 @@ struct pfq_kernel_stats __percpu;
 struct pfq_memory_stats __percpu;
 struct pfq_percpu_data  __percpu;
 struct pfq_percpu_pool  __percpu;
+struct pfq_devmap_entry;
 
 
 struct pfq_global_data
@@ -44,6 +45,8 @@ struct pfq_global_data
 
 	int xmit_batch_len;
 	int capt_batch_len;
+	int capt_latency;	/* default Rx latency bound (usec, 0 = none) */
+	int rx_latency;		/* effective Rx latency bound: the tightest among the sockets (usec) */
 
 	int skb_tx_pool_size;
 	int skb_rx_pool_size;
@@ -53,13 +56,25 @@ struct pfq_global_data
 	int tx_cpu[Q_MAX_CPU];
 	int tx_cpu_nr;
 	int tx_retry;
+	int tx_pace_spin;	/* Tx pacing: busy-wait below this distance from the timestamp (nsec) */
+	int tx_pace_window;	/* Tx pacing: packets due within this window are sent in a batch (nsec) */
+	int tx_quantum;		/* Tx kthreads: deficit round-robin quantum (bytes) */
+	int tx_idle;		/* Tx kthreads: idle time before sleeping (usec) */
+	int tx_aggr;		/* Tx kthreads: max socket queues per device queue burst */
+
+	int lang_opt;		/* pfq-lang: optimize computations at link time */
+
+	int rx_zerocopy;	/* zero-copy Rx allowed: the area exposes the whole Rx skb pools */
+
+	int max_groups;
 
 	atomic_long_t   socket_ptr[Q_MAX_ID];
 	atomic_t        socket_count;
 	struct mutex	socket_lock;
 
-	atomic_long_t   devmap [Q_MAX_DEVICE][Q_MAX_QUEUE];
-	atomic_t        devmap_toggle [Q_MAX_DEVICE];
+	struct pfq_devmap_entry __rcu *devmap[Q_MAX_DEVICE];	/* groups bound to the devices (see devmap.h) */
+	struct pfq_devmap_entry __rcu *devmap_any;		/* groups bound to any device */
+	int		devmap_words;
 	struct mutex	devmap_lock;
 
 	atomic_t	pool_enabled;
@@ -28,12 +28,19 @@
 #include <pfq/bitops.h>
 #include <pfq/bpf.h>
 #include <pfq/devmap.h>
+#include <pfq/flow_table.h>
 #include <pfq/global.h>
 #include <pfq/group.h>
+#include <pfq/group_ring.h>
 #include <pfq/kcompat.h>
 #include <pfq/percpu.h>
+#include <pfq/sock.h>
 #include <pfq/thread.h>
 
+#include <linux/bitmap.h>
+#include <linux/jhash.h>
+#include <linux/workqueue.h>
+
 void
 pfq_group_lock(void)
 {
@@ -48,11 +55,107 @@ pfq_group_unlock(void)
 }
 
 
+/*
+ * Objects detached from a group (computation, context, BPF filter, ring and flow
+ * table) are released once all the Rx paths that might be using them have completed.
+ * Destruction can sleep, hence it's deferred from the RCU callback to a work.
+ */
+
+struct pfq_group_garbage
+{
+	struct rcu_head				rcu;
+	struct work_struct			work;
+
+	struct pfq_lang_computation_tree	*comp;
+	void					*ctx;
+	struct sk_filter			*filter;
+	struct pfq_group_ring			*ring;
+	struct pfq_flow_table			*flow;
+};
+
+
+static void
+__pfq_group_garbage_destruct(struct pfq_lang_computation_tree *comp, void *ctx,
+			     struct sk_filter *filter, struct pfq_group_ring *ring,
+			     struct pfq_flow_table *flow)
+{
+	pfq_group_ring_destroy(ring);
+	pfq_flow_table_destroy(flow);
+
+	/* finalize old computation */
+
+	if (comp)
+		pfq_lang_computation_destruct(comp);
+
+	pfq_lang_computation_free(comp);
+	kfree(ctx);
+
+	if (filter)
+		pfq_free_sk_filter(filter);
+}
+
+
+static void
+pfq_group_garbage_work(struct work_struct *work)
+{
+	struct pfq_group_garbage *g = container_of(work, struct pfq_group_garbage, work);
+	__pfq_group_garbage_destruct(g->comp, g->ctx, g->filter, g->ring, g->flow);
+	kfree(g);
+}
+
+
+static void
+pfq_group_garbage_rcu(struct rcu_head *rcu)
+{
+	struct pfq_group_garbage *g = container_of(rcu, struct pfq_group_garbage, rcu);
+	INIT_WORK(&g->work, pfq_group_garbage_work);
+	schedule_work(&g->work);
+}
+
+
+static void
+pfq_group_release(struct pfq_lang_computation_tree *comp, void *ctx,
+		  struct sk_filter *filter, struct pfq_group_ring *ring,
+		  struct pfq_flow_table *flow)
+{
+	struct pfq_group_garbage *g;
+
+	if (!comp && !ctx && !filter && !ring && !flow)
+		return;
+
+	g = kmalloc(sizeof(struct pfq_group_garbage), GFP_KERNEL);
+	if (g == NULL) {
+		/* out of memory: wait for the grace period here */
+		synchronize_rcu();
+		__pfq_group_garbage_destruct(comp, ctx, filter, ring, flow);
+		return;
+	}
+
+	g->comp   = comp;
+	g->ctx    = ctx;
+	g->filter = filter;
+	g->ring   = ring;
+	g->flow   = flow;
+
+	call_rcu(&g->rcu, pfq_group_garbage_rcu);
+}
+
+
+/* wait for the pending releases to complete (module unload) */
+
+void
+pfq_group_release_barrier(void)
+{
+	rcu_barrier();
+	flush_scheduled_work();
+}
+
+
 int
 pfq_groups_init(void)
 {
 	int n;
-	for(n = 0; n < Q_MAX_GID; n++)
+	for(n = 0; n < global->max_groups; n++)
 	{
 		struct pfq_group * group = &global->groups[n];
 
@@ -62,6 +165,10 @@ pfq_groups_init(void)
 		group->owner = Q_INVALID_ID;
 		group->policy = Q_POLICY_GROUP_UNDEFINED;
 
+		memset(group->member, 0xff, sizeof(group->member));
+		group->direct = true;
+		group->lang_profile = 0;
+
 		group->stats = alloc_percpu(pfq_group_stats_t);
 		if (group->stats == NULL) {
 			goto err;
@@ -88,7 +195,7 @@ void
 pfq_groups_destruct(void)
 {
 	int n;
-	for(n = 0; n < Q_MAX_GID; n++)
+	for(n = 0; n < global->max_groups; n++)
 	{
 		struct pfq_group * group = &global->groups[n];
 
@@ -161,6 +268,201 @@ pfq_group_access(pfq_gid_t gid, pfq_id_t id)
 }
 
 
+/*
+ * Group members: a socket that joins a group takes one of its Q_MAX_GROUP_SOCK
+ * slots, and the socket masks of the group (sock_id, steering tables, ring
+ * readers) are expressed in slots. The slot equal to the socket id is preferred,
+ * so that groups made of sockets with id < 64 (the common case) translate slots
+ * to sockets for free (direct).
+ */
+
+static int
+__pfq_group_slot(struct pfq_group *group, pfq_id_t id)
+{
+	int n;
+	for(n = 0; n < Q_MAX_GROUP_SOCK; n++)
+	{
+		if (group->member[n] == (__force int)id)
+			return n;
+	}
+	return -1;
+}
+
+
+int
+pfq_group_slot(pfq_gid_t gid, pfq_id_t id)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	if (group == NULL)
+		return -1;
+	return __pfq_group_slot(group, id);
+}
+
+
+static void
+__pfq_group_direct_update(struct pfq_group *group)
+{
+	bool direct = true;
+	int n;
+
+	for(n = 0; n < Q_MAX_GROUP_SOCK; n++)
+	{
+		if (group->member[n] >= 0 && group->member[n] != n)
+			direct = false;
+	}
+
+	WRITE_ONCE(group->direct, direct);
+	smp_wmb();
+}
+
+
+static int
+__pfq_group_slot_alloc(struct pfq_group *group, pfq_id_t id)
+{
+	int slot = __pfq_group_slot(group, id);
+	int n;
+
+	if (slot >= 0)
+		return slot;
+
+	if ((__force int)id < Q_MAX_GROUP_SOCK && group->member[(__force int)id] < 0)
+		slot = (__force int)id;
+	else {
+		for(n = 0; n < Q_MAX_GROUP_SOCK; n++)
+		{
+			if (group->member[n] < 0) {
+				slot = n;
+				break;
+			}
+		}
+	}
+
+	if (slot < 0)
+		return -EBUSY;
+
+	group->member[slot] = (__force int)id;
+	__pfq_group_direct_update(group);
+	return slot;
+}
+
+
+/*
+ * Maglev steering tables: every member walks the table following its own
+ * permutation (offset + j * skip, derived from its socket id) and claims the
+ * first free entry, once for each unit of its weight per round. The layout
+ * depends only on the ids and weights of the sockets, hence a socket that
+ * rejoins with the same id gets the same flows back. Entries are member slots.
+ */
+
+static void
+__pfq_steering_table_fill(struct pfq_group *group, struct pfq_steering_table *table, unsigned long slot_mask)
+{
+	uint16_t offset[Q_MAX_GROUP_SOCK], skip[Q_MAX_GROUP_SOCK], next[Q_MAX_GROUP_SOCK];
+	uint8_t weight[Q_MAX_GROUP_SOCK];
+	unsigned long bit;
+	size_t filled = 0;
+
+	memset(table->entry, 0xff, sizeof(table->entry));
+
+	pfq_bitwise_foreach(slot_mask, bit,
+	{
+		int slot = (int)pfq_ctz(bit);
+		int id = group->member[slot];
+		struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)id);
+
+		offset[slot] = (uint16_t)(jhash_1word((u32)id, 0x9e3779b9) % Q_STEERING_TABLE_LEN);
+		skip[slot]   = (uint16_t)(jhash_1word((u32)id, 0x7f4a7c15) % (Q_STEERING_TABLE_LEN - 1) + 1);
+		next[slot]   = 0;
+		weight[slot] = so ? (uint8_t)so->weight : 1;
+	});
+
+	while (filled < Q_STEERING_TABLE_LEN)
+	{
+		pfq_bitwise_foreach(slot_mask, bit,
+		{
+			int slot = (int)pfq_ctz(bit);
+			unsigned int w;
+
+			for(w = 0; w < weight[slot] && filled < Q_STEERING_TABLE_LEN; w++)
+			{
+				unsigned int c;
+				do {
+					c = (offset[slot] + (unsigned int)next[slot] * skip[slot]) % Q_STEERING_TABLE_LEN;
+					next[slot]++;
+				}
+				while (table->entry[c] != 0xff);
+
+				table->entry[c] = (uint8_t)slot;
+				filled++;
+			}
+		});
+	}
+}
+
+
+/* rebuild the steering tables of the group (groups_lock held) */
+
+static void
+__pfq_group_steering_update(struct pfq_group *group)
+{
+	size_t i;
+
+	for(i = 0; i < Q_CLASS_MAX; i++)
+	{
+		unsigned long sock_mask = (unsigned long)atomic_long_read(&group->sock_id[i]);
+		struct pfq_steering_table *table = NULL, *old;
+
+		old = rcu_dereference_protected(group->steering[i], lockdep_is_held(&global->groups_lock));
+		if (sock_mask == 0 && old == NULL)
+			continue;
+
+		/* on allocation failure packets are steered without the table */
+
+		if (sock_mask) {
+			table = kmalloc(sizeof(struct pfq_steering_table), GFP_KERNEL);
+			if (table)
+				__pfq_steering_table_fill(group, table, sock_mask);
+			else
+				printk(KERN_WARNING "[PFQ] steering table: out of memory!\n");
+		}
+
+		rcu_assign_pointer(group->steering[i], table);
+		if (old)
+			kfree_rcu(old, rcu);
+	}
+}
+
+
+void
+pfq_group_steering_update(pfq_id_t id)
+{
+	int n;
+
+	mutex_lock(&global->groups_lock);
+	for(n = 0; n < global->max_groups; n++)
+	{
+		pfq_gid_t gid = (__force pfq_gid_t)n;
+		struct pfq_group *group = pfq_group_get(gid);
+
+		if (group && group->enabled && pfq_group_has_joined(gid, id))
+			__pfq_group_steering_update(group);
+	}
+	mutex_unlock(&global->groups_lock);
+}
+
+
+/* groups_lock held: the profiling static key counts the groups with profiling enabled */
+
+static void
+__pfq_group_set_lang_profile(struct pfq_group *group, int sample)
+{
+        if (!group->lang_profile != !sample)
+		pfq_lang_profile_enable(sample != 0);
+
+        group->lang_profile = sample;
+}
+
+
 static void
 __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
 {
@@ -175,14 +477,29 @@ __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
                 atomic_long_set(&group->sock_id[i], 0);
         }
 
+        for(i = 0; i < Q_MAX_GROUP_SOCK; i++)
+        {
+                group->member[i] = -1;
+        }
+
+        group->direct = true;
+
         atomic_long_set(&group->bp_filter,0L);
         atomic_long_set(&group->comp,     0L);
         atomic_long_set(&group->comp_ctx, 0L);
+        atomic_long_set(&group->ring,     0L);
+        atomic_long_set(&group->flow,     0L);
+
+        for(i = 0; i < Q_CLASS_MAX; i++)
+        {
+                RCU_INIT_POINTER(group->steering[i], NULL);
+        }
 
 	pfq_group_stats_reset(group->stats);
 	pfq_group_counters_reset(group->counters);
 
 	group->vlan_filt = false;
+	__pfq_group_set_lang_profile(group, 0);
 
 	for(i = 0; i < 4096; i++) {
 		group->vid_filters[i] = 0;
@@ -198,10 +515,12 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 {
         struct sk_filter *filter;
         struct pfq_lang_computation_tree *old_comp;
+        struct pfq_group_ring *old_ring;
+        struct pfq_flow_table *old_flow;
         void *old_ctx;
         size_t i;
 
-        /* remove this gid from devmap matrix */
+        /* remove this gid from devmap matrix (allocation-free, it cannot fail) */
 
         pfq_devmap_update(Q_DEVMAP_RESET, Q_ANY_DEVICE, Q_ANY_QUEUE, gid);
 
@@ -214,20 +533,12 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
         filter   = (struct sk_filter *)atomic_long_xchg(&group->bp_filter, 0L);
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, 0L);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, 0L);
+        old_ring = (struct pfq_group_ring *)atomic_long_xchg(&group->ring, 0L);
+        old_flow = (struct pfq_flow_table *)atomic_long_xchg(&group->flow, 0L);
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
-
-	/* finalize old computation */
-
-	if (old_comp) {
-		pfq_lang_computation_destruct(old_comp);
-	}
-
-	kfree(old_comp);
-	kfree(old_ctx);
+	pfq_group_release(old_comp, old_ctx, filter, old_ring, old_flow);
 
-	if (filter)
-		pfq_free_sk_filter(filter);
+	__pfq_group_set_lang_profile(group, 0);
 
         group->vlan_filt = false;
 	for(i = 0; i < 4096; i++) {
@@ -244,6 +555,7 @@ __pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int polic
         struct pfq_group * group;
         unsigned long bit;
         long tmp = 0;
+        int slot;
 
 	group = pfq_group_get(gid);
         if (group == NULL)
@@ -263,14 +575,25 @@ __pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int polic
 
 	if (policy != Q_POLICY_GROUP_UNDEFINED)
 	{
+		slot = __pfq_group_slot_alloc(group, id);
+		if (slot < 0) {
+			printk(KERN_INFO "[PFQ|%d] join group gid=%d: no free slot (max %d sockets per group)!\n",
+			       id, gid, Q_MAX_GROUP_SOCK);
+			if (__pfq_group_is_empty(gid))
+				__pfq_group_free(group, gid);
+			return slot;
+		}
+
 		pfq_bitwise_foreach(class_mask, bit,
 		{
 			 unsigned int class = pfq_ctz(bit);
 			 tmp = atomic_long_read(&group->sock_id[class]);
-			 tmp |= 1L << (__force int)id;
+			 tmp |= 1L << slot;
 			 atomic_long_set(&group->sock_id[class], tmp);
 		});
 
+		__pfq_group_steering_update(group);
+
 		if (group->owner == Q_INVALID_ID)
 			group->owner = id;
 		if (group->pid == 0)
@@ -296,17 +619,30 @@ __pfq_group_leave(pfq_gid_t gid, pfq_id_t id)
         struct pfq_group * group;
         long tmp;
         size_t i;
+        int slot;
 
 	group = pfq_group_get(gid);
         if (group == NULL)
                 return -EINVAL;
 
-        for(i = 0; i < Q_CLASS_MAX; ++i)
-        {
-                tmp = atomic_long_read(&group->sock_id[i]);
-                tmp &= ~(1L << (__force int)id);
-                atomic_long_set(&group->sock_id[i], tmp);
-        }
+	slot = __pfq_group_slot(group, id);
+	if (slot >= 0) {
+
+		pfq_group_ring_detach(gid, id);
+
+		for(i = 0; i < Q_CLASS_MAX; ++i)
+		{
+			tmp = atomic_long_read(&group->sock_id[i]);
+			tmp &= ~(1L << slot);
+			atomic_long_set(&group->sock_id[i], tmp);
+		}
+
+		group->member[slot] = -1;
+		__pfq_group_direct_update(group);
+
+		if (group->enabled)
+			__pfq_group_steering_update(group);
+	}
 
 	if (group->enabled && __pfq_group_is_empty(gid))
 		__pfq_group_free(group, gid);
@@ -348,10 +684,7 @@ pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter)
 
         old_filter = (void *)atomic_long_xchg(&group->bp_filter, (long)filter);
 
-        msleep(Q_GRACE_PERIOD);
-
-	if (old_filter)
-		pfq_free_sk_filter(old_filter);
+	pfq_group_release(NULL, NULL, old_filter, NULL, NULL);
 }
 
 
@@ -371,19 +704,11 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, (long)comp);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, (long)ctx);
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
-
-	/* call fini on old computation */
-
-	if (old_comp)
-		pfq_lang_computation_destruct(old_comp);
-
-        /* free the old computation/context */
+        mutex_unlock(&global->groups_lock);
 
-        kfree(old_comp);
-        kfree(old_ctx);
+	/* fini and free the old computation/context once no Rx path can see them */
 
-        mutex_unlock(&global->groups_lock);
+	pfq_group_release(old_comp, old_ctx, NULL, NULL, NULL);
         return 0;
 }
 
@@ -413,14 +738,14 @@ pfq_group_join_free(pfq_id_t id, unsigned long class_mask, int policy)
         int n = 0;
 
         mutex_lock(&global->groups_lock);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < global->max_groups; n++)
         {
 		pfq_gid_t gid = (__force pfq_gid_t)n;
 
                 if(!pfq_group_get(gid)->enabled) {
-                        __pfq_group_join(gid, id, class_mask, policy);
+                        int rc = __pfq_group_join(gid, id, class_mask, policy);
                         mutex_unlock(&global->groups_lock);
-                        return n;
+                        return rc < 0 ? rc : n;
                 }
         }
         mutex_unlock(&global->groups_lock);
@@ -451,7 +776,7 @@ pfq_group_leave_all(pfq_id_t id)
         int n = 0;
 
         mutex_lock(&global->groups_lock);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < global->max_groups; n++)
         {
 		pfq_gid_t gid = (__force pfq_gid_t)n;
                 __pfq_group_leave(gid, id);
@@ -462,22 +787,24 @@ pfq_group_leave_all(pfq_id_t id)
 }
 
 
-unsigned long
-pfq_group_get_groups(pfq_id_t id)
+/* mask is a bitmap of Q_MAX_GID bits */
+
+void
+pfq_group_get_groups(pfq_id_t id, unsigned long *mask)
 {
-        unsigned long rc = 0;
         int n = 0;
+
+        bitmap_zero(mask, Q_MAX_GID);
+
         mutex_lock(&global->groups_lock);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < global->max_groups; n++)
         {
 		pfq_gid_t gid = (__force pfq_gid_t)n;
-                unsigned long mask = pfq_group_get_all_sock_mask(gid);
 
-                if(mask & (1UL << (__force int)id))
-                        rc |= (1UL << n);
+                if(pfq_group_has_joined(gid, id))
+                        set_bit(n, mask);
         }
         mutex_unlock(&global->groups_lock);
-        return rc;
 }
 
 
@@ -485,7 +812,7 @@ struct pfq_group *
 pfq_group_get(pfq_gid_t gid)
 {
         if ((__force int)gid < 0 ||
-            (__force int)gid >= Q_MAX_GID)
+            (__force int)gid >= global->max_groups)
                 return NULL;
         return &global->groups[(__force int)gid];
 }
@@ -535,6 +862,22 @@ pfq_group_toggle_vlan_filters(pfq_gid_t gid, bool value)
 }
 
 
+int
+pfq_group_set_lang_profile(pfq_gid_t gid, int sample)
+{
+        struct pfq_group *group;
+
+        group = pfq_group_get(gid);
+        if (group == NULL || sample < 0)
+                return -EINVAL;
+
+        mutex_lock(&global->groups_lock);
+        __pfq_group_set_lang_profile(group, sample);
+        mutex_unlock(&global->groups_lock);
+        return 0;
+}
+
+
 void
 pfq_group_set_vlan_filter(pfq_gid_t gid, bool value, int vid)
 {
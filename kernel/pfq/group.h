@@ -32,10 +32,30 @@
 #include <pfq/bpf.h>
 
 #include <linux/pf_q.h>
+#include <linux/rcupdate.h>
 
 typedef struct pfq_kernel_stats pfq_group_stats_t;
 struct pfq_group_counters;
 
+
+/* precomputed steering table of a class (Maglev consistent hashing): each socket
+ * fills a share of the entries proportional to its weight, and adding or removing
+ * a socket remaps only the entries of that socket */
+
+struct pfq_steering_table
+{
+	struct rcu_head	rcu;
+	uint8_t		entry[Q_STEERING_TABLE_LEN];	/* member slots */
+};
+
+
+static inline
+unsigned int pfq_steering_index(uint32_t hash)
+{
+	return (unsigned int)(((uint64_t)hash * Q_STEERING_TABLE_LEN) >> 32);
+}
+
+
 struct pfq_group
 {
         int policy;                                     /* group policy */
@@ -43,17 +63,27 @@ struct pfq_group
 
 	pfq_id_t owner;					/* owner's pfq id */
 
-        atomic_long_t sock_id[Q_CLASS_MAX];		/* list of (bitwise) socket ids that joined this group, for each different class:
+        atomic_long_t sock_id[Q_CLASS_MAX];		/* list of (bitwise) member slots that joined this group, for each different class:
         						   Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
 
+        int member[Q_MAX_GROUP_SOCK];			/* slot -> socket id (-1 if free) */
+        bool direct;					/* every member sits in the slot equal to its id */
+
         atomic_long_t bp_filter;			/* struct sk_filter pointer */
 
         atomic_long_t comp;                             /* struct pfq_lang_computation_tree *  (new functional program) */
         atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
 
+        atomic_long_t ring;                             /* struct pfq_group_ring * (single-copy ring of the group) */
+        atomic_long_t flow;                             /* struct pfq_flow_table * (flow table of the group) */
+
+        struct pfq_steering_table __rcu *steering[Q_CLASS_MAX];	/* steering tables, rebuilt on join/leave/weight */
+
 	pfq_group_stats_t __percpu *stats;
 	struct pfq_group_counters __percpu *counters;
 
+        int    lang_profile;                            /* pfq-lang profiling: sampling period, 0 = disabled */
+
         bool   enabled;
         bool   vlan_filt;                               /* enable/disable vlan filtering */
         char   vid_filters[4096];                       /* vlan filters */
@@ -68,9 +98,11 @@ extern int  pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask,
 extern int  pfq_group_leave(pfq_gid_t gid, pfq_id_t id);
 extern int  pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *prog, void *ctx);
 extern void pfq_group_leave_all(pfq_id_t id);
+extern void pfq_group_steering_update(pfq_id_t id);
 
-extern unsigned long pfq_group_get_groups(pfq_id_t id);
+extern void pfq_group_get_groups(pfq_id_t id, unsigned long *mask);
 extern unsigned long pfq_group_get_all_sock_mask(pfq_gid_t gid);
+extern int  pfq_group_slot(pfq_gid_t gid, pfq_id_t id);
 
 extern int  pfq_group_get_context(pfq_gid_t gid, int level, int size, void __user *context);
 extern void pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter);
@@ -80,6 +112,7 @@ extern struct pfq_group * pfq_group_get(pfq_gid_t gid);
 extern bool pfq_group_vlan_filters_enabled(pfq_gid_t gid);
 extern bool pfq_group_check_vlan_filter(pfq_gid_t gid, int vid);
 extern bool pfq_group_toggle_vlan_filters(pfq_gid_t gid, bool value);
+extern int  pfq_group_set_lang_profile(pfq_gid_t gid, int sample);
 extern void pfq_group_set_vlan_filter(pfq_gid_t gid, bool value, int vid);
 
 extern bool pfq_group_policy_access(pfq_gid_t gid, pfq_id_t id, int policy);
@@ -90,11 +123,13 @@ extern void pfq_group_unlock(void);
 
 extern int  pfq_groups_init(void);
 extern void pfq_groups_destruct(void);
+extern void pfq_group_release_barrier(void);
 
 static inline
 bool pfq_group_has_joined(pfq_gid_t gid, pfq_id_t id)
 {
-        return (pfq_group_get_all_sock_mask(gid) & (1UL << (__force int)id));
+        int slot = pfq_group_slot(gid, id);
+        return slot >= 0 && (pfq_group_get_all_sock_mask(gid) & (1UL << slot));
 }
 
 static inline
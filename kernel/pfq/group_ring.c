@@ -0,0 +1,276 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/bitops.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/group_ring.h>
+#include <pfq/shmem.h>
+#include <pfq/sock.h>
+
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+
+static size_t
+__pfq_group_ring_mem(size_t slots, size_t slot_size)
+{
+	return PAGE_ALIGN(sizeof(struct pfq_shared_ring) + slots * slot_size);
+}
+
+
+int
+pfq_group_ring_create(pfq_gid_t gid, pfq_id_t id, size_t slots, size_t caplen, int policy)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_group_ring *ring;
+	struct pfq_shared_ring *sr;
+	size_t n;
+
+	if (group == NULL)
+		return -EINVAL;
+
+	if (atomic_long_read(&group->ring)) {
+		printk(KERN_INFO "[PFQ|%d] group ring: gid=%d has already a ring!\n", id, gid);
+		return -EBUSY;
+	}
+
+	/* the groups with a ring are marked in the (single word) qbuff ring_mask */
+
+	if ((__force int)gid >= BITS_PER_LONG) {
+		printk(KERN_INFO "[PFQ|%d] group ring: gid=%d not supported (rings available for gid < %d)!\n",
+		       id, gid, BITS_PER_LONG);
+		return -EPERM;
+	}
+
+	ring = kzalloc(sizeof(struct pfq_group_ring), GFP_KERNEL);
+	if (ring == NULL) {
+		printk(KERN_WARNING "[PFQ|%d] group ring: out of memory!\n", id);
+		return -ENOMEM;
+	}
+
+	ring->slots = slots;
+	ring->slot_size = PFQ_SHARED_QUEUE_SLOT_SIZE(caplen);
+	ring->caplen = caplen;
+	ring->policy = policy;
+	atomic_long_set(&ring->readers, 0);
+
+	if (pfq_vmalloc_user(id, &ring->shmem, __pfq_group_ring_mem(slots, ring->slot_size), NUMA_NO_NODE) < 0) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	/* vmalloc_user memory is zeroed: indexes and commits start from 0 */
+
+	sr = pfq_group_ring_shared(ring);
+	sr->info.slots = slots;
+	sr->info.slot_size = ring->slot_size;
+	sr->info.caplen = caplen;
+	sr->info.policy = policy;
+
+	for(n = 0; n < slots; n++)
+		((struct pfq_pkthdr *)pfq_group_ring_slot(ring, n))->info.commit = 0;
+
+	if (atomic_long_cmpxchg(&group->ring, 0L, (long)ring) != 0L) {
+		pfq_shared_memory_free(&ring->shmem);
+		kfree(ring);
+		return -EBUSY;
+	}
+
+	printk(KERN_INFO "[PFQ|%d] group ring: gid=%d slots=%zu slot_size=%zu policy=%s (%zu bytes)\n",
+	       id, gid, slots, ring->slot_size, policy == Q_RING_POLICY_DROP ? "drop" : "block", ring->shmem.size);
+	return 0;
+}
+
+
+/* called by the group, once the ring is no longer reachable by the Rx path */
+
+void
+pfq_group_ring_destroy(struct pfq_group_ring *ring)
+{
+	if (ring == NULL)
+		return;
+
+	pfq_shared_memory_free(&ring->shmem);
+	kfree(ring);
+}
+
+
+int
+pfq_group_ring_attach(pfq_gid_t gid, struct pfq_sock *so)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_group_ring *ring;
+	struct pfq_shared_ring *sr;
+	struct pfq_shared_ring_reader *reader;
+	int slot;
+
+	if (group == NULL)
+		return -EINVAL;
+
+	/* the readers of the ring are the member slots of the group */
+
+	slot = pfq_group_slot(gid, so->id);
+	if (slot < 0) {
+		printk(KERN_INFO "[PFQ|%d] group ring: gid=%d not joined!\n", so->id, gid);
+		return -EACCES;
+	}
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	if (ring == NULL) {
+		printk(KERN_INFO "[PFQ|%d] group ring: gid=%d has no ring!\n", so->id, gid);
+		return -ENOENT;
+	}
+
+	if (so->ring_gid != -1) {
+		printk(KERN_INFO "[PFQ|%d] group ring: socket already attached to gid=%d!\n", so->id, so->ring_gid);
+		return -EBUSY;
+	}
+
+	/* the reader starts from the packets produced from now on */
+
+	sr = pfq_group_ring_shared(ring);
+	reader = &sr->reader[slot];
+
+	__atomic_store_n(&reader->lost, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&reader->index, __atomic_load_n(&sr->prod.index, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+	smp_wmb();
+
+	atomic_long_set(&ring->readers, atomic_long_read(&ring->readers) | (1L << slot));
+	so->ring_reader = slot;
+	so->ring_gid = (__force int)gid;
+
+	pr_devel("[PFQ|%d] group ring: attached to gid=%d.\n", so->id, gid);
+	return 0;
+}
+
+
+int
+pfq_group_ring_detach(pfq_gid_t gid, pfq_id_t id)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_group_ring *ring;
+	struct pfq_sock *so;
+	int slot;
+
+	if (group == NULL)
+		return -EINVAL;
+
+	slot = pfq_group_slot(gid, id);
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	if (ring && slot >= 0)
+		atomic_long_set(&ring->readers, atomic_long_read(&ring->readers) & ~(1L << slot));
+
+	so = pfq_sock_get_by_id(id);
+	if (so && so->ring_gid == (__force int)gid) {
+		so->ring_gid = -1;
+		so->ring_reader = -1;
+	}
+
+	return 0;
+}
+
+
+size_t
+pfq_group_ring_mem(pfq_gid_t gid)
+{
+	struct pfq_group *group = pfq_group_get(gid);
+	struct pfq_group_ring *ring;
+
+	if (group == NULL)
+		return 0;
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	return ring ? ring->shmem.size : 0;
+}
+
+
+/* number of packets available to the attached socket (poll) */
+
+size_t
+pfq_group_ring_avail(struct pfq_sock *so)
+{
+	struct pfq_group_ring *ring;
+	struct pfq_shared_ring *sr;
+	struct pfq_group *group;
+	size_t avail = 0;
+
+	if (so->ring_gid == -1)
+		return 0;
+
+	group = pfq_group_get((__force pfq_gid_t)so->ring_gid);
+	if (group == NULL)
+		return 0;
+
+	/* the ring is released after a grace period */
+
+	rcu_read_lock();
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	if (ring) {
+		sr = pfq_group_ring_shared(ring);
+		avail = __atomic_load_n(&sr->prod.index, __ATOMIC_ACQUIRE) -
+			__atomic_load_n(&sr->reader[so->ring_reader & (Q_MAX_RING_READERS-1)].index, __ATOMIC_RELAXED);
+	}
+
+	rcu_read_unlock();
+	return avail;
+}
+
+
+int
+pfq_group_ring_mmap(struct pfq_sock *so, pfq_gid_t gid, struct vm_area_struct *vma)
+{
+	unsigned long size = (unsigned long)(vma->vm_end - vma->vm_start);
+	struct pfq_group_ring *ring;
+	struct pfq_group *group;
+
+	group = pfq_group_get(gid);
+	if (group == NULL || !pfq_group_has_joined(gid, so->id)) {
+		printk(KERN_WARNING "[PFQ|%d] error: group ring mmap: gid=%d not joined!\n", so->id, gid);
+		return -EACCES;
+	}
+
+	ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	if (ring == NULL) {
+		printk(KERN_WARNING "[PFQ|%d] error: group ring mmap: gid=%d has no ring!\n", so->id, gid);
+		return -EINVAL;
+	}
+
+	if (size > ring->shmem.size) {
+		printk(KERN_WARNING "[PFQ|%d] error: group ring mmap: area too large!\n", so->id);
+		return -EINVAL;
+	}
+
+	vma->vm_flags |= VM_LOCKED;
+
+	if (remap_vmalloc_range(vma, ring->shmem.addr, 0) != 0) {
+		printk(KERN_WARNING "[PFQ|%d] error: group ring mmap: remap_vmalloc_range failed!\n", so->id);
+		return -EAGAIN;
+	}
+
+	printk(KERN_INFO "[PFQ|%d] group ring: gid=%d, %lu bytes mapped.\n", so->id, gid, size);
+	return 0;
+}
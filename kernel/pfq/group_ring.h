@@ -0,0 +1,103 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_GROUP_RING_H
+#define PFQ_GROUP_RING_H
+
+#include <pfq/atomic.h>
+#include <pfq/group.h>
+#include <pfq/qbuff.h>
+#include <pfq/shmem.h>
+#include <pfq/sock.h>
+#include <pfq/types.h>
+
+#include <linux/pf_q.h>
+
+
+/* single-copy ring owned by a group (see struct pfq_shared_ring) */
+
+struct pfq_group_ring
+{
+	struct pfq_shmem_descr	shmem;		/* struct pfq_shared_ring + slots */
+
+	size_t			slots;
+	size_t			slot_size;
+	size_t			caplen;
+	int			policy;		/* Q_RING_POLICY_* */
+
+	atomic_long_t		readers;	/* bitwise member slots of the readers */
+};
+
+
+static inline
+struct pfq_shared_ring *
+pfq_group_ring_shared(struct pfq_group_ring *ring)
+{
+	return (struct pfq_shared_ring *)ring->shmem.addr;
+}
+
+
+static inline
+char *
+pfq_group_ring_slot(struct pfq_group_ring *ring, unsigned long index)
+{
+	return (char *)ring->shmem.addr + sizeof(struct pfq_shared_ring) + (index % ring->slots) * ring->slot_size;
+}
+
+
+/* the packets broadcast to the readers of the ring are written to the ring once:
+ * mark the qbuff for the ring of this group and return the remaining sockets */
+
+static inline
+unsigned long
+pfq_group_ring_filter(struct pfq_group *group, pfq_gid_t gid, struct qbuff *buff, unsigned long sock_mask)
+{
+	struct pfq_group_ring *ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+	unsigned long readers;
+
+	if (likely(ring == NULL))
+		return sock_mask;
+
+	readers = sock_mask & (unsigned long)atomic_long_read(&ring->readers);
+	if (readers) {
+		buff->ring_mask |= 1UL << (__force int)gid;
+		return sock_mask & ~readers;
+	}
+
+	return sock_mask;
+}
+
+
+extern int  pfq_group_ring_create(pfq_gid_t gid, pfq_id_t id, size_t slots, size_t caplen, int policy);
+extern void pfq_group_ring_destroy(struct pfq_group_ring *ring);
+
+extern int  pfq_group_ring_attach(pfq_gid_t gid, struct pfq_sock *so);
+extern int  pfq_group_ring_detach(pfq_gid_t gid, pfq_id_t id);
+
+extern size_t pfq_group_ring_mem(pfq_gid_t gid);
+extern size_t pfq_group_ring_avail(struct pfq_sock *so);
+
+extern int  pfq_group_ring_mmap(struct pfq_sock *so, pfq_gid_t gid, struct vm_area_struct *vma);
+
+
+#endif /* PFQ_GROUP_RING_H */
@@ -34,6 +34,7 @@
 #include <pfq/bitops.h>
 #include <pfq/devmap.h>
 #include <pfq/global.h>
+#include <pfq/group_ring.h>
 #include <pfq/io.h>
 #include <pfq/memory.h>
 #include <pfq/netdev.h>
@@ -45,6 +46,7 @@
 #include <pfq/skbuff.h>
 #include <pfq/thread.h>
 #include <pfq/vlan.h>
+#include <pfq/zcopy.h>
 
 
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(3,13,0))
@@ -82,31 +84,26 @@ pfq_netdev_pick_tx(struct net_device *dev, struct sk_buff *skb, int *queue)
 }
 
 
-#if 0
-
 /*
- * wait function for active timestamping
+ * Tx pacing (active timestamping)
  *
+ * the Tx kthreads sleep until the tx_pace_spin window of the earliest timestamp
+ * (see pfq_tx_thread), then busy-wait here. Packets due within tx_pace_window
+ * are transmitted in a batch.
  */
 
-
-static inline
-bool giveup_tx_process(atomic_t const *stop)
-{
-	return atomic_read(stop) == -1 || signal_pending(current) || is_kthread_should_stop();
-}
-
 static inline
-ktime_t wait_until_busy(uint64_t ts, atomic_t const *stop, bool *intr)
+ktime_t wait_until_busy(uint64_t ts, bool *intr)
 {
 	ktime_t now;
 	do
 	{
 		now = ktime_get_real();
-		if (giveup_tx_process(stop)) {
-			*intr= true;
+		if (is_kthread_should_stop()) {
+			*intr = true;
 			return now;
 		}
+		cpu_relax();
 	}
 	while (ktime_to_ns(now) < ts);
 	return now;
@@ -114,53 +111,27 @@ ktime_t wait_until_busy(uint64_t ts, atomic_t const *stop, bool *intr)
 
 
 static inline
-ktime_t wait_until_relaxed(uint64_t ts, atomic_t const *stop, bool *intr)
+bool tx_slot_due(struct pfq_pkthdr const *hdr, ktime_t now, size_t deficit)
 {
-	ktime_t now;
-	do
-	{
-		now = ktime_get_real();
-		if (giveup_tx_process(stop)) {
-			*intr= true;
-			return now;
-		}
-	}
-	while (ktime_to_ns(now) < ts
-	       && (pfq_relax(), true));
-
-	return now;
+	return hdr->caplen <= deficit &&
+		(!hdr->tstamp.tv64 || hdr->tstamp.tv64 <= ktime_to_ns(now) + global->tx_pace_window);
 }
 
 
-static
-ktime_t wait_until(uint64_t tv64, ktime_t now, struct pfq_dev_queue *dev_queue, atomic_t const *stop, bool *intr)
+static inline
+void tx_pacing_account(struct pfq_sock *so, uint64_t ts, ktime_t now)
 {
-	ktime_t now_;
-
-	if (tv64 > ktime_to_ns(now)) {
-
-		if ((tv64 - ktime_to_ns(now)) < 100000) { /* < 100us, just like pktgen */
-
-			now_ = wait_until_busy(tv64, stop, intr);
-		}
-		else {
-			pfq_hard_tx_unlock(dev_queue);
-			local_bh_enable();
-
-			now_ = wait_until_relaxed(tv64, stop, intr);
+	uint64_t lag = ktime_to_ns(now) > ts ? ktime_to_ns(now) - ts : 0;
+	uint64_t usec = div_u64(lag, 1000);
+	int bucket = usec ? min_t(int, ilog2(usec) + 1, Q_TX_PACING_BUCKETS - 1) : 0;
 
-			local_bh_disable();
-			pfq_hard_tx_lock(dev_queue);
-		}
-	}
-	else {
-		if (!global->tx_rate_control_eager)
-			return now;
-	}
+	sparse_inc(so->pacing, paced);
+	sparse_add(so->pacing, lag, (long)lag);
+	sparse_inc(so->pacing, hist[bucket]);
 
-	return now_;
+	if (lag > global->tx_pace_window)
+		sparse_inc(so->pacing, late);
 }
-#endif
 
 
 static inline
@@ -271,6 +242,113 @@ pfq_xmit(struct qbuff *buff, struct net_device *dev, int queue, int more)
 }
 
 
+/*
+ * zero-copy Tx: the skb references the slot of the shared queue. The slot is
+ * released by the ubuf_info callback, when the data of the skb is freed or
+ * copied (skb_orphan_frags), not by the skb destructor that skb_orphan runs
+ * while the device may still be reading the slot. Skbs orphaned by
+ * pfq_sock_disable (older generation) no longer touch the shared queue.
+ */
+
+struct pfq_tx_zc_ubuf
+{
+	struct ubuf_info	ubuf;
+	unsigned int		gen;
+};
+
+
+static void
+pfq_tx_zc_callback(struct ubuf_info *uarg, bool zerocopy_success)
+{
+	struct pfq_tx_zc_ubuf *zc = container_of(uarg, struct pfq_tx_zc_ubuf, ubuf);
+	struct pfq_sock *so = (struct pfq_sock *)uarg->ctx;
+
+	rcu_read_lock();
+	if (likely(zc->gen == READ_ONCE(so->tx_zc_gen)))
+		__atomic_sub_fetch((unsigned int *)uarg->desc, 1, __ATOMIC_RELEASE);
+	rcu_read_unlock();
+
+	atomic_dec(&so->tx_zc_pending);
+	sock_put(&so->sk);
+	kfree(zc);
+}
+
+
+static struct sk_buff *
+pfq_tx_zc_skb(const void *buf, size_t len, struct net_device *dev, struct pfq_xmit_context *ctx)
+{
+	const char *data = (const char *)buf + Q_TX_ZC_HEADER_LEN;
+	size_t rem = len - Q_TX_ZC_HEADER_LEN;
+	struct pfq_tx_zc_ubuf *zc;
+	struct sk_buff *skb;
+	int nr_frags = 0;
+
+	/* the device must handle fragments, the copy path is taken otherwise */
+
+	if (!(dev->features & NETIF_F_SG))
+		return NULL;
+
+	if (unlikely(DIV_ROUND_UP(offset_in_page(data) + rem, PAGE_SIZE) > MAX_SKB_FRAGS))
+		return NULL;
+
+	zc = kmalloc(sizeof(struct pfq_tx_zc_ubuf), GFP_ATOMIC);
+	if (unlikely(zc == NULL))
+		return NULL;
+
+	skb = alloc_skb(Q_TX_ZC_HEADER_LEN + LL_RESERVED_SPACE(dev), GFP_ATOMIC);
+	if (unlikely(skb == NULL)) {
+		kfree(zc);
+		return NULL;
+	}
+
+	/* the headers are copied in the linear part... */
+
+	skb_reserve(skb, LL_RESERVED_SPACE(dev));
+	memcpy(__skb_put(skb, Q_TX_ZC_HEADER_LEN), buf, Q_TX_ZC_HEADER_LEN);
+
+	/* ...the rest of the slot is attached as page fragments */
+
+	while (rem)
+	{
+		struct page *page = pfq_shmem_page(data);
+		size_t off = offset_in_page(data);
+		size_t n = min_t(size_t, rem, PAGE_SIZE - off);
+
+		if (PageHighMem(page) && !(dev->features & NETIF_F_HIGHDMA)) {
+			kfree_skb(skb);
+			kfree(zc);
+			return NULL;
+		}
+
+		get_page(page);
+		skb_fill_page_desc(skb, nr_frags++, page, off, n);
+
+		skb->data_len += n;
+		skb->len      += n;
+		skb->truesize += n;
+
+		data += n;
+		rem  -= n;
+	}
+
+	/* the slot is released by the callback, upon the Tx completion */
+
+	sock_hold(&ctx->so->sk);
+
+	zc->ubuf.callback = pfq_tx_zc_callback;
+	zc->ubuf.ctx = ctx->so;
+	zc->ubuf.desc = (unsigned long)ctx->zc_pending;
+	zc->gen = READ_ONCE(ctx->so->tx_zc_gen);
+
+	skb_shinfo(skb)->destructor_arg = &zc->ubuf;
+	skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+
+	atomic_inc(&ctx->so->tx_zc_pending);
+	__atomic_fetch_add(ctx->zc_pending, 1, __ATOMIC_RELAXED);
+	return skb;
+}
+
+
 /*
  * transmit a buff with copies
  */
@@ -281,40 +359,52 @@ __pfq_slot_xmit(const void *buf,
 		struct pfq_dev_queue *dev_queue,
 		struct pfq_xmit_context *ctx)
 {
-	struct sk_buff *skb;
+	struct sk_buff *skb = NULL;
         tx_response_t rc = { 0 };
+	bool zcopy = false;
 
 	if (unlikely(!dev_queue->dev))
 		return (tx_response_t){.ok = 0, .fail = ctx->copies};
 
-	/* allocate a new socket buffer */
+	/* zero-copy Tx, for packets larger than the headers */
 
-	skb = pfq_alloc_skb_pool( len + LL_RESERVED_SPACE(dev_queue->dev)
-				, GFP_KERNEL
-				, ctx->node
-				, 1
-				, ctx->tx);
-
-	if (unlikely(skb == NULL)) {
-		if (printk_ratelimit())
-			printk(KERN_INFO "[PFQ] Tx could not allocate an skb!\n");
-		return (tx_response_t){.ok = 0, .fail = ctx->copies};
+	if (ctx->zc_pending && len > Q_TX_ZC_HEADER_LEN) {
+		skb = pfq_tx_zc_skb(buf, len, dev_queue->dev, ctx);
+		zcopy = skb != NULL;
 	}
 
-	/* fill the socket buffer */
+	if (skb == NULL) {
 
-	skb_reserve(skb, LL_RESERVED_SPACE(dev_queue->dev));
-	skb_reset_tail_pointer(skb);
+		/* allocate a new socket buffer */
 
-	skb->dev = dev_queue->dev;
-	skb->len = 0;
+		skb = pfq_alloc_skb_pool( len + LL_RESERVED_SPACE(dev_queue->dev)
+					, GFP_KERNEL
+					, ctx->node
+					, 1
+					, ctx->tx);
+
+		if (unlikely(skb == NULL)) {
+			if (printk_ratelimit())
+				printk(KERN_INFO "[PFQ] Tx could not allocate an skb!\n");
+			return (tx_response_t){.ok = 0, .fail = ctx->copies};
+		}
+
+		/* fill the socket buffer */
+
+		skb_reserve(skb, LL_RESERVED_SPACE(dev_queue->dev));
+		skb_reset_tail_pointer(skb);
+
+		skb->len = 0;
 
-	__skb_put(skb, len);
+		__skb_put(skb, len);
+		skb_store_bits(skb, 0, buf, len);
+	}
+
+	skb->dev = dev_queue->dev;
 
 	/* set the Tx queue */
 
 	skb_set_queue_mapping(skb, dev_queue->mapping);
-	skb_store_bits(skb, 0, buf, len);
 
 	/* transmit the packet + copies */
 
@@ -333,9 +423,12 @@ __pfq_slot_xmit(const void *buf,
 	}
 	while (ctx->copies > 0);
 
-	/* release the packet */
+	/* release the packet (zero-copy skbs are not recycled) */
 
-	pfq_free_skb_pool(skb, ctx->tx);
+	if (zcopy)
+		consume_skb(skb);
+	else
+		pfq_free_skb_pool(skb, ctx->tx);
 
 	if (rc.ok)
 	     dev_queue->queue->trans_start = ctx->jiffies;
@@ -345,90 +438,121 @@ __pfq_slot_xmit(const void *buf,
 
 
 /*
- * transmit packets from a socket queue..
+ * arm (or disarm) the doorbell of a socket queue, before a Tx kthread goes to sleep.
+ * Return true if packets are pending in the queue.
  */
 
-tx_response_t
-pfq_sk_queue_xmit( struct pfq_sock *so
-		 , int sock_queue
-		 , int cpu)
+bool
+pfq_sk_queue_doorbell(struct pfq_sock *so, int sock_queue, bool arm)
 {
-	struct pfq_queue_info const * txinfo = pfq_sock_get_tx_queue_info(so, sock_queue);
-	struct pfq_dev_queue dev_queue = {.dev = NULL, .queue = NULL, .mapping = 0};
-	struct pfq_xmit_context ctx;
-	struct pfq_percpu_pool *pool;
-	int batch_cntr = 0, cons_idx;
-	struct pfq_shared_tx_queue *tx_queue;
-	struct pfq_pkthdr *hdr;
-	ptrdiff_t prod_off;
-        char *begin, *end;
-        void *tx_queue_mem;
-        tx_response_t rc = {0};
-
-	/* get the Tx queue descriptor */
+	struct pfq_shared_tx_queue *tx_queue = pfq_sock_tx_shared_queue(so, sock_queue);
+	unsigned int prod_idx, cons_idx;
 
-	tx_queue = pfq_sock_tx_shared_queue(so, sock_queue);
 	if (unlikely(tx_queue == NULL))
-		return rc; /* socket not enabled... */
+		return false;
 
-	tx_queue_mem = pfq_sock_tx_queue_mem(so,sock_queue);
-	BUG_ON(tx_queue_mem == NULL);
+	if (!arm) {
+		__atomic_store_n(&tx_queue->cons.wait, 0, __ATOMIC_RELAXED);
+		return false;
+	}
 
+	/* pairs with the producer that publishes a packet and then reads the flag */
 
-	/* enable skb_pool for Tx threads */
+	__atomic_store_n(&tx_queue->cons.wait, 1, __ATOMIC_SEQ_CST);
+	smp_mb();
 
-	pool = this_cpu_ptr(global->percpu_pool);
-	ctx.tx = &pool->tx;
+	prod_idx = __atomic_load_n(&tx_queue->prod.index, __ATOMIC_ACQUIRE);
+	cons_idx = __atomic_load_n(&tx_queue->cons.index, __ATOMIC_RELAXED);
 
-	/* lock the Tx pool */
+	return prod_idx != cons_idx || acquire_sk_tx_prod_off_by(cons_idx, tx_queue) != tx_queue->cons.off;
+}
 
-	spin_lock(&pool->tx_lock);
-	local_bh_disable();
 
-	if (cpu == Q_NO_KTHREAD) {
-		cpu = smp_processor_id();
-	}
+/*
+ * boundaries of a socket queue to transmit
+ */
 
-	/* initialize the boundaries of this queue */
+struct pfq_tx_cursor
+{
+	struct pfq_shared_tx_queue *tx_queue;
+	char			   *base;
+	char			   *end;
+	ptrdiff_t		    prod_off;
+	unsigned int		   *zc_pending;
+};
 
-	prod_off = maybe_swap_sk_tx_queue(tx_queue, &cons_idx);
-	begin    = tx_queue_mem + (cons_idx & 1) * tx_queue->size + tx_queue->cons.off;
-	end      = tx_queue_mem + (cons_idx & 1) * tx_queue->size + prod_off;
 
-        /* setup the context */
+static bool
+pfq_sk_queue_cursor(struct pfq_tx_member *m, struct pfq_tx_cursor *cur, ktime_t now)
+{
+	struct pfq_pkthdr const *hdr;
+	unsigned int cons_idx;
+        void *tx_queue_mem;
 
-        ctx.net	    = sock_net(&so->sk);
-	ctx.now	    = ktime_get_real();
-	ctx.jiffies = jiffies;
-        ctx.node    = cpu == -1 ? NUMA_NO_NODE : cpu_to_node(cpu);
+	cur->tx_queue = pfq_sock_tx_shared_queue(m->so, m->sock_queue);
+	if (unlikely(cur->tx_queue == NULL))
+		return false; /* socket not enabled... */
 
-	/* lock the dev_queue */
+	tx_queue_mem = pfq_sock_tx_queue_mem(m->so, m->sock_queue);
+	BUG_ON(tx_queue_mem == NULL);
 
-	if (pfq_dev_queue_get(ctx.net, txinfo->ifindex, txinfo->queue, &dev_queue) < 0) {
-		local_bh_enable();
-		spin_unlock(&pool->tx_lock);
+	/* initialize the boundaries of this queue */
 
-		if (printk_ratelimit())
-			printk(KERN_INFO "[PFQ] sk_queue_xmit: could not lock the dev_queue!\n");
-		return rc;
+	cur->prod_off = maybe_swap_sk_tx_queue(cur->tx_queue, &cons_idx);
+	cur->base     = tx_queue_mem + (cons_idx & 1) * cur->tx_queue->size;
+	cur->end      = cur->base + cur->prod_off;
+
+	cur->zc_pending = (m->so->tx_flags & Q_ENABLE_TX_ZEROCOPY) ? &cur->tx_queue->done.pending[cons_idx & 1] : NULL;
+
+	if (m->sched) {
+		m->sched->next_ts = 0;
+		m->sched->backlog = false;
 	}
 
+	/* is the first packet ready to be transmitted? */
+
+	hdr = (struct pfq_pkthdr const *)(cur->base + cur->tx_queue->cons.off);
+
+	return (char *)hdr < cur->end && hdr->caplen &&
+		(!m->sched || tx_slot_due(hdr, now, m->sched->deficit));
+}
+
+
+/*
+ * transmit the packets of a socket queue, with the device queue locked.
+ * more: a socket queue that follows in the burst has packets ready (xmit_more).
+ */
+
+static tx_response_t
+__pfq_sk_queue_xmit( struct pfq_tx_member *m
+		   , struct pfq_tx_cursor *cur
+		   , struct pfq_dev_queue *dev_queue
+		   , struct pfq_xmit_context *ctx
+		   , int *batch_cntr
+		   , bool more)
+{
+	struct pfq_tx_sched *sched = m->sched;
+	struct pfq_sock *so = m->so;
+	struct pfq_pkthdr *hdr;
+        tx_response_t rc = {0};
+	bool intr = false;
+
+	ctx->so = so;
+	ctx->zc_pending = cur->zc_pending;
+
 	/* prefetch packets... */
 
-	hdr  = (struct pfq_pkthdr *)begin;
+	hdr  = (struct pfq_pkthdr *)(cur->base + cur->tx_queue->cons.off);
         prefetch_r3(hdr);
         prefetch_r3((char *)hdr+64);
 
-	/* disable bottom half and lock the queue */
-
-	HARD_TX_LOCK(dev_queue.dev, dev_queue.queue, cpu);
-
-	for_each_sk_slot(hdr, end, so->tx_slot_size)
+	for_each_sk_slot(hdr, cur->end, pfq_sk_tx_slot_size(so, hdr))
 	{
 		struct pfq_pkthdr *next;
                 tx_response_t tmp = {0};
+		size_t len;
 
-		next = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, so->tx_slot_size);
+		next = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, pfq_sk_tx_slot_size(so, hdr));
 		prefetch_r3(next);
 		prefetch_r3((char *)next+64);
 
@@ -446,45 +570,80 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 			break;
 		}
 
+		len = min_t( size_t
+			   , hdr->caplen
+			   , so->tx_slot_size - sizeof(struct pfq_pkthdr) - LL_RESERVED_SPACE(dev_queue->dev));
+
 		/* get the number of copies to transmit */
 
-                ctx.copies = dev_tx_max_skb_copies(dev_queue.dev, hdr->info.data.copies);
-		batch_cntr += ctx.copies;
+                ctx->copies = dev_tx_max_skb_copies(dev_queue->dev, hdr->info.data.copies);
 
-                /* set the xmit_more bit */
+		/* Tx kthreads: deficit round-robin, the packet is left in the queue when it exceeds the budget */
 
-		ctx.xmit_more = batch_cntr < global->xmit_batch_len ?
-				PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, so->tx_slot_size) < (struct pfq_pkthdr *)end : (batch_cntr = 0, false);
+		if (sched && len * ctx->copies > sched->deficit) {
+			sched->backlog = true;
+			break;
+		}
 
-		/* transmit this packet */
+		/* paced Tx (Tx kthreads): wait for the timestamp of the packet */
+
+		if (sched && hdr->tstamp.tv64) {
+
+			const uint64_t ts = hdr->tstamp.tv64;
+
+			ctx->now = ktime_get_real();
+
+			if (ts > ktime_to_ns(ctx->now) + global->tx_pace_spin) {
+				sched->next_ts = ts; /* not due yet: left to the next round */
+				break;
+			}
+
+			if (ts > ktime_to_ns(ctx->now) + global->tx_pace_window) {
+				ctx->now = wait_until_busy(ts, &intr);
+				if (unlikely(intr))
+					break;
+			}
+
+			tx_pacing_account(so, ts, ctx->now);
+		}
+
+		*batch_cntr += ctx->copies;
+
+		if (sched)
+			sched->deficit -= len * ctx->copies;
+
+                /* set the xmit_more bit (the next packet, of this queue or of the next one in the burst,
+                 * must be due within the pacing window and the budget) */
 
-		if (likely(netif_running(dev_queue.dev) && netif_carrier_ok(dev_queue.dev))) {
+		ctx->xmit_more = *batch_cntr < global->xmit_batch_len ?
+				more || (next < (struct pfq_pkthdr *)cur->end && (!sched || tx_slot_due(next, ctx->now, sched->deficit))) :
+				(*batch_cntr = 0, false);
 
-			size_t len = min_t( size_t
-					  , hdr->caplen
-					  , so->tx_slot_size - sizeof(struct pfq_pkthdr) - LL_RESERVED_SPACE(dev_queue.dev));
+		/* transmit this packet */
+
+		if (likely(netif_running(dev_queue->dev) && netif_carrier_ok(dev_queue->dev))) {
 
-			tmp = __pfq_slot_xmit(hdr+1, len, &dev_queue, &ctx);
+			tmp = __pfq_slot_xmit(hdr+1, len, dev_queue, ctx);
 
 			rc.value += tmp.value;
 		}
 	}
 
-	/* unlock the current queue, enable bottom half */
-
-	HARD_TX_UNLOCK(dev_queue.dev, dev_queue.queue);
-	local_bh_enable();
+	if (unlikely(intr))
+		*ctx->intr = true;
 
-	pfq_dev_queue_put(&dev_queue);
-	spin_unlock(&pool->tx_lock);
+	/* update the local consumer offset (packets not due yet or beyond the budget are left in the queue) */
 
-	/* update the local consumer offset */
+	if (sched && (sched->next_ts || sched->backlog || intr)) {
+		cur->tx_queue->cons.off = (char *)hdr - cur->base;
+		return rc;
+	}
 
-	tx_queue->cons.off = prod_off;
+	cur->tx_queue->cons.off = cur->prod_off;
 
 	/* count the packets left in the shared queue */
 
-	for_each_sk_slot(hdr, end, so->tx_slot_size) {
+	for_each_sk_slot(hdr, cur->end, pfq_sk_tx_slot_size(so, hdr)) {
 		/* dynamic slot size: ensure the caplen is not zero! */
 		if (unlikely(!hdr->caplen))
 			break;
@@ -495,16 +654,123 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 }
 
 
+/*
+ * transmit packets from socket queues bound to the same device queue: the
+ * device queue is locked once, and xmit_more is chained across the queues.
+ */
+
+void
+pfq_sk_queues_xmit(struct pfq_tx_member *members, int num, int cpu)
+{
+	struct pfq_queue_info const * txinfo = pfq_sock_get_tx_queue_info(members[0].so, members[0].sock_queue);
+	struct pfq_dev_queue dev_queue = {.dev = NULL, .queue = NULL, .mapping = 0};
+	struct pfq_tx_cursor cur[Q_TX_AGGR_MAX];
+	struct pfq_xmit_context ctx;
+	struct pfq_percpu_pool *pool;
+	int batch_cntr = 0, n, last = -1, enabled = 0;
+	bool intr = false;
+
+	BUG_ON(num < 1 || num > Q_TX_AGGR_MAX);
+
+	/* enable skb_pool for Tx threads */
+
+	pool = this_cpu_ptr(global->percpu_pool);
+	ctx.tx = &pool->tx;
+
+	/* lock the Tx pool */
+
+	spin_lock(&pool->tx_lock);
+	local_bh_disable();
+
+	if (cpu == Q_NO_KTHREAD) {
+		cpu = smp_processor_id();
+	}
+
+        /* setup the context */
+
+        ctx.net	    = sock_net(&members[0].so->sk);
+	ctx.now	    = ktime_get_real();
+	ctx.jiffies = jiffies;
+        ctx.node    = cpu == -1 ? NUMA_NO_NODE : cpu_to_node(cpu);
+	ctx.intr    = &intr;
+
+	/* get the queue boundaries of the members: the last ready one ends the xmit_more chain */
+
+	for(n = 0; n < num; n++)
+	{
+		members[n].rc.value = 0;
+		if (pfq_sk_queue_cursor(&members[n], &cur[n], ctx.now))
+			last = n;
+		if (cur[n].tx_queue)
+			enabled++;
+	}
+
+	if (unlikely(!enabled)) {
+		local_bh_enable();
+		spin_unlock(&pool->tx_lock);
+		return; /* sockets not enabled... */
+	}
+
+	/* lock the dev_queue */
+
+	if (pfq_dev_queue_get(ctx.net, txinfo->ifindex, txinfo->queue, &dev_queue) < 0) {
+		local_bh_enable();
+		spin_unlock(&pool->tx_lock);
+
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ] sk_queue_xmit: could not lock the dev_queue!\n");
+		return;
+	}
+
+	/* disable bottom half and lock the queue */
+
+	HARD_TX_LOCK(dev_queue.dev, dev_queue.queue, cpu);
+
+	for(n = 0; n < num && !intr; n++)
+	{
+		if (cur[n].tx_queue == NULL)
+			continue;
+
+		members[n].rc = __pfq_sk_queue_xmit(&members[n], &cur[n], &dev_queue, &ctx, &batch_cntr, n < last);
+	}
+
+	/* unlock the current queue, enable bottom half */
+
+	HARD_TX_UNLOCK(dev_queue.dev, dev_queue.queue);
+	local_bh_enable();
+
+	pfq_dev_queue_put(&dev_queue);
+	spin_unlock(&pool->tx_lock);
+}
+
+
+/*
+ * transmit packets from a socket queue..
+ */
+
+tx_response_t
+pfq_sk_queue_xmit( struct pfq_sock *so
+		 , int sock_queue
+		 , int cpu
+		 , struct pfq_tx_sched *sched)
+{
+	struct pfq_tx_member m = { .so = so, .sock_queue = sock_queue, .sched = sched };
+
+	pfq_sk_queues_xmit(&m, 1, cpu);
+	return m.rc;
+}
+
+
 /*
  * transmit queue of qbuff...
  */
 
 tx_response_t
-pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buffs, unsigned __int128 mask, struct net_device *dev, int queue)
+pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buffs, unsigned long const *mask, struct net_device *dev, int queue)
 {
 	struct netdev_queue *txq;
 	struct qbuff *buff;
-	int n, last_idx;
+	size_t n;
 	tx_response_t rc = {0};
 
 	/* get txq and fix the queue for this batch.
@@ -512,8 +778,6 @@ pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buffs, unsigned __int128 mask, stru
 	 * note: in case the queue is set to any-queue (-1), the driver along the first skb
 	 * select the queue */
 
-	last_idx = buffs->len - 1;
-
 	txq = pfq_netdev_pick_tx(dev, QBUFF_SKB(&buffs->queue[0]), &queue);
 
 	local_bh_disable();
@@ -526,7 +790,7 @@ pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buffs, unsigned __int128 mask, stru
 
 		if (likely(!netif_xmit_frozen_or_drv_stopped(txq))) {
 
-			if (__pfq_xmit(QBUFF_SKB(buff), dev, !( n == last_idx || ((mask & (mask-1)) == 0)), global->tx_retry) == NETDEV_TX_OK)
+			if (__pfq_xmit(QBUFF_SKB(buff), dev, find_next_bit(mask, buffs->len, n + 1) < buffs->len, global->tx_retry) == NETDEV_TX_OK)
 				++rc.ok;
 			else
 				++rc.fail;
@@ -568,10 +832,14 @@ pfq_qbuff_lazy_xmit(struct qbuff * buff, struct net_device *dev, int queue)
 		return 0;
 	}
 
-	skb_set_queue_mapping(QBUFF_SKB(buff), queue);
-
-	buff->fwd_dev[buff->fwd_dev_num++] = dev;
-	return 1;
+	if (!qbuff_fwd_dev_add(buff, dev)) {
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ] bridge %s: annotation table full!\n", dev->name);
+		return 0;
+	}
+
+	skb_set_queue_mapping(QBUFF_SKB(buff), queue);
+	return 1;
 }
 
 
@@ -603,7 +871,7 @@ pfq_qbuff_lazy_xmit_run(struct pfq_qbuff_queue *buffs, struct pfq_endpoint_info
 			struct qbuff * buff = &buffs->queue[i];
 			struct sk_buff *skb = QBUFF_SKB(buff);
 
-			num = pfq_count_fwd_devs(dev, buff->fwd_dev, buff->fwd_dev_num);
+			num = pfq_count_fwd_devs(dev, buff);
 			if (num == 0)
 				continue;
 
@@ -702,13 +970,74 @@ unsigned int pfq_fold(unsigned int a, unsigned int b)
 }
 
 
-int
-pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
+/* the socket masks of a group are expressed in member slots: groups whose members
+ * all sit in the slot equal to their id (the common case) take the fast path */
+
+static inline void
+pfq_fwd_group_slots(struct pfq_group const *group, struct qbuff *buff, unsigned long slots)
+{
+	unsigned long bit;
+
+	if (likely(READ_ONCE(group->direct))) {
+		buff->fwd_mask |= slots;
+		return;
+	}
+
+	pfq_bitwise_foreach(slots, bit,
+	{
+		int id = READ_ONCE(group->member[pfq_ctz(bit)]);
+		if (likely(id >= 0))
+			qbuff_fwd_sock(buff, id);
+	});
+}
+
+
+/*
+ * Adaptive flush: the batch length follows the arrival rate, so that a batch
+ * fills within the latency bound (at high rates up to capt_batch_len), and a
+ * pinned hrtimer armed on the first packet of the batch enforces the bound when
+ * the traffic stops. Drivers that complete the NAPI poll flush the batch too
+ * (see pfq_napi_complete_done).
+ */
+
+static inline void
+pfq_rx_gap_update(struct pfq_percpu_data *data, ktime_t now, s64 latency)
+{
+	s64 gap = ktime_to_ns(ktime_sub(now, data->last_rx));
+
+	if (gap < 0)
+		gap = 0;
+	if (latency && gap > latency)
+		gap = latency;
+
+	data->rx_gap = data->rx_gap - (data->rx_gap >> 3) + ((u64)gap >> 3);
+	data->last_rx = now;
+}
+
+
+static inline void
+pfq_rx_batch_update(struct pfq_percpu_data *data, s64 latency)
+{
+	size_t len = (size_t)global->capt_batch_len;
+
+	if (latency && data->rx_gap) {
+		u64 n = div64_u64((u64)latency, data->rx_gap);
+		if (n < len)
+			len = n ? (size_t)n : 1;
+	}
+
+	data->batch_len = len;
+}
+
+
+static int
+__pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int reason)
 {
 	struct pfq_percpu_data * data;
 	struct pfq_percpu_pool * pool;
 	unsigned long bit;
-	int cpu;
+	s64 latency;
+	int cpu, w;
 
 	/* if no socket is open drop the packet */
 
@@ -726,7 +1055,9 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 	data = per_cpu_ptr(global->percpu_data, cpu);
 
-	if (likely(skb)) /* ensure this is not the timer heartbeat */
+	latency = (s64)READ_ONCE(global->rx_latency) * NSEC_PER_USEC;
+
+	if (likely(skb)) /* ensure this is not a flush (timers or end of NAPI poll) */
 	{
 		struct pfq_lang_monad monad;
 		unsigned long group_mask;
@@ -759,127 +1090,155 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 		qbuff_init( buff
 			  , skb
 			  , &monad
-			  , data->counter++);
+			  , data->fwd_table
+			  , data->counter++
+			  , data->qbuff_queue->len);
 
-		/* get the eligible groups */
+		/* process all the eligible groups for this qbuff (one word of the devmap at a time) */
 
-		group_mask = pfq_devmap_get_groups( qbuff_get_ifindex(buff)
-						  , qbuff_get_rx_queue(buff));
+		for(w = 0; w < global->devmap_words; w++)
+		{
+			group_mask = pfq_devmap_get_groups( qbuff_get_ifindex(buff)
+							  , qbuff_get_rx_queue(buff)
+							  , w);
 
+			pfq_bitwise_foreach(group_mask, bit,
+			{
+				pfq_gid_t gid = (__force pfq_gid_t)(w * BITS_PER_LONG + pfq_ctz(bit));
+				struct pfq_group * this_group = pfq_group_get(gid);
+				struct pfq_lang_computation_tree *prg;
+				unsigned long slots = 0;
 
-		/* process all groups for this qbuff */
+				if (unlikely(!this_group))
+					continue;
 
-		pfq_bitwise_foreach(group_mask, bit,
-		{
-			pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
-			struct pfq_group * this_group = pfq_group_get(gid);
-			struct pfq_lang_computation_tree *prg;
+				/* increment counter for this group */
 
-			if (unlikely(!this_group))
-				continue;
+				__sparse_inc(this_group->stats, recv, cpu);
 
-			/* increment counter for this group */
+				/* check if bp filter is enabled */
 
-			__sparse_inc(this_group->stats, recv, cpu);
+				if (atomic_long_read(&this_group->bp_filter)) {
+					if (!qbuff_run_bp_filter(buff, this_group)) {
+						__sparse_inc(this_group->stats, drop, cpu);
+						continue;
+					}
+				}
 
-			/* check if bp filter is enabled */
+				/* check vlan filter */
 
-			if (atomic_long_read(&this_group->bp_filter)) {
-				if (!qbuff_run_bp_filter(buff, this_group)) {
-					__sparse_inc(this_group->stats, drop, cpu);
-					continue;
+				if (pfq_group_vlan_filters_enabled(gid)) {
+					if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
+						__sparse_inc(this_group->stats, drop, cpu);
+						continue;
+					}
 				}
-			}
 
-			/* check vlan filter */
+				/* process pfq-lang */
 
-			if (pfq_group_vlan_filters_enabled(gid)) {
-				if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
-					__sparse_inc(this_group->stats, drop, cpu);
-					continue;
-				}
-			}
+				prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
+				if (prg) {
+					unsigned long cbit, elig_mask = 0;
+					size_t to_kernel = buff->to_kernel;
+					size_t num_fwd = buff->fwd_dev_num;
+
+				 	/* setup monad for this computation */
+
+				 	monad.fanout.class_mask = Q_CLASS_DEFAULT;
+				 	monad.fanout.type = fanout_copy;
+				 	monad.group = this_group;
+				 	monad.state = 0;
+				 	monad.shift = 0;
+				 	monad.ipoff = 0;
+				 	monad.ipproto = IPPROTO_NONE;
+				 	monad.parse.flags = 0;
+				 	monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
 
-			/* process pfq-lang */
+				 	/* run the functional program */
 
-			prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
-			if (prg) {
-				unsigned long cbit, elig_mask = 0;
-				size_t to_kernel = buff->to_kernel;
-				size_t num_fwd = buff->fwd_dev_num;
+				 	if (!pfq_lang_run(buff, prg).qbuff) {
+				 		__sparse_inc(this_group->stats, drop, cpu);
+				 		continue;
+				 	}
 
-			 	/* setup monad for this computation */
+				 	/* update stats */
 
-			 	monad.fanout.class_mask = Q_CLASS_DEFAULT;
-			 	monad.fanout.type = fanout_copy;
-			 	monad.group = this_group;
-			 	monad.state = 0;
-			 	monad.shift = 0;
-			 	monad.ipoff = 0;
-			 	monad.ipproto = IPPROTO_NONE;
-			 	monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
+	                                 __sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
+	                                 __sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
 
-			 	/* run the functional program */
+				 	/* skip this packet? */
 
-			 	if (!pfq_lang_run(buff, prg).qbuff) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+				 	if (is_drop(monad.fanout)) {
+				 		__sparse_inc(this_group->stats, drop, cpu);
+				 		continue;
+				 	}
 
-			 	/* update stats */
+				 	/* compute the eligible mask of sockets enabled to receive this packet... */
 
-                                 __sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
-                                 __sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
+				 	pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
+				 	{
+				 		int class = (int)pfq_ctz(cbit);
+				 		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
+				 	});
 
-			 	/* skip this packet? */
 
-			 	if (is_drop(monad.fanout)) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+				 	if (is_steering(monad.fanout)) { /* single or double */
 
-			 	/* compute the eligible mask of sockets enabled to receive this packet... */
+						struct pfq_steering_table *table = NULL;
 
-			 	pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
-			 	{
-			 		int class = (int)pfq_ctz(cbit);
-			 		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
-			 	});
+						/* single class: use the precomputed steering table... */
 
+						if (likely(monad.fanout.class_mask &&
+							   (monad.fanout.class_mask & (monad.fanout.class_mask - 1)) == 0))
+							table = rcu_dereference(this_group->steering[pfq_ctz(monad.fanout.class_mask)]);
 
-			 	if (is_steering(monad.fanout)) { /* single or double */
+						if (likely(table)) {
 
-			 		unsigned long steer_mask[Q_MAX_STEERING_MASK];
-			 		unsigned int sbit, steer_mask_numb = 0;
+							slots |= 1UL << table->entry[pfq_steering_index(monad.fanout.hash)];
 
-					/* compute the load balancing mask list */
+							if (is_double_steering(monad.fanout))
+								slots |= 1UL << table->entry[pfq_steering_index(monad.fanout.hash2)];
+						}
 
-			 		pfq_bitwise_foreach(elig_mask, sbit,
-			 		{
-			 			pfq_id_t id = (__force pfq_id_t)pfq_ctz(sbit);
-			 			struct pfq_sock * so = pfq_sock_get_by_id(id);
+						if (unlikely(!table)) {
 
-						int i, end = so ? so->weight : 1;
-						for(i = 0; i < end; ++i)
-							steer_mask[steer_mask_numb++] = sbit;
-			 		});
+							unsigned long steer_mask[Q_MAX_STEERING_MASK];
+							unsigned int sbit, steer_mask_numb = 0;
 
-					buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad.fanout.hash), (unsigned int)steer_mask_numb)];
+							/* compute the load balancing mask list */
 
-					if (is_double_steering(monad.fanout))
-						buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
+							pfq_bitwise_foreach(elig_mask, sbit,
+							{
+								int id = this_group->member[pfq_ctz(sbit)];
+								struct pfq_sock * so = id < 0 ? NULL : pfq_sock_get_by_id((__force pfq_id_t)id);
 
-			 	}
-			 	else {  /* broadcast */
+								int i, end = so ? so->weight : 1;
+								for(i = 0; i < end; ++i)
+									steer_mask[steer_mask_numb++] = sbit;
+							});
 
-			 		buff->fwd_mask |= elig_mask;
-			 	}
+							slots |= steer_mask[pfq_fold(prefold(monad.fanout.hash), (unsigned int)steer_mask_numb)];
 
-			} else {
-				buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
+							if (is_double_steering(monad.fanout))
+								slots |= steer_mask[pfq_fold(prefold(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
+						}
+				 	}
+				 	else {  /* broadcast: the readers of the group ring get a single copy */
+
+				 		slots |= pfq_group_ring_filter(this_group, gid, buff, elig_mask);
+				 	}
+
+				} else {
+					slots |= pfq_group_ring_filter(this_group, gid, buff,
+								(unsigned long)atomic_long_read(&this_group->sock_id[0]));
+				}
+
+				/* member slots -> sockets */
+
+				pfq_fwd_group_slots(this_group, buff, slots);
 			}
+			);
 		}
-		);
 
 		/* get the current timestamp */
 
@@ -887,7 +1246,7 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 		/* this packet is ready to be enqueued for transmission or possibly dropped */
 
-		if (buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel) {
+		if (buff->fwd_mask || buff->fwd_banks || buff->ring_mask || buff->fwd_dev_num || buff->to_kernel) {
 			/* commit this buff to the queue */
 			data->qbuff_queue->len++;
 		}
@@ -895,14 +1254,28 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 			qbuff_free(buff, &pool->rx);
 		}
 
+		pfq_rx_gap_update(data, current_rx, latency);
+
+		if (data->qbuff_queue->len == 0)
+			return 0;
+
 		/* transmit the queue or wait for the next packet? */
 
-		if (data->qbuff_queue->len < (size_t)global->capt_batch_len &&
-		     ktime_to_ns(ktime_sub(current_rx, data->last_rx)) < 1000000) {
+		if (data->qbuff_queue->len >= data->batch_len)
+			reason = Q_FLUSH_FULL;
+		else if (data->qbuff_queue->len == 1) {
+
+			/* first packet of the batch: arm the latency bound */
+
+			data->first_rx = current_rx;
+			if (latency)
+				hrtimer_start(&data->flush_timer, ns_to_ktime(latency), HRTIMER_MODE_REL_PINNED);
 			return 0;
 		}
-
-		data->last_rx = current_rx;
+		else if (latency && ktime_to_ns(ktime_sub(current_rx, data->first_rx)) >= latency)
+			reason = Q_FLUSH_LATENCY;
+		else
+			return 0;
 	}
 	else {
 		if (data->qbuff_queue->len == 0)
@@ -911,6 +1284,9 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 	/* run IO now */
 
+	data->flush[reason]++;
+	pfq_rx_batch_update(data, latency);
+
 	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
 
 	return pfq_receive_run( data
@@ -920,16 +1296,122 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 
 
+/*
+ * The whole Rx path is an RCU read-side critical section: sockets, computations,
+ * filters and rings are released only after a grace period (see group.c).
+ */
+
+int
+pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
+{
+	int ret;
+#ifdef PFQ_RX_PROFILE
+	cycles_t start = get_cycles();
+#endif
+	rcu_read_lock();
+	ret = __pfq_receive(napi, skb, Q_FLUSH_HEARTBEAT);
+	rcu_read_unlock();
+
+#ifdef PFQ_RX_PROFILE
+	{
+		struct pfq_percpu_data *data = this_cpu_ptr(global->percpu_data);
+		data->rx_cycles += get_cycles() - start;
+		if (skb)
+			data->rx_packets++;
+	}
+#endif
+	return ret;
+}
+
+
+/* flush the per-cpu batch (Q_FLUSH_* reason) */
+
+int
+pfq_receive_flush(int reason)
+{
+	int ret;
+
+	rcu_read_lock();
+	ret = __pfq_receive(NULL, NULL, reason);
+	rcu_read_unlock();
+	return ret;
+}
+
+
+/*
+ * Extract the row `id` of the (transposed) forward matrix of the batch: the bit n
+ * is set if the qbuff n is forwarded to the socket (or the group ring) `id`.
+ * For sockets with id < BITS_PER_LONG the inner loop is branch-free, so that the
+ * compiler can vectorize it.
+ */
+
+static inline void
+pfq_fwd_matrix_row(unsigned long *row, struct pfq_qbuff_queue const *buffs, int id, bool ring)
+{
+	const int bank = id / BITS_PER_LONG, shift = id % BITS_PER_LONG;
+	size_t w, k, len = buffs->len;
+
+	for(w = 0; w * BITS_PER_LONG < len; w++)
+	{
+		struct qbuff const *q = &buffs->queue[w * BITS_PER_LONG];
+		size_t end = min_t(size_t, BITS_PER_LONG, len - w * BITS_PER_LONG);
+		unsigned long word = 0;
+
+		if (likely(bank == 0)) {
+			for(k = 0; k < end; k++)
+			{
+				unsigned long m = ring ? q[k].ring_mask : q[k].fwd_mask;
+				word |= ((m >> shift) & 1UL) << k;
+			}
+		}
+		else {
+			for(k = 0; k < end; k++)
+				word |= ((qbuff_fwd_word(&q[k], bank) >> shift) & 1UL) << k;
+		}
+
+		row[w] = word;
+	}
+}
+
+
+static inline void
+pfq_fwd_to_sockets( struct pfq_qbuff_queue *buffs
+		  , unsigned long *row
+		  , int bank
+		  , unsigned long sock_mask
+		  , int cpu)
+{
+	unsigned long bit;
+
+	pfq_bitwise_foreach(sock_mask, bit,
+	{
+		int id = bank * BITS_PER_LONG + (int)pfq_ctz(bit);
+		struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)id);
+		if (likely(so))
+		{
+			pfq_fwd_matrix_row(row, buffs, id, false);
+			pfq_copy_to_endpoint_qbuffs(so, buffs, row, cpu);
+		}
+	});
+}
+
+
 int pfq_receive_run( struct pfq_percpu_data *data
 		   , struct pfq_percpu_pool *pool
 		   , int cpu)
 {
-	unsigned __int128 socket_mask[Q_MAX_ID] = { 0 };
-	unsigned long long all_fwd_mask = 0;
+	struct pfq_qbuff_queue *buffs = PFQ_QBUFF_QUEUE(data->qbuff_queue);
+	unsigned long row[Q_BUFF_MASK_WORDS];
+	unsigned long all_fwd_mask = 0;
+	unsigned long all_fwd_banks = 0;
+	unsigned long all_ring_mask = 0;
 	struct pfq_endpoint_info endpoints;
         struct qbuff *buff;
-        unsigned int bit;
+        unsigned long bit;
 	size_t n;
+#ifdef PFQ_RX_PROFILE
+	cycles_t start = get_cycles();
+#endif
 
 #if 0
 	for(n = 0; n < data->qbuff_queue->len; n++)
@@ -942,29 +1424,44 @@ int pfq_receive_run( struct pfq_percpu_data *data
 	return 0;
 #endif
 
-	/* transpose the forward matrix */
+	/* collect the endpoints of the batch */
 
-	for(n = 0; n < data->qbuff_queue->len; n++)
+	for(n = 0; n < buffs->len; n++)
 	{
-		buff = &data->qbuff_queue->queue[n];
-		all_fwd_mask |= buff->fwd_mask;
-		pfq_bitwise_foreach(buff->fwd_mask, bit,
-		{
-			socket_mask[pfq_ctz(bit)] |= (unsigned __int128)1 << n;
-		})
+		all_fwd_mask |= buffs->queue[n].fwd_mask;
+		all_fwd_banks |= buffs->queue[n].fwd_banks;
+		all_ring_mask |= buffs->queue[n].ring_mask;
 	}
 
+	/* forward packets to group rings (usually a single one) */
+
+	pfq_bitwise_foreach(all_ring_mask, bit,
+	{
+		int gid = (int)pfq_ctz(bit);
+
+		pfq_fwd_matrix_row(row, buffs, gid, true);
+		pfq_copy_to_group_ring((__force pfq_gid_t)gid, buffs, row, cpu);
+	});
+
         /* forward packets to endpoints */
 
-	pfq_bitwise_foreach(all_fwd_mask, bit,
+	pfq_fwd_to_sockets(buffs, row, 0, all_fwd_mask, cpu);
+
+	/* ...and to the sockets with id >= BITS_PER_LONG */
+
+	if (unlikely(all_fwd_banks))
 	{
-		pfq_id_t id = (__force pfq_id_t)pfq_ctz(bit);
-		struct pfq_sock *so = pfq_sock_get_by_id(id);
-		if (likely(so))
+		pfq_bitwise_foreach(all_fwd_banks, bit,
 		{
-			pfq_copy_to_endpoint_qbuffs(so, PFQ_QBUFF_QUEUE(data->qbuff_queue), socket_mask[(int __force)id], cpu);
-		}
-	});
+			int bank = (int)pfq_ctz(bit);
+			unsigned long sock_mask = 0;
+
+			for(n = 0; n < buffs->len; n++)
+				sock_mask |= qbuff_fwd_word(&buffs->queue[n], bank);
+
+			pfq_fwd_to_sockets(buffs, row, bank, sock_mask, cpu);
+		});
+	}
 
 	/* forward packets to device */
 
@@ -980,6 +1477,9 @@ int pfq_receive_run( struct pfq_percpu_data *data
 
  	for_each_qbuff(PFQ_QBUFF_QUEUE(data->qbuff_queue), buff, n)
  	{
+		if (unlikely(buff->fwd_banks))
+			qbuff_fwd_banks_reset(buff);
+
  		if (fwd_to_kernel(buff)) {
 
  			bool peeked = QBUFF_SKB(buff)->peeked;
@@ -992,13 +1492,18 @@ int pfq_receive_run( struct pfq_percpu_data *data
 
  			__sparse_inc(global->percpu_stats, kern, cpu);
  		}
- 		else {
- 			/* Peeked or not, always free the qbuff here...*/
+ 		else if (likely(QBUFF_SKB(buff))) {
+ 			/* Peeked or not, always free the qbuff here (unless held by a zero-copy socket)...*/
  			qbuff_free(buff, &pool->rx);
  		}
  	}
 
 	data->qbuff_queue->len = 0;
+	data->fwd_table->len = 0;
+
+#ifdef PFQ_RX_PROFILE
+	data->run_cycles += get_cycles() - start;
+#endif
 	return 0;
 }
 
@@ -1019,46 +1524,392 @@ int pfq_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 }
 
 
+static inline void
+pfq_fill_pkthdr(struct pfq_pkthdr *hdr, struct sk_buff *skb, size_t bytes, int tstamp)
+{
+	if (likely(tstamp != 0)) {
+		struct timespec ts;
+		skb_get_timestampns(skb, &ts);
+		hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+		hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+	}
+
+	hdr->caplen = (uint16_t)bytes;
+	hdr->len = (uint16_t)skb->len;
+	hdr->info.data.mark = skb->mark;
+	hdr->info.ifindex = skb->dev->ifindex;
+	hdr->info.vlan.tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
+	hdr->info.queue = skb_rx_queue_recorded(skb) ? (uint16_t)skb_get_rx_queue(skb) : 0;
+}
+
+
+/*
+ * streaming Rx: the queue memory is a single ring of 2 x rx_queue_len slots.
+ * Producers reserve slots by advancing the producer index, as long as they do
+ * not overtake the consumer index, which the user advances as soon as slots are
+ * released. A slot is committed with the lap of its index (PFQ_STREAM_COMMIT),
+ * so that no reset of the ring is ever required.
+ */
+
+static size_t
+pfq_sk_queue_recv_stream(struct pfq_sock *so,
+			 struct pfq_qbuff_queue *buffs,
+			 unsigned long const *mask,
+			 int burst_len)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	const size_t cap = 2 * so->rx_queue_len;
+	unsigned long head, cons;
+	size_t n, len, copied = 0;
+	struct qbuff *buff;
+	char *base;
+
+	if (unlikely(sq == NULL))
+		return 0;
+
+	base = (char *)sq + sizeof(struct pfq_shared_queue);
+
+	/* reserve the slots available for the burst */
+
+	head = __atomic_load_n(&sq->rx_ring.prod.index, __ATOMIC_RELAXED);
+	do {
+		cons = __atomic_load_n(&sq->rx_ring.cons.index, __ATOMIC_ACQUIRE);
+		len = min_t(size_t, burst_len, cap - (head - cons));
+		if (len == 0)
+			goto wakeup;
+	}
+	while (!__atomic_compare_exchange_n(&sq->rx_ring.prod.index, &head, head + len, false,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	for_each_qbuff_with_mask(mask, buffs, buff, n)
+	{
+		struct sk_buff *skb = QBUFF_SKB(buff);
+		const unsigned long index = head + copied;
+		struct pfq_pkthdr *hdr;
+		size_t bytes;
+
+		if (copied == len)
+			break;
+
+		hdr = (struct pfq_pkthdr *)(base + (index % cap) * so->rx_slot_size);
+		bytes = min_t(size_t, skb->len, so->rx_len);
+
+		prefetch_w0(hdr);
+		prefetch_w0((char *)hdr + 64);
+
+		/* a reserved slot must be committed anyway: on failure it is left empty */
+
+		if (unlikely(pfq_copy_bits(skb, 0, hdr+1, bytes) != 0))
+			bytes = 0;
+
+		pfq_fill_pkthdr(hdr, skb, bytes, so->tstamp);
+
+		__atomic_store_n(&hdr->info.commit, PFQ_STREAM_COMMIT(index, cap), __ATOMIC_RELEASE);
+		copied++;
+	}
+
+wakeup:
+#ifdef PFQ_USE_POLL
+	if (waitqueue_active(&so->waitqueue))
+		wake_up_interruptible(&so->waitqueue);
+#endif
+	return copied;
+}
+
+
+/*
+ * group ring: the packets broadcast to the readers of a group are written once.
+ * The slots are reserved and committed as in the streaming Rx ring, and they are
+ * bounded by the slowest reader. With Q_RING_POLICY_DROP the readers that would
+ * hold the ring are overrun instead: their index is moved forward and the packets
+ * they miss are accounted in their lost counter. The commit of an overwritten
+ * slot is cleared before the packet is copied, so that a reader can detect it.
+ */
+
+static unsigned long
+pfq_group_ring_tail(struct pfq_shared_ring *sr, unsigned long readers, unsigned long head)
+{
+	unsigned long bit, lag = 0;
+
+	pfq_bitwise_foreach(readers, bit,
+	{
+		int id = (int)pfq_ctz(bit);
+		unsigned long index = __atomic_load_n(&sr->reader[id].index, __ATOMIC_ACQUIRE);
+		if (head - index > lag)
+			lag = head - index;
+	});
+
+	return head - lag;
+}
+
+
+static void
+pfq_group_ring_overrun(struct pfq_shared_ring *sr, unsigned long readers, unsigned long tail)
+{
+	unsigned long bit;
+
+	pfq_bitwise_foreach(readers, bit,
+	{
+		int id = (int)pfq_ctz(bit);
+		unsigned long index = __atomic_load_n(&sr->reader[id].index, __ATOMIC_RELAXED);
+
+		/* the reader may release slots concurrently: move its index only forward */
+
+		while ((long)(tail - index) > 0)
+		{
+			if (__atomic_compare_exchange_n(&sr->reader[id].index, &index, tail, false,
+							__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+				__atomic_fetch_add(&sr->reader[id].lost, tail - index, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+	});
+}
+
+
+size_t
+pfq_group_ring_recv(struct pfq_group_ring *ring,
+		    struct pfq_qbuff_queue *buffs,
+		    unsigned long const *mask,
+		    int burst_len)
+{
+	struct pfq_shared_ring *sr = pfq_group_ring_shared(ring);
+	const unsigned long readers = (unsigned long)atomic_long_read(&ring->readers);
+	const bool overrun = ring->policy == Q_RING_POLICY_DROP;
+	const size_t cap = ring->slots;
+	unsigned long head, tail;
+	size_t n, len, copied = 0;
+	struct qbuff *buff;
+
+	if (unlikely(readers == 0))
+		return 0;
+
+	/* reserve the slots for the burst */
+
+	head = __atomic_load_n(&sr->prod.index, __ATOMIC_RELAXED);
+	do {
+		tail = pfq_group_ring_tail(sr, readers, head);
+		len = min_t(size_t, burst_len, cap - (head - tail));
+
+		if (len < (size_t)burst_len && overrun) {
+			len = min_t(size_t, burst_len, cap);
+			pfq_group_ring_overrun(sr, readers, head + len - cap);
+		}
+
+		if (len == 0)
+			return 0;
+	}
+	while (!__atomic_compare_exchange_n(&sr->prod.index, &head, head + len, false,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	for_each_qbuff_with_mask(mask, buffs, buff, n)
+	{
+		struct sk_buff *skb = QBUFF_SKB(buff);
+		const unsigned long index = head + copied;
+		struct pfq_pkthdr *hdr;
+		size_t bytes;
+
+		if (copied == len)
+			break;
+
+		hdr = (struct pfq_pkthdr *)pfq_group_ring_slot(ring, index);
+		bytes = min_t(size_t, skb->len, ring->caplen);
+
+		if (overrun) {
+			__atomic_store_n(&hdr->info.commit, 0, __ATOMIC_RELAXED);
+			smp_wmb();
+		}
+
+		if (unlikely(pfq_copy_bits(skb, 0, hdr+1, bytes) != 0))
+			bytes = 0;
+
+		pfq_fill_pkthdr(hdr, skb, bytes, Q_TSTAMP_ON);
+
+		__atomic_store_n(&hdr->info.commit, PFQ_STREAM_COMMIT(index, cap), __ATOMIC_RELEASE);
+		copied++;
+	}
+
+	return copied;
+}
+
+
+/*
+ * packed Rx: the producers reserve the bytes of the whole burst in a single
+ * atomic operation. The part of the reservation that is not filled with packets
+ * (the end of the queue or a copy failure) is covered by padding records, so that
+ * the consumer can always walk the queue from one header to the next one.
+ */
+
+static void
+pfq_sk_queue_pad(struct pfq_sock *so, char *base, size_t off, size_t end, pfq_qver_t qver)
+{
+	const size_t hdr_len = (so->rx_flags & Q_ENABLE_RX_COMPACT) ? sizeof(struct pfq_pkthdr_compact)
+								    : sizeof(struct pfq_pkthdr);
+	while (off < end)
+	{
+		struct pfq_pkthdr_compact *hdr = (struct pfq_pkthdr_compact *)(base + off);
+		size_t pad = min_t(size_t, end - off, PFQ_PACKED_PAD_MAX);
+
+		/* caplen and len are at the same offsets in both headers */
+
+		hdr->caplen = (uint16_t)(pad - hdr_len);
+		hdr->len = 0;
+
+		__atomic_store_n(PFQ_PACKED_COMMIT(so->rx_flags, hdr), qver, __ATOMIC_RELEASE);
+		off += pad;
+	}
+}
+
+
+static size_t
+pfq_sk_queue_recv_packed(struct pfq_sock *so,
+			 struct pfq_qbuff_queue *buffs,
+			 unsigned long const *mask,
+			 int burst_len)
+{
+	const unsigned int lane = pfq_mpsc_lane(so);
+	unsigned long *shinfo = pfq_mpsc_lane_shinfo(so, lane);
+	const bool compact = so->rx_flags & Q_ENABLE_RX_COMPACT;
+	const size_t size = pfq_mpsc_lane_len(so) * so->rx_slot_size;
+	size_t n, off, end, total = 0, copied = 0;
+	struct qbuff *buff;
+	unsigned long data;
+	pfq_qver_t qver;
+	char *base;
+
+	if (unlikely(shinfo == NULL))
+		return 0;
+
+	/* compute the bytes required by the burst */
+
+	for_each_qbuff_with_mask(mask, buffs, buff, n)
+	{
+		total += PFQ_PACKED_SLOT_SIZE(so->rx_flags, min_t(size_t, QBUFF_SKB(buff)->len, so->rx_len));
+	}
+
+	/* do not advance the length of a full queue: it would overflow into the version */
+
+	data = __atomic_load_n(shinfo, __ATOMIC_RELAXED);
+	if (unlikely(PFQ_SHARED_QUEUE_LEN(data) >= size))
+		return 0;
+
+	data = __atomic_fetch_add(shinfo, total, __ATOMIC_RELAXED);
+	off  = PFQ_SHARED_QUEUE_LEN(data);
+	qver = PFQ_SHARED_QUEUE_VER(data);
+
+	base = pfq_mpsc_lane_ptr(so, lane, qver);
+	if (unlikely(base == NULL))
+		return 0;
+
+	end = min(off + total, size);
+
+	for_each_qbuff_with_mask(mask, buffs, buff, n)
+	{
+		struct sk_buff *skb = QBUFF_SKB(buff);
+		size_t bytes = min_t(size_t, skb->len, so->rx_len);
+		size_t slot_size = PFQ_PACKED_SLOT_SIZE(so->rx_flags, bytes);
+		char *hdr = base + off;
+
+		if (off + slot_size > end)
+			break;
+
+		prefetch_w0(hdr);
+		prefetch_w0(hdr + 64);
+
+		if (compact) {
+			struct pfq_pkthdr_compact *h = (struct pfq_pkthdr_compact *)hdr;
+
+			if (unlikely(pfq_copy_bits(skb, 0, h+1, bytes) != 0))
+				break;
+
+			if (likely(so->tstamp != 0)) {
+				struct timespec ts;
+				skb_get_timestampns(skb, &ts);
+				h->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+				h->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+			}
+
+			h->caplen = (uint16_t)bytes;
+			h->len = (uint16_t)skb->len;
+
+			__atomic_store_n(&h->commit, qver, __ATOMIC_RELEASE);
+		}
+		else {
+			struct pfq_pkthdr *h = (struct pfq_pkthdr *)hdr;
+
+			if (unlikely(pfq_copy_bits(skb, 0, h+1, bytes) != 0))
+				break;
+
+			pfq_fill_pkthdr(h, skb, bytes, so->tstamp);
+
+			__atomic_store_n(&h->info.commit, qver, __ATOMIC_RELEASE);
+		}
+
+		off += slot_size;
+		copied++;
+	}
+
+	pfq_sk_queue_pad(so, base, off, end, qver);
+
+#ifdef PFQ_USE_POLL
+	if (waitqueue_active(&so->waitqueue))
+		wake_up_interruptible(&so->waitqueue);
+#endif
+	return copied;
+}
+
+
 size_t pfq_sk_queue_recv(struct pfq_sock *so,
 			 struct pfq_qbuff_queue *buffs,
-			 unsigned __int128 mask,
+			 unsigned long const *mask,
 			 int burst_len)
 {
-	struct pfq_shared_rx_queue *rx_queue = pfq_sock_rx_shared_queue(so);
+	const unsigned int lane = pfq_mpsc_lane(so);
+	const size_t lane_len = pfq_mpsc_lane_len(so);
+	unsigned long *shinfo = pfq_mpsc_lane_shinfo(so, lane);
 	struct pfq_pkthdr *hdr;
 	struct qbuff *buff;
 	unsigned long data;
 	size_t n, copied = 0;
 	pfq_qver_t qver;
-	int qlen;
+	size_t qlen;
 
-	if (unlikely(rx_queue == NULL))
+	if (unlikely(shinfo == NULL))
 		return 0;
 
-	data = __atomic_fetch_add(&rx_queue->shinfo, burst_len, __ATOMIC_RELAXED);
+	if (so->rx_flags & Q_ENABLE_RX_PACKED)
+		return pfq_sk_queue_recv_packed(so, buffs, mask, burst_len);
+
+	if (so->rx_flags & Q_ENABLE_RX_STREAM)
+		return pfq_sk_queue_recv_stream(so, buffs, mask, burst_len);
+
+	data = __atomic_fetch_add(shinfo, burst_len, __ATOMIC_RELAXED);
 	qlen = PFQ_SHARED_QUEUE_LEN(data);
 	qver = PFQ_SHARED_QUEUE_VER(data);
 
-	hdr  = (struct pfq_pkthdr *) pfq_mpsc_slot_ptr(so, qver, qlen);
+	hdr  = (struct pfq_pkthdr *) pfq_mpsc_lane_ptr(so, lane, qver);
 	if (unlikely(hdr == NULL))
 		return 0;
 
+	hdr  = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, min(qlen, lane_len) * so->rx_slot_size);
+
 	for_each_qbuff_with_mask(mask, buffs, buff, n)
 	{
 		struct sk_buff *skb = QBUFF_SKB(buff);
 		size_t bytes, slot_index;
+		bool zcopy = false;
 		char *pkt;
 
 		/* compute the boundaries */
 
-		bytes = min_t(size_t, skb->len, so->tx_len);
+		bytes = min_t(size_t, skb->len, so->rx_len);
 		pkt = (char *)(hdr+1);
 		slot_index = qlen + copied;
 
 		prefetch_w0(hdr);
 		prefetch_w0((char *)hdr + 64);
 
-		if (unlikely(slot_index >= so->rx_queue_len)) {
+		if (unlikely(slot_index >= lane_len)) {
 #ifdef PFQ_USE_POLL
 			if (waitqueue_active(&so->waitqueue)) {
 				wake_up_interruptible(&so->waitqueue);
@@ -1067,10 +1918,41 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 			return copied;
 		}
 
+		/* zero-copy Rx: reference the pool buffer or fall back to an inline copy */
+
+		if (so->rx_zc_skb) {
+
+			struct pfq_pkt_ref *ref = (struct pfq_pkt_ref *)pkt;
+			struct sk_buff **held = &so->rx_zc_skb[(qver & 1) * so->rx_queue_len + slot_index];
+			struct sk_buff *old;
+
+			/* the skbs held by the socket are capped (copied inline past the limit) */
+
+			if (pfq_zc_eligible(buff, bytes) && atomic_read(&so->rx_zc_held) < pfq_zc_max_held()) {
+				ref->off = pfq_zc_offset(skb);
+				old = xchg(held, skb);
+				buff->addr = NULL; /* the skb is owned by this slot now */
+				zcopy = true;
+				if (!old)
+					atomic_inc(&so->rx_zc_held);
+			}
+			else {
+				ref->off = PFQ_PKT_REF_INLINE;
+				pkt = (char *)(ref+1);
+				old = xchg(held, NULL);
+				if (old)
+					atomic_dec(&so->rx_zc_held);
+			}
+
+			/* the previous content of this slot has been released by the user */
+
+			if (old)
+				pfq_zc_release(old);
+		}
 
 		/* copy bytes of packet */
 #if 1
-		if (pfq_copy_bits(skb, 0, pkt, bytes) != 0) {
+		if (!zcopy && pfq_copy_bits(skb, 0, pkt, bytes) != 0) {
 			printk(KERN_WARNING "[PFQ] error: BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
 			       bytes, skb->len, skb->mac_len);
 			return copied;
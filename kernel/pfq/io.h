@@ -24,12 +24,13 @@
 #ifndef PFQ_IO_H
 #define PFQ_IO_H
 
+#include <pfq/qbuff.h>
 #include <pfq/sock.h>
 #include <pfq/types.h>
 
 
 #define pfq_qbuff_queue_lazy_xmit(buffs, mask, dev, queue_index) ({ \
-		int check = STATIC_TYPE(unsigned __int128, mask) && \
+		int check = STATIC_TYPE(unsigned long const *, mask) && \
 			    STATIC_TYPE(struct net_device *, dev) && \
 			    STATIC_TYPE(int, queue_index); \
 		struct qbuff * buff; \
@@ -50,6 +51,12 @@
                hdr = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, fix))
 
 
+/* size of a Tx slot: fixed, or given by the caplen of the header (packed Tx) */
+
+#define pfq_sk_tx_slot_size(so, hdr) \
+	(((so)->tx_flags & Q_ENABLE_TX_PACKED) ? PFQ_SHARED_QUEUE_SLOT_SIZE((hdr)->caplen) : (so)->tx_slot_size)
+
+
 typedef union
 {
 	uint64_t value;
@@ -68,14 +75,34 @@ struct napi_struct;
 
 extern size_t pfq_sk_queue_recv( struct pfq_sock *so
 			       , struct pfq_qbuff_queue *buffs
-			       , unsigned __int128 buffs_mask
+			       , unsigned long const *buffs_mask
 			       , int burst_len
 			       );
 
+struct pfq_group_ring;
+
+extern size_t pfq_group_ring_recv( struct pfq_group_ring *ring
+				 , struct pfq_qbuff_queue *buffs
+				 , unsigned long const *buffs_mask
+				 , int burst_len
+				 );
+
+
+/* scheduling of a socket queue by the Tx kthreads (NULL for synchronous Tx) */
+
+struct pfq_tx_sched
+{
+	size_t		deficit;	/* in: byte budget of the queue, out: the unused part */
+	uint64_t	next_ts;	/* out: timestamp of the first packet not due yet (0 = none) */
+	bool		backlog;	/* out: packets beyond the budget are left in the queue */
+};
+
 
 struct pfq_xmit_context
 {
 	struct pfq_skb_pool	*tx;
+	struct pfq_sock		*so;
+	unsigned int		*zc_pending;	/* zero-copy Tx: pending counter of the current half */
 	struct net		*net;
 	ktime_t			now;
 	unsigned long		jiffies;
@@ -87,12 +114,15 @@ struct pfq_xmit_context
 
 
 static inline size_t
-pfq_count_fwd_devs(struct net_device *dev, struct net_device **devs, size_t num_devs)
+pfq_count_fwd_devs(struct net_device *dev, struct qbuff const *buff)
 {
-	size_t n, ret = 0;
-	for(n = 0; n < num_devs; n++)
+	struct net_device *fwd;
+	size_t ret = 0;
+	uint16_t i;
+
+	for_each_qbuff_fwd_dev(buff, fwd, i)
 	{
-		if (dev == devs[n])
+		if (dev == fwd)
 			ret++;
 	}
 	return ret;
@@ -102,7 +132,27 @@ pfq_count_fwd_devs(struct net_device *dev, struct net_device **devs, size_t num_
 /* socket queues */
 
 extern tx_response_t
-pfq_sk_queue_xmit(struct pfq_sock *so, int qindex, int cpu);
+pfq_sk_queue_xmit(struct pfq_sock *so, int qindex, int cpu, struct pfq_tx_sched *sched);
+
+extern bool
+pfq_sk_queue_doorbell(struct pfq_sock *so, int qindex, bool arm);
+
+
+/* Tx aggregation: socket queues bound to the same device queue are transmitted
+ * in a single burst, under one HARD_TX_LOCK hold */
+
+#define Q_TX_AGGR_MAX	16
+
+struct pfq_tx_member
+{
+	struct pfq_sock		*so;
+	int			 sock_queue;
+	struct pfq_tx_sched	*sched;
+	tx_response_t		 rc;	/* out */
+};
+
+extern void
+pfq_sk_queues_xmit(struct pfq_tx_member *members, int num, int cpu);
 
 
 /* skb queues */
@@ -110,7 +160,7 @@ pfq_sk_queue_xmit(struct pfq_sock *so, int qindex, int cpu);
 extern int pfq_xmit(struct qbuff *buff, struct net_device *dev, int queue, int more);
 
 extern tx_response_t
-pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buff, unsigned __int128 buffs_mask, struct net_device *dev, int queue_index);
+pfq_qbuff_queue_xmit(struct pfq_qbuff_queue *buff, unsigned long const *buffs_mask, struct net_device *dev, int queue_index);
 
 /* skb lazy xmit */
 
@@ -121,6 +171,7 @@ extern int pfq_qbuff_lazy_xmit_run(struct pfq_qbuff_queue *queue, struct pfq_end
 /* receive */
 
 extern int pfq_receive(struct napi_struct *napi, struct sk_buff * skb);
+extern int pfq_receive_flush(int reason);
 extern int pfq_receive_run( struct pfq_percpu_data *data , struct pfq_percpu_pool *pool , int cpu);
 
 #endif /* PFQ_IO_H */
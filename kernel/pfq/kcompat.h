@@ -28,6 +28,9 @@
 #include <linux/netdevice.h>
 #include <linux/slab.h>
 #include <linux/inetdevice.h>
+#include <linux/jump_label.h>
+#include <linux/vmalloc.h>
+#include <asm/shmparam.h>
 
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(3,14,0))
 static inline bool netif_xmit_frozen_or_drv_stopped(const struct netdev_queue *queue)
@@ -56,4 +59,36 @@ netdev_notifier_info_to_dev(void *data)
 #endif
 
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+#  define PFQ_DEFINE_STATIC_KEY_FALSE(name)	DEFINE_STATIC_KEY_FALSE(name)
+#  define pfq_static_branch_unlikely(key)	static_branch_unlikely(key)
+#  define pfq_static_branch_inc(key)		static_branch_inc(key)
+#  define pfq_static_branch_dec(key)		static_branch_dec(key)
+#else
+#  define PFQ_DEFINE_STATIC_KEY_FALSE(name)	struct static_key name = STATIC_KEY_INIT_FALSE
+#  define pfq_static_branch_unlikely(key)	static_key_false(key)
+#  define pfq_static_branch_inc(key)		static_key_slow_inc(key)
+#  define pfq_static_branch_dec(key)		static_key_slow_dec(key)
+#endif
+
+
+
+/* vmalloc_user on a given node: the area is tagged VM_USERMAP when it is
+ * created (required by remap_vmalloc_range). Before 4.0 the vm flags cannot be
+ * passed to the allocator and the node is not honored. */
+
+static inline void *
+pfq_vmalloc_user_node(size_t size, int node)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0))
+	return __vmalloc_node_range(size, SHMLBA, VMALLOC_START, VMALLOC_END,
+				    GFP_KERNEL | __GFP_ZERO, PAGE_KERNEL, VM_USERMAP, node,
+				    __builtin_return_address(0));
+#else
+	(void)node;
+	return vmalloc_user(size);
+#endif
+}
+
+
 #endif /* PFQ_KCOMPACT_H */
@@ -171,7 +171,7 @@ pfq_skb_recycle(struct sk_buff *skb)
 	atomic_set(&shinfo->dataref,1);
 	// kmemcheck_annotate_variable(shinfo->destructor_arg);
 #if 1
-	__builtin_memcpy(skb, skb+global->max_pool_size, sizeof(struct sk_buff));
+	__builtin_memcpy(skb, skb+PFQ_POOL_CHUNK, sizeof(struct sk_buff));
 #else
 	unsigned int size = 2048;
 	void *data;
@@ -222,14 +222,34 @@ struct sk_buff * pfq_netdev_alloc_skb_ip_align(struct net_device *dev,
 
 static inline
 struct sk_buff *
-____pfq_alloc_skb_pool(unsigned int size, gfp_t priority, int fclone, int node, int idx, struct pfq_spsc_fifo *pool)
+____pfq_alloc_skb_pool(unsigned int size, gfp_t priority, int fclone, int node, int idx, struct pfq_skb_pool *pool)
 {
 #ifdef PFQ_USE_SKB_POOL
 	if (likely(pool)) {
-		struct sk_buff *skb = pfq_spsc_peek(pool);
+		struct pfq_spsc_fifo *fifo = READ_ONCE(pool->fifo);
+		struct sk_buff *skb;
+
+		if (unlikely(!fifo)) {
+			pfq_skb_pool_request(pool);
+			goto os_alloc;
+		}
+
+		skb = pfq_spsc_peek(fifo);
+		if (unlikely(!skb)) {
+
+			/* take back the skbs freed on other cpus, grow the pool if there are none */
+
+			if (!skb_queue_empty(&pool->returned))
+				pfq_skb_pool_drain(pool);
+			else
+				pfq_skb_pool_request(pool);
+
+			skb = pfq_spsc_peek(fifo);
+		}
+
 		if (likely(skb && pfq_skb_is_recycleable(skb))) {
 
-			pfq_spsc_consume(pool);
+			pfq_spsc_consume(fifo);
 
 			sparse_inc(global->percpu_memory, pool_pop[idx]);
 
@@ -248,18 +268,39 @@ ____pfq_alloc_skb_pool(unsigned int size, gfp_t priority, int fclone, int node,
 			}
 		}
 	}
+os_alloc:
 #endif
 	sparse_inc(global->percpu_memory, os_alloc);
 	return  __alloc_skb(size, priority, fclone, node);
 }
 
 
+/* pool the skb belongs to */
+
+static inline
+struct pfq_skb_pool *pfq_skb_pool_owner(struct sk_buff *skb)
+{
+	struct pfq_percpu_pool *owner = per_cpu_ptr(global->percpu_pool, PFQ_CB(skb)->cpu);
+	return PFQ_CB(skb)->pool ? &owner->tx : &owner->rx;
+}
+
+
+/* release an skb: pool is the pool of the calling cpu (the only producer of its
+ * fifo), skbs of other pools are returned to their owner */
+
 static inline
 void pfq_free_skb_pool(struct sk_buff *skb, struct pfq_skb_pool *pool)
 {
 #ifdef PFQ_USE_SKB_POOL
 	if (likely(skb->peeked)) {
 		const int idx = PFQ_CB(skb)->pool;
+		struct pfq_skb_pool *owner = pfq_skb_pool_owner(skb);
+
+		if (unlikely(owner != pool)) {
+			pfq_skb_pool_return(skb, owner);
+			return;
+		}
+
 		if (likely(pool->fifo)) {
 			if (unlikely(!pfq_spsc_push(pool->fifo, skb))) {
 
@@ -285,7 +326,7 @@ struct sk_buff * pfq_alloc_skb(unsigned int size, gfp_t priority)
 
 	if (likely(atomic_read(&global->pool_enabled))) {
 		struct pfq_percpu_pool *cpu_pool = this_cpu_ptr(global->percpu_pool);
-		struct pfq_spsc_fifo *pool = pfq_skb_pool_get(&cpu_pool->rx, size);
+		struct pfq_skb_pool *pool = pfq_skb_pool_get(&cpu_pool->rx, size);
 		return ____pfq_alloc_skb_pool(size, priority, 0, NUMA_NO_NODE, 0, pool);
 	}
 
@@ -309,7 +350,7 @@ struct sk_buff *
 pfq_alloc_skb_pool(unsigned int size, gfp_t priority, int node, int idx, struct pfq_skb_pool *pool)
 {
 #ifdef PFQ_USE_SKB_POOL
-	return ____pfq_alloc_skb_pool(size, priority, 0, node, idx, pool->fifo);
+	return ____pfq_alloc_skb_pool(size, priority, 0, node, idx, pool);
 #endif
 	sparse_inc(global->percpu_memory, os_alloc);
 	return __alloc_skb(size, priority, 0, NUMA_NO_NODE);
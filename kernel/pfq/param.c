@@ -24,35 +24,81 @@
 #include <pfq/global.h>
 #include <pfq/define.h>
 
+#include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 
 
 extern struct pfq_global_data default_global;
 
 
+/* Tx pacing distances can be changed at runtime: negative values are rejected
+ * here, as they are read by the Tx threads without further checks */
+
+static int
+pfq_param_set_nsec(const char *val, const struct kernel_param *kp)
+{
+	int ret, nsec;
+
+	ret = kstrtoint(val, 0, &nsec);
+	if (ret < 0)
+		return ret;
+	if (nsec < 0)
+		return -EINVAL;
+
+	*(int *)kp->arg = nsec;
+	return 0;
+}
+
+
+static const struct kernel_param_ops pfq_param_nsec_ops =
+{
+	.set = pfq_param_set_nsec,
+	.get = param_get_int,
+};
+
+
 module_param_named(max_slot_size,	 default_global.max_slot_size,		int, 0644);
 module_param_named(max_pool_size,	 default_global.max_pool_size,		int, 0644);
 
 module_param_named(capt_batch_len,	 default_global.capt_batch_len,		int, 0644);
+module_param_named(capt_latency,	 default_global.capt_latency,		int, 0644);
 module_param_named(xmit_batch_len,	 default_global.xmit_batch_len,		int, 0644);
 module_param_named(skb_tx_pool_size,	 default_global.skb_tx_pool_size,	int, 0644);
 module_param_named(skb_rx_pool_size,	 default_global.skb_rx_pool_size,	int, 0644);
 module_param_named(vlan_untag,		 default_global.vlan_untag,		int, 0644);
 module_param_named(tx_retry,		 default_global.tx_retry,		int, 0644);
+module_param_cb(tx_pace_spin,		 &pfq_param_nsec_ops, &default_global.tx_pace_spin,   0644);
+module_param_cb(tx_pace_window,		 &pfq_param_nsec_ops, &default_global.tx_pace_window, 0644);
+module_param_named(tx_quantum,		 default_global.tx_quantum,		int, 0644);
+module_param_named(tx_idle,		 default_global.tx_idle,		int, 0644);
+module_param_named(tx_aggr,		 default_global.tx_aggr,		int, 0644);
+module_param_named(lang_opt,		 default_global.lang_opt,		int, 0644);
+module_param_named(rx_zerocopy,		 default_global.rx_zerocopy,		int, 0644);
+module_param_named(max_groups,		 default_global.max_groups,		int, 0444);
 
 module_param_array_named(tx_cpu,	 default_global.tx_cpu,	  int, &default_global.tx_cpu_nr, 0644);
 
 MODULE_PARM_DESC(max_slot_size,		" Maximum socket slot size (default=2048 bytes)");
 MODULE_PARM_DESC(max_pool_size,		" Maximum socket buffer pool size (default=2048)");
 MODULE_PARM_DESC(capt_batch_len,	" Capture batch queue length");
+MODULE_PARM_DESC(capt_latency,		" Capture latency bound (default=1000 usec, 0 = none)");
 MODULE_PARM_DESC(xmit_batch_len,	" Transmit batch queue length");
 MODULE_PARM_DESC(vlan_untag,		" Enable vlan untagging (default=0)");
 
 #ifdef PFQ_USE_SKB_POOL
-MODULE_PARM_DESC(skb_tx_pool_size,	" Socket buffer Tx pool size (default=1024)");
-MODULE_PARM_DESC(skb_rx_pool_size,	" Socket buffer Rx pool size (default=1024)");
+MODULE_PARM_DESC(skb_tx_pool_size,	" Socket buffer Tx pool initial size and growth step (default=1024)");
+MODULE_PARM_DESC(skb_rx_pool_size,	" Socket buffer Rx pool initial size and growth step (default=1024)");
 #endif
 
 MODULE_PARM_DESC(tx_cpu,		" Tx k-threads cpu");
 MODULE_PARM_DESC(tx_retry,		" Tx retry attempts (default 1)");
+MODULE_PARM_DESC(tx_pace_spin,		" Tx pacing busy-wait threshold (default=100000 nsec)");
+MODULE_PARM_DESC(tx_pace_window,	" Tx pacing batch window (default=1000 nsec)");
+MODULE_PARM_DESC(tx_quantum,		" Tx threads round-robin quantum (default=65536 bytes)");
+MODULE_PARM_DESC(tx_idle,		" Tx threads idle time before sleeping (default=1000 usec)");
+MODULE_PARM_DESC(tx_aggr,		" Tx threads socket queues per device queue burst (default=16, 1 = none)");
+MODULE_PARM_DESC(lang_opt,		" Optimize pfq-lang computations at link time (default=1)");
+MODULE_PARM_DESC(rx_zerocopy,		" Allow zero-copy Rx sockets, which can read the Rx skb pools of every socket (default=0)");
+MODULE_PARM_DESC(max_groups,		" Maximum number of groups (default=64, up to 256)");
 
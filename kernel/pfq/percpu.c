@@ -73,6 +73,7 @@ void pfq_percpu_free(void)
 
 		struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
 		pfq_free_pages(data->qbuff_queue, sizeof(struct pfq_qbuff_long_queue));
+		pfq_free_pages(data->fwd_table, sizeof(struct pfq_qbuff_fwd_table));
 	}
 
 	free_percpu(global->percpu_stats);
@@ -98,13 +99,22 @@ int pfq_percpu_init(void)
                 data = per_cpu_ptr(global->percpu_data, cpu);
 
 		data->counter = 0;
+		data->rx_gap = 0;
+		data->batch_len = (size_t)global->capt_batch_len;
+		memset(data->flush, 0, sizeof(data->flush));
 
-		data->qbuff_queue = pfq_malloc_pages(sizeof(struct pfq_qbuff_long_queue), GFP_KERNEL);
+		data->qbuff_queue = pfq_malloc_pages_node(sizeof(struct pfq_qbuff_long_queue), GFP_KERNEL, cpu_to_node(cpu));
 		if (!data->qbuff_queue)
 			return -ENOMEM;
 
 		data->qbuff_queue->len = 0;
 
+		data->fwd_table = pfq_malloc_pages_node(sizeof(struct pfq_qbuff_fwd_table), GFP_KERNEL | __GFP_ZERO, cpu_to_node(cpu));
+		if (!data->fwd_table)
+			return -ENOMEM;
+
+		data->fwd_table->len = 0;
+
 		preempt_enable();
 	}
 
@@ -135,11 +145,13 @@ int pfq_percpu_qbuff_queue_reset(void)
 		for(n = 0; n < data->qbuff_queue->len; n++)
 		{
 			buff = &data->qbuff_queue->queue[n];
+			qbuff_fwd_banks_reset(buff);
 			pfq_free_skb_pool(QBUFF_SKB(buff), &pool->rx);
 		}
 
                 total += data->qbuff_queue->len;
 		data->qbuff_queue->len = 0;
+		data->fwd_table->len = 0;
 
 		preempt_enable();
         }
@@ -166,6 +178,7 @@ int pfq_percpu_destruct(void)
 
                 total += data->qbuff_queue->len;
 		data->qbuff_queue->len = 0;
+		data->fwd_table->len = 0;
 
 		preempt_enable();
         }
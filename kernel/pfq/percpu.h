@@ -35,6 +35,8 @@
 #include <pfq/qbuff.h>
 
 #include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 
 extern int  pfq_percpu_init(void);
 extern int  pfq_percpu_qbuff_queue_reset(void);
@@ -48,6 +50,9 @@ struct pfq_percpu_pool
 	struct pfq_skb_pool	tx;
 	struct pfq_skb_pool	rx;
 
+	struct sk_buff_head	remote;		/* skbs of another cpu pool freed on this cpu */
+	struct pfq_skb_pool    *remote_pool;	/* the pool they are returned to */
+
 } ____pfq_cacheline_aligned;
 
 
@@ -55,14 +60,42 @@ int  pfq_percpu_alloc(void);
 void pfq_percpu_free(void);
 
 
+/* why a per-cpu batch has been flushed */
+
+enum
+{
+	Q_FLUSH_FULL,			/* adaptive batch length reached */
+	Q_FLUSH_LATENCY,		/* the oldest packet is older than the latency bound */
+	Q_FLUSH_NAPI,			/* end of NAPI poll */
+	Q_FLUSH_TIMER,			/* latency bound hrtimer */
+	Q_FLUSH_HEARTBEAT,		/* periodic timer */
+	Q_FLUSH_MAX
+};
+
+
 struct pfq_percpu_data
 {
 	struct pfq_qbuff_long_queue  *qbuff_queue;
+	struct pfq_qbuff_fwd_table   *fwd_table;
+
+	ktime_t			first_rx;	/* arrival of the oldest packet of the batch */
+	ktime_t			last_rx;	/* arrival of the last packet */
+	uint64_t		rx_gap;		/* average inter-arrival time (nsec, EWMA 1/8) */
+	size_t			batch_len;	/* adaptive batch length */
 
-	ktime_t			last_rx;
-	struct timer_list	timer;
+	struct hrtimer		flush_timer;	/* latency bound */
+	struct tasklet_struct	flush_tasklet;
+	struct timer_list	timer;		/* heartbeat */
 	uint32_t		counter;
 
+	uint64_t		flush[Q_FLUSH_MAX];
+
+#ifdef PFQ_RX_PROFILE
+	uint64_t		rx_cycles;	/* spent in pfq_receive */
+	uint64_t		run_cycles;	/* spent in pfq_receive_run */
+	uint64_t		rx_packets;
+#endif
+
 } ____pfq_cacheline_aligned;
 
 
@@ -27,6 +27,8 @@
 #include <pfq/pool.h>
 #include <pfq/printk.h>
 
+#include <linux/slab.h>
+
 
 static
 struct sk_buff *
@@ -60,105 +62,334 @@ pfq_build_skb(void *base, void *data, unsigned int frag_size)
 }
 
 
+/* chunks of pool memory: PFQ_POOL_CHUNK sk_buffs followed by their pristine
+ * copies (see pfq_skb_recycle), and PFQ_POOL_CHUNK data buffers */
+
+static inline size_t
+pfq_skb_pool_max_chunks(void)
+{
+	return DIV_ROUND_UP((size_t)global->max_pool_size, PFQ_POOL_CHUNK);
+}
+
+
+static inline size_t
+pfq_skb_pool_base_chunk_size(void)
+{
+	return PFQ_POOL_CHUNK * 2 * sizeof(struct sk_buff);
+}
+
+
+static inline size_t
+pfq_skb_pool_data_chunk_size(void)
+{
+	return PFQ_POOL_CHUNK * (size_t)global->max_slot_size;
+}
+
+
 static
 size_t
 pfq_skb_pool_flush(struct pfq_skb_pool *pool)
 {
-	printk(KERN_INFO "[PFQ] pool: releasing base@%p (%zu bytes)...\n", pool->base, pool->base_size);
-	printk(KERN_INFO "[PFQ] pool: releasing data@%p (%zu bytes)...\n", pool->data, pool->data_size);
+	size_t n;
 
-	if (pool->base) {
-		pfq_free_pages(pool->base, pool->base_size);
-		pool->base = NULL;
-		pool->base_size = 0;
-	}
+	printk(KERN_INFO "[PFQ] pool: releasing %zu chunks (%zu bytes)...\n", pool->chunks,
+	       pool->chunks * (pfq_skb_pool_base_chunk_size() + pfq_skb_pool_data_chunk_size()));
 
-	if (pool->data) {
-		pfq_free_pages(pool->data, pool->data_size);
-		pool->data = NULL;
-		pool->data_size = 0;
+	for(n = 0; n < pool->chunks; n++)
+	{
+		pfq_free_pages(pool->base[n], pfq_skb_pool_base_chunk_size());
+		pfq_free_pages(pool->data[n], pfq_skb_pool_data_chunk_size());
 	}
 
+	kfree(pool->base);
+	kfree(pool->data);
+
+	pool->base = NULL;
+	pool->data = NULL;
+	pool->chunks = 0;
 	return 0;
 }
 
 
-static
-int pfq_skb_pool_init(struct pfq_skb_pool *pool, size_t pool_size, size_t skb_len, int idx, int cpu)
+/* allocate the chunks hosting the skbs [0, to) of the pool (the data is zeroed,
+ * as it can be mapped by zero-copy Rx sockets): returns the skbs available */
+
+static size_t
+pfq_skb_pool_alloc_chunks(struct pfq_skb_pool *pool, size_t to)
 {
-	struct sk_buff *skb;
-	int total = 0;
+	const int node = cpu_to_node(pool->cpu);
+	size_t n = DIV_ROUND_UP(to, PFQ_POOL_CHUNK);
 
-	if (!pool)
-		return -1;
+	for(; pool->chunks < n; pool->chunks++)
+	{
+		void *base, *data;
+
+		base = pfq_malloc_pages_node(pfq_skb_pool_base_chunk_size(), GFP_KERNEL, node);
+		data = pfq_malloc_pages_node(pfq_skb_pool_data_chunk_size(), GFP_KERNEL | __GFP_ZERO, node);
+		if (!base || !data) {
+			printk(KERN_ERR "[PFQ] pool: cpu %d %s: could not allocate chunk %zu!\n", pool->cpu, pool->idx ? "Tx" : "Rx", pool->chunks);
+			pfq_free_pages(base, pfq_skb_pool_base_chunk_size());
+			pfq_free_pages(data, pfq_skb_pool_data_chunk_size());
+			break;
+		}
 
-	if (pool->fifo != NULL)
-		return 0;
+		pool->base[pool->chunks] = base;
+		pool->data[pool->chunks] = data;
+	}
 
-	/* allocate pages for skb */
+	return min_t(size_t, to, pool->chunks * PFQ_POOL_CHUNK);
+}
 
-	pool->base = pfq_malloc_pages( global->max_pool_size * 2 * sizeof(struct sk_buff), GFP_KERNEL);
-	pool->base_size = pool->base ? global->max_pool_size * 2 * sizeof(struct sk_buff) :  0;
-	if (!pool->base) {
-		printk(KERN_ERR "[PFQ] pfq_skb_pool_init(base): could not allocate memory!\n");
-		goto err;
-	}
 
-	pool->data = pfq_malloc_pages( global->max_pool_size * global->max_slot_size, GFP_KERNEL);
-	pool->data_size = pool->data ? global->max_pool_size * global->max_slot_size: 0;
-	if (!pool->data) {
-		printk(KERN_ERR "[PFQ] pfq_skb_pool_init(data): could not allocate memory!\n");
-		goto err;
-	}
+/* the fifo hosts all the skbs the pool can grow to (one slot is added by the
+ * queue to distinguish between full and empty state) */
 
-	printk(KERN_INFO "[PFQ] pool: base@%p (%zu bytes).\n", pool->base, pool->base_size);
-	printk(KERN_INFO "[PFQ] pool: data@%p (%zu bytes).\n", pool->data, pool->data_size);
+static inline size_t
+pfq_skb_pool_fifo_len(void)
+{
+	return (size_t)global->max_pool_size + PFQ_POOL_CACHELINE_PAD-1;
+}
+
+
+/* initial size (and growth step) of the pool */
+
+static inline size_t
+pfq_skb_pool_init_size(struct pfq_skb_pool *pool)
+{
+	return (size_t)(pool->idx ? global->skb_tx_pool_size : global->skb_rx_pool_size);
+}
 
-	/* one slot is added by the queue to distinguish between full and empty state */
-	pool->fifo = pfq_spsc_init(pool_size + PFQ_POOL_CACHELINE_PAD-1, cpu);
-	if (!pool->fifo) {
-		printk(KERN_ERR "[PFQ] pfq_skb_pool_init(fifo): out of memory!\n");
-		goto err;
-	}
 
-	for(; total < pool_size; total++)
+/* build the skbs [from, to) of the pool (chunks allocated) and push them into the fifo */
+
+static void
+pfq_skb_pool_fill(struct pfq_skb_pool *pool, struct pfq_spsc_fifo *fifo, size_t from, size_t to)
+{
+	size_t n;
+
+	for(n = from; n < to; n++)
 	{
+		struct sk_buff *skb;
                 void *buf, *data;
 
-                buf  = pool->base + total * sizeof(struct sk_buff);
-		data = pool->data + total * global->max_slot_size;
+                buf  = pool->base[n / PFQ_POOL_CHUNK] + (n % PFQ_POOL_CHUNK) * sizeof(struct sk_buff);
+		data = pool->data[n / PFQ_POOL_CHUNK] + (n % PFQ_POOL_CHUNK) * global->max_slot_size;
 
 		skb = pfq_build_skb(buf, data, global->max_slot_size);
 
 		skb->peeked = 1;
 
-		PFQ_CB(skb)->id = total;
-		PFQ_CB(skb)->pool = idx;
+		PFQ_CB(skb)->id = (uint32_t)n;
+		PFQ_CB(skb)->pool = (u8)pool->idx;
+		PFQ_CB(skb)->cpu = (u16)pool->cpu;
 		PFQ_CB(skb)->head = skb->head;
 
-		memcpy(skb + global->max_pool_size, skb, sizeof(struct sk_buff));
+		memcpy(skb + PFQ_POOL_CHUNK, skb, sizeof(struct sk_buff));
 
-		pfq_spsc_push(pool->fifo, skb);
+		pfq_spsc_push(fifo, skb);
 		sparse_inc(global->percpu_memory, os_alloc);
 	}
 
-	return pool_size;
+	WRITE_ONCE(pool->size, to);
+}
+
+
+/* pool_mutex held: the fifo is published once the pool is filled */
+
+static
+int pfq_skb_pool_create(struct pfq_skb_pool *pool, size_t pool_size)
+{
+	struct pfq_spsc_fifo *fifo;
+	const int node = cpu_to_node(pool->cpu);
+
+	if (pool->fifo != NULL)
+		return 0;
+
+	/* chunk tables, and the chunks of the initial skbs (on the node of the cpu that owns the pool) */
+
+	pool->base = kzalloc_node(pfq_skb_pool_max_chunks() * sizeof(void *), GFP_KERNEL, node);
+	pool->data = kzalloc_node(pfq_skb_pool_max_chunks() * sizeof(void *), GFP_KERNEL, node);
+	if (!pool->base || !pool->data) {
+		printk(KERN_ERR "[PFQ] pfq_skb_pool_create(chunks): out of memory!\n");
+		goto err;
+	}
+
+	pool_size = min_t(size_t, pool_size, (size_t)global->max_pool_size);
+	if (pfq_skb_pool_alloc_chunks(pool, pool_size) < pool_size)
+		goto err;
+
+	pool->node = pfq_pages_node(pool->data[0]);
+
+	printk(KERN_INFO "[PFQ] pool: cpu %d %s: %zu chunks of %d skbs (node %d).\n", pool->cpu, pool->idx ? "Tx" : "Rx",
+	       pool->chunks, PFQ_POOL_CHUNK, pool->node);
+
+	fifo = pfq_spsc_init(pfq_skb_pool_fifo_len(), pool->cpu);
+	if (!fifo) {
+		printk(KERN_ERR "[PFQ] pfq_skb_pool_create(fifo): out of memory!\n");
+		goto err;
+	}
+
+	pfq_skb_pool_fill(pool, fifo, 0, pool_size);
+
+	smp_wmb();
+	WRITE_ONCE(pool->fifo, fifo);
+	return (int)pool_size;
 err:
 	pfq_skb_pool_flush(pool);
 	return -ENOMEM;
 }
 
 
-
-static size_t
-pfq_skb_pool_free(struct pfq_skb_pool *pool, size_t pool_size)
+static void
+pfq_skb_pool_free(struct pfq_skb_pool *pool)
 {
-	if (pool) {
+	if (pool->fifo) {
 		pfq_skb_pool_flush(pool);
-		pfq_spsc_free(pool_size, pool->fifo, NULL);
+		pfq_spsc_free(pfq_skb_pool_fifo_len(), pool->fifo, NULL);
 		pool->fifo = NULL;
 	}
-	return 0;
+	pool->size = 0;
+}
+
+
+static DEFINE_MUTEX(pfq_pool_mutex);
+static bool pfq_pool_active;
+
+
+/* lazy creation and growth of the pool, on the owner cpu */
+
+static void
+pfq_skb_pool_work(struct work_struct *work)
+{
+	struct pfq_skb_pool *pool = container_of(work, struct pfq_skb_pool, work);
+	struct pfq_percpu_pool *percpu = per_cpu_ptr(global->percpu_pool, pool->cpu);
+	const size_t init = pfq_skb_pool_init_size(pool);
+	size_t size, grow;
+
+	mutex_lock(&pfq_pool_mutex);
+
+	if (!pfq_pool_active)
+		goto done;
+
+	if (!pool->fifo) {
+		pfq_skb_pool_create(pool, init);
+		goto done;
+	}
+
+	size = pool->size;
+	if (size >= (size_t)global->max_pool_size)
+		goto done;
+
+	grow = min_t(size_t, (size_t)global->max_pool_size - size, max_t(size_t, init, PFQ_POOL_CHUNK));
+
+	/* the memory of the new skbs, allocated in process context */
+
+	grow = pfq_skb_pool_alloc_chunks(pool, size + grow) - size;
+	if (!grow)
+		goto done;
+
+	/* the fifo is fed by the owner cpu only: exclude its Rx softirq (Rx
+	 * pool) or its Tx threads (Tx pool) */
+
+	if (pool->idx)
+		spin_lock_bh(&percpu->tx_lock);
+	else
+		local_bh_disable();
+
+	if (smp_processor_id() == pool->cpu) {
+		pfq_skb_pool_fill(pool, pool->fifo, size, size + grow);
+		sparse_inc(global->percpu_memory, pool_grow[pool->idx]);
+	}
+
+	if (pool->idx)
+		spin_unlock_bh(&percpu->tx_lock);
+	else
+		local_bh_enable();
+
+	pr_devel("[PFQ] pool: cpu %d %s: grown to %zu skbs.\n", pool->cpu, pool->idx ? "Tx" : "Rx", pool->size);
+done:
+	mutex_unlock(&pfq_pool_mutex);
+}
+
+
+/* move the skbs returned by other cpus into the fifo (owner cpu only) */
+
+void pfq_skb_pool_drain(struct pfq_skb_pool *pool)
+{
+	struct sk_buff_head list;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_irqsave(&pool->returned.lock, flags);
+	skb_queue_splice_init(&pool->returned, &list);
+	spin_unlock_irqrestore(&pool->returned.lock, flags);
+
+	while ((skb = __skb_dequeue(&list)))
+	{
+		if (unlikely(!pfq_spsc_push(pool->fifo, skb))) {
+			pfq_printk_skb("[PFQ] internal error", skb);
+			continue;
+		}
+
+		sparse_inc(global->percpu_memory, pool_push[pool->idx]);
+	}
+}
+
+
+/* irqs disabled */
+
+static void
+__pfq_skb_pool_return_flush(struct pfq_percpu_pool *this)
+{
+	struct pfq_skb_pool *owner = this->remote_pool;
+
+	if (owner && !skb_queue_empty(&this->remote)) {
+		spin_lock(&owner->returned.lock);
+		skb_queue_splice_tail_init(&this->remote, &owner->returned);
+		spin_unlock(&owner->returned.lock);
+	}
+}
+
+
+/* return an skb freed on this cpu to the pool of another cpu: skbs are batched
+ * (per owner) to amortize the lock of the owner list */
+
+void pfq_skb_pool_return(struct sk_buff *skb, struct pfq_skb_pool *owner)
+{
+	struct pfq_percpu_pool *this;
+	unsigned long flags;
+
+	local_irq_save(flags);
+
+	this = this_cpu_ptr(global->percpu_pool);
+
+	if (this->remote_pool != owner) {
+		__pfq_skb_pool_return_flush(this);
+		this->remote_pool = owner;
+	}
+
+	__skb_queue_tail(&this->remote, skb);
+
+	if (skb_queue_len(&this->remote) >= PFQ_POOL_RETURN_BATCH)
+		__pfq_skb_pool_return_flush(this);
+
+	local_irq_restore(flags);
+
+	sparse_inc(global->percpu_memory, pool_return[owner->idx]);
+}
+
+
+/* hand the pending batch of this cpu to its owner (heartbeat) */
+
+void pfq_skb_pool_return_flush(void)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__pfq_skb_pool_return_flush(this_cpu_ptr(global->percpu_pool));
+	local_irq_restore(flags);
 }
 
 
@@ -182,6 +413,12 @@ pfq_get_skb_pool_stats(void)
         ,  .pool_norecycl[0] = sparse_read(global->percpu_memory, pool_norecycl[0])
         ,  .pool_norecycl[1] = sparse_read(global->percpu_memory, pool_norecycl[1])
 
+        ,  .pool_return[0]   = sparse_read(global->percpu_memory, pool_return[0])
+        ,  .pool_return[1]   = sparse_read(global->percpu_memory, pool_return[1])
+
+        ,  .pool_grow[0]     = sparse_read(global->percpu_memory, pool_grow[0])
+        ,  .pool_grow[1]     = sparse_read(global->percpu_memory, pool_grow[1])
+
         ,  .err_shared       = sparse_read(global->percpu_memory, err_shared)
         ,  .err_cloned       = sparse_read(global->percpu_memory, err_cloned)
         ,  .err_memory       = sparse_read(global->percpu_memory, err_memory)
@@ -205,24 +442,58 @@ pfq_get_skb_pool_stats(void)
 int pfq_skb_pool_init_all(void)
 {
 	int cpu;
+
+	/* pools are created on demand, by their cpu */
+
 	for_each_present_cpu(cpu)
 	{
 		struct pfq_percpu_pool *pool = per_cpu_ptr(global->percpu_pool, cpu);
 		if (pool)
 		{
 			spin_lock_init(&pool->tx_lock);
-
-			if (pfq_skb_pool_init(&pool->rx, global->skb_rx_pool_size, global->max_slot_size, 0, cpu) < 0)
-				goto err;
-			if (pfq_skb_pool_init(&pool->tx, global->skb_tx_pool_size, global->max_slot_size, 1, cpu) < 0)
-				goto err;
+			skb_queue_head_init(&pool->remote);
+			pool->remote_pool = NULL;
+
+			pool->rx.cpu = cpu;
+			pool->rx.idx = 0;
+			skb_queue_head_init(&pool->rx.returned);
+			INIT_WORK(&pool->rx.work, pfq_skb_pool_work);
+
+			pool->tx.cpu = cpu;
+			pool->tx.idx = 1;
+			skb_queue_head_init(&pool->tx.returned);
+			INIT_WORK(&pool->tx.work, pfq_skb_pool_work);
 		}
 	}
 
+	mutex_lock(&pfq_pool_mutex);
+	pfq_pool_active = true;
+	mutex_unlock(&pfq_pool_mutex);
 	return 0;
-err:
-	pfq_skb_pool_free_all();
-	return -ENOMEM;
+}
+
+
+/* create the Rx pools of all the cpus now, with the memory of max_pool_size
+ * skbs: zero-copy Rx maps all the chunks at once */
+
+int pfq_skb_pool_rx_create_all(void)
+{
+	int cpu, err = 0;
+
+	mutex_lock(&pfq_pool_mutex);
+
+	for_each_present_cpu(cpu)
+	{
+		struct pfq_skb_pool *pool = &per_cpu_ptr(global->percpu_pool, cpu)->rx;
+		if (pfq_skb_pool_create(pool, pfq_skb_pool_init_size(pool)) < 0 ||
+		    pfq_skb_pool_alloc_chunks(pool, (size_t)global->max_pool_size) < (size_t)global->max_pool_size) {
+			err = -ENOMEM;
+			break;
+		}
+	}
+
+	mutex_unlock(&pfq_pool_mutex);
+	return err;
 }
 
 
@@ -230,13 +501,33 @@ int pfq_skb_pool_free_all(void)
 {
 	int cpu;
 
+	mutex_lock(&pfq_pool_mutex);
+	pfq_pool_active = false;
+	mutex_unlock(&pfq_pool_mutex);
+
+	for_each_present_cpu(cpu)
+	{
+		struct pfq_percpu_pool *pool = per_cpu_ptr(global->percpu_pool, cpu);
+		if (pool) {
+			cancel_work_sync(&pool->rx.work);
+			cancel_work_sync(&pool->tx.work);
+		}
+	}
+
 	for_each_present_cpu(cpu)
 	{
 		struct pfq_percpu_pool *pool = per_cpu_ptr(global->percpu_pool, cpu);
 		if (pool) {
+			/* skbs on the way back to a pool live in the pool memory */
+
+			__skb_queue_head_init(&pool->remote);
+			pool->remote_pool = NULL;
+			__skb_queue_head_init(&pool->rx.returned);
+			__skb_queue_head_init(&pool->tx.returned);
+
 			spin_lock(&pool->tx_lock);
-			pfq_skb_pool_free(&pool->rx, global->skb_rx_pool_size);
-			pfq_skb_pool_free(&pool->tx, global->skb_tx_pool_size);
+			pfq_skb_pool_free(&pool->rx);
+			pfq_skb_pool_free(&pool->tx);
 			spin_unlock(&pool->tx_lock);
 		}
 	}
@@ -244,5 +535,3 @@ int pfq_skb_pool_free_all(void)
 	return 0;
 }
 
-
-
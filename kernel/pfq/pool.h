@@ -26,33 +26,72 @@
 
 #include <pfq/global.h>
 #include <linux/skbuff.h>
+#include <linux/workqueue.h>
 
 
 #define PFQ_POOL_CACHELINE_PAD		(64/sizeof(void *))
+#define PFQ_POOL_RETURN_BATCH		32	/* skbs of a remote pool returned at once */
+#define PFQ_POOL_CHUNK			256	/* skbs of a chunk of pool memory (unit of growth) */
 
 
+/*
+ * Pools are created lazily, on the first allocation of their cpu, and grow in
+ * steps of skb_{rx,tx}_pool_size skbs (up to max_pool_size) when they run out of
+ * buffers. Creation and growth are done by a work item on the owner cpu, the
+ * allocation that triggers them falls back to the kernel allocator.
+ *
+ * The memory of a pool is allocated along with its skbs, in chunks of
+ * PFQ_POOL_CHUNK skbs (the sk_buffs followed by their pristine copies, and the
+ * data buffers): only the fifo is sized for max_pool_size upfront.
+ *
+ * A pool skb freed on a cpu other than its owner is not pushed into the local
+ * fifo (owned by another producer), but batched and returned to its pool: the
+ * owner moves the returned skbs into the fifo when it runs out of buffers.
+ */
+
 struct pfq_skb_pool
 {
 	struct pfq_spsc_fifo *fifo;
-	void		      *base;
-	size_t		       base_size;
-	void		      *data;
-	size_t		       data_size;
+	void		     **base;		/* chunks of sk_buffs (and their copies) */
+	void		     **data;		/* chunks of data buffers */
+	size_t		       chunks;		/* chunks allocated */
+	int		       node;		/* NUMA node the pool memory landed on */
+
+	int		       cpu;		/* owner cpu */
+	int		       idx;		/* 0 = Rx, 1 = Tx */
+	size_t		       size;		/* skbs of the pool (up to max_pool_size) */
+
+	struct sk_buff_head    returned;	/* skbs freed on other cpus, not in the fifo yet */
+	struct work_struct     work;		/* lazy creation and growth */
 };
 
 
-extern int pfq_skb_pool_init_all(void);
-extern int pfq_skb_pool_free_all(void);
+extern int  pfq_skb_pool_init_all(void);
+extern int  pfq_skb_pool_free_all(void);
+extern int  pfq_skb_pool_rx_create_all(void);
+extern void pfq_skb_pool_drain(struct pfq_skb_pool *pool);
+extern void pfq_skb_pool_return(struct sk_buff *skb, struct pfq_skb_pool *owner);
+extern void pfq_skb_pool_return_flush(void);
 extern struct pfq_pool_stats pfq_get_skb_pool_stats(void);
 
 
 static inline
-struct pfq_spsc_fifo *pfq_skb_pool_get(struct pfq_skb_pool *pool, size_t size)
+struct pfq_skb_pool *pfq_skb_pool_get(struct pfq_skb_pool *pool, size_t size)
 {
 	if (likely(size <= global->max_slot_size))
-		return pool->fifo;
+		return pool;
 	return NULL;
 }
 
 
+/* ask the owner cpu to create the pool, or to grow it */
+
+static inline
+void pfq_skb_pool_request(struct pfq_skb_pool *pool)
+{
+	if (READ_ONCE(pool->size) < (size_t)global->max_pool_size && !work_pending(&pool->work))
+		schedule_work_on(pool->cpu, &pool->work);
+}
+
+
 #endif /* PFQ_POOL_H */
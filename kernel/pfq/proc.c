@@ -22,6 +22,7 @@
  ****************************************************************/
 
 
+#include <lang/engine.h>
 #include <lang/module.h>
 
 #include <pfq/bitops.h>
@@ -29,10 +30,12 @@
 #include <pfq/global.h>
 #include <pfq/group.h>
 #include <pfq/memory.h>
+#include <pfq/percpu.h>
 #include <pfq/printk.h>
 #include <pfq/proc.h>
 #include <pfq/sparse.h>
 #include <pfq/sock.h>
+#include <pfq/thread.h>
 
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -52,6 +55,7 @@ static const char proc_groups[]  = "groups";
 static const char proc_sockets[] = "sockets";
 static const char proc_global[]  = "global";
 static const char proc_memory[]  = "memory";
+static const char proc_tx[]	 = "tx";
 
 
 static void
@@ -64,7 +68,7 @@ seq_printf_functional_node(struct seq_file *m, struct pfq_lang_functional_node c
 
 
 static void
-seq_printf_computation_tree(struct seq_file *m, struct pfq_lang_computation_tree const *tree)
+seq_printf_computation_tree(struct seq_file *m, struct pfq_lang_computation_tree const *tree, bool profile)
 {
 	size_t n;
 
@@ -78,6 +82,23 @@ seq_printf_computation_tree(struct seq_file *m, struct pfq_lang_computation_tree
 	{
 		seq_printf_functional_node(m, &tree->node[n], n);
 	}
+
+	seq_printf(m, "program size=%zu\n", tree->prog_size);
+	for(n = 0; n < tree->prog_size; n++)
+	{
+		struct pfq_lang_node_profile prof;
+		size_t index;
+
+		if (!profile) {
+			seq_printf(m, "%3zu   %pF (%p)\n", n, tree->prog[n].run, tree->prog[n].fun);
+			continue;
+		}
+
+		index = pfq_lang_profile_get(tree, n, &prof);
+
+		seq_printf(m, "%3zu   %pF (fun %zu) hit=%lu pass=%lu drop=%lu avg_cycles=%lu\n", n, tree->prog[n].run, index,
+			   prof.hit, prof.pass, prof.drop, prof.samples ? prof.cycles / prof.samples : 0);
+	}
 }
 
 
@@ -88,7 +109,7 @@ static int pfq_proc_lang(struct seq_file *m, void *v)
 
 	pfq_group_lock();
 
-	for(n = 0; n < Q_MAX_GID; n++)
+	for(n = 0; n < (size_t)global->max_groups; n++)
 	{
 		pfq_gid_t gid = (__force pfq_gid_t)n;
 
@@ -97,10 +118,16 @@ static int pfq_proc_lang(struct seq_file *m, void *v)
 		if (!this_group->policy)
 			continue;
 
+		/* old computations are released after a grace period */
+
+		rcu_read_lock();
+
 		comp = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
 
 		seq_printf(m, "group=%zu ", n);
-		seq_printf_computation_tree(m, comp);
+		seq_printf_computation_tree(m, comp, this_group->lang_profile != 0);
+
+		rcu_read_unlock();
 	}
 
 	pfq_group_unlock();
@@ -149,7 +176,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 
 	pfq_group_lock();
 
-	for(n = 0; n < Q_MAX_GID; n++)
+	for(n = 0; n < (size_t)global->max_groups; n++)
 	{
 		pfq_gid_t gid = (__force pfq_gid_t)n;
 
@@ -196,16 +223,77 @@ static int pfq_proc_stats(struct seq_file *m, void *v)
 	seq_printf(m, "FORWARD:\n");
 	seq_printf(m, "  forwarded : %ld\n", sparse_read(global->percpu_stats, frwd));
 	seq_printf(m, "  kernel    : %ld\n", sparse_read(global->percpu_stats, kern));
+	{
+		int cpu;
+
+		seq_printf(m, "FLUSH:  (latency bound %d usec)\n", READ_ONCE(global->rx_latency));
+		seq_printf(m, "   cpu: full      latency   napi      timer     heartbeat batch\n");
+
+		for_each_present_cpu(cpu) {
+			struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
+			seq_printf(m, "%6d: %-9llu %-9llu %-9llu %-9llu %-9llu %zu\n", cpu,
+				   (unsigned long long)data->flush[Q_FLUSH_FULL],
+				   (unsigned long long)data->flush[Q_FLUSH_LATENCY],
+				   (unsigned long long)data->flush[Q_FLUSH_NAPI],
+				   (unsigned long long)data->flush[Q_FLUSH_TIMER],
+				   (unsigned long long)data->flush[Q_FLUSH_HEARTBEAT],
+				   data->batch_len);
+		}
+	}
+
+#ifdef PFQ_RX_PROFILE
+	{
+		uint64_t rx = 0, run = 0, pkts = 0;
+		int cpu;
+
+		for_each_present_cpu(cpu) {
+			struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
+			rx   += data->rx_cycles;
+			run  += data->run_cycles;
+			pkts += data->rx_packets;
+		}
+
+		seq_printf(m, "PROFILE:\n");
+		seq_printf(m, "  packets   : %llu\n", (unsigned long long)pkts);
+		seq_printf(m, "  receive   : %llu cycles/pkt\n", pkts ? (unsigned long long)div64_u64(rx, pkts) : 0ULL);
+		seq_printf(m, "  run       : %llu cycles/pkt\n", pkts ? (unsigned long long)div64_u64(run, pkts) : 0ULL);
+	}
+#endif
 	return 0;
 }
 
 
-static int pfq_proc_memory(struct seq_file *m, void *v)
+static int pfq_proc_tx(struct seq_file *m, void *v)
 {
-#ifdef PFQ_USE_SKB_POOL
+	int n;
+
+	seq_printf(m, "quantum: %d bytes, idle: %d usec, aggr: %d\n", global->tx_quantum, global->tx_idle, global->tx_aggr);
+	seq_printf(m, "Tx  cpu queues backlog util%%   sent         bursts       steals     sleeps     wakeups\n");
 
+	for(n = 0; n < global->tx_cpu_nr; n++)
+	{
+		struct pfq_thread_tx_data *data = pfq_get_tx_thread(n);
+		if (!data || !data->task)
+			continue;
+
+		seq_printf(m, "%-3d %-3d %-6d %-7d %3d.%d  %-12lu %-12lu %-10lu %-10lu %-10lu\n",
+			   data->id, data->cpu,
+			   READ_ONCE(data->nr_queues), READ_ONCE(data->backlog),
+			   READ_ONCE(data->util) / 10, READ_ONCE(data->util) % 10,
+			   data->sent, data->bursts, data->steals, data->sleeps, data->wakeups);
+	}
+
+	return 0;
+}
+
+
+static int pfq_proc_memory(struct seq_file *m, void *v)
+{
+	size_t n;
 	int i;
 
+#ifdef PFQ_USE_SKB_POOL
+
 	long int push_0 = sparse_read(global->percpu_memory, pool_push[0]);
 	long int push_1 = sparse_read(global->percpu_memory, pool_push[1]);
 
@@ -218,11 +306,19 @@ static int pfq_proc_memory(struct seq_file *m, void *v)
 	long int norecycl_0  = sparse_read(global->percpu_memory, pool_norecycl[0]);
 	long int norecycl_1  = sparse_read(global->percpu_memory, pool_norecycl[1]);
 
+	long int return_0  = sparse_read(global->percpu_memory, pool_return[0]);
+	long int return_1  = sparse_read(global->percpu_memory, pool_return[1]);
+
+	long int grow_0  = sparse_read(global->percpu_memory, pool_grow[0]);
+	long int grow_1  = sparse_read(global->percpu_memory, pool_grow[1]);
+
 	seq_printf(m, "\nPFQ POOL (%d)        %10s %10s\n", atomic_read(&global->pool_enabled), "Rx", "Tx");
 	seq_printf(m, "  push           : %10ld %10ld\n", push_0, push_1);
 	seq_printf(m, "  pop            : %10ld %10ld\n", pop_0, pop_1);
 	seq_printf(m, "  empty          : %10ld %10ld\n", empty_0, empty_1);
-	seq_printf(m, "  norecycl       : %10ld %10ld\n\n", norecycl_0, norecycl_1);
+	seq_printf(m, "  norecycl       : %10ld %10ld\n", norecycl_0, norecycl_1);
+	seq_printf(m, "  return         : %10ld %10ld\n", return_0, return_1);
+	seq_printf(m, "  grow           : %10ld %10ld\n\n", grow_0, grow_1);
 
 	for_each_present_cpu(i)
 	{
@@ -231,10 +327,18 @@ static int pfq_proc_memory(struct seq_file *m, void *v)
 		seq_printf(m, "CPU-%d:\n", i);
 		if (pool)
 		{
-			long int rx = pfq_spsc_len(pool->rx.fifo);
-			long int tx = pfq_spsc_len(pool->tx.fifo);
+			struct pfq_spsc_fifo *rx_fifo = READ_ONCE(pool->rx.fifo);
+			struct pfq_spsc_fifo *tx_fifo = READ_ONCE(pool->tx.fifo);
+
+			long int rx = rx_fifo ? pfq_spsc_len(rx_fifo) : 0;
+			long int tx = tx_fifo ? pfq_spsc_len(tx_fifo) : 0;
 
+			seq_printf(m, "     pool skbs   : %10zu %10zu\n", READ_ONCE(pool->rx.size), READ_ONCE(pool->tx.size));
 			seq_printf(m, "     pool size   : %10ld %10ld\n", rx, tx);
+			seq_printf(m, "     returned    : %10u %10u\n", skb_queue_len(&pool->rx.returned), skb_queue_len(&pool->tx.returned));
+			seq_printf(m, "     pool node   : %10d %10d\n",
+				   pool->rx.fifo ? pool->rx.node : NUMA_NO_NODE,
+				   pool->tx.fifo ? pool->tx.node : NUMA_NO_NODE);
 		}
 	}
 
@@ -262,6 +366,35 @@ static int pfq_proc_memory(struct seq_file *m, void *v)
 	seq_printf(m, "  skb_alloc      : %10ld\n", sparse_read(global->percpu_memory, os_alloc));
 	seq_printf(m, "  skb_free       : %10ld\n", sparse_read(global->percpu_memory, os_free));
 
+	/* NUMA node each allocation landed on (-1 = not allocated) */
+
+	seq_printf(m, "\nNUMA             %6s %6s %6s\n", "cpu", "qbuff", "fwd");
+
+	for_each_present_cpu(i)
+	{
+		struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, i);
+
+		seq_printf(m, "  CPU-%-10d : %6d %6d %6d\n", i, cpu_to_node(i),
+			   pfq_pages_node(data->qbuff_queue),
+			   pfq_pages_node(data->fwd_table));
+	}
+
+	seq_printf(m, "\n  socket         : %6s %6s %12s\n", "req.", "node", "size");
+
+	mutex_lock(&global->socket_lock);
+
+        for(n = 0; n < (__force int)Q_MAX_ID; n++)
+        {
+		struct pfq_sock *so = (struct pfq_sock *)atomic_long_read(&global->socket_ptr[(__force int)n]);
+
+		if (!so || !atomic_long_read(&so->shmem_addr))
+			continue;
+
+		seq_printf(m, "  %-14zu : %6d %6d %12zu\n", n, so->mem_node, so->shmem.node, so->shmem.size);
+        }
+
+	mutex_unlock(&global->socket_lock);
+
 	return 0;
 }
 
@@ -303,6 +436,11 @@ static int pfq_proc_lang_open(struct inode *inode, struct file *file)
 	return single_open(file, pfq_proc_lang, PDE_DATA(inode));
 }
 
+static int pfq_proc_tx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pfq_proc_tx, PDE_DATA(inode));
+}
+
 static int pfq_proc_stats_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, pfq_proc_stats, PDE_DATA(inode));
@@ -350,6 +488,14 @@ static const struct file_operations pfq_proc_lang_fops = {
 	.release = single_release,
 };
 
+static const struct file_operations pfq_proc_tx_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pfq_proc_tx_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 int pfq_proc_init(void)
 {
 	pfq_proc_dir = proc_mkdir("pfq", init_net.proc_net);
@@ -363,6 +509,7 @@ int pfq_proc_init(void)
 	proc_create(proc_sockets, 0644, pfq_proc_dir, &pfq_proc_sockets_fops);
 	proc_create(proc_global,  0644, pfq_proc_dir, &pfq_proc_global_fops);
 	proc_create(proc_memory,  0644, pfq_proc_dir, &pfq_proc_memory_fops);
+	proc_create(proc_tx,	  0644, pfq_proc_dir, &pfq_proc_tx_fops);
 
 	return 0;
 }
@@ -375,6 +522,7 @@ int pfq_proc_destruct(void)
 	remove_proc_entry(proc_sockets, pfq_proc_dir);
 	remove_proc_entry(proc_global,	pfq_proc_dir);
 	remove_proc_entry(proc_memory,	pfq_proc_dir);
+	remove_proc_entry(proc_tx,	pfq_proc_dir);
 	remove_proc_entry("pfq", init_net.proc_net);
 
 	return 0;
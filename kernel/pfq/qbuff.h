@@ -23,6 +23,7 @@
 #ifndef PFQ_QBUFF_H
 #define PFQ_QBUFF_H
 
+#include <pfq/bitops.h>
 #include <pfq/global.h>
 #include <pfq/vlan.h>
 #include <pfq/types.h>
@@ -32,20 +33,65 @@
 #include <linux/version.h>
 #include <linux/skbuff.h>
 #include <linux/ip.h>
+#include <linux/cache.h>
+#include <linux/bitmap.h>
 
 struct pfq_lang_monad;
 
 
+/*
+ * Forward-to-device annotations of a batch: each qbuff links its own entries,
+ * so that the qbuff itself stays within a cache line. The table holds
+ * Q_BUFF_LOG_LEN entries for each qbuff of the batch, the per-qbuff limit
+ * checked by pfq_qbuff_lazy_xmit: it cannot fill up before the limit is hit.
+ */
+
+#define Q_BUFF_FWD_NIL		((uint16_t)-1)
+
+struct pfq_qbuff_fwd_entry
+{
+	struct net_device      *dev;
+	uint16_t		next;
+};
+
+
+/*
+ * Sockets with id >= BITS_PER_LONG a qbuff is forwarded to are annotated in the socket
+ * banks of the table (the word 0 of each row is unused: it is the qbuff
+ * fwd_mask), and the qbuff only records which banks are in use.
+ */
+
+struct pfq_qbuff_fwd_table
+{
+	size_t len;
+	struct pfq_qbuff_fwd_entry entry[Q_BUFF_FWD_TABLE_LEN];
+	unsigned long sock[Q_BUFF_QUEUE_LEN][Q_SOCK_MASK_WORDS];
+};
+
+
+/*
+ * Batch masks are bitmaps with one bit per qbuff of the batch (up to
+ * Q_BUFF_BATCH_LEN).
+ */
+
+#define Q_BUFF_MASK_WORDS	BITS_TO_LONGS(Q_BUFF_BATCH_LEN)
+
+
 struct qbuff
 {
 	void		       *addr;				/* struct sk_buff * */
 	struct pfq_lang_monad  *monad;
-	struct net_device      *fwd_dev[Q_BUFF_QUEUE_LEN];	/* fwd to devs */
-	size_t			fwd_dev_num;
+	struct pfq_qbuff_fwd_table *fwd_table;			/* fwd to devs (shared by the batch) */
         unsigned long		fwd_mask;			/* fwd to sockets */
+        unsigned long		ring_mask;			/* fwd to group rings */
         uint32_t		counter;			/* unique id */
+	uint16_t		fwd_dev_head;			/* first annotation in fwd_table */
+	uint8_t			fwd_dev_num;			/* number of annotations */
         bool			to_kernel;			/* fwd to kernel */
-};
+	uint32_t		fwd_banks;			/* socket banks (ids >= BITS_PER_LONG) in fwd_table */
+	uint16_t		index;				/* position in the batch */
+
+} ____cacheline_aligned;
 
 
 
@@ -53,17 +99,88 @@ static inline void
 qbuff_init( struct qbuff *buff
 	      , void *addr
 	      , struct pfq_lang_monad *monad
-	      , size_t id)
+	      , struct pfq_qbuff_fwd_table *fwd_table
+	      , size_t id
+	      , size_t index)
 {
 	buff->addr = addr;
 	buff->monad = monad;
+	buff->fwd_table = fwd_table;
+	buff->fwd_dev_head = Q_BUFF_FWD_NIL;
 	buff->fwd_dev_num = 0;
 	buff->counter = id;
 	buff->fwd_mask = 0;
+	buff->ring_mask = 0;
 	buff->to_kernel = false;
+	buff->fwd_banks = 0;
+	buff->index = (uint16_t)index;
+}
+
+
+static inline void
+qbuff_fwd_sock(struct qbuff *buff, int id)
+{
+	const int w = id / BITS_PER_LONG;
+
+	if (likely(w == 0)) {
+		buff->fwd_mask |= 1UL << id;
+		return;
+	}
+
+	buff->fwd_table->sock[buff->index][w & (Q_SOCK_MASK_WORDS-1)] |= 1UL << (id % BITS_PER_LONG);
+	buff->fwd_banks |= 1U << (w & (Q_SOCK_MASK_WORDS-1));
 }
 
 
+static inline unsigned long
+qbuff_fwd_word(struct qbuff const *buff, int w)
+{
+	if (w == 0)
+		return buff->fwd_mask;
+	return (buff->fwd_banks & (1U << w)) ? buff->fwd_table->sock[buff->index][w] : 0;
+}
+
+
+static inline void
+qbuff_fwd_banks_reset(struct qbuff *buff)
+{
+	unsigned long bit, banks = buff->fwd_banks;
+
+	pfq_bitwise_foreach(banks, bit,
+	{
+		buff->fwd_table->sock[buff->index][pfq_ctz(bit)] = 0;
+	});
+
+	buff->fwd_banks = 0;
+}
+
+
+static inline bool
+qbuff_fwd_dev_add(struct qbuff *buff, struct net_device *dev)
+{
+	struct pfq_qbuff_fwd_table *table = buff->fwd_table;
+	size_t n = table->len;
+
+	BUILD_BUG_ON(Q_BUFF_FWD_TABLE_LEN >= Q_BUFF_FWD_NIL);
+
+	if (unlikely(n >= Q_BUFF_FWD_TABLE_LEN))
+		return false;
+
+	table->entry[n].dev  = dev;
+	table->entry[n].next = buff->fwd_dev_head;
+	table->len = n + 1;
+
+	buff->fwd_dev_head = (uint16_t)n;
+	buff->fwd_dev_num++;
+	return true;
+}
+
+
+#define for_each_qbuff_fwd_dev(buff, dev, i) \
+	for((i) = (buff)->fwd_dev_head; ((i) != Q_BUFF_FWD_NIL) && ((dev) = (buff)->fwd_table->entry[i].dev); \
+		(i) = (buff)->fwd_table->entry[i].next)
+
+
 #define PFQ_DEFINE_QUEUE(name, size) \
 	name {  \
 		size_t len; \
@@ -102,8 +219,11 @@ PFQ_DEFINE_QUEUE(struct pfq_qbuff_long_queue,  Q_BUFF_QUEUE_LEN);
 
 
 #define for_each_qbuff_with_mask(mask, q, buff, n) \
-        for((n) = pfq_ctz(mask); ((n) < (q)->len) && (mask) && ((buff) = PFQ_QBUFF_QUEUE_AT((q),n)); \
-                (mask) ^=(((unsigned __int128)1) << (n)), n = pfq_ctz(mask))
+        for((n) = find_first_bit((mask), (q)->len); ((n) < (q)->len) && ((buff) = PFQ_QBUFF_QUEUE_AT((q),n)); \
+                (n) = find_next_bit((mask), (q)->len, (n) + 1))
+
+
+#define qbuff_mask_weight(mask, q)	bitmap_weight((mask), (q)->len)
 
 
 #define for_each_qbuff_from(x, q, buff, n) \
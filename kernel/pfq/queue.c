@@ -38,13 +38,18 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 		struct pfq_shared_queue * mapped_queue;
                 unsigned int i; size_t n;
 
-		/* alloc queue memory */
+		/* alloc queue memory (on the requested NUMA node) */
 
-		if (pfq_shared_memory_alloc(so->id, &so->shmem, user_addr, user_size, hugepage_size, pfq_total_queue_mem_aligned(so)) < 0)
+		const int node = pfq_sock_mem_node(so);
+
+		if (pfq_shared_memory_alloc(so->id, &so->shmem, user_addr, user_size, hugepage_size, pfq_total_queue_mem_aligned(so), node) < 0)
 		{
 			return -ENOMEM;
 		}
 
+		if (node != NUMA_NO_NODE && so->shmem.node != node)
+			printk(KERN_INFO "[PFQ|%d] queues requested on node %d, landed on node %d!\n", so->id, node, so->shmem.node);
+
 		/* initialize queues headers */
 
 		mapped_queue = (struct pfq_shared_queue *)so->shmem.addr;
@@ -55,16 +60,33 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 		mapped_queue->rx.len       = (unsigned int)so->rx_queue_len;
 		mapped_queue->rx.size      = (unsigned int)pfq_mpsc_queue_mem(so)/2;
 		mapped_queue->rx.slot_size = (unsigned int)so->rx_slot_size;
+		mapped_queue->rx.lanes     = so->rx_lanes;
+
+		for(n = 0; n < Q_MAX_RX_LANES; n++)
+			mapped_queue->rx_lane[n].shinfo = 0;
+
+		mapped_queue->rx_ring.prod.index = 0;
+		mapped_queue->rx_ring.cons.index = 0;
 
-		/* reset Rx slots */
+		/* reset Rx slots (of each lane) */
 
-		for(i = 0; i < 2; i++)
+		for(i = 0; i < 2 * max(so->rx_lanes, 1U); i++)
 		{
-			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + i * mapped_queue->rx.size;
-			char * end = raw + mapped_queue->rx.size;
-			const int rst = !i;
-			for(;raw < end; raw += mapped_queue->rx.slot_size)
-				((struct pfq_pkthdr *)raw)->info.commit = (uint16_t)rst;
+			const size_t lane_size = pfq_mpsc_lane_len(so) * so->rx_slot_size;
+			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + i * lane_size;
+			char * end = raw + lane_size;
+			const int rst = (so->rx_flags & Q_ENABLE_RX_STREAM) ? 0 : !(i & 1);
+
+			if (so->rx_flags & Q_ENABLE_RX_PACKED) {
+				/* any aligned offset may host the header of a packed slot */
+				const size_t align = PFQ_PACKED_SLOT_ALIGNMENT(so->rx_flags);
+				for(;raw < end; raw += align)
+					*PFQ_PACKED_COMMIT(so->rx_flags, raw) = (uint32_t)rst;
+			}
+			else {
+				for(;raw < end; raw += mapped_queue->rx.slot_size)
+					((struct pfq_pkthdr *)raw)->info.commit = (uint16_t)rst;
+			}
 		}
 
 		/* initialize TX queues */
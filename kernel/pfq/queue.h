@@ -52,8 +52,20 @@ size_t pfq_mpsc_queue_len(struct pfq_sock *p)
 {
 	struct pfq_shared_queue *q = pfq_sock_shared_queue(p);
 	unsigned long data;
+	size_t len = 0;
+	unsigned int n;
 	if (!q)
 		return 0;
+	if (p->rx_flags & Q_ENABLE_RX_STREAM)
+		return __atomic_load_n(&q->rx_ring.prod.index, __ATOMIC_RELAXED) -
+		       __atomic_load_n(&q->rx_ring.cons.index, __ATOMIC_RELAXED);
+	if (p->rx_lanes > 1) {
+		for(n = 0; n < p->rx_lanes; n++) {
+			data = __atomic_load_n(&q->rx_lane[n].shinfo, __ATOMIC_RELAXED);
+			len += PFQ_SHARED_QUEUE_LEN(data);
+		}
+		return len;
+	}
 	data = __atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED);
         return PFQ_SHARED_QUEUE_LEN(data);
 }
@@ -96,14 +108,41 @@ void *pfq_sock_tx_queue_mem(struct pfq_sock *so, int index)
 }
 
 
+/* per-cpu Rx lanes */
+
+static inline
+size_t pfq_mpsc_lane_len(struct pfq_sock *so)
+{
+	return so->rx_lanes > 1 ? so->rx_queue_len / so->rx_lanes : so->rx_queue_len;
+}
+
+
+static inline
+unsigned int pfq_mpsc_lane(struct pfq_sock *so)
+{
+	return so->rx_lanes > 1 ? raw_smp_processor_id() % so->rx_lanes : 0;
+}
+
+
+static inline
+unsigned long *pfq_mpsc_lane_shinfo(struct pfq_sock *so, unsigned int lane)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL))
+		return NULL;
+
+	return so->rx_lanes > 1 ? &sq->rx_lane[lane].shinfo : &sq->rx.shinfo;
+}
+
+
 static inline
-char *pfq_mpsc_slot_ptr(struct pfq_sock *so, size_t qindex, size_t slot)
+char *pfq_mpsc_lane_ptr(struct pfq_sock *so, unsigned int lane, size_t qindex)
 {
 	void *rx_mem = pfq_sock_rx_queue_mem(so);
 	if (!rx_mem)
 		return NULL;
 
-	return (char *)rx_mem + (so->rx_queue_len * (qindex & 1) + slot) * so->rx_slot_size;
+	return (char *)rx_mem + (lane * 2 + (qindex & 1)) * pfq_mpsc_lane_len(so) * so->rx_slot_size;
 }
 
 
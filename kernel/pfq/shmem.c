@@ -21,8 +21,12 @@
  *
  ****************************************************************/
 
+#include <pfq/flow_table.h>
+#include <pfq/group_ring.h>
+#include <pfq/kcompat.h>
 #include <pfq/queue.h>
 #include <pfq/shmem.h>
+#include <pfq/zcopy.h>
 
 #include <linux/kernel.h>
 #include <linux/version.h>
@@ -199,6 +203,27 @@ pfq_mmap(struct file *file, struct socket *sock, struct vm_area_struct *vma)
                 return -EINVAL;
         }
 
+	/* group rings and flow tables are mapped at the offset of their gid */
+
+	if (vma->vm_pgoff >= PFQ_GROUP_RING_PGOFF(0) &&
+	    vma->vm_pgoff <  PFQ_GROUP_RING_PGOFF(Q_MAX_GID))
+		return pfq_group_ring_mmap(so, (__force pfq_gid_t)(vma->vm_pgoff - PFQ_GROUP_RING_PGOFF(0)), vma);
+
+	if (vma->vm_pgoff >= PFQ_GROUP_FLOW_PGOFF(0) &&
+	    vma->vm_pgoff <  PFQ_GROUP_FLOW_PGOFF(Q_MAX_GID))
+		return pfq_flow_table_mmap(so, (__force pfq_gid_t)(vma->vm_pgoff - PFQ_GROUP_FLOW_PGOFF(0)), vma);
+
+	/* the zero-copy Rx area is mapped right after the socket queues */
+
+	if (vma->vm_pgoff) {
+		if ((vma->vm_pgoff << PAGE_SHIFT) != so->shmem.size) {
+			printk(KERN_WARNING "[PFQ] error: pfq_mmap: invalid offset!\n");
+			return -EINVAL;
+		}
+
+		return pfq_zc_mmap(so, vma);
+	}
+
         if(size > so->shmem.size) {
                 printk(KERN_WARNING "[PFQ] error: pfq_mmap: area too large!\n");
                 return -EINVAL;
@@ -224,9 +249,10 @@ pfq_hugepages_map(pfq_id_t id, struct pfq_shmem_descr *shmem, unsigned long user
 	shmem->id   = (int)id;
         shmem->size = req_size;
 	shmem->kind = pfq_shmem_user;
+	shmem->node = page_to_nid(hpages->hugepages[0]);
         shmem->hugepages_descr = hpages;
 
-	printk(KERN_INFO "[PFQ|%d] mapped memory: %zu bytes.\n", (int)id, req_size);
+	printk(KERN_INFO "[PFQ|%d] mapped memory: %zu bytes (node %d).\n", (int)id, req_size, shmem->node);
 	return 0;
 }
 
@@ -248,16 +274,16 @@ pfq_hugepages_unmap(struct pfq_shmem_descr *shmem)
 
 
 int
-pfq_vmalloc_user(pfq_id_t id, struct pfq_shmem_descr *shmem, size_t mem_size)
+pfq_vmalloc_user(pfq_id_t id, struct pfq_shmem_descr *shmem, size_t mem_size, int node)
 {
 	size_t tot_mem = PAGE_ALIGN(mem_size);
         void *addr;
 
-	pr_devel("[PFQ] allocating shared memory...\n");
+	pr_devel("[PFQ] allocating shared memory (node %d)...\n", node);
 
-	addr = vmalloc_user(tot_mem);
+	addr = pfq_vmalloc_user_node(tot_mem, node);
 	if (addr == NULL) {
-		printk(KERN_WARNING "[PFQ] error: shmem: out of memory (vmalloc %zu bytes)!", tot_mem);
+		printk(KERN_WARNING "[PFQ] error: shmem: out of memory (vmalloc %zu bytes, node %d)!", tot_mem, node);
 		return -ENOMEM;
 	}
 
@@ -265,6 +291,7 @@ pfq_vmalloc_user(pfq_id_t id, struct pfq_shmem_descr *shmem, size_t mem_size)
 	shmem->id   = (int)id;
         shmem->size = tot_mem;
 	shmem->kind = pfq_shmem_virt;
+	shmem->node = page_to_nid(vmalloc_to_page(addr));
         shmem->hugepages_descr = NULL;
 
 	pr_devel("[PFQ] total shared memory: %zu bytes.\n", tot_mem);
@@ -273,14 +300,14 @@ pfq_vmalloc_user(pfq_id_t id, struct pfq_shmem_descr *shmem, size_t mem_size)
 
 
 int
-pfq_shared_memory_alloc(pfq_id_t id, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t hugepage_size, size_t req_size)
+pfq_shared_memory_alloc(pfq_id_t id, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t hugepage_size, size_t req_size, int node)
 {
 	if (hugepage_size) {
 		if (pfq_hugepages_map(id, shmem, user_addr, user_size, hugepage_size, req_size) < 0)
 			return -ENOMEM;
 	}
 	else {
-		if (pfq_vmalloc_user(id, shmem, req_size) < 0)
+		if (pfq_vmalloc_user(id, shmem, req_size, node) < 0)
 			return -ENOMEM;
 	}
 
@@ -302,6 +329,7 @@ pfq_shared_memory_free(struct pfq_shmem_descr *shmem)
 		shmem->addr = NULL;
 		shmem->hugepages_descr = NULL;
 		shmem->size = 0;
+		shmem->node = NUMA_NO_NODE;
 
 		pr_devel("[PFQ] shared memory freed.\n");
 	}
@@ -24,6 +24,7 @@
 #ifndef PFQ_SHMEM_H
 #define PFQ_SHMEM_H
 
+#include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/net.h>
 
@@ -52,21 +53,31 @@ struct pfq_shmem_descr
 	void		       *addr;
 	size_t			size;
 	enum pfq_shmem_kind     kind;
+	int			node;		/* NUMA node the memory landed on (NUMA_NO_NODE = unknown) */
 	struct pfq_pages_descr *hugepages_descr;
 };
 
 
+/* page backing an address of the shared memory (vmalloc, vm_map_ram or 1G HugePages) */
+
+static inline struct page *
+pfq_shmem_page(const void *addr)
+{
+	return is_vmalloc_addr(addr) ? vmalloc_to_page(addr) : virt_to_page(addr);
+}
+
+
 extern size_t pfq_total_queue_mem(struct pfq_sock *so);
 extern size_t pfq_total_queue_mem_aligned(struct pfq_sock *so);
 
 extern int    pfq_mmap(struct file *file, struct socket *sock, struct vm_area_struct *vma);
-extern int    pfq_vmalloc_user(pfq_id_t, struct pfq_shmem_descr *shmem, size_t size);
+extern int    pfq_vmalloc_user(pfq_id_t, struct pfq_shmem_descr *shmem, size_t size, int node);
 
 extern int    pfq_hugepages_map(pfq_id_t, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t hugepage_size, size_t req_size);
 extern int    pfq_hugepages_unmap(struct pfq_shmem_descr *shmem);
 
 
-extern int    pfq_shared_memory_alloc(pfq_id_t, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t huge_size, size_t req_size);
+extern int    pfq_shared_memory_alloc(pfq_id_t, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t huge_size, size_t req_size, int node);
 extern void   pfq_shared_memory_free(struct pfq_shmem_descr *shmem);
 
 
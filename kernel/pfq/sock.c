@@ -22,16 +22,23 @@
  ****************************************************************/
 
 #include <pfq/atomic.h>
+#include <pfq/devmap.h>
 #include <pfq/global.h>
+#include <pfq/group.h>
 #include <pfq/kcompat.h>
+#include <pfq/netdev.h>
 #include <pfq/pool.h>
 #include <pfq/printk.h>
 #include <pfq/queue.h>
 #include <pfq/sock.h>
 #include <pfq/sock.h>
 #include <pfq/thread.h>
+#include <pfq/zcopy.h>
 
+#include <linux/delay.h>
 #include <linux/pf_q.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
 
 void
 pfq_sock_init_once(void)
@@ -64,6 +71,9 @@ void pfq_sock_destruct(struct sock *sk)
 	free_percpu(so->stats);
         so->stats = NULL;
 
+	free_percpu(so->pacing);
+	so->pacing = NULL;
+
         skb_queue_purge(&sk->sk_error_queue);
 
         WARN_ON(atomic_read(&sk->sk_rmem_alloc));
@@ -97,6 +107,75 @@ int pfq_sock_counter(void)
 }
 
 
+/* the Rx latency bound is the tightest among the open sockets (socket_lock held) */
+
+void pfq_sock_rx_latency_update(void)
+{
+	int n, latency = 0;
+
+        for(n = 0; n < (__force int)Q_MAX_ID; n++)
+        {
+		struct pfq_sock *so = (struct pfq_sock *)atomic_long_read(&global->socket_ptr[n]);
+		int value;
+
+		if (!so)
+			continue;
+
+		value = so->rx_latency ? so->rx_latency : global->capt_latency;
+		if (value && (latency == 0 || value < latency))
+			latency = value;
+	}
+
+	WRITE_ONCE(global->rx_latency, latency ? latency : global->capt_latency);
+}
+
+
+/* device the socket transmits to or, failing that, the first device bound
+ * to one of its groups (-1 if none) */
+
+static int
+pfq_sock_device_index(struct pfq_sock *so)
+{
+	DECLARE_BITMAP(grps, Q_MAX_GID);
+	int n;
+
+	if (so->tx.ifindex != -1)
+		return so->tx.ifindex;
+
+	for(n = 0; n < Q_MAX_TX_QUEUES; n++)
+		if (so->tx_async[n].ifindex != -1)
+			return so->tx_async[n].ifindex;
+
+	pfq_group_get_groups(so->id, grps);
+	return pfq_devmap_first_device(grps);
+}
+
+
+/* NUMA node the queues of the socket are to be allocated on (NUMA_NO_NODE = any) */
+
+int pfq_sock_mem_node(struct pfq_sock *so)
+{
+	int node = so->mem_node;
+
+	if (node == Q_NODE_DEVICE) {
+		int ifindex = pfq_sock_device_index(so);
+		struct net_device *dev = ifindex != -1 ? pfq_dev_get_by_index(ifindex) : NULL;
+
+		node = NUMA_NO_NODE;
+		if (dev) {
+			if (dev->dev.parent)
+				node = dev_to_node(dev->dev.parent);
+			pfq_dev_put(dev);
+		}
+	}
+
+	if (node < 0 || node >= MAX_NUMNODES || !node_online(node))
+		return NUMA_NO_NODE;
+
+	return node;
+}
+
+
 struct pfq_sock *
 pfq_sock_get_by_id(pfq_id_t id)
 {
@@ -121,7 +200,6 @@ void pfq_sock_release_id(pfq_id_t id)
 
         if (atomic_dec_return(&global->socket_count) == 0) {
 		pr_devel("[PFQ] calling sock_fini_once...\n");
-		msleep(Q_GRACE_PERIOD);
 		pfq_sock_fini_once();
 	}
 }
@@ -137,6 +215,13 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 	if (!so->stats)
 		return -ENOMEM;
 
+	so->pacing = alloc_percpu(struct pfq_kernel_pacing);	/* zeroed */
+	if (!so->pacing) {
+		free_percpu(so->stats);
+		so->stats = NULL;
+		return -ENOMEM;
+	}
+
 	for_each_present_cpu(i)
 	{
 		pfq_sock_stats_t * stat = per_cpu_ptr(so->stats, i);
@@ -165,9 +250,18 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 
 	so->weight = 1;
 
+	/* default latency bound */
+
+	so->rx_latency = 0;
+
+	/* queues allocated on the node of the enabling cpu */
+
+	so->mem_node = Q_NODE_ANY;
+
         so->shmem.addr = NULL;
         so->shmem.size = 0;
         so->shmem.kind = 0;
+        so->shmem.node = NUMA_NO_NODE;
         so->shmem.hugepages_descr = NULL;
 
         atomic_long_set(&so->shmem_addr,0);
@@ -187,6 +281,12 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
         so->rx_len = caplen;
         so->rx_queue_len = 0;
         so->rx_slot_size  = PFQ_SHARED_QUEUE_SLOT_SIZE(caplen);
+        so->rx_flags = 0;
+        so->rx_lanes = 0;
+        so->rx_zc_skb = NULL;
+        so->rx_zc_num = 0;
+        so->ring_gid = -1;
+        so->ring_reader = -1;
 
 	/* Tx queues setup */
 
@@ -194,6 +294,9 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 
         so->tx_len = xmitlen;
         so->tx_queue_len  = 0;
+        so->tx_flags = 0;
+        atomic_set(&so->tx_zc_pending, 0);
+        so->tx_zc_gen = 0;
         so->tx_slot_size  = PFQ_SHARED_QUEUE_SLOT_SIZE(xmitlen);
 	so->txq_num_async = 0;
 
@@ -259,20 +362,104 @@ pfq_sock_tx_unbind(struct pfq_sock *so)
 }
 
 
+/* zero-copy Tx skbs reference the shared memory until the driver completes
+ * them: the wait is bounded (Q_TX_ZC_WAIT) and killable, as a stuck device or
+ * qdisc may hold them indefinitely. Returns false if skbs are still pending. */
+
+bool
+pfq_sock_tx_zc_wait(struct pfq_sock *so)
+{
+	unsigned long end = jiffies + Q_TX_ZC_WAIT;
+
+	while (atomic_read(&so->tx_zc_pending))
+	{
+		if (time_after(jiffies, end) || fatal_signal_pending(current))
+			return false;
+		msleep(1);
+	}
+
+	return true;
+}
+
+
 int
 pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem)
 {
+	bool first;
         int err;
 
-	printk(KERN_INFO "[PFQ|%d] enable: mapping user_addr=%p user_size=%zu hugepage_size=%zu...\n", so->id,
-		(void *)mem->user_addr, mem->user_size, mem->hugepage_size);
+	printk(KERN_INFO "[PFQ|%d] enable: mapping user_addr=%p user_size=%zu hugepage_size=%zu flags=%x...\n", so->id,
+		(void *)mem->user_addr, mem->user_size, mem->hugepage_size, mem->flags);
+
+	/* Tx flags are set when the queue is allocated: they cannot change on an enabled socket */
+
+	if (atomic_long_read(&so->shmem_addr) &&
+	    so->tx_flags != (mem->flags & (Q_ENABLE_TX_ZEROCOPY|Q_ENABLE_TX_PACKED))) {
+		printk(KERN_INFO "[PFQ|%d] enable error (socket already enabled with Tx flags=%x)!\n", so->id, so->tx_flags);
+		return -EBUSY;
+	}
+
+	/* per-cpu Rx lanes */
+
+	if (so->rx_lanes > 1) {
+		if (so->rx_queue_len < so->rx_lanes || (mem->flags & Q_ENABLE_RX_ZEROCOPY)) {
+			printk(KERN_INFO "[PFQ|%d] enable error (Rx lanes=%u with slots=%zu flags=%x)!\n", so->id,
+			       so->rx_lanes, so->rx_queue_len, mem->flags);
+			return -EINVAL;
+		}
+	}
+
+	/* streaming Rx ring */
+
+	if (mem->flags & Q_ENABLE_RX_STREAM) {
+		if ((mem->flags & (Q_ENABLE_RX_PACKED|Q_ENABLE_RX_COMPACT|Q_ENABLE_RX_ZEROCOPY)) || so->rx_lanes > 1) {
+			printk(KERN_INFO "[PFQ|%d] enable error (streaming Rx with flags=%x lanes=%u)!\n", so->id,
+			       mem->flags, so->rx_lanes);
+			return -EINVAL;
+		}
+		if (!atomic_long_read(&so->shmem_addr))
+			so->rx_flags = Q_ENABLE_RX_STREAM;
+	}
+
+	/* packed Rx slots: the layout must be set before the queues are initialized */
+
+	if (mem->flags & (Q_ENABLE_RX_PACKED|Q_ENABLE_RX_COMPACT)) {
+		if (!(mem->flags & Q_ENABLE_RX_PACKED) || (mem->flags & Q_ENABLE_RX_ZEROCOPY)) {
+			printk(KERN_INFO "[PFQ|%d] enable error (invalid Rx layout flags=%x)!\n", so->id, mem->flags);
+			return -EINVAL;
+		}
+		if (so->rx_queue_len * so->rx_slot_size > PFQ_SHARED_QUEUE_LEN_MASK/2) {
+			printk(KERN_INFO "[PFQ|%d] enable error (Rx queue too large for packed slots)!\n", so->id);
+			return -EINVAL;
+		}
+		if (!atomic_long_read(&so->shmem_addr))
+			so->rx_flags = mem->flags & (Q_ENABLE_RX_PACKED|Q_ENABLE_RX_COMPACT);
+	}
+
+	/* zero-copy Rx changes the slot size: it must be set before the queues are allocated */
+
+	if (mem->flags & Q_ENABLE_RX_ZEROCOPY) {
+		err = pfq_zc_enable(so);
+		if (err < 0) {
+			printk(KERN_INFO "[PFQ|%d] enable error (zero-copy Rx)!\n", so->id);
+			return err;
+		}
+	}
+
+	first = !atomic_long_read(&so->shmem_addr);
 
         err = pfq_shared_queue_enable(so, mem->user_addr, mem->user_size, mem->hugepage_size);
         if (err < 0) {
                 printk(KERN_INFO "[PFQ|%d] enable error!\n", so->id);
+		pfq_zc_disable(so);
+		so->rx_flags = 0;
                 return err;
         }
 
+	mem->zc_size = so->rx_zc_skb ? pfq_zc_area_size() : 0;
+	if (first)
+		so->tx_flags = mem->flags & (Q_ENABLE_TX_ZEROCOPY|Q_ENABLE_TX_PACKED);
+
 	if (mem->hugepage_size) {
 		if (!so->shmem.hugepages_descr) {
 			printk(KERN_INFO "[PFQ|%d] enable error (null HugePages descriptor)!\n", so->id);
@@ -290,24 +477,39 @@ pfq_sock_disable(struct pfq_sock *so)
 	pr_devel("[PFQ|%d] leaving all groups...\n", so->id);
 	pfq_group_leave_all(so->id);
 
-	msleep(Q_GRACE_PERIOD);
-
 	if (atomic_long_read(&so->shmem_addr)) {
 
-		/* unbind Tx threads */
+		/* unbind Tx threads (waits for them to drop the socket) */
 
 		pr_devel("[PFQ|%d] unbinding Tx threads...\n", so->id);
 		pfq_sock_tx_unbind(so);
 
-		msleep(Q_GRACE_PERIOD);
-
 		pr_devel("[PFQ|%d] disabling shared queue...\n", so->id);
 		atomic_long_set(&so->shmem_addr, 0);
 
-		msleep(Q_GRACE_PERIOD);
+		/* wait for the Rx paths still delivering to this socket */
+
+		synchronize_rcu();
+
+		/* wait for the zero-copy Tx skbs still referencing the shared memory;
+		 * past the timeout they are orphaned: their completion no longer
+		 * touches the shared queue, and the pages of their data stay
+		 * referenced by the skbs until they are freed */
+
+		if (!pfq_sock_tx_zc_wait(so)) {
+			printk(KERN_WARNING "[PFQ|%d] orphaning %d zero-copy Tx skbs not completed!\n", so->id,
+			       atomic_read(&so->tx_zc_pending));
+			WRITE_ONCE(so->tx_zc_gen, so->tx_zc_gen + 1);
+			synchronize_rcu();
+		}
+
+		so->tx_flags = 0;
 
 		pr_devel("[PFQ|%d] unmapping shared queue...\n", so->id);
 		pfq_shared_queue_unmap(so);
+
+		pfq_zc_disable(so);
+		so->rx_flags = 0;
 	}
 	else {
 		pr_devel("[PFQ|%d] socket (already) disabled.\n", so->id);
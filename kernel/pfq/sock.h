@@ -74,15 +74,29 @@ struct pfq_sock
         int			egress_queue;
 	int			weight;
 	int			tstamp;
+	int			rx_latency;	/* Rx latency bound (usec, 0 = module default) */
+	int			mem_node;	/* NUMA node of the queues (Q_NODE_ANY, Q_NODE_DEVICE or node) */
 
 	size_t			rx_len;
 	size_t			tx_len;
 
 	size_t			rx_queue_len;
 	size_t			rx_slot_size;
+	unsigned int		rx_flags;	/* Q_ENABLE_RX_PACKED/COMPACT/STREAM layout of the Rx queue */
+	unsigned int		rx_lanes;	/* per-cpu Rx lanes (0 or 1 = single queue) */
+
+	struct sk_buff	      **rx_zc_skb;	/* zero-copy Rx: skbs referenced by the slots */
+	size_t			rx_zc_num;
+	atomic_t		rx_zc_held;	/* zero-copy Rx: skbs currently referenced (see pfq_zc_max_held) */
+
+	int			ring_gid;	/* group ring the socket is attached to (-1 = none) */
+	int			ring_reader;	/* reader of the ring (member slot of the socket in ring_gid) */
 
 	size_t			tx_queue_len;
 	size_t			tx_slot_size;
+	unsigned int		tx_flags;	/* Q_ENABLE_TX_ZEROCOPY, Q_ENABLE_TX_PACKED */
+	atomic_t		tx_zc_pending;	/* zero-copy Tx skbs not completed yet */
+	unsigned int		tx_zc_gen;	/* bumped when the pending zero-copy Tx skbs are orphaned */
 
 	wait_queue_head_t	waitqueue;
 
@@ -97,6 +111,7 @@ struct pfq_sock
 	atomic_long_t		shmem_addr;
 
         pfq_sock_stats_t __percpu *stats;
+	struct pfq_kernel_pacing __percpu *pacing;	/* Tx pacing of the async queues */
 
 } ____pfq_cacheline_aligned;
 
@@ -163,9 +178,12 @@ extern pfq_id_t pfq_sock_get_free_id(struct pfq_sock * so);
 extern int	pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitlen);
 extern struct	pfq_sock * pfq_sock_get_by_id(pfq_id_t id);
 extern int	pfq_sock_counter(void);
+extern void	pfq_sock_rx_latency_update(void);
+extern int	pfq_sock_mem_node(struct pfq_sock *so);
 extern void	pfq_sock_release_id(pfq_id_t id);
 extern int	pfq_sock_tx_bind(struct pfq_sock *so, int tid, int if_index, int queue);
 extern int	pfq_sock_tx_unbind(struct pfq_sock *so);
+extern bool	pfq_sock_tx_zc_wait(struct pfq_sock *so);
 
 extern int	pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem);
 extern int	pfq_sock_disable(struct pfq_sock *so);
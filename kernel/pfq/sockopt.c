@@ -27,8 +27,10 @@
 #include <pfq/bpf.h>
 #include <pfq/devmap.h>
 #include <pfq/endpoint.h>
+#include <pfq/flow_table.h>
 #include <pfq/global.h>
 #include <pfq/group.h>
+#include <pfq/group_ring.h>
 #include <pfq/io.h>
 #include <pfq/memory.h>
 #include <pfq/netdev.h>
@@ -156,6 +158,19 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_TX_PACING:
+        {
+                struct pfq_tx_pacing_stats pacing;
+
+                if (len != sizeof(pacing))
+                        return -EINVAL;
+
+		pfq_kernel_pacing_read(so->pacing, &pacing);
+
+                if (copy_to_user(optval, &pacing, sizeof(pacing)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_RX_TSTAMP:
         {
                 if (len != sizeof(so->tstamp))
@@ -199,6 +214,14 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_RX_LANES:
+        {
+                if (len != sizeof(so->rx_lanes))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_lanes, sizeof(so->rx_lanes)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_TX_SLOTS:
         {
                 if (len != sizeof(so->tx_queue_len))
@@ -209,11 +232,13 @@ int pfq_getsockopt(struct socket *sock,
 
         case Q_SO_GET_GROUPS:
         {
-                unsigned long grps;
-                if(len != sizeof(grps))
+                /* one or more words: groups >= 64 are reported to the callers that ask for them */
+
+                DECLARE_BITMAP(grps, Q_MAX_GID);
+                if (len <= 0 || len % sizeof(unsigned long) || (size_t)len > sizeof(grps))
                         return -EINVAL;
-                grps = pfq_group_get_groups(so->id);
-                if (copy_to_user(optval, &grps, sizeof(grps)))
+                pfq_group_get_groups(so->id, grps);
+                if (copy_to_user(optval, grps, len))
                         return -EFAULT;
         } break;
 
@@ -255,6 +280,75 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_GROUP_LANG_PROFILE:
+        {
+                struct pfq_so_lang_profile prof;
+                struct pfq_lang_computation_tree *comp;
+                struct pfq_lang_node_profile *node;
+                struct pfq_group *group;
+                pfq_gid_t gid;
+                size_t size;
+                bool same;
+
+                if (len != sizeof(prof))
+                        return -EINVAL;
+
+                if (copy_from_user(&prof, optval, sizeof(prof)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)prof.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] lang profile error: gid=%d permission denied!\n",
+                               so->id, gid);
+                        return -EACCES;
+                }
+
+		/* old computations are released after a grace period */
+
+		rcu_read_lock();
+		comp = (struct pfq_lang_computation_tree *)atomic_long_read(&group->comp);
+		size = comp ? comp->size : 0;
+		rcu_read_unlock();
+
+		if (size && prof.size >= size) {
+
+			node = kmalloc_array(size, sizeof(*node), GFP_KERNEL);
+			if (node == NULL)
+				return -ENOMEM;
+
+			rcu_read_lock();
+			comp = (struct pfq_lang_computation_tree *)atomic_long_read(&group->comp);
+			same = comp && comp->size == size;
+			if (same)
+				pfq_lang_profile_read(comp, node);
+			rcu_read_unlock();
+
+			if (!same) {  /* the computation has been replaced */
+				kfree(node);
+				return -EAGAIN;
+			}
+
+			if (copy_to_user(prof.node, node, size * sizeof(*node))) {
+				kfree(node);
+				return -EFAULT;
+			}
+
+			kfree(node);
+		}
+
+		prof.size = size;
+
+                if (copy_to_user(optval, &prof, sizeof(prof)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_GROUP_COUNTERS:
         {
                 struct pfq_group *group;
@@ -293,6 +387,96 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_GROUP_RING:
+        {
+                struct pfq_so_group_ring info;
+                struct pfq_group_ring *ring;
+                struct pfq_group *group;
+                pfq_gid_t gid;
+
+                if (len != sizeof(info))
+                        return -EINVAL;
+
+                if (copy_from_user(&info, optval, sizeof(info)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)info.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: gid=%d not joined!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                pfq_group_lock();
+
+                ring = (struct pfq_group_ring *)atomic_long_read(&group->ring);
+                if (ring) {
+                        info.policy = ring->policy;
+                        info.slots  = ring->slots;
+                        info.caplen = ring->caplen;
+                        info.size   = ring->shmem.size;
+                        info.reader = pfq_group_slot(gid, so->id);
+                }
+
+                pfq_group_unlock();
+
+                if (ring == NULL)
+                        return -ENOENT;
+
+                if (copy_to_user(optval, &info, sizeof(info)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_FLOW_TABLE:
+        {
+                struct pfq_so_group_flow_table info;
+                struct pfq_flow_table *table;
+                struct pfq_group *group;
+                pfq_gid_t gid;
+
+                if (len != sizeof(info))
+                        return -EINVAL;
+
+                if (copy_from_user(&info, optval, sizeof(info)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)info.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] flow table error: gid=%d not joined!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                pfq_group_lock();
+
+                table = (struct pfq_flow_table *)atomic_long_read(&group->flow);
+                if (table) {
+                        info.entries = pfq_flow_table_shared(table)->info.entries;
+                        info.timeout = pfq_flow_table_shared(table)->info.timeout;
+                        info.size    = table->shmem.size;
+                }
+
+                pfq_group_unlock();
+
+                if (table == NULL)
+                        return -ENOENT;
+
+                if (copy_to_user(optval, &info, sizeof(info)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_WEIGHT:
         {
                 if (len != sizeof(so->weight))
@@ -302,6 +486,32 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_RX_LATENCY:
+        {
+                if (len != sizeof(so->rx_latency))
+                        return -EINVAL;
+
+                if (copy_to_user(optval, &so->rx_latency, sizeof(so->rx_latency)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_MEM_NODE:
+        {
+                /* the node the queues landed on or, before enabling, the node they will be allocated on */
+
+                int node;
+
+                if (len != sizeof(node))
+                        return -EINVAL;
+
+                node = atomic_long_read(&so->shmem_addr) ? so->shmem.node : pfq_sock_mem_node(so);
+                if (node == NUMA_NO_NODE)
+                        node = Q_NODE_ANY;
+
+                if (copy_to_user(optval, &node, sizeof(node)))
+                        return -EFAULT;
+        } break;
+
         default:
                 return -EFAULT;
         }
@@ -327,10 +537,13 @@ int pfq_setsockopt(struct socket *sock,
         {
         case Q_SO_ENABLE:
 	{
-		struct pfq_so_enable mem;
+		struct pfq_so_enable mem = { 0 };
                 int err;
 
-                if (optlen != sizeof(mem))
+		/* accept the descriptor without flags as well */
+
+                if (optlen != sizeof(mem) &&
+                    optlen != offsetof(struct pfq_so_enable, flags))
                         return -EINVAL;
 
                 if (copy_from_user(&mem, optval, optlen))
@@ -359,6 +572,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+                int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -385,7 +599,12 @@ int pfq_setsockopt(struct socket *sock,
                         return -EACCES;
                 }
 
-                pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] bind: gid=%d ifindex=%d qindex=%d error!\n", so->id,
+                               bind.gid, bind.ifindex, bind.qindex);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d bind: device ifindex=%d qindex=%d\n",
 					so->id, bind.gid, bind.ifindex, bind.qindex);
@@ -396,6 +615,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+                int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -417,7 +637,12 @@ int pfq_setsockopt(struct socket *sock,
 		}
 #endif
 
-                pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] unbind: gid=%d ifindex=%d qindex=%d error!\n", so->id,
+                               bind.gid, bind.ifindex, bind.qindex);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d unbind: device ifindex=%d qindex=%d\n",
 					so->id, gid, bind.ifindex, bind.qindex);
@@ -521,6 +746,32 @@ int pfq_setsockopt(struct socket *sock,
                 pr_devel("[PFQ|%d] rx_queue: slots=%zu\n", so->id, so->rx_queue_len);
         } break;
 
+        case Q_SO_SET_RX_LANES:
+        {
+                typeof(so->rx_lanes) lanes;
+
+                if (optlen != sizeof(lanes))
+                        return -EINVAL;
+
+                if (copy_from_user(&lanes, optval, optlen))
+                        return -EFAULT;
+
+                if (lanes > Q_MAX_RX_LANES) {
+                        printk(KERN_INFO "[PFQ|%d] invalid Rx lanes=%u (max %d)\n",
+                               so->id, lanes, Q_MAX_RX_LANES);
+                        return -EPERM;
+                }
+
+                if (atomic_long_read(&so->shmem_addr)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx lanes: socket already enabled\n", so->id);
+                        return -EBUSY;
+                }
+
+                so->rx_lanes = lanes;
+
+                pr_devel("[PFQ|%d] rx_queue: lanes=%u\n", so->id, so->rx_lanes);
+        } break;
+
         case Q_SO_SET_TX_SLOTS:
         {
                 typeof (so->tx_queue_len) slots;
@@ -575,23 +826,73 @@ int pfq_setsockopt(struct socket *sock,
                 if (copy_from_user(&weight, optval, optlen))
                         return -EFAULT;
 
-		if (weight < 1 || weight > (Q_MAX_STEERING_MASK/Q_MAX_ID)) {
+		if (weight < 1 || weight > (Q_MAX_STEERING_MASK/Q_MAX_GROUP_SOCK)) {
                         printk(KERN_INFO "[PFQ|%d] weight=%d: invalid range (min 1, max %d)\n", so->id, weight,
-                               Q_MAX_STEERING_MASK/Q_MAX_ID);
+                               Q_MAX_STEERING_MASK/Q_MAX_GROUP_SOCK);
                         return -EPERM;
 		}
 
                 so->weight = weight;
 
-		/* invalidate per-cpu sock mask cache
-                 *
-		 * pfq_invalidate_percpu_eligible_mask(so->id);
-                 */
+		/* rebuild the steering tables of the joined groups */
+
+		pfq_group_steering_update(so->id);
 
                 pr_devel("[PFQ|%d] new weight set to %d.\n", so->id, weight);
 
         } break;
 
+        case Q_SO_SET_RX_LATENCY:
+        {
+                int latency;
+
+                if (optlen != sizeof(so->rx_latency))
+                        return -EINVAL;
+
+                if (copy_from_user(&latency, optval, optlen))
+                        return -EFAULT;
+
+		if (latency < 0 || latency > Q_MAX_RX_LATENCY) {
+                        printk(KERN_INFO "[PFQ|%d] rx latency=%d: invalid range (min 0, max %d usec)\n", so->id, latency,
+                               Q_MAX_RX_LATENCY);
+                        return -EPERM;
+		}
+
+		mutex_lock(&global->socket_lock);
+                so->rx_latency = latency;
+		pfq_sock_rx_latency_update();
+		mutex_unlock(&global->socket_lock);
+
+                pr_devel("[PFQ|%d] rx latency bound set to %d usec.\n", so->id, latency);
+
+        } break;
+
+        case Q_SO_SET_MEM_NODE:
+        {
+                int node;
+
+                if (optlen != sizeof(so->mem_node))
+                        return -EINVAL;
+
+                if (copy_from_user(&node, optval, optlen))
+                        return -EFAULT;
+
+                if (atomic_long_read(&so->shmem_addr)) {
+                        printk(KERN_INFO "[PFQ|%d] memory node: socket already enabled\n", so->id);
+                        return -EPERM;
+                }
+
+                if (node != Q_NODE_ANY && node != Q_NODE_DEVICE &&
+                    (node < 0 || node >= MAX_NUMNODES || !node_online(node))) {
+                        printk(KERN_INFO "[PFQ|%d] memory node=%d: invalid node\n", so->id, node);
+                        return -EINVAL;
+                }
+
+                so->mem_node = node;
+
+                pr_devel("[PFQ|%d] memory node set to %d.\n", so->id, node);
+        } break;
+
         case Q_SO_GROUP_LEAVE:
         {
                 pfq_gid_t gid;
@@ -689,6 +990,35 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_LANG_PROFILE:
+        {
+                struct pfq_so_lang_profile_toggle prof;
+                pfq_gid_t gid;
+
+                if (optlen != sizeof(prof))
+                        return -EINVAL;
+
+                if (copy_from_user(&prof, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)prof.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] lang profile: gid=%d not joined!\n", so->id, prof.gid);
+			return -EACCES;
+		}
+
+		if (pfq_group_set_lang_profile(gid, prof.sample) < 0) {
+                        printk(KERN_INFO "[PFQ|%d] lang profile: gid=%d invalid sampling period %d!\n",
+			       so->id, prof.gid, prof.sample);
+			return -EINVAL;
+		}
+
+                pr_devel("[PFQ|%d] lang profile %s for gid=%d (sample=%d)\n",
+			 so->id, (prof.sample ? "enabled" : "disabled"), prof.gid, prof.sample);
+
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT:
         {
                 struct pfq_so_vlan_toggle filt;
@@ -810,7 +1140,7 @@ int pfq_setsockopt(struct socket *sock,
 
 		if (queue == 0) { /* transmit Tx queue */
 
-			tx_response_t tx = pfq_sk_queue_xmit(so, -1, Q_NO_KTHREAD);
+			tx_response_t tx = pfq_sk_queue_xmit(so, -1, Q_NO_KTHREAD, NULL);
 
 			sparse_add(so->stats, sent, tx.ok);
 			sparse_add(so->stats, fail, tx.fail);
@@ -820,11 +1150,145 @@ int pfq_setsockopt(struct socket *sock,
 			return 0;
 		}
 
+		if (queue > 0 && queue <= Q_MAX_TX_QUEUES) { /* doorbell of an async Tx queue */
+			pfq_tx_thread_doorbell(so, queue - 1);
+			return 0;
+		}
+
 		printk(KERN_INFO "[PFQ|%d] Tx queue: bad queue %d!\n", so->id, queue);
 		return -EPERM;
 
         } break;
 
+        case Q_SO_GROUP_RING_CREATE:
+        {
+                struct pfq_so_group_ring tmp;
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)tmp.gid;
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: gid=%d not joined!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                if (tmp.slots == 0 || tmp.slots > Q_MAX_SOCKQUEUE_LEN) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: invalid slots=%zu (max %d)\n",
+                               so->id, tmp.slots, Q_MAX_SOCKQUEUE_LEN);
+                        return -EPERM;
+                }
+
+                if (PFQ_SHARED_QUEUE_SLOT_SIZE(tmp.caplen) > (size_t)global->max_slot_size) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: invalid caplen=%zu (max slot size = %d)\n",
+                               so->id, tmp.caplen, global->max_slot_size);
+                        return -EPERM;
+                }
+
+                if (tmp.policy != Q_RING_POLICY_BLOCK && tmp.policy != Q_RING_POLICY_DROP) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: invalid policy %d!\n", so->id, tmp.policy);
+                        return -EINVAL;
+                }
+
+                pfq_group_lock();
+                err = pfq_group_ring_create(gid, so->id, tmp.slots, tmp.caplen, tmp.policy);
+                pfq_group_unlock();
+
+                if (err < 0)
+                        return err;
+
+        } break;
+
+        case Q_SO_GROUP_RING_ATTACH:
+        {
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(gid))
+                        return -EINVAL;
+
+                if (copy_from_user(&gid, optval, optlen))
+                        return -EFAULT;
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group ring error: gid=%d not joined!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                pfq_group_lock();
+                err = pfq_group_ring_attach(gid, so);
+                pfq_group_unlock();
+
+                if (err < 0)
+                        return err;
+
+        } break;
+
+        case Q_SO_GROUP_RING_DETACH:
+        {
+                pfq_gid_t gid;
+
+                if (optlen != sizeof(gid))
+                        return -EINVAL;
+
+                if (copy_from_user(&gid, optval, optlen))
+                        return -EFAULT;
+
+                pfq_group_lock();
+                pfq_group_ring_detach(gid, so->id);
+                pfq_group_unlock();
+
+                pr_devel("[PFQ|%d] group ring: detached from gid=%d.\n", so->id, gid);
+
+        } break;
+
+        case Q_SO_GROUP_FLOW_TABLE:
+        {
+                struct pfq_so_group_flow_table tmp;
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)tmp.gid;
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] flow table error: gid=%d not joined!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                if (tmp.entries < Q_FLOW_WAYS || tmp.entries > Q_MAX_FLOW_TABLE_ENTRIES ||
+                    (tmp.entries & (tmp.entries - 1))) {
+                        printk(KERN_INFO "[PFQ|%d] flow table error: invalid entries=%zu (power of 2, %d to %d)\n",
+                               so->id, tmp.entries, Q_FLOW_WAYS, Q_MAX_FLOW_TABLE_ENTRIES);
+                        return -EPERM;
+                }
+
+                if (tmp.timeout == 0 || tmp.timeout > Q_MAX_FLOW_TIMEOUT) {
+                        printk(KERN_INFO "[PFQ|%d] flow table error: invalid timeout=%u msec (max %d)\n",
+                               so->id, tmp.timeout, Q_MAX_FLOW_TIMEOUT);
+                        return -EPERM;
+                }
+
+                pfq_group_lock();
+                err = pfq_flow_table_create(gid, so->id, tmp.entries, tmp.timeout);
+                pfq_group_unlock();
+
+                if (err < 0)
+                        return err;
+
+        } break;
+
         case Q_SO_GROUP_FUNCTION:
         {
                 struct pfq_lang_computation_descr *descr = NULL;
@@ -931,7 +1395,7 @@ int pfq_setsockopt(struct socket *sock,
 		kfree(descr);
                 return 0;
 
-	error:  kfree(comp);
+	error:  pfq_lang_computation_free(comp);
 		kfree(context);
 		kfree(descr);
 		return err;
@@ -219,7 +219,7 @@ struct pfq_spsc_fifo *
 pfq_spsc_init(size_t size, int cpu)
 {
 	struct pfq_spsc_fifo *fifo = (struct pfq_spsc_fifo *)
-		pfq_malloc_pages(sizeof(struct pfq_spsc_fifo) + sizeof(void *)*(size+1), GFP_KERNEL);
+		pfq_malloc_pages_node(sizeof(struct pfq_spsc_fifo) + sizeof(void *)*(size+1), GFP_KERNEL, cpu_to_node(cpu));
 	if (fifo != NULL)
 	{
 		fifo->size = size+1;
@@ -40,6 +40,19 @@ void pfq_kernel_stats_read(struct pfq_kernel_stats __percpu *kstats, struct pfq_
 }
 
 
+void pfq_kernel_pacing_read(struct pfq_kernel_pacing __percpu *kpacing, struct pfq_tx_pacing_stats *pacing)
+{
+	int n;
+
+	pacing->paced = (long unsigned)sparse_read(kpacing, paced);
+	pacing->late  = (long unsigned)sparse_read(kpacing, late);
+	pacing->lag   = (long unsigned)sparse_read(kpacing, lag);
+
+	for(n = 0; n < Q_TX_PACING_BUCKETS; n++)
+		pacing->hist[n] = (long unsigned)sparse_read(kpacing, hist[n]);
+}
+
+
 void pfq_kernel_stats_reset(struct pfq_kernel_stats __percpu *stats)
 {
 	int i;
@@ -92,6 +105,12 @@ void pfq_memory_stats_reset(struct pfq_memory_stats __percpu *stats)
 		local_set(&stat->pool_norecycl[0],  0);
 		local_set(&stat->pool_norecycl[1],  0);
 
+		local_set(&stat->pool_return[0],  0);
+		local_set(&stat->pool_return[1],  0);
+
+		local_set(&stat->pool_grow[0],  0);
+		local_set(&stat->pool_grow[1],  0);
+
 		local_set(&stat->err_shared, 0);
 		local_set(&stat->err_cloned, 0);
 		local_set(&stat->err_memory, 0);
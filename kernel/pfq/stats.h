@@ -45,6 +45,15 @@ struct pfq_kernel_stats
 };
 
 
+struct pfq_kernel_pacing
+{
+	local_t paced;
+	local_t late;
+	local_t lag;
+	local_t hist[Q_TX_PACING_BUCKETS];
+};
+
+
 typedef struct pfq_kernel_stats	pfq_sock_stats_t;
 typedef struct pfq_kernel_stats	pfq_group_stats_t;
 typedef struct pfq_kernel_stats	pfq_global_stats_t;
@@ -65,6 +74,8 @@ struct pfq_memory_stats
 	local_t pool_pop[2];
 	local_t pool_empty[2];
 	local_t pool_norecycl[2];
+	local_t pool_return[2];		/* skbs freed on a cpu other than their owner */
+	local_t pool_grow[2];
 
 	local_t err_shared;
 	local_t err_cloned;
@@ -92,6 +103,8 @@ struct pfq_pool_stats
 	uint64_t pool_pop[2];
 	uint64_t pool_empty[2];
 	uint64_t pool_norecycl[2];
+	uint64_t pool_return[2];
+	uint64_t pool_grow[2];
 
 	uint64_t err_shared;
 	uint64_t err_cloned;
@@ -112,6 +125,7 @@ struct pfq_pool_stats
 
 extern void pfq_kernel_stats_read(struct pfq_kernel_stats __percpu *kstats, struct pfq_stats *stats);
 extern void pfq_kernel_stats_reset(struct pfq_kernel_stats __percpu *stats);
+extern void pfq_kernel_pacing_read(struct pfq_kernel_pacing __percpu *kpacing, struct pfq_tx_pacing_stats *pacing);
 extern void pfq_group_counters_reset(struct pfq_group_counters __percpu *counters);
 extern void pfq_memory_stats_reset(struct pfq_memory_stats __percpu *stats);
 
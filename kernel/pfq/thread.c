@@ -22,6 +22,7 @@
  ****************************************************************/
 
 #include <pfq/define.h>
+#include <pfq/global.h>
 #include <pfq/io.h>
 #include <pfq/memory.h>
 #include <pfq/sock.h>
@@ -33,10 +34,16 @@
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/jiffies.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
 
 
 static DEFINE_MUTEX(pfq_thread_tx_pool_lock);
 
+/* Tx scheduler lock: protects the queues of all the Tx threads (binding, stealing) */
+
+static DEFINE_SPINLOCK(pfq_tx_sched_lock);
+
 
 static struct pfq_thread_tx_data pfq_thread_tx_pool[Q_MAX_CPU] =
 {
@@ -44,12 +51,19 @@ static struct pfq_thread_tx_data pfq_thread_tx_pool[Q_MAX_CPU] =
 		.id	= -1,
 		.cpu    = -1,
 		.task	= NULL,
-		.sock   = {NULL, NULL, NULL, NULL},
-		.sock_queue = {{-1}, {-1}, {-1}, {-1}}
 	}
 };
 
 
+struct pfq_thread_tx_data *
+pfq_get_tx_thread(int tid)
+{
+	if (tid < 0 || tid >= global->tx_cpu_nr)
+		return NULL;
+	return &pfq_thread_tx_pool[tid];
+}
+
+
 #ifdef PFQ_DEBUG
 static void
 pfq_thread_ping(const char *type, struct pfq_thread_data const *data)
@@ -64,10 +78,174 @@ pfq_thread_ping(const char *type, struct pfq_thread_data const *data)
 
 
 
+/*
+ * Tx pacing: sleep until the busy-wait window of the earliest timestamp,
+ * in slices of at most 1 msec (not to delay the socket unbinding).
+ */
+
+static void
+pfq_tx_thread_pace(uint64_t ts)
+{
+	s64 delta = (s64)(ts - (uint64_t)global->tx_pace_spin) - ktime_to_ns(ktime_get_real());
+	unsigned long usec;
+
+	if (delta <= 0) {
+		pfq_relax();
+		return;
+	}
+
+	usec = (unsigned long)min_t(s64, div_s64(delta, 1000), 1000);
+	if (usec)
+		usleep_range(usec, usec + 10);
+	else
+		pfq_relax();
+}
+
+
+static void
+pfq_tx_thread_ring(struct pfq_thread_tx_data *data)
+{
+	atomic_set(&data->ring, 1);
+	wake_up_interruptible(&data->doorbell);
+}
+
+
+/*
+ * work stealing: an idle thread takes a queue with a backlog from the most
+ * loaded thread (one with at least two queues with a backlog).
+ */
+
+static bool
+pfq_tx_thread_steal(struct pfq_thread_tx_data *thief)
+{
+	struct pfq_thread_tx_data *victim = NULL;
+	struct pfq_tx_entry *e;
+	bool ret = false;
+	int n;
+
+	spin_lock(&pfq_tx_sched_lock);
+
+	for(n = 0; n < global->tx_cpu_nr; n++)
+	{
+		struct pfq_thread_tx_data *data = &pfq_thread_tx_pool[n];
+		if (data != thief && data->backlog > 1 && (!victim || data->backlog > victim->backlog))
+			victim = data;
+	}
+
+	if (victim) {
+		list_for_each_entry(e, &victim->queues, list)
+		{
+			if (e->backlog && !e->busy) {
+				list_move_tail(&e->list, &thief->queues);
+				e->thread = thief;
+				victim->nr_queues--;
+				victim->backlog--;
+				thief->nr_queues++;
+				thief->backlog++;
+				thief->steals++;
+				ret = true;
+				break;
+			}
+		}
+	}
+
+	spin_unlock(&pfq_tx_sched_lock);
+	return ret;
+}
+
+
+/*
+ * sleep until a doorbell: the flag in the shared queues is armed first, then the
+ * queues are checked again not to miss the packets queued in the meantime.
+ */
+
+static void
+pfq_tx_thread_sleep(struct pfq_thread_tx_data *data)
+{
+	struct pfq_tx_entry *e;
+	bool pending = false;
+
+	spin_lock(&pfq_tx_sched_lock);
+	list_for_each_entry(e, &data->queues, list)
+		pending |= pfq_sk_queue_doorbell(e->sock, e->sock_queue, true);
+	spin_unlock(&pfq_tx_sched_lock);
+
+	if (!pending) {
+		data->sleeps++;
+		if (wait_event_interruptible_timeout(data->doorbell, atomic_read(&data->ring) || kthread_should_stop(), HZ) > 0)
+			data->wakeups++;
+	}
+
+	atomic_set(&data->ring, 0);
+
+	spin_lock(&pfq_tx_sched_lock);
+	list_for_each_entry(e, &data->queues, list)
+		pfq_sk_queue_doorbell(e->sock, e->sock_queue, false);
+	spin_unlock(&pfq_tx_sched_lock);
+}
+
+
+/*
+ * Tx aggregation: pick the head queue along with the idle queues bound to the
+ * same device queue, and move them to the tail (Tx scheduler lock held).
+ */
+
+static int
+pfq_tx_thread_pick(struct pfq_thread_tx_data *data, struct pfq_tx_entry **group)
+{
+	struct pfq_tx_entry *e, *head;
+	int n, num = 0;
+
+	head = list_first_entry_or_null(&data->queues, struct pfq_tx_entry, list);
+	if (!head)
+		return 0;
+
+	group[num++] = head;
+
+	list_for_each_entry(e, &data->queues, list)
+	{
+		if (num == global->tx_aggr)
+			break;
+
+		if (e != head &&
+		    e->ifindex == head->ifindex &&
+		    e->queue == head->queue &&
+		    net_eq(e->net, head->net))
+			group[num++] = e;
+	}
+
+	for(n = 0; n < num; n++)
+		list_move_tail(&group[n]->list, &data->queues);
+
+	return num;
+}
+
+
+static void
+pfq_tx_thread_util(struct pfq_thread_tx_data *data, uint64_t now)
+{
+	if (now - data->window_ns >= NSEC_PER_SEC) {
+		data->util = (int)div64_u64((data->busy_ns - data->window_busy_ns) * 1000, now - data->window_ns);
+		data->window_ns = now;
+		data->window_busy_ns = data->busy_ns;
+	}
+}
+
+
+/*
+ * Tx thread: the socket queues are served in deficit round-robin (tx_quantum
+ * bytes per round); the ones bound to the same device queue are transmitted
+ * together, in a single burst (up to tx_aggr queues). When a round makes no progress for tx_idle usec, the thread
+ * tries to steal a queue from an overloaded thread, then sleeps until a doorbell.
+ */
+
 static int
 pfq_tx_thread(void *_data)
 {
 	struct pfq_thread_tx_data *data = (struct pfq_thread_tx_data *)_data;
+	uint64_t next = 0, idle_since;
+	bool progress = false;
+	int picks = 0;
 
 #ifdef PFQ_DEBUG
         int now = 0;
@@ -82,36 +260,79 @@ pfq_tx_thread(void *_data)
 
 	__set_current_state(TASK_RUNNING);
 
+	idle_since = data->window_ns = ktime_to_ns(ktime_get());
+
         for(;;)
 	{
-		/* transmit the registered socket's queues */
-		bool reg = false;
-		int total_sent = 0, n;
+		struct pfq_tx_entry *group[Q_TX_AGGR_MAX];
+		struct pfq_tx_member members[Q_TX_AGGR_MAX];
+		struct pfq_tx_sched sched[Q_TX_AGGR_MAX];
+		uint64_t t0, t1;
+		int n, num;
 
-		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
+                if (kthread_should_stop())
+                        break;
+
+		/* pick the next socket queue(s) */
+
+		spin_lock(&pfq_tx_sched_lock);
+		num = pfq_tx_thread_pick(data, group);
+		for(n = 0; n < num; n++)
 		{
-			struct pfq_sock *sock;
-			int sock_queue;
-			tx_response_t tx;
+			struct pfq_tx_entry *e = group[n];
+			e->busy = true;
+			e->deficit += (size_t)global->tx_quantum;
+			sched[n] = (struct pfq_tx_sched){ .deficit = e->deficit };
+			members[n] = (struct pfq_tx_member){ .so = e->sock, .sock_queue = e->sock_queue, .sched = &sched[n] };
+		}
+		spin_unlock(&pfq_tx_sched_lock);
 
-			sock_queue = atomic_read(&data->sock_queue[n]);
-			smp_rmb();
-			sock = data->sock[n];
+		t0 = ktime_to_ns(ktime_get());
 
-			if (sock_queue != -1 && sock != NULL) {
-				reg = true;
-				tx = pfq_sk_queue_xmit(sock, sock_queue, data->cpu);
-				total_sent += tx.ok;
+		if (num) {
+			bool sent = false;
+
+			pfq_sk_queues_xmit(members, num, data->cpu);
+			data->bursts++;
+
+			for(n = 0; n < num; n++)
+			{
+				struct pfq_sock *sock = members[n].so;
+				tx_response_t tx = members[n].rc;
 
 				sparse_add(sock->stats,	  sent, tx.ok);
 				sparse_add(sock->stats,   fail, tx.fail);
 				sparse_add(global->percpu_stats,  sent, tx.ok);
 				sparse_add(global->percpu_stats,  fail, tx.fail);
+
+				if (tx.ok + tx.fail) {
+					sent = true;
+					data->sent += tx.ok;
+				}
+
+				if (sched[n].next_ts && (next == 0 || sched[n].next_ts < next))
+					next = sched[n].next_ts;
 			}
-		}
 
-                if (kthread_should_stop())
-                        break;
+			if (sent) {
+				progress = true;
+				data->busy_ns += ktime_to_ns(ktime_get()) - t0;
+			}
+
+			/* the deficit is kept only while the queue has a backlog */
+
+			spin_lock(&pfq_tx_sched_lock);
+			for(n = 0; n < num; n++)
+			{
+				struct pfq_tx_entry *e = group[n];
+				e->deficit = sched[n].backlog ? sched[n].deficit : 0;
+				if (e->thread == data && e->backlog != sched[n].backlog)
+					data->backlog += sched[n].backlog ? 1 : -1;
+				e->backlog = sched[n].backlog;
+				smp_store_release(&e->busy, false);
+			}
+			spin_unlock(&pfq_tx_sched_lock);
+		}
 
 #ifdef PFQ_DEBUG
 		if (now != jiffies/(HZ*10)) {
@@ -119,12 +340,42 @@ pfq_tx_thread(void *_data)
 			pfq_thread_ping("Tx", (struct pfq_thread_data *)data);
 		}
 #endif
+		/* end of the round? */
+
+		picks += max(num, 1);
+		if (picks < READ_ONCE(data->nr_queues))
+			continue;
+
+		picks = 0;
+		t1 = ktime_to_ns(ktime_get());
+		pfq_tx_thread_util(data, t1);
+
+		if (progress || READ_ONCE(data->backlog)) {
+			progress = false;
+			next = 0;
+			idle_since = t1;
+			continue;
+		}
+
+		if (next) {
+			pfq_tx_thread_pace(next);
+			next = 0;
+			idle_since = t1;
+			continue;
+		}
+
+		/* idle round */
 
-		if (total_sent == 0)
+		if (t1 - idle_since < (uint64_t)global->tx_idle * NSEC_PER_USEC) {
 			pfq_relax();
+			continue;
+		}
+
+		if (pfq_tx_thread_steal(data))
+			continue;
 
-		if (!reg)
-			msleep(1);
+		pfq_tx_thread_sleep(data);
+		idle_since = ktime_to_ns(ktime_get());
 	}
 
         printk(KERN_INFO "[PFQ] Tx[%d] thread stopped on cpu %d.\n", data->id, data->cpu);
@@ -137,7 +388,7 @@ int
 pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 {
 	struct pfq_thread_tx_data *thread_data;
-	int n;
+	struct pfq_tx_entry *e;
 
 	if (tid >= global->tx_cpu_nr) {
 		printk(KERN_INFO "[PFQ] Tx[%d] thread not available (%d Tx threads running)!\n", tid, global->tx_cpu_nr);
@@ -146,23 +397,27 @@ pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 
 	thread_data = &pfq_thread_tx_pool[tid];
 
-	mutex_lock(&pfq_thread_tx_pool_lock);
-
-	for(n = 0; n < Q_MAX_TX_QUEUES; n++)
-	{
-		if (atomic_read(&thread_data->sock_queue[n]) == -1)
-			break;
+	e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (!e) {
+		printk(KERN_INFO "[PFQ] Tx[%d] thread: out of memory!\n", tid);
+		return -ENOMEM;
 	}
 
-	if (n == Q_MAX_TX_QUEUES) {
-		mutex_unlock(&pfq_thread_tx_pool_lock);
-		printk(KERN_INFO "[PFQ] Tx[%d] thread busy (no queue available)!\n", tid);
-		return -EBUSY;
-	}
+	e->thread = thread_data;
+	e->sock = sock;
+	e->sock_queue = sock_queue;
+	e->net = sock_net(&sock->sk);
+	e->ifindex = sock->tx_async[sock_queue].ifindex;
+	e->queue = sock->tx_async[sock_queue].queue;
 
-	thread_data->sock[n] = sock;
-	smp_wmb();
-	atomic_set(&thread_data->sock_queue[n], sock_queue);
+	mutex_lock(&pfq_thread_tx_pool_lock);
+
+	spin_lock(&pfq_tx_sched_lock);
+	list_add_tail(&e->list, &thread_data->queues);
+	thread_data->nr_queues++;
+	spin_unlock(&pfq_tx_sched_lock);
+
+	pfq_tx_thread_ring(thread_data);
 
         mutex_unlock(&pfq_thread_tx_pool_lock);
         printk(KERN_INFO "[PFQ] Tx[%d] thread bound to sock_id = %d, queue = %d...\n", tid, sock->id, sock_queue);
@@ -170,35 +425,83 @@ pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 }
 
 
+/*
+ * The Tx path can sleep, hence Tx threads are not RCU readers: once a queue is
+ * removed from a thread, it's enough to wait for the thread to complete its service.
+ */
+
 int
 pfq_unbind_tx_thread(struct pfq_sock *sock)
 {
-	int n, i;
+	struct pfq_tx_entry *e, *tmp;
+	LIST_HEAD(unbound);
+	int n;
+
 	mutex_lock(&pfq_thread_tx_pool_lock);
 
+	spin_lock(&pfq_tx_sched_lock);
+
 	for(n = 0; n < global->tx_cpu_nr; n++)
 	{
 		struct pfq_thread_tx_data *data = &pfq_thread_tx_pool[n];
 
-		for(i = 0; i < Q_MAX_TX_QUEUES; i++)
+		list_for_each_entry_safe(e, tmp, &data->queues, list)
 		{
-			if (atomic_read(&data->sock_queue[i]) != -1)
-			{
-				if (data->sock[i] == sock) {
-					atomic_set(&data->sock_queue[i], -1);
-					smp_wmb();
-					msleep(Q_GRACE_PERIOD);
-					data->sock[i] = NULL;
-				}
+			if (e->sock == sock) {
+				list_move(&e->list, &unbound);
+				e->thread = NULL;
+				data->nr_queues--;
+				if (e->backlog)
+					data->backlog--;
 			}
 		}
 	}
 
+	spin_unlock(&pfq_tx_sched_lock);
+
+	list_for_each_entry_safe(e, tmp, &unbound, list)
+	{
+		while (smp_load_acquire(&e->busy))
+			usleep_range(10, 100);
+
+		list_del(&e->list);
+		kfree(e);
+	}
+
         mutex_unlock(&pfq_thread_tx_pool_lock);
         return 0;
 }
 
 
+/*
+ * doorbell: wake up the Tx thread serving the given async queue of the socket
+ */
+
+void
+pfq_tx_thread_doorbell(struct pfq_sock *sock, int sock_queue)
+{
+	struct pfq_tx_entry *e;
+	int n;
+
+	spin_lock(&pfq_tx_sched_lock);
+
+	for(n = 0; n < global->tx_cpu_nr; n++)
+	{
+		struct pfq_thread_tx_data *data = &pfq_thread_tx_pool[n];
+
+		list_for_each_entry(e, &data->queues, list)
+		{
+			if (e->sock == sock && e->sock_queue == sock_queue) {
+				pfq_tx_thread_ring(data);
+				goto done;
+			}
+		}
+	}
+done:
+	spin_unlock(&pfq_tx_sched_lock);
+}
+
+
 int
 pfq_start_tx_threads(void)
 {
@@ -217,6 +520,13 @@ pfq_start_tx_threads(void)
 
 			data->id = n;
 			data->cpu = global->tx_cpu[n];
+
+			INIT_LIST_HEAD(&data->queues);
+			data->nr_queues = 0;
+			data->backlog = 0;
+			init_waitqueue_head(&data->doorbell);
+			atomic_set(&data->ring, 0);
+
 			data->task = kthread_create_on_node(pfq_tx_thread,
 							    data, node,
 							    "kpfq-Tx/%d", data->cpu);
@@ -255,7 +565,7 @@ pfq_stop_tx_threads(void)
 
 			if (data->task)
 			{
-				int i;
+				struct pfq_tx_entry *e, *tmp;
 				pr_devel("[PFQ stopping Tx[%d] thread@%p\n", data->id, data->task);
 
 				kthread_stop(data->task);
@@ -263,11 +573,15 @@ pfq_stop_tx_threads(void)
 				data->cpu  = -1;
 				data->task = NULL;
 
-				for(i=0; i < Q_MAX_TX_QUEUES; ++i)
-				{
-					atomic_set(&data->sock_queue[i], -1);
-					data->sock[i] = NULL;
+				/* sockets are closed by now, release the queues left */
+
+				list_for_each_entry_safe(e, tmp, &data->queues, list) {
+					list_del(&e->list);
+					kfree(e);
 				}
+
+				data->nr_queues = 0;
+				data->backlog = 0;
 			}
 		}
 	}
@@ -27,11 +27,14 @@
 #include <pfq/define.h>
 
 #include <linux/kthread.h>
+#include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
+#include <linux/wait.h>
 
 
 struct pfq_sock;
+struct net;
 
 extern struct task_struct *kthread_tx_pool [Q_MAX_CPU];
 
@@ -39,6 +42,9 @@ extern int  pfq_start_tx_threads(void);
 extern void pfq_stop_tx_threads(void);
 extern int  pfq_bind_tx_thread(int tx_index, struct pfq_sock *sock, int sock_queue);
 extern int  pfq_unbind_tx_thread(struct pfq_sock *sock);
+extern void pfq_tx_thread_doorbell(struct pfq_sock *sock, int sock_queue);
+
+extern struct pfq_thread_tx_data *pfq_get_tx_thread(int tid);
 
 extern int pfq_check_threads_affinity(void);
 extern int pfq_check_napi_contexts(void);
@@ -51,6 +57,23 @@ struct pfq_thread_data
 };
 
 
+/* a socket queue served by a Tx kthread */
+
+struct pfq_tx_entry
+{
+	struct list_head		 list;
+	struct pfq_thread_tx_data	*thread;	/* owner (NULL once unbound) */
+	struct pfq_sock			*sock;
+	int				 sock_queue;
+	struct net			*net;		/* device queue (Tx aggregation) */
+	int				 ifindex;
+	int				 queue;
+	size_t				 deficit;	/* deficit round-robin (bytes) */
+	bool				 backlog;	/* packets left in the queue at the last service */
+	bool				 busy;		/* in service */
+};
+
+
 struct pfq_thread_tx_data
 {
 	int			id;
@@ -59,8 +82,25 @@ struct pfq_thread_tx_data
 
 	/* specific for Tx data */
 
-	struct pfq_sock *	sock[Q_MAX_TX_QUEUES];
-	atomic_t		sock_queue[Q_MAX_TX_QUEUES];
+	struct list_head	queues;		/* pfq_tx_entry (Tx scheduler lock) */
+	int			nr_queues;
+	int			backlog;	/* queues with a backlog */
+
+	wait_queue_head_t	doorbell;
+	atomic_t		ring;
+
+	/* utilization */
+
+	uint64_t		busy_ns;
+	uint64_t		window_ns;
+	uint64_t		window_busy_ns;
+	int			util;		/* permille, over the last second */
+
+	unsigned long		sent;
+	unsigned long		bursts;		/* device queue locks */
+	unsigned long		steals;
+	unsigned long		sleeps;
+	unsigned long		wakeups;
 
 } ____pfq_cacheline_aligned;
 
@@ -30,7 +30,10 @@ static void pfq_timer(unsigned long cpu)
 {
 	struct pfq_percpu_data *data;
 
-	pfq_receive(NULL, NULL);
+	pfq_receive_flush(Q_FLUSH_HEARTBEAT);
+#ifdef PFQ_USE_SKB_POOL
+	pfq_skb_pool_return_flush();
+#endif
 	data = per_cpu_ptr(global->percpu_data, cpu);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 31) || LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
@@ -55,6 +58,26 @@ void pfq_setup_timer(struct timer_list *timer, unsigned long cpu)
 
 
 
+/*
+ * Latency bound: the hrtimer is armed (pinned) when the first packet enters an
+ * empty batch. It fires in hard-irq context, hence the flush is deferred to a
+ * tasklet, which runs on the same cpu, serialized with the Rx softirq.
+ */
+
+static void pfq_flush_tasklet(unsigned long cpu)
+{
+	pfq_receive_flush(Q_FLUSH_TIMER);
+}
+
+
+static enum hrtimer_restart pfq_flush_timer(struct hrtimer *timer)
+{
+	struct pfq_percpu_data *data = container_of(timer, struct pfq_percpu_data, flush_timer);
+	tasklet_schedule(&data->flush_tasklet);
+	return HRTIMER_NORESTART;
+}
+
+
 void pfq_timer_init(void)
 {
 	int cpu;
@@ -83,3 +106,33 @@ void pfq_timer_fini(void)
 }
 
 
+/* the flush timers are armed by the Rx path: initialize them before any socket
+ * can be opened and finalize them when no Rx path can run anymore */
+
+void pfq_flush_timer_init(void)
+{
+	int cpu;
+	for_each_present_cpu(cpu)
+	{
+                struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
+
+		hrtimer_init(&data->flush_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+		data->flush_timer.function = pfq_flush_timer;
+		tasklet_init(&data->flush_tasklet, pfq_flush_tasklet, (unsigned long)cpu);
+	}
+}
+
+
+void pfq_flush_timer_fini(void)
+{
+	int cpu;
+	for_each_present_cpu(cpu)
+	{
+                struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
+
+		hrtimer_cancel(&data->flush_timer);
+		tasklet_kill(&data->flush_tasklet);
+	}
+}
+
+
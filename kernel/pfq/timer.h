@@ -30,5 +30,8 @@
 extern void pfq_timer_init(void);
 extern void pfq_timer_fini(void);
 
+extern void pfq_flush_timer_init(void);
+extern void pfq_flush_timer_fini(void);
+
 #endif /* PFQ_TIMER_H */
 
@@ -0,0 +1,202 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/global.h>
+#include <pfq/memory.h>
+#include <pfq/percpu.h>
+#include <pfq/pool.h>
+#include <pfq/printk.h>
+#include <pfq/sock.h>
+#include <pfq/zcopy.h>
+
+#include <linux/capability.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+
+
+size_t pfq_zc_area_size(void)
+{
+	return (size_t)nr_cpu_ids * pfq_zc_stride();
+}
+
+
+int pfq_zc_enable(struct pfq_sock *so)
+{
+#ifdef PFQ_USE_SKB_POOL
+	size_t slot_size;
+
+	if (so->rx_zc_skb)
+		return 0;
+
+	/* the area exposes the pools shared by every socket, group and the kernel */
+
+	if (!global->rx_zerocopy) {
+		printk(KERN_INFO "[PFQ|%d] zero-copy Rx: disabled (see the rx_zerocopy module parameter)!\n", so->id);
+		return -EPERM;
+	}
+
+	if (!capable(CAP_NET_ADMIN)) {
+		printk(KERN_INFO "[PFQ|%d] zero-copy Rx: CAP_NET_ADMIN required!\n", so->id);
+		return -EPERM;
+	}
+
+	if (atomic_long_read(&so->shmem_addr)) {
+		printk(KERN_INFO "[PFQ|%d] zero-copy Rx: socket already enabled!\n", so->id);
+		return -EBUSY;
+	}
+
+	/* the chunks of a pool are mapped back to back */
+
+	if ((PFQ_POOL_CHUNK * (size_t)global->max_slot_size) % PAGE_SIZE) {
+		printk(KERN_INFO "[PFQ|%d] zero-copy Rx: max_slot_size=%d not allowed (chunks not page aligned)!\n", so->id, global->max_slot_size);
+		return -EPERM;
+	}
+
+	slot_size = PFQ_SHARED_QUEUE_SLOT_SIZE(so->rx_len + sizeof(struct pfq_pkt_ref));
+	if (slot_size > (size_t)global->max_slot_size) {
+		printk(KERN_INFO "[PFQ|%d] zero-copy Rx: invalid caplen=%zu (max slot size = %d)\n", so->id, so->rx_len, global->max_slot_size);
+		return -EPERM;
+	}
+
+	/* the area maps the Rx pools of all the cpus: create them now */
+
+	if (pfq_skb_pool_rx_create_all() < 0) {
+		printk(KERN_WARNING "[PFQ|%d] zero-copy Rx: could not create the skb pools!\n", so->id);
+		return -ENOMEM;
+	}
+
+	so->rx_zc_skb = vzalloc(2 * so->rx_queue_len * sizeof(struct sk_buff *));
+	if (!so->rx_zc_skb) {
+		printk(KERN_WARNING "[PFQ|%d] zero-copy Rx: out of memory!\n", so->id);
+		return -ENOMEM;
+	}
+
+	so->rx_zc_num = 2 * so->rx_queue_len;
+	atomic_set(&so->rx_zc_held, 0);
+	so->rx_slot_size = slot_size;
+
+	pr_devel("[PFQ|%d] zero-copy Rx: rx_slot_size=%zu area=%zu bytes\n", so->id, so->rx_slot_size, pfq_zc_area_size());
+	return 0;
+#else
+	printk(KERN_INFO "[PFQ|%d] zero-copy Rx: skb pool not available!\n", so->id);
+	return -EPERM;
+#endif
+}
+
+
+void pfq_zc_disable(struct pfq_sock *so)
+{
+	size_t n, held = 0;
+
+	if (!so->rx_zc_skb)
+		return;
+
+	/* give the skbs still referenced by the slots back to their pools */
+
+	local_bh_disable();
+
+	for(n = 0; n < so->rx_zc_num; n++)
+	{
+		struct sk_buff *skb = xchg(&so->rx_zc_skb[n], NULL);
+		if (skb) {
+			pfq_zc_release(skb);
+			held++;
+		}
+	}
+
+	local_bh_enable();
+
+	vfree(so->rx_zc_skb);
+
+	so->rx_zc_skb = NULL;
+	so->rx_zc_num = 0;
+	atomic_set(&so->rx_zc_held, 0);
+	so->rx_slot_size = PFQ_SHARED_QUEUE_SLOT_SIZE(so->rx_len);
+
+	pr_devel("[PFQ|%d] zero-copy Rx: %zu skbs released.\n", so->id, held);
+}
+
+
+int pfq_zc_mmap(struct pfq_sock *so, struct vm_area_struct *vma)
+{
+	unsigned long size = (unsigned long)(vma->vm_end - vma->vm_start);
+	size_t stride = pfq_zc_stride();
+	size_t chunk = PFQ_POOL_CHUNK * (size_t)global->max_slot_size;
+	int cpu;
+
+	if (!so->rx_zc_skb) {
+		printk(KERN_WARNING "[PFQ|%d] error: zero-copy mmap: Rx zero-copy not enabled!\n", so->id);
+		return -EINVAL;
+	}
+
+	if (size > pfq_zc_area_size()) {
+		printk(KERN_WARNING "[PFQ|%d] error: zero-copy mmap: area too large!\n", so->id);
+		return -EINVAL;
+	}
+
+	if (vma->vm_flags & VM_WRITE) {
+		printk(KERN_WARNING "[PFQ|%d] error: zero-copy mmap: the area is read-only!\n", so->id);
+		return -EPERM;
+	}
+
+	/* the socket might have been handed over to a less privileged process */
+
+	if (!global->rx_zerocopy || !capable(CAP_NET_ADMIN)) {
+		printk(KERN_WARNING "[PFQ|%d] error: zero-copy mmap: not allowed!\n", so->id);
+		return -EPERM;
+	}
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND;
+
+	/* the pool of each cpu is mapped chunk by chunk, at cpu * stride */
+
+	for_each_present_cpu(cpu)
+	{
+		struct pfq_percpu_pool *pool = per_cpu_ptr(global->percpu_pool, cpu);
+		size_t n;
+
+		if (!pool || !pool->rx.fifo)
+			continue;
+
+		for(n = 0; n < pool->rx.chunks; n++)
+		{
+			unsigned long off = (unsigned long)cpu * stride + (unsigned long)(n * chunk);
+
+			if (off >= size)
+				break;
+
+			if (remap_pfn_range(vma, vma->vm_start + off,
+					    virt_to_phys(pool->rx.data[n]) >> PAGE_SHIFT,
+					    min3(chunk, stride - n * chunk, (size_t)(size - off)),
+					    vma->vm_page_prot) != 0) {
+				printk(KERN_WARNING "[PFQ|%d] error: zero-copy mmap: remap_pfn_range failed (cpu=%d)!\n", so->id, cpu);
+				return -EAGAIN;
+			}
+		}
+	}
+
+	printk(KERN_INFO "[PFQ|%d] zero-copy Rx area: %lu bytes mapped.\n", so->id, size);
+	return 0;
+}
+
@@ -0,0 +1,111 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_ZCOPY_H
+#define PFQ_ZCOPY_H
+
+#include <pfq/global.h>
+#include <pfq/memory.h>
+#include <pfq/qbuff.h>
+#include <pfq/skbuff.h>
+
+#include <linux/mm.h>
+#include <linux/pf_q.h>
+
+struct pfq_sock;
+
+
+extern int	pfq_zc_enable(struct pfq_sock *so);
+extern void	pfq_zc_disable(struct pfq_sock *so);
+extern int	pfq_zc_mmap(struct pfq_sock *so, struct vm_area_struct *vma);
+extern size_t	pfq_zc_area_size(void);
+
+
+/* each cpu exposes the data of its Rx skb pool at cpu * stride in the zero-copy area */
+
+static inline
+size_t pfq_zc_stride(void)
+{
+	return PAGE_ALIGN((size_t)global->max_pool_size * (size_t)global->max_slot_size);
+}
+
+
+static inline
+uint64_t pfq_zc_offset(struct sk_buff const *skb)
+{
+	return (uint64_t)PFQ_CB(skb)->cpu * pfq_zc_stride()
+	     + (uint64_t)PFQ_CB(skb)->id * (uint64_t)global->max_slot_size
+	     + (uint64_t)(skb->data - skb->head);
+}
+
+
+/* a packet can be handed over to the socket only if it's a linear Rx pool skb
+ * that no other endpoint (socket, device or kernel) is going to use */
+
+static inline
+bool pfq_zc_eligible(struct qbuff const *buff, size_t bytes)
+{
+	struct sk_buff const *skb = QBUFF_SKB(buff);
+
+	return  skb->peeked					&&
+		PFQ_CB(skb)->pool == 0				&&
+		PFQ_CB(skb)->head == skb->head			&&
+		(buff->fwd_mask & (buff->fwd_mask - 1)) == 0	&&
+		buff->fwd_banks == 0				&&
+		buff->ring_mask == 0				&&
+		buff->fwd_dev_num == 0				&&
+		!buff->to_kernel				&&
+		skb_headlen(skb) >= bytes			&&
+		atomic_read(&skb->users) == 1			&&
+		!skb_cloned(skb);
+}
+
+
+/* skbs a socket may hold at once: half of a pool, so that a zero-copy socket
+ * (up to 2 x rx_queue_len slots) cannot drain the pools of the other sockets */
+
+static inline
+int pfq_zc_max_held(void)
+{
+	return global->max_pool_size / 2;
+}
+
+
+/* release an skb held by a slot (bottom halves disabled): it goes back to the
+ * Rx pool of the cpu that allocated it, pushed in the fifo only if this cpu is
+ * the owner (the single producer), handed over to the owner otherwise */
+
+static inline
+void pfq_zc_release(struct sk_buff *skb)
+{
+	struct pfq_skb_pool *local = &this_cpu_ptr(global->percpu_pool)->rx;
+	struct pfq_skb_pool *owner = pfq_skb_pool_owner(skb);
+
+	if (owner == local)
+		pfq_free_skb_pool(skb, local);
+	else
+		pfq_skb_pool_return(skb, owner);
+}
+
+
+#endif /* PFQ_ZCOPY_H */
@@ -450,6 +450,16 @@ namespace pfq { namespace lang {
 
         auto icmp_code  = property("icmp_code");
 
+        //! Evaluate to the state of the flow in the flow table of the group (Q_FLOW_STATE_*).
+        /*! Nothing if the flow is not tracked. Example:
+         *
+         * flow_count >> when (flow_state == Q_FLOW_STATE_ESTABLISHED, steer_flow)
+         *
+         * \see flow_count
+         */
+
+        auto flow_state = property("flow_state");
+
         //
         // default network functions:
         //
@@ -886,6 +896,24 @@ namespace pfq { namespace lang {
 
         auto dec            = [] (int value) { return function("dec", value); };
 
+        //! Account the packet to its flow, in the flow table of the group.
+        /*
+         * The table is created with pfq_group_flow_table_create. Example:
+         *
+         * ip >> flow_count >> steer_flow
+         */
+
+        auto flow_count     = function("flow_count");
+
+        //! Pass the first n packets of each flow (accounted as \c flow_count does).
+        /*
+         * The packets of the flows that are not tracked pass. Example:
+         *
+         * tcp >> flow_first (10) >> steer_flow
+         */
+
+        auto flow_first     = [] (int value) { return function("flow_first", value); };
+
         //! Monadic version of \c is_l3_proto predicate.
         /*!
          * Predicates are used in conditional expressions, while monadic functions
@@ -695,6 +695,52 @@ namespace pfq { namespace lang
         return { std::move(v1) + std::move(v2), n2 };
     }
 
+    ///////// pretty with profile:
+
+    inline std::string
+    pretty_profile(pfq_lang_node_profile const &p)
+    {
+        std::ostringstream out;
+        out << " {hit=" << p.hit << " pass=" << p.pass << " drop=" << p.drop;
+        if (p.samples)
+            out << " cycles=" << p.cycles / p.samples;
+        out << '}';
+        return out.str();
+    }
+
+    template <typename ...Ts>
+    inline std::string
+    pretty(Function<Ts...> const &f, std::vector<pfq_lang_node_profile> const &prof, std::ptrdiff_t &n)
+    {
+        auto idx = n;
+        n = serialize(f, n).second;
+        if (idx < static_cast<std::ptrdiff_t>(prof.size()))
+            return pretty(f) + pretty_profile(prof[idx]);
+        return pretty(f);
+    }
+
+    template <typename C1, typename C2>
+    inline std::string
+    pretty(Kleisli<C1,C2> const &comp, std::vector<pfq_lang_node_profile> const &prof, std::ptrdiff_t &n)
+    {
+        auto f = pretty(comp.f_, prof, n);
+        return f + " >-> " + pretty(comp.g_, prof, n);
+    }
+
+    //! Pretty print a computation, annotating each function with its profile.
+    /*!
+     * The profile is the one returned by socket::group_lang_profile for the
+     * computation set with the same expression.
+     */
+
+    template <typename Comp>
+    inline std::string
+    pretty(Comp const &comp, std::vector<pfq_lang_node_profile> const &prof)
+    {
+        std::ptrdiff_t n = 0;
+        return pretty(comp, prof, n);
+    }
+
 } // namespace lang
 } // namespace pfq
 
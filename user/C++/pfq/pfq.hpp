@@ -398,6 +398,49 @@ namespace pfq {
             throw system_error("PFQ: socket not open");
         }
 
+        net_queue
+        read_stream(struct pfq_shared_queue *q, long int microseconds)
+        {
+            const size_t cap = 2 * data_->rx_slots;
+            auto next = data_->rx_stream_next;
+
+            // release the slots returned by the previous read...
+            //
+
+            if (data_->rx_stream_cons != next)
+            {
+                data_->rx_stream_cons = next;
+                __atomic_store_n(&q->rx_ring.cons.index, next, __ATOMIC_RELEASE);
+            }
+
+            auto prod = __atomic_load_n(&q->rx_ring.prod.index, __ATOMIC_ACQUIRE);
+            if (prod == next)
+            {
+#ifdef PFQ_USE_POLL
+                this->poll(microseconds);
+                prod = __atomic_load_n(&q->rx_ring.prod.index, __ATOMIC_ACQUIRE);
+#else
+                usleep(10);
+                (void)microseconds;
+                return net_queue();
+#endif
+            }
+
+            // return the slots up to the end of the ring...
+            //
+
+            auto off = next % cap;
+            auto len = std::min(static_cast<size_t>(prod - next), cap - off);
+
+            data_->rx_stream_next = next + len;
+
+            return net_queue( static_cast<char *>(data_->rx_queue_addr) + off * data_->rx_slot_size
+                            , data_->rx_slot_size
+                            , len
+                            , PFQ_STREAM_COMMIT(next, cap)
+                            , data_->rx_flags);
+        }
+
     public:
 
         //! Close the socket.
@@ -429,6 +472,22 @@ namespace pfq {
             throw_if(q, pfq_enable(q));
         }
 
+        //! Enable the socket with the given Q_ENABLE_* flags.
+        /*!
+         * Q_ENABLE_RX_PACKED selects variable-length Rx slots, optionally with
+         * compact headers (Q_ENABLE_RX_COMPACT). Q_ENABLE_RX_STREAM turns the
+         * Rx queue into a single ring (see release). Q_ENABLE_TX_ZEROCOPY
+         * transmits the Tx slots without copies (see tx_pending), Q_ENABLE_TX_PACKED
+         * selects variable-length Tx slots. See pfq_enable_flags.
+         */
+
+        void
+        enable(unsigned int flags)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_enable_flags(q, flags));
+        }
+
         //! Disable the socket.
         /*!
          * Release the shared memory, stop kernel threads.
@@ -491,6 +550,50 @@ namespace pfq {
         }
 
 
+        //! Set the Rx latency bound of the socket, in microseconds (0 = module default).
+
+        void
+        rx_latency(int usec)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_rx_latency(q, usec));
+        }
+
+
+        //! Return the Rx latency bound of the socket.
+
+        int
+        rx_latency() const
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_get_rx_latency(q));
+        }
+
+
+        //! Specify the NUMA node of the socket queues (Q_NODE_ANY, Q_NODE_DEVICE or a node).
+        /*!
+         * The node must be set before the socket is enabled; Q_NODE_DEVICE
+         * requires the socket to be bound first.
+         */
+
+        void
+        mem_node(int node)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_mem_node(q, node));
+        }
+
+
+        //! Return the NUMA node of the socket queues (the node they landed on, once enabled).
+
+        int
+        mem_node() const
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_get_mem_node(q));
+        }
+
+
         //! Specify the capture length of packets, in bytes.
         /*!
          * Capture length must be set before the socket is enabled.
@@ -539,6 +642,23 @@ namespace pfq {
             return as<size_t>(q, pfq_get_rx_slots(q));
         }
 
+        //! Split the Rx queue into per-cpu lanes (see pfq_set_rx_lanes).
+
+        void
+        rx_lanes(unsigned int value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_rx_lanes(q, value));
+        }
+
+        //! Return the number of per-cpu Rx lanes.
+
+        unsigned int
+        rx_lanes() const
+        {
+            return pfq_get_rx_lanes(this->data());
+        }
+
         //! Return the length of a Rx slot, in bytes.
 
         size_t
@@ -684,6 +804,91 @@ namespace pfq {
             throw_if(q, pfq_leave_group(q, gid));
         }
 
+        //! Create the single-copy ring of the given group (see pfq_group_ring_create).
+
+        void
+        group_ring_create(int gid, size_t slots, size_t caplen, int policy = Q_RING_POLICY_BLOCK)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ring_create(q, gid, slots, caplen, policy));
+        }
+
+        //! Attach the socket to the ring of the given group, as a reader.
+
+        void
+        group_ring_attach(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ring_attach(q, gid));
+        }
+
+        //! Detach the socket from its group ring.
+
+        void
+        group_ring_detach()
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ring_detach(q));
+        }
+
+        //! Read packets in place from the group ring.
+        /*!
+         * The packets returned by the previous read are released.
+         */
+
+        net_queue
+        group_ring_read(long int microseconds = -1)
+        {
+            auto q = this->data();
+            struct pfq_net_queue nq;
+
+            throw_if(q, pfq_group_ring_read(q, &nq, microseconds));
+            if (nq.len == 0)
+                return net_queue();
+
+            return net_queue(nq.queue, nq.slot_size, nq.len, nq.index);
+        }
+
+        //! Return the number of packets of the group ring lost by the socket (overruns).
+
+        unsigned long
+        group_ring_lost() const
+        {
+            auto q = this->data();
+            unsigned long lost;
+            throw_if(q, pfq_group_ring_lost(q, &lost));
+            return lost;
+        }
+
+        //! Create the flow table of the given group (see pfq_group_flow_table_create).
+
+        void
+        group_flow_table_create(int gid, size_t entries, unsigned int timeout)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_flow_table_create(q, gid, entries, timeout));
+        }
+
+        //! Map in memory (read-only) the flow table of the given group.
+
+        pfq_shared_flow_table const *
+        group_flow_table_map(int gid)
+        {
+            auto q = this->data();
+            pfq_shared_flow_table const *table;
+            throw_if(q, pfq_group_flow_table_map(q, gid, &table));
+            return table;
+        }
+
+        //! Unmap the flow table mapped by the socket.
+
+        void
+        group_flow_table_unmap()
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_flow_table_unmap(q));
+        }
+
 
         //! Return the mask of the joined groups.
         /*!
@@ -796,6 +1001,46 @@ namespace pfq {
         }
 
 
+        //! Enable/disable the profiling of the computation of the given group.
+        /*!
+         * One packet every sample (per cpu) is timed in cycles; a sample of 0
+         * disables profiling.
+         */
+
+        void
+        group_lang_profile(int gid, int sample)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_group_lang_profile(q, gid, sample));
+        }
+
+        //! Return the profile of the computation of the given group.
+        /*!
+         * The profile is indexed as the functions of the computation descriptor.
+         */
+
+        std::vector<pfq_lang_node_profile>
+        group_lang_profile(int gid) const
+        {
+            auto q = this->data();
+            std::vector<pfq_lang_node_profile> prof;
+            size_t size = 0;
+
+            throw_if(q, pfq_get_group_lang_profile(q, gid, nullptr, &size));
+
+            // the computation may be replaced in the meantime...
+
+            while (size > prof.size())
+            {
+                prof.resize(size);
+                throw_if(q, pfq_get_group_lang_profile(q, gid, prof.data(), &size));
+            }
+
+            prof.resize(size);
+            return prof;
+        }
+
+
         //! Specify a BPF program for the given group.
         /*!
          * This function can be used to set a specific BPF filter for the group.
@@ -858,10 +1103,27 @@ namespace pfq {
             if (unlikely(!q))
                 throw system_error("PFQ: read: socket not enabled");
 
+            if (data_->rx_flags & Q_ENABLE_RX_STREAM)
+                return read_stream(q, microseconds);
+
+            const unsigned int lanes = data_->rx_lanes > 1 ? data_->rx_lanes : 1;
+            const size_t lane_slots = data_->rx_slots / lanes;
+            const size_t lane_size = lane_slots * data_->rx_slot_size;
+
+            auto shinfo = [&](unsigned int n) {
+                return data_->rx_lanes > 1 ? &q->rx_lane[n].shinfo : &q->rx.shinfo;
+            };
+
             unsigned long int data, qver;
+            size_t queue_len = 0;
+
+            for(unsigned int n = 0; n < lanes; n++)
+            {
+                data = __atomic_load_n(shinfo(n), __ATOMIC_RELAXED);
+                queue_len += PFQ_SHARED_QUEUE_LEN(data);
+            }
 
-            data = __atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED);
-            if (PFQ_SHARED_QUEUE_LEN(data) == 0)
+            if (queue_len == 0)
             {
 #ifdef PFQ_USE_POLL
                 this->poll(microseconds);
@@ -872,32 +1134,82 @@ namespace pfq {
 #endif
             }
 
+            // lanes are swapped together, their version is the same
+            //
+
+            data = __atomic_load_n(shinfo(0), __ATOMIC_RELAXED);
             qver = PFQ_SHARED_QUEUE_VER(data);
+            queue_len = 0;
 
-            // at wrap-around reset Rx slots...
-            //
+            const unsigned int flags = data_->rx_flags;
 
-            if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
+            for(unsigned int n = 0; n < lanes; n++)
             {
-                auto raw = static_cast<char *>(data_->rx_queue_addr) + ((qver+1) & 1) * data_->rx_queue_size;
-                auto end = raw + data_->rx_queue_size;
-                const pfq_qver_t rst = qver & 1;
-                for(; raw < end; raw += data_->rx_slot_size)
-                    reinterpret_cast<pfq_pkthdr *>(raw)->info.commit = rst;
-            }
+                auto lane = static_cast<char *>(data_->rx_queue_addr) + n * 2 * lane_size;
 
-            // swap the net_queue...
-            //
+                // packed slots: reset the headers of the queue consumed at the previous read...
+                //
+
+                if (flags & Q_ENABLE_RX_PACKED)
+                {
+                    auto raw = lane + ((qver+1) & 1) * lane_size;
+                    auto end = raw + data_->rx_lane_len[n];
+                    const size_t align = PFQ_PACKED_SLOT_ALIGNMENT(flags);
+                    for(; raw < end; raw += align)
+                        *PFQ_PACKED_COMMIT(flags, raw) = static_cast<uint32_t>(qver);
+                }
 
-            data = __atomic_exchange_n(&q->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+                // at wrap-around reset Rx slots...
+                //
+
+                else if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
+                {
+                    auto raw = lane + ((qver+1) & 1) * lane_size;
+                    auto end = raw + lane_size;
+                    const pfq_qver_t rst = qver & 1;
+                    for(; raw < end; raw += data_->rx_slot_size)
+                        reinterpret_cast<pfq_pkthdr *>(raw)->info.commit = rst;
+                }
 
-            auto queue_len = std::min( static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data))
-                                      , data_->rx_slots);
+                // swap the net_queue...
+                //
 
-            return net_queue( static_cast<char *>(data_->rx_queue_addr) + (qver & 1) * data_->rx_queue_size
+                data = __atomic_exchange_n(shinfo(n), ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+
+                if (flags & Q_ENABLE_RX_PACKED)
+                {
+                    data_->rx_lane_len[n] = std::min(static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data)), lane_size);
+                    queue_len += data_->rx_lane_len[n];
+                }
+                else
+                {
+                    auto len = std::min(static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data)), lane_slots);
+                    data_->rx_lane_len[n] = len * data_->rx_slot_size;
+                    queue_len += len;
+                }
+            }
+
+            auto addr = static_cast<char *>(data_->rx_queue_addr) + (qver & 1) * lane_size;
+
+            return net_queue( addr
                             , data_->rx_slot_size
                             , queue_len
-                            , qver);
+                            , qver
+                            , flags
+                            , net_queue::lanes{ addr, 2 * lane_size, data_->rx_lane_len, data_->rx_lanes > 1 ? lanes : 0 });
+        }
+
+        //! Release the first 'count' packets returned by the last read.
+        /*!
+         * Streaming Rx only (Q_ENABLE_RX_STREAM): the slots are given back
+         * to the kernel at once, instead of at the next read.
+         */
+
+        void
+        release(size_t count)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_rx_release(q, count));
         }
 
         //! Return the current commit version (used internally by the memory mapped queue).
@@ -924,13 +1236,19 @@ namespace pfq {
             if (data_->fd == -1)
                 throw system_error("PFQ: socket not open");
 
+            if (data_->rx_lanes > 1)
+                throw system_error("PFQ: recv: not supported with Rx lanes");
+
             auto this_queue = this->read(microseconds);
 
             if (buff.second < data_->rx_slots * data_->rx_slot_size)
                 throw system_error("PFQ: buffer too small");
 
-            memcpy(buff.first, this_queue.data(), this_queue.slot_size() * this_queue.size());
-            return net_queue(buff.first, this_queue.slot_size(), this_queue.size(), this_queue.index());
+            auto bytes = this_queue.flags() & Q_ENABLE_RX_PACKED ? this_queue.size()
+                                                                 : this_queue.slot_size() * this_queue.size();
+
+            memcpy(buff.first, this_queue.data(), bytes);
+            return net_queue(buff.first, this_queue.slot_size(), this_queue.size(), this_queue.index(), this_queue.flags());
         }
 
 
@@ -955,6 +1273,23 @@ namespace pfq {
                 while (!it.ready())
                     std::this_thread::yield();
 
+                if (many.flags() & Q_ENABLE_RX_PACKED)
+                {
+                    if (it.padding())
+                        continue;
+
+                    if (many.flags() & Q_ENABLE_RX_COMPACT)
+                    {
+                        pfq_pkthdr h {};
+                        h.tstamp.tv64 = it.compact_header()->tstamp.tv64;
+                        h.caplen = it.compact_header()->caplen;
+                        h.len = it.compact_header()->len;
+                        callback(user, &h, reinterpret_cast<const char *>(it.data()));
+                        n++;
+                        continue;
+                    }
+                }
+
                 callback(user, &(*it), reinterpret_cast<const char *>(it.data()));
                 n++;
             }
@@ -1019,6 +1354,17 @@ namespace pfq {
             return stat;
         }
 
+        //! Return the Tx pacing statistics of the socket.
+
+        pfq_tx_pacing_stats
+        tx_pacing_stats() const
+        {
+            pfq_tx_pacing_stats stat;
+            auto q = this->data();
+            throw_if(q, pfq_get_tx_pacing_stats(q, &stat));
+            return stat;
+        }
+
         //! Return the statistics of the given group.
 
         pfq_stats
@@ -1094,6 +1440,22 @@ namespace pfq {
             return send_raw(pkt.first, pkt.second, 0, copies, async);
         }
 
+        //! Transmit the packet at the given time.
+        /*!
+         * The packet is transmitted by a PFQ kernel thread when the system clock
+         * reaches 'tp'. Requires the socket is bound to one (or multiple) PFQ kernel
+         * threads (see 'bind_tx'); packets must be queued in timestamp order.
+         * See 'tx_pacing_stats' for the accuracy of the transmission.
+         */
+
+        template <typename Duration>
+        bool
+        send_at(const_buffer pkt, std::chrono::time_point<std::chrono::system_clock, Duration> const &tp, unsigned int copies = 1, int async = any_kthread)
+        {
+            auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+            return send_raw(pkt.first, pkt.second, static_cast<uint64_t>(nsec), copies, async);
+        }
+
         //! Schedule a packet transmission.
         /*!
          * The packet is copied into a Tx queue. If 'async' is true and 'queue' is set to any_queue, a TSS symmetric hash
@@ -1112,6 +1474,9 @@ namespace pfq {
             if (unlikely(!data_->shm_addr))
                 throw system_error("PFQ: send: socket not enabled");
 
+            if (unlikely(data_->tx_resv_num != 0))
+                throw system_error("PFQ: send: Tx slots reserved (see commit)");
+
             ptrdiff_t *poff_addr;
             uint16_t caplen;
             int tss;
@@ -1129,14 +1494,19 @@ namespace pfq {
                 return &static_cast<struct pfq_shared_queue *>(data_->shm_addr)->tx;
             }();
 
-            // swap the queue...
+            // swap the queue, when the kernel has reached the producer half...
             //
 
-            auto index = __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED);
-            if (index == __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED))
+            auto index = __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED);
+            if (index == __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED))
             {
                 ++index;
 
+                // zero-copy Tx: the half is still referenced by the driver
+                //
+                if (unlikely(__atomic_load_n(&tx->done.pending[index & 1], __ATOMIC_ACQUIRE)))
+                    return false;
+
                 poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
                 __atomic_store_n(poff_addr, 0, __ATOMIC_RELEASE);
                 __atomic_store_n(&tx->prod.index, index, __ATOMIC_RELEASE);
@@ -1159,9 +1529,13 @@ namespace pfq {
                     std::min(len, data_->tx_slot_size - sizeof(struct pfq_pkthdr)));
 
 
+            // the size of the slot: fixed, or after the caplen (packed Tx)
+            //
+            size_t slot_size = (data_->tx_flags & Q_ENABLE_TX_PACKED) ? PFQ_SHARED_QUEUE_SLOT_SIZE(static_cast<size_t>(caplen)) : data_->tx_slot_size;
+
             // ensure there's enough space for the current packet
             //
-            if (likely((static_cast<size_t>(offset) + data_->tx_slot_size) < data_->tx_queue_size))
+            if (likely((static_cast<size_t>(offset) + slot_size) < data_->tx_queue_size))
             {
                 auto hdr = (struct pfq_pkthdr *)(base_addr + offset);
 
@@ -1172,17 +1546,84 @@ namespace pfq {
 
 			    memcpy(hdr+1, buf, caplen);
 
-                __atomic_store_n(poff_addr, offset + static_cast<ptrdiff_t>(data_->tx_slot_size), __ATOMIC_RELEASE);
+                if (tss == -1) {
+                    __atomic_store_n(poff_addr, offset + static_cast<ptrdiff_t>(slot_size), __ATOMIC_RELEASE);
+                }
+                else {
+                    // async queue: ring the doorbell if the Tx kthread sleeps
+                    //
+                    __atomic_store_n(poff_addr, offset + static_cast<ptrdiff_t>(slot_size), __ATOMIC_SEQ_CST);
+                    if (unlikely(__atomic_load_n(&tx->cons.wait, __ATOMIC_SEQ_CST)) &&
+                        __atomic_exchange_n(&tx->cons.wait, 0u, __ATOMIC_ACQ_REL))
+                        this->sync_queue(tss + 1);
+                }
+
                 return true;
             }
 
             return false;
         }
 
+        //! Reserve a slot of the Tx queue, to build a packet of 'len' bytes in place.
+        /*!
+         * Return the address where the packet is to be written, or nullptr if the
+         * queue is full. The packet is transmitted once committed (see 'commit').
+         * 'async' is the index of the async queue, or no_kthread for the sync one.
+         * See pfq_tx_reserve.
+         */
+
+        char *
+        reserve(size_t len, int async = no_kthread)
+        {
+            auto q = this->data();
+            auto slot = pfq_tx_reserve(q, len, async);
+            if (slot == nullptr && q->error)
+                throw system_error(errno, pfq_error(q));
+            return static_cast<char *>(slot);
+        }
+
+        //! Reserve up to 'n' slots of the Tx queue, to build packets of 'len' bytes in place.
+        /*!
+         * The addresses of the slots are stored in 'slots'; return the number of
+         * slots reserved (0 if the queue is full).
+         */
+
+        int
+        reserve(size_t len, char *slots[], int n, int async = no_kthread)
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_tx_reserve_burst(q, len, reinterpret_cast<void **>(slots), n, async));
+        }
+
+        //! Publish the first 'n' reserved slots (the others are released).
+        /*!
+         * See pfq_tx_commit.
+         */
+
+        void
+        commit(int n = 1)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_tx_commit(q, n));
+        }
+
+        //! Return the number of zero-copy Tx packets not yet completed by the driver.
+        /*!
+         * See pfq_tx_pending.
+         */
+
+        int
+        tx_pending(int async = no_kthread)
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_tx_pending(q, async));
+        }
+
         //! Transmit the packets in the queue.
         /*!
          * Transmit the packets in the queue of the socket. 'queue = 0' is the
-         * queue of the socket enabled for synchronous transmission.
+         * queue of the socket enabled for synchronous transmission, 'queue = n+1'
+         * rings the doorbell of the kernel thread serving the async queue n.
          */
 
         void
@@ -39,6 +39,54 @@ namespace pfq {
     {
     public:
 
+        //! Per-cpu Rx lanes of the queue.
+        /*!
+         * Lanes are laid out every 'stride' bytes starting from 'base';
+         * 'len' holds the bytes available in each of them.
+         */
+
+        struct lanes
+        {
+            char         *base;
+            size_t        stride;
+            const size_t *len;
+            unsigned int  count;
+
+            //! Return the first non-empty lane starting from the given one (nullptr if none).
+
+            char *
+            first(unsigned int lane) const
+            {
+                for(; lane < count; ++lane)
+                    if (len[lane])
+                        return base + lane * stride;
+                return nullptr;
+            }
+
+            //! Return the end of the last non-empty lane.
+
+            char *
+            last() const
+            {
+                for(unsigned int lane = count; lane-- > 0;)
+                    if (len[lane])
+                        return base + lane * stride + len[lane];
+                return base;
+            }
+
+            //! Given the current and the next slot, move to the following lane if needed.
+
+            char *
+            next(char *cur, char *nxt) const
+            {
+                auto lane = static_cast<unsigned int>(static_cast<size_t>(cur - base) / stride);
+                if (nxt == base + lane * stride + len[lane])
+                    if (auto n = first(lane + 1))
+                        return n;
+                return nxt;
+            }
+        };
+
         struct const_iterator;
 
         //! Forward iterator over packets.
@@ -47,21 +95,23 @@ namespace pfq {
         {
             friend struct net_queue::const_iterator;
 
-            iterator(pfq_pkthdr *h, size_t slot_size, size_t index)
-            : hdr_(h), slot_size_(slot_size), index_(index)
+            iterator(pfq_pkthdr *h, size_t slot_size, size_t index, unsigned int flags = 0, lanes l = lanes{})
+            : hdr_(h), slot_size_(slot_size), index_(index), flags_(flags), lanes_(l)
             {}
 
             ~iterator() = default;
 
             iterator(const iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), flags_(other.flags_), lanes_(other.lanes_)
             {}
 
             iterator &
             operator++()
             {
+                size_t size = flags_ & Q_ENABLE_RX_PACKED ? PFQ_PACKED_SLOT_SIZE(flags_, hdr_->caplen) : slot_size_;
+                auto cur = reinterpret_cast<char *>(hdr_);
                 hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                        unlikely(lanes_.count > 1) ? lanes_.next(cur, cur + size) : cur + size);
                 return *this;
             }
 
@@ -88,12 +138,32 @@ namespace pfq {
             void *
             data() const
             {
+                if (flags_ & Q_ENABLE_RX_COMPACT)
+                    return compact_header()+1;
                 return hdr_+1;
             }
 
+            //! Return the header of a compact queue slot.
+
+            pfq_pkthdr_compact *
+            compact_header() const
+            {
+                return reinterpret_cast<pfq_pkthdr_compact *>(hdr_);
+            }
+
+            //! Check whether the slot of a packed queue is padding.
+
+            bool
+            padding() const
+            {
+                return hdr_->len == 0;
+            }
+
             bool
             ready() const
             {
+                if (flags_ & Q_ENABLE_RX_COMPACT)
+                    return likely(__atomic_load_n(&compact_header()->commit, __ATOMIC_ACQUIRE) == index_);
                 return likely(__atomic_load_n(&hdr_->info.commit, __ATOMIC_ACQUIRE) == index_);
             }
 
@@ -113,22 +183,24 @@ namespace pfq {
             pfq_pkthdr *hdr_;
             size_t   slot_size_;
             size_t   index_;
+            unsigned int flags_;
+            lanes    lanes_;
         };
 
         //! Constant forward iterator over packets.
 
         struct const_iterator : public std::iterator<std::forward_iterator_tag, pfq_pkthdr>
         {
-            const_iterator(pfq_pkthdr *h, size_t slot_size, size_t index)
-            : hdr_(h), slot_size_(slot_size), index_(index)
+            const_iterator(pfq_pkthdr *h, size_t slot_size, size_t index, unsigned int flags = 0, lanes l = lanes{})
+            : hdr_(h), slot_size_(slot_size), index_(index), flags_(flags), lanes_(l)
             {}
 
             const_iterator(const const_iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), flags_(other.flags_), lanes_(other.lanes_)
             {}
 
             const_iterator(const net_queue::iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), flags_(other.flags_), lanes_(other.lanes_)
             {}
 
             ~const_iterator() = default;
@@ -136,8 +208,10 @@ namespace pfq {
             const_iterator &
             operator++()
             {
+                size_t size = flags_ & Q_ENABLE_RX_PACKED ? PFQ_PACKED_SLOT_SIZE(flags_, hdr_->caplen) : slot_size_;
+                auto cur = reinterpret_cast<char *>(hdr_);
                 hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                        unlikely(lanes_.count > 1) ? lanes_.next(cur, cur + size) : cur + size);
                 return *this;
             }
 
@@ -164,12 +238,32 @@ namespace pfq {
             const void *
             data() const
             {
+                if (flags_ & Q_ENABLE_RX_COMPACT)
+                    return compact_header()+1;
                 return hdr_+1;
             }
 
+            //! Return the header of a compact queue slot.
+
+            const pfq_pkthdr_compact *
+            compact_header() const
+            {
+                return reinterpret_cast<const pfq_pkthdr_compact *>(hdr_);
+            }
+
+            //! Check whether the slot of a packed queue is padding.
+
+            bool
+            padding() const
+            {
+                return hdr_->len == 0;
+            }
+
             bool
             ready() const
             {
+                if (flags_ & Q_ENABLE_RX_COMPACT)
+                    return __atomic_load_n(&compact_header()->commit, __ATOMIC_ACQUIRE) == index_;
                 auto b = __atomic_load_n(&hdr_->info.commit, __ATOMIC_ACQUIRE) == index_;
                 return b;
             }
@@ -190,6 +284,8 @@ namespace pfq {
             pfq_pkthdr *hdr_;
             size_t  slot_size_;
             size_t  index_;
+            unsigned int flags_;
+            lanes   lanes_;
         };
 
     public:
@@ -201,16 +297,23 @@ namespace pfq {
         , slot_size_(0)
         , queue_len_(0)
         , index_(0)
+        , flags_(0)
+        , lanes_()
         {}
 
         //! Constructor
-        //
+        /*!
+         * With Q_ENABLE_RX_PACKED in flags, the queue length is expressed in bytes.
+         * With per-cpu lanes (l.count > 1) the iterators walk all the lanes.
+         */
 
-        net_queue(void *addr, size_t slot_size, size_t queue_len, size_t index)
+        net_queue(void *addr, size_t slot_size, size_t queue_len, size_t index, unsigned int flags = 0, lanes l = lanes{})
         : addr_(addr)
         , slot_size_(slot_size)
         , queue_len_(queue_len)
         , index_(index)
+        , flags_(flags)
+        , lanes_(l)
         {}
 
         //! Defaulted copy constructor.
@@ -222,7 +325,7 @@ namespace pfq {
         ~net_queue() = default;
 
 
-        //! Return the number of packets stored in this queue.
+        //! Return the number of packets stored in this queue (bytes, if packed).
 
         size_t
         size() const
@@ -254,6 +357,14 @@ namespace pfq {
             return slot_size_;
         }
 
+        //! Return the Rx layout flags (Q_ENABLE_RX_PACKED/COMPACT).
+
+        unsigned int
+        flags() const
+        {
+            return flags_;
+        }
+
         //! Return the pointer to the packet.
 
         const void *
@@ -270,7 +381,7 @@ namespace pfq {
         iterator
         begin()
         {
-            return iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return iterator(reinterpret_cast<pfq_pkthdr *>(first()), slot_size_, index_, flags_, lanes_);
         }
 
         //! Return a constant iterator to the first slot of a non-empty queue.
@@ -281,7 +392,7 @@ namespace pfq {
         const_iterator
         begin() const
         {
-            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return const_iterator(reinterpret_cast<pfq_pkthdr *>(first()), slot_size_, index_, flags_, lanes_);
         }
 
         //! Return an iterator past to the end of the queue.
@@ -290,7 +401,7 @@ namespace pfq {
         end()
         {
             return iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        last()), slot_size_, index_, flags_, lanes_);
         }
 
         //! Return a constant iterator past to the end of the queue.
@@ -299,7 +410,7 @@ namespace pfq {
         end() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        last()), slot_size_, index_, flags_, lanes_);
         }
 
         //! Return a constant iterator to the first slot of an non-empty queue.
@@ -310,7 +421,7 @@ namespace pfq {
         const_iterator
         cbegin() const
         {
-            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return const_iterator(reinterpret_cast<pfq_pkthdr *>(first()), slot_size_, index_, flags_, lanes_);
         }
 
         //! Return a constant iterator past to the end of the queue.
@@ -319,14 +430,35 @@ namespace pfq {
         cend() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        last()), slot_size_, index_, flags_, lanes_);
         }
 
     private:
+
+        void *
+        first() const
+        {
+            if (unlikely(lanes_.count > 1)) {
+                auto p = lanes_.first(0);
+                return p ? p : addr_;
+            }
+            return addr_;
+        }
+
+        void *
+        last() const
+        {
+            if (unlikely(lanes_.count > 1))
+                return lanes_.last();
+            return static_cast<char *>(addr_) + (flags_ & Q_ENABLE_RX_PACKED ? queue_len_ : queue_len_ * slot_size_);
+        }
+
         void    *addr_;
         size_t  slot_size_;
         size_t  queue_len_;
         size_t  index_;
+        unsigned int flags_;
+        lanes   lanes_;
     };
 
     //! Return the pointer to the packet.
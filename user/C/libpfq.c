@@ -27,6 +27,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <net/if.h>
 #include <net/ethernet.h>
@@ -48,6 +49,7 @@
 #include <strings.h>
 
 #include <linux/if_ether.h>
+#include <linux/mempolicy.h>
 #include <linux/pf_q.h>
 
 #include <pfq/pfq.h>
@@ -163,6 +165,9 @@ pfq_open_group(unsigned long class_mask, int group_policy, size_t caplen, size_t
 	q->hd = -1;
 	q->id = -1;
 	q->gid = -1;
+	q->ring_gid = -1;
+	q->ring_reader = -1;
+	q->flow_gid = -1;
 
         memset(&q->nq, 0, sizeof(q->nq));
 
@@ -228,6 +233,12 @@ int pfq_close(pfq_t *q)
 {
 	if (q->fd != -1)
 	{
+		if (q->ring_addr)
+			pfq_group_ring_detach(q);
+
+		if (q->flow_addr)
+			pfq_group_flow_table_unmap(q);
+
 		if (q->shm_addr)
 			pfq_disable(q);
 
@@ -306,16 +317,37 @@ const char *size_to_string(size_t size)
 }
 
 
-int
-pfq_enable(pfq_t *q)
+/* bind the (not yet faulted) pages of a mapping to a NUMA node */
+
+static int
+mbind_node(void *addr, size_t len, int node)
+{
+	unsigned long mask[16] = { 0 };
+	const int bits = 8 * sizeof(unsigned long);
+
+	if (node < 0 || node >= (int)sizeof(mask) * 8) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	mask[node / bits] |= 1UL << (node % bits);
+	return (int)syscall(SYS_mbind, addr, len, MPOL_BIND, mask, sizeof(mask) * 8, 0);
+}
+
+
+static int
+__pfq_enable(pfq_t *q, unsigned int flags)
 {
 	size_t sock_mem; socklen_t size = sizeof(sock_mem);
+	int node; socklen_t node_size = sizeof(node);
 	char filename[256], *hugepages_mpoint;
         char *pfq_hugepages;
 
 	struct pfq_so_enable mem = { .user_addr = 0
 				   , .user_size  = 0
 				   , .hugepage_size = 0
+				   , .flags = flags
+				   , .zc_size = 0
 				   };
 
 	if (q->shm_addr != MAP_FAILED &&
@@ -366,6 +398,14 @@ pfq_enable(pfq_t *q)
 
 		q->shm_hugepages_size = mem.user_size;
 
+		/* HugePages are user memory: the kernel pins them as they are, so
+		 * they are placed on the requested node before the socket is enabled */
+
+		if (getsockopt(q->fd, PF_Q, Q_SO_GET_MEM_NODE, &node, &node_size) == 0 && node >= 0) {
+			if (mbind_node(q->shm_hugepages, mem.user_size, node) == -1)
+				fprintf(stderr, "[PFQ] could not bind HugePages to node %d: %s\n", node, strerror(errno));
+		}
+
 		mem.user_addr = (unsigned long)q->shm_hugepages;
 
 		/* enable socket memory */
@@ -394,6 +434,12 @@ pfq_enable(pfq_t *q)
 		if(setsockopt(q->fd, PF_Q, Q_SO_ENABLE, &mem, sizeof(mem)) == -1)
 			return Q_ERROR(q, "PFQ: socket enable");
 
+		/* the size of the queues depends on the enable flags */
+
+		size = sizeof(sock_mem);
+		if (getsockopt(q->fd, PF_Q, Q_SO_GET_SHMEM_SIZE, &sock_mem, &size) == -1)
+			return Q_ERROR(q, "PFQ: queue memory error");
+
 		/* queue memory... */
 
 		q->shm_addr = mmap(NULL, sock_mem, PROT_READ|PROT_WRITE, MAP_SHARED, q->fd, 0);
@@ -407,22 +453,78 @@ pfq_enable(pfq_t *q)
 		q->shm_hugepages_size = 0;
 	}
 
+	/* zero-copy Rx: slots are prefixed by a reference to the packet, and
+	 * the read-only zero-copy area is mapped right after the queues */
+
+	if (flags & Q_ENABLE_RX_ZEROCOPY) {
+
+		q->rx_slot_size = ALIGN(sizeof(struct pfq_pkthdr) + sizeof(struct pfq_pkt_ref) + q->rx_len, PFQ_SLOT_ALIGNMENT);
+
+		size = sizeof(sock_mem);
+		if (getsockopt(q->fd, PF_Q, Q_SO_GET_SHMEM_SIZE, &sock_mem, &size) == -1)
+			return Q_ERROR(q, "PFQ: queue memory error");
+
+		q->zc_addr = mmap(NULL, mem.zc_size, PROT_READ, MAP_SHARED, q->fd, (off_t)sock_mem);
+		if (q->zc_addr == MAP_FAILED) {
+			q->zc_addr = NULL;
+			return Q_ERROR(q, "PFQ: socket enable (zero-copy memory map)");
+		}
+
+		q->zc_size = mem.zc_size;
+	}
+
+	q->rx_flags = flags & (Q_ENABLE_RX_PACKED|Q_ENABLE_RX_COMPACT|Q_ENABLE_RX_STREAM);
+	q->rx_stream_cons = 0;
+	q->rx_stream_next = 0;
+	memset(q->rx_lane_len, 0, sizeof(q->rx_lane_len));
+
 	q->rx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue);
 	q->rx_queue_size = q->rx_slots * q->rx_slot_size;
 
 	q->tx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue) + q->rx_queue_size * 2;
 	q->tx_queue_size = q->tx_slots * q->tx_slot_size;
+	q->tx_flags = flags & Q_ENABLE_TX_PACKED;
+	q->tx_resv_num = 0;
+	q->tx_resv_len = 0;
 
 	return Q_OK(q);
 }
 
 
+int
+pfq_enable(pfq_t *q)
+{
+	return __pfq_enable(q, 0);
+}
+
+
+int
+pfq_enable_zerocopy(pfq_t *q)
+{
+	return __pfq_enable(q, Q_ENABLE_RX_ZEROCOPY);
+}
+
+
+int
+pfq_enable_flags(pfq_t *q, unsigned int flags)
+{
+	return __pfq_enable(q, flags);
+}
+
+
 int
 pfq_disable(pfq_t *q)
 {
 	if (q->fd == -1)
 		return Q_ERROR(q, "PFQ: socket not open");
 
+	if (q->zc_addr) {
+		if (munmap(q->zc_addr, q->zc_size) == -1)
+			return Q_ERROR(q, "PFQ: munmap error (zero-copy)");
+		q->zc_addr = NULL;
+		q->zc_size = 0;
+	}
+
 	if (q->shm_addr != MAP_FAILED) {
 
 		if (q->shm_hugepages_size) {
@@ -516,6 +618,50 @@ pfq_get_weight(pfq_t const *q)
 	return Q_VALUE(q, ret);
 }
 
+
+int
+pfq_set_rx_latency(pfq_t *q, int usec)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_LATENCY, &usec, sizeof(usec)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx latency bound");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_rx_latency(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(ret);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_RX_LATENCY, &ret, &size) == -1) {
+	        return Q_ERROR(q, "PFQ: get Rx latency bound");
+	}
+	return Q_VALUE(q, ret);
+}
+
+
+int
+pfq_set_mem_node(pfq_t *q, int node)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_MEM_NODE, &node, sizeof(node)) == -1) {
+		return Q_ERROR(q, "PFQ: set memory node");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_mem_node(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(ret);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_MEM_NODE, &ret, &size) == -1) {
+	        return Q_ERROR(q, "PFQ: get memory node");
+	}
+	return Q_VALUE(q, ret);
+}
+
 int
 pfq_ifindex(pfq_t const *q, const char *dev)
 {
@@ -630,6 +776,29 @@ pfq_set_rx_slots(pfq_t *q, size_t value)
 }
 
 
+unsigned int
+pfq_get_rx_lanes(pfq_t const *q)
+{
+	return q->rx_lanes;
+}
+
+
+int
+pfq_set_rx_lanes(pfq_t *q, unsigned int value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (Rx lanes could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_LANES, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx lanes error");
+	}
+
+	q->rx_lanes = value;
+	return Q_OK(q);
+}
+
+
 int
 pfq_set_tx_slots(pfq_t *q, size_t value)
 {
@@ -1563,6 +1732,12 @@ pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group_policy)
 int
 pfq_leave_group(pfq_t *q, int gid)
 {
+	if (q->ring_addr && q->ring_gid == gid)
+		pfq_group_ring_detach(q);
+
+	if (q->flow_addr && q->flow_gid == gid)
+		pfq_group_flow_table_unmap(q);
+
 	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_LEAVE, &gid, sizeof(gid)) == -1) {
 	        return Q_ERROR(q, "PFQ: leave group error");
 	}
@@ -1573,6 +1748,212 @@ pfq_leave_group(pfq_t *q, int gid)
 }
 
 
+int
+pfq_group_ring_create(pfq_t *q, int gid, size_t slots, size_t caplen, int policy)
+{
+	struct pfq_so_group_ring ring = { .gid = gid, .policy = policy, .slots = slots, .caplen = caplen, .size = 0 };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_RING_CREATE, &ring, sizeof(ring)) == -1) {
+	        return Q_ERROR(q, "PFQ: group ring create error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_ring_attach(pfq_t *q, int gid)
+{
+	struct pfq_so_group_ring info = { .gid = gid };
+	socklen_t size = sizeof(info);
+	struct pfq_shared_ring *ring;
+	void *addr;
+
+	if (q->ring_addr)
+		return Q_ERROR(q, "PFQ: group ring: socket already attached");
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_RING, &info, &size) == -1)
+		return Q_ERROR(q, "PFQ: group ring: ring not available");
+
+	/* the ring is mapped at the offset of its gid */
+
+	addr = mmap(NULL, info.size, PROT_READ|PROT_WRITE, MAP_SHARED, q->fd,
+		    (off_t)PFQ_GROUP_RING_PGOFF(gid) * (off_t)getpagesize());
+	if (addr == MAP_FAILED)
+		return Q_ERROR(q, "PFQ: group ring: memory map error");
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_RING_ATTACH, &gid, sizeof(gid)) == -1) {
+		munmap(addr, info.size);
+		return Q_ERROR(q, "PFQ: group ring: attach error");
+	}
+
+	ring = (struct pfq_shared_ring *)addr;
+
+	q->ring_addr = addr;
+	q->ring_size = info.size;
+	q->ring_gid  = gid;
+	q->ring_reader = info.reader;
+	q->ring_next = __atomic_load_n(&ring->reader[q->ring_reader].index, __ATOMIC_ACQUIRE);
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_ring_detach(pfq_t *q)
+{
+	int gid = q->ring_gid;
+
+	if (q->ring_addr == NULL)
+		return Q_ERROR(q, "PFQ: group ring: socket not attached");
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_RING_DETACH, &gid, sizeof(gid)) == -1)
+		return Q_ERROR(q, "PFQ: group ring: detach error");
+
+	if (munmap(q->ring_addr, q->ring_size) == -1)
+		return Q_ERROR(q, "PFQ: group ring: munmap error");
+
+	q->ring_addr = NULL;
+	q->ring_size = 0;
+	q->ring_gid  = -1;
+	q->ring_reader = -1;
+	q->ring_next = 0;
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_ring_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+{
+	struct pfq_shared_ring *ring = (struct pfq_shared_ring *)q->ring_addr;
+	unsigned long *index, prod, cur, next = q->ring_next;
+	size_t cap, off, len;
+
+	if (unlikely(ring == NULL))
+		return Q_ERROR(q, "PFQ: group ring: socket not attached");
+
+	cap = ring->info.slots;
+	index = &ring->reader[q->ring_reader].index;
+
+	/* release the packets returned by the previous read: if this reader
+	 * has been overrun, the kernel has already moved its index forward... */
+
+	cur = __atomic_load_n(index, __ATOMIC_RELAXED);
+	while ((long)(next - cur) > 0) {
+		if (__atomic_compare_exchange_n(index, &cur, next, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if ((long)(cur - next) > 0)
+		next = cur;
+
+	prod = __atomic_load_n(&ring->prod.index, __ATOMIC_ACQUIRE);
+
+	if (unlikely(prod == next)) {
+#ifdef PFQ_USE_POLL
+		if (pfq_poll(q, microseconds) < 0)
+			return Q_ERROR(q, "PFQ: poll error");
+		prod = __atomic_load_n(&ring->prod.index, __ATOMIC_ACQUIRE);
+#else
+		(void)microseconds;
+		q->ring_next = next;
+		nq->len = 0;
+		return Q_VALUE(q, (int)0);
+#endif
+	}
+
+	/* return the packets up to the end of the ring (the rest at the next read) */
+
+	off = next % cap;
+	len = min(prod - next, cap - off);
+
+	nq->queue = (char *)ring + sizeof(struct pfq_shared_ring) + off * ring->info.slot_size;
+	nq->index = PFQ_STREAM_COMMIT(next, cap);
+	nq->len   = len;
+        nq->slot_size = ring->info.slot_size;
+	nq->zc_addr = NULL;
+	nq->flags = 0;
+	nq->lanes = 0;
+
+	q->ring_next = next + len;
+
+	return Q_VALUE(q, (int)len);
+}
+
+
+int
+pfq_group_ring_lost(pfq_t const *q, unsigned long *lost)
+{
+	struct pfq_shared_ring *ring = (struct pfq_shared_ring *)q->ring_addr;
+
+	if (ring == NULL)
+		return Q_ERROR(q, "PFQ: group ring: socket not attached");
+
+	*lost = __atomic_load_n(&ring->reader[q->ring_reader].lost, __ATOMIC_RELAXED);
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_flow_table_create(pfq_t *q, int gid, size_t entries, unsigned int timeout)
+{
+	struct pfq_so_group_flow_table table = { .gid = gid, .timeout = timeout, .entries = entries, .size = 0 };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_FLOW_TABLE, &table, sizeof(table)) == -1) {
+	        return Q_ERROR(q, "PFQ: group flow table create error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_flow_table_map(pfq_t *q, int gid, struct pfq_shared_flow_table const **table)
+{
+	struct pfq_so_group_flow_table info = { .gid = gid };
+	socklen_t size = sizeof(info);
+	void *addr;
+
+	if (q->flow_addr)
+		return Q_ERROR(q, "PFQ: group flow table: socket already mapped a table");
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_FLOW_TABLE, &info, &size) == -1)
+		return Q_ERROR(q, "PFQ: group flow table: table not available");
+
+	/* the table is mapped (read-only) at the offset of its gid */
+
+	addr = mmap(NULL, info.size, PROT_READ, MAP_SHARED, q->fd,
+		    (off_t)PFQ_GROUP_FLOW_PGOFF(gid) * (off_t)getpagesize());
+	if (addr == MAP_FAILED)
+		return Q_ERROR(q, "PFQ: group flow table: memory map error");
+
+	q->flow_addr = addr;
+	q->flow_size = info.size;
+	q->flow_gid  = gid;
+
+	*table = (struct pfq_shared_flow_table const *)addr;
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_flow_table_unmap(pfq_t *q)
+{
+	if (q->flow_addr == NULL)
+		return Q_ERROR(q, "PFQ: group flow table: table not mapped");
+
+	if (munmap(q->flow_addr, q->flow_size) == -1)
+		return Q_ERROR(q, "PFQ: group flow table: munmap error");
+
+	q->flow_addr = NULL;
+	q->flow_size = 0;
+	q->flow_gid  = -1;
+
+	return Q_OK(q);
+}
+
+
 int
 pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */)
 {
@@ -1608,6 +1989,17 @@ pfq_get_stats(pfq_t const *q, struct pfq_stats *stats)
 }
 
 
+int
+pfq_get_tx_pacing_stats(pfq_t const *q, struct pfq_tx_pacing_stats *stats)
+{
+	socklen_t size = sizeof(struct pfq_tx_pacing_stats);
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_TX_PACING, stats, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get Tx pacing stats error");
+	}
+	return Q_OK(q);
+}
+
+
 int
 pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 {
@@ -1633,6 +2025,34 @@ pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs)
 }
 
 
+int
+pfq_set_group_lang_profile(pfq_t *q, int gid, int sample)
+{
+        struct pfq_so_lang_profile_toggle value = { gid, sample };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_LANG_PROFILE, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: set group lang profile");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_get_group_lang_profile(pfq_t const *q, int gid, struct pfq_lang_node_profile *node, size_t *size)
+{
+	struct pfq_so_lang_profile prof = { gid, node ? *size : 0, node };
+	socklen_t len = sizeof(prof);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_LANG_PROFILE, &prof, &len) == -1) {
+		return Q_ERROR(q, "PFQ: get group lang profile");
+	}
+
+	*size = prof.size;
+	return Q_OK(q);
+}
+
+
 int
 pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle)
 {
@@ -1669,19 +2089,83 @@ int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid)
 }
 
 
-int
-pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+static inline unsigned long *
+__pfq_rx_shinfo(pfq_t const *q, struct pfq_shared_queue *qd, unsigned int lane)
+{
+	return q->rx_lanes > 1 ? &qd->rx_lane[lane].shinfo : &qd->rx.shinfo;
+}
+
+
+static int
+__pfq_read_stream(pfq_t *q, struct pfq_shared_queue *qd, struct pfq_net_queue *nq, long int microseconds)
+{
+	const size_t cap = 2 * q->rx_slots;
+	unsigned long prod, next = q->rx_stream_next;
+	size_t off, len;
+
+	/* release the slots returned by the previous read... */
+
+	if (q->rx_stream_cons != next) {
+		q->rx_stream_cons = next;
+		__atomic_store_n(&qd->rx_ring.cons.index, next, __ATOMIC_RELEASE);
+	}
+
+	prod = __atomic_load_n(&qd->rx_ring.prod.index, __ATOMIC_ACQUIRE);
+
+	if (unlikely(prod == next)) {
+#ifdef PFQ_USE_POLL
+		if (pfq_poll(q, microseconds) < 0)
+			return Q_ERROR(q, "PFQ: poll error");
+		prod = __atomic_load_n(&qd->rx_ring.prod.index, __ATOMIC_ACQUIRE);
+#else
+		(void)microseconds;
+		nq->len = 0;
+		return Q_VALUE(q, (int)0);
+#endif
+	}
+
+	/* return the slots up to the end of the ring (the rest at the next read) */
+
+	off = next % cap;
+	len = min(prod - next, cap - off);
+
+	nq->queue = (char *)(q->rx_queue_addr) + off * q->rx_slot_size;
+	nq->index = PFQ_STREAM_COMMIT(next, cap);
+	nq->len   = len;
+        nq->slot_size = q->rx_slot_size;
+	nq->flags = q->rx_flags;
+	nq->lanes = 0;
+
+	q->rx_stream_next = next + len;
+
+	return Q_VALUE(q, (int)len);
+}
+
+
+static int
+__pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 {
 	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	const unsigned int lanes = q->rx_lanes > 1 ? q->rx_lanes : 1;
+	const size_t lane_slots = q->rx_slots / lanes;
+	const size_t lane_size = lane_slots * q->rx_slot_size;
 	unsigned long int data, qver;
+	size_t queue_len = 0;
+	unsigned int n;
 
         if (unlikely(qd == NULL)) {
 		return Q_ERROR(q, "PFQ: read: socket not enabled");
 	}
 
-	data = __atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED);
+	if (q->rx_flags & Q_ENABLE_RX_STREAM)
+		return __pfq_read_stream(q, qd, nq, microseconds);
 
-	if (unlikely(PFQ_SHARED_QUEUE_LEN(data) == 0)) {
+	for(n = 0; n < lanes; n++) {
+		data = __atomic_load_n(__pfq_rx_shinfo(q, qd, n), __ATOMIC_RELAXED);
+		queue_len += PFQ_SHARED_QUEUE_LEN(data);
+	}
+
+	if (unlikely(queue_len == 0)) {
 #ifdef PFQ_USE_POLL
 		if (pfq_poll(q, microseconds) < 0)
 			return Q_ERROR(q, "PFQ: poll error");
@@ -1692,37 +2176,108 @@ pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 #endif
 	}
 
-        /* at wrap-around reset Rx slots... */
+	/* lanes are swapped together, their version is the same */
 
+	data = __atomic_load_n(__pfq_rx_shinfo(q, qd, 0), __ATOMIC_RELAXED);
 	qver = PFQ_SHARED_QUEUE_VER(data);
+	queue_len = 0;
 
-        if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
-        {
-            char * raw = (char *)(q->rx_queue_addr) + ((qver+1) & 1) * q->rx_queue_size;
-            char * end = raw + q->rx_queue_size;
-            const pfq_qver_t rst = qver & 1;
-            for(; raw < end; raw += q->rx_slot_size)
-                ((struct pfq_pkthdr *)raw)->info.commit = rst;
-        }
+	for(n = 0; n < lanes; n++)
+	{
+		char * lane = (char *)(q->rx_queue_addr) + n * 2 * lane_size;
+
+		if (q->rx_flags & Q_ENABLE_RX_PACKED)
+		{
+			/* packed slots: reset the headers of the queue consumed at the previous read,
+			 * at any aligned offset, as stale packet data could match the next commit... */
+
+			char * raw = lane + ((qver+1) & 1) * lane_size;
+			char * end = raw + q->rx_lane_len[n];
+			const size_t align = PFQ_PACKED_SLOT_ALIGNMENT(q->rx_flags);
+			for(; raw < end; raw += align)
+				*PFQ_PACKED_COMMIT(q->rx_flags, raw) = (uint32_t)qver;
+		}
+		/* at wrap-around reset Rx slots... */
+		else if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
+		{
+			char * raw = lane + ((qver+1) & 1) * lane_size;
+			char * end = raw + lane_size;
+			const pfq_qver_t rst = qver & 1;
+			for(; raw < end; raw += q->rx_slot_size)
+				((struct pfq_pkthdr *)raw)->info.commit = rst;
+		}
 
-	/* swap the queue... */
+		/* swap the queue... */
 
-        data = __atomic_exchange_n(&qd->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+		data = __atomic_exchange_n(__pfq_rx_shinfo(q, qd, n), ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
 
-	size_t queue_len = min(PFQ_SHARED_QUEUE_LEN(data), q->rx_slots);
+		if (q->rx_flags & Q_ENABLE_RX_PACKED) {
+			q->rx_lane_len[n] = min(PFQ_SHARED_QUEUE_LEN(data), lane_size);
+			queue_len += q->rx_lane_len[n];
+		}
+		else {
+			size_t len = min(PFQ_SHARED_QUEUE_LEN(data), lane_slots);
+			q->rx_lane_len[n] = len * q->rx_slot_size;
+			queue_len += len;
+		}
+	}
 
-	nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * q->rx_queue_size;
+	nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * lane_size;
 	nq->index = (unsigned int)qver;
 	nq->len   = queue_len;
         nq->slot_size = q->rx_slot_size;
+	nq->flags = q->rx_flags;
+	nq->lanes = q->rx_lanes > 1 ? lanes : 0;
+	nq->lane_stride = 2 * lane_size;
+	nq->lane_len = q->rx_lane_len;
 
 	return Q_VALUE(q, (int)queue_len);
 }
 
 
+int
+pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+{
+	if (unlikely(q->zc_addr != NULL))
+		return Q_ERROR(q, "PFQ: read: zero-copy socket (use pfq_read_zerocopy)");
+
+	nq->zc_addr = NULL;
+	return __pfq_read(q, nq, microseconds);
+}
+
+
+int
+pfq_read_zerocopy(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+{
+	if (unlikely(q->zc_addr == NULL))
+		return Q_ERROR(q, "PFQ: read: zero-copy Rx not enabled");
+
+	nq->zc_addr = q->zc_addr;
+	return __pfq_read(q, nq, microseconds);
+}
+
+
+int
+pfq_rx_release(pfq_t *q, size_t count)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+
+	if (unlikely(qd == NULL || !(q->rx_flags & Q_ENABLE_RX_STREAM)))
+		return Q_ERROR(q, "PFQ: release: streaming Rx not enabled");
+
+	q->rx_stream_cons += min(count, q->rx_stream_next - q->rx_stream_cons);
+	__atomic_store_n(&qd->rx_ring.cons.index, q->rx_stream_cons, __ATOMIC_RELEASE);
+	return Q_OK(q);
+}
+
+
 int
 pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int microseconds)
 {
+	if (q->rx_lanes > 1) {
+		return Q_ERROR(q, "PFQ: recv: not supported with Rx lanes");
+	}
+
 	if (buflen < (q->rx_slots * q->rx_slot_size)) {
 		return Q_ERROR(q, "PFQ: buffer too small");
 	}
@@ -1730,7 +2285,7 @@ pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int
 	if (pfq_read(q, nq, microseconds) < 0)
 		return -1;
 
-	memcpy(buf, nq->queue, q->rx_slot_size * nq->len);
+	memcpy(buf, nq->queue, (q->rx_flags & Q_ENABLE_RX_PACKED) ? nq->len : q->rx_slot_size * nq->len);
 	return Q_OK(q);
 }
 
@@ -1741,7 +2296,8 @@ pfq_dispatch(pfq_t *q, pfq_handler_t cb, long int microseconds, char *user)
 	pfq_iterator_t it, it_end;
 	int n = 0;
 
-	if (pfq_read(q, &q->nq, microseconds) < 0)
+	if ((q->zc_addr ? pfq_read_zerocopy(q, &q->nq, microseconds)
+			: pfq_read(q, &q->nq, microseconds)) < 0)
 		return -1;
 
 	it = pfq_net_queue_begin(&q->nq);
@@ -1752,7 +2308,21 @@ pfq_dispatch(pfq_t *q, pfq_handler_t cb, long int microseconds, char *user)
 		while (!pfq_pkt_ready(&q->nq, it))
 			pfq_relax();
 
-		cb(user, pfq_pkt_header(it), pfq_pkt_data(it));
+		if (q->rx_flags & Q_ENABLE_RX_PACKED) {
+
+			if (pfq_pkt_padding(it))
+				continue;
+
+			if (q->rx_flags & Q_ENABLE_RX_COMPACT) {
+				struct pfq_pkthdr_compact const *c = pfq_pkt_compact_header(it);
+				struct pfq_pkthdr h = { .tstamp.tv64 = c->tstamp.tv64, .caplen = c->caplen, .len = c->len };
+				cb(user, &h, pfq_pkt_compact_data(it));
+				n++;
+				continue;
+			}
+		}
+
+		cb(user, pfq_pkt_header(it), q->zc_addr ? pfq_pkt_zc_data(&q->nq, it) : pfq_pkt_data(it));
 		n++;
 	}
         return Q_VALUE(q, n);
@@ -1792,6 +2362,119 @@ pfq_unbind_tx(pfq_t *q)
 }
 
 
+/* Tx queues: the producer appends to the half published in prod.index, and
+ * switches to the other one when the kernel has reached it */
+
+static inline struct pfq_shared_tx_queue *
+__pfq_tx_queue(pfq_t *q, int tss)
+{
+        struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
+
+	return tss == -1 ? (struct pfq_shared_tx_queue *)&sh_queue->tx
+			 : (struct pfq_shared_tx_queue *)&sh_queue->tx_async[tss];
+}
+
+
+static inline ptrdiff_t *
+__pfq_tx_prod_off(struct pfq_shared_tx_queue *tx, unsigned int index)
+{
+	return (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
+}
+
+
+/* size of a Tx slot: fixed, or given by the caplen (packed Tx) */
+
+static inline size_t
+__pfq_tx_slot_size(pfq_t const *q, size_t caplen)
+{
+	return (q->tx_flags & Q_ENABLE_TX_PACKED) ? PFQ_SHARED_QUEUE_SLOT_SIZE(caplen) : q->tx_slot_size;
+}
+
+
+/* reserve up to *n slots of caplen bytes, after the ones already reserved:
+ * return the header of the first slot, *n is set to the number of slots */
+
+static struct pfq_pkthdr *
+__pfq_tx_reserve(pfq_t *q, int tss, size_t caplen, size_t *n)
+{
+	struct pfq_shared_tx_queue *tx = __pfq_tx_queue(q, tss);
+	unsigned int index = __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED);
+	size_t slot_size = __pfq_tx_slot_size(q, caplen);
+	struct pfq_pkthdr *hdr;
+	ptrdiff_t offset;
+	char *base_addr;
+	size_t avail, i;
+
+	/* switch half (never with slots reserved in the current one) */
+
+	if (q->tx_resv_num == 0 && __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED) == index) {
+		++index;
+
+		/* zero-copy Tx: the half is still referenced by skbs not completed by the driver */
+
+		if (unlikely(__atomic_load_n(&tx->done.pending[index & 1], __ATOMIC_ACQUIRE)))
+			return *n = 0, NULL;
+
+                __atomic_store_n(__pfq_tx_prod_off(tx, index), 0, __ATOMIC_RELEASE);
+                __atomic_store_n(&tx->prod.index, index, __ATOMIC_RELEASE);
+	}
+
+	base_addr = q->tx_queue_addr + q->tx_queue_size * (size_t)(2 * (1+tss) + (index & 1 ? 1 : 0));
+        offset = __atomic_load_n(__pfq_tx_prod_off(tx, index), __ATOMIC_RELAXED) + (ptrdiff_t)q->tx_resv_len;
+
+        /* ensure there's enough space for the slots */
+
+	avail = (size_t)offset < q->tx_queue_size ? (q->tx_queue_size - (size_t)offset - 1) / slot_size : 0;
+	*n = min(*n, avail);
+
+	hdr = (struct pfq_pkthdr *)(base_addr + offset);
+
+	for(i = 0; i < *n; i++)
+	{
+		struct pfq_pkthdr *h = (struct pfq_pkthdr *)((char *)hdr + i * slot_size);
+		h->tstamp.tv64      = 0;
+		h->len		    = (uint16_t)caplen;
+		h->caplen	    = (uint16_t)caplen;
+		h->info.data.copies = 1;
+	}
+
+	return hdr;
+}
+
+
+/* publish n slots with a single store */
+
+static void
+__pfq_tx_commit(pfq_t *q, int tss, size_t n)
+{
+	struct pfq_shared_tx_queue *tx = __pfq_tx_queue(q, tss);
+	unsigned int index = __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED);
+	ptrdiff_t *poff_addr = __pfq_tx_prod_off(tx, index);
+	ptrdiff_t offset = __atomic_load_n(poff_addr, __ATOMIC_RELAXED);
+
+	if (q->tx_flags & Q_ENABLE_TX_PACKED) {
+		char *base_addr = q->tx_queue_addr + q->tx_queue_size * (size_t)(2 * (1+tss) + (index & 1 ? 1 : 0));
+		for(; n > 0; n--)
+			offset += (ptrdiff_t)PFQ_SHARED_QUEUE_SLOT_SIZE(((struct pfq_pkthdr *)(base_addr + offset))->caplen);
+	}
+	else {
+		offset += (ptrdiff_t)(n * q->tx_slot_size);
+	}
+
+	if (tss == -1) {
+		__atomic_store_n(poff_addr, offset, __ATOMIC_RELEASE);
+	}
+	else {
+		/* async queue: ring the doorbell if the Tx kthread sleeps (see pfq_sync_queue) */
+
+		__atomic_store_n(poff_addr, offset, __ATOMIC_SEQ_CST);
+		if (unlikely(__atomic_load_n(&tx->cons.wait, __ATOMIC_SEQ_CST)) &&
+		    __atomic_exchange_n(&tx->cons.wait, 0, __ATOMIC_ACQ_REL))
+			pfq_sync_queue(q, tss + 1);
+	}
+}
+
+
 int
 pfq_send_raw( pfq_t *q
 	    , const void *buf
@@ -1800,60 +2483,116 @@ pfq_send_raw( pfq_t *q
 	    , unsigned int copies
 	    , int async)
 {
-        struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
-        struct pfq_shared_tx_queue *tx;
-        unsigned int index;
-        ptrdiff_t offset, *poff_addr;
-        uint16_t caplen;
-        char *base_addr;
+        struct pfq_pkthdr *hdr;
+        size_t caplen, n = 1;
         int tss;
 
 	if (unlikely(q->shm_addr == NULL))
 		return Q_ERROR(q, "PFQ: send: socket not enabled");
 
+	if (unlikely(q->tx_resv_num != 0))
+		return Q_ERROR(q, "PFQ: send: Tx slots reserved (see pfq_tx_commit)");
+
 	if (async != Q_NO_KTHREAD) {
 		if (unlikely(q->tx_num_async == 0))
 			return Q_ERROR(q, "PFQ: send: socket not bound to async thread");
 
 		tss = (int)pfq_fold((async == Q_ANY_KTHREAD ? pfq_symmetric_hash(buf) : (unsigned int)async)
 				   ,(unsigned int)q->tx_num_async);
-
-		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx_async[tss];
 	}
 	else {
 		tss = -1;
-		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx;
 	}
 
-	index = __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED);
-	if (index == __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED)) {
-		++index;
-		poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
-                __atomic_store_n(poff_addr, 0, __ATOMIC_RELEASE);
-                __atomic_store_n(&tx->prod.index, index, __ATOMIC_RELEASE);
+	caplen = min(len, q->tx_slot_size - sizeof(struct pfq_pkthdr));
+
+	hdr = __pfq_tx_reserve(q, tss, caplen, &n);
+	if (n == 0)
+		return Q_VALUE(q, 0);
+
+	hdr->tstamp.tv64       = nsec;
+	hdr->len	       = (uint16_t)len;
+	hdr->info.data.copies  = copies;
+	__builtin_memcpy(hdr+1, buf, caplen);
+
+	__pfq_tx_commit(q, tss, 1);
+	return Q_VALUE(q, (int)len);
+}
+
+
+static int
+pfq_tx_reserve_queue(pfq_t *q, size_t len, int async, int *tss)
+{
+	if (unlikely(q->shm_addr == NULL))
+		return Q_ERROR(q, "PFQ: Tx reserve: socket not enabled");
+
+	if (unlikely(len == 0 || len > q->tx_slot_size - sizeof(struct pfq_pkthdr)))
+		return Q_ERROR(q, "PFQ: Tx reserve: bad packet length");
+
+	if (async != Q_NO_KTHREAD) {
+		if (unlikely(async < 0 || async >= (int)q->tx_num_async))
+			return Q_ERROR(q, "PFQ: Tx reserve: bad async queue");
+		*tss = async;
 	}
 	else {
-		poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
+		*tss = -1;
 	}
 
-	base_addr = q->tx_queue_addr + q->tx_queue_size * (size_t)(2 * (1+tss) + (index & 1 ? 1 : 0));
-        offset = __atomic_load_n(poff_addr, __ATOMIC_RELAXED);
-	caplen = (uint16_t)min(len, q->tx_slot_size - sizeof(struct pfq_pkthdr));
+	if (unlikely(q->tx_resv_num && q->tx_resv_queue != *tss))
+		return Q_ERROR(q, "PFQ: Tx reserve: slots reserved in another queue");
 
-        /* ensure there's enough space for the current packet */
+	return Q_OK(q);
+}
 
-	if (likely(((size_t)(offset) + q->tx_slot_size) < q->tx_queue_size)) {
-		struct pfq_pkthdr *hdr = (struct pfq_pkthdr *)(base_addr + offset);
-		hdr->tstamp.tv64       = nsec;
-		hdr->len	       = (uint16_t)len;
-		hdr->caplen	       = (uint16_t)caplen;
-		hdr->info.data.copies  = copies;
-		__builtin_memcpy(hdr+1, buf, caplen);
-                __atomic_store_n(poff_addr, offset + (ptrdiff_t)q->tx_slot_size, __ATOMIC_RELEASE);
-		return Q_VALUE(q, (int)len);
+
+int
+pfq_tx_reserve_burst(pfq_t *q, size_t len, void *slots[], int n, int async)
+{
+	struct pfq_pkthdr *hdr;
+	size_t num = n > 0 ? (size_t)n : 0, i;
+	int tss;
+
+	if (pfq_tx_reserve_queue(q, len, async, &tss) < 0)
+		return -1;
+
+	hdr = __pfq_tx_reserve(q, tss, len, &num);
+
+	for(i = 0; i < num; i++)
+		slots[i] = (char *)hdr + i * __pfq_tx_slot_size(q, len) + sizeof(struct pfq_pkthdr);
+
+	if (num) {
+		q->tx_resv_queue = tss;
+		q->tx_resv_num += num;
+		q->tx_resv_len += num * __pfq_tx_slot_size(q, len);
 	}
 
-	return Q_VALUE(q, 0);
+	return Q_VALUE(q, (int)num);
+}
+
+
+void *
+pfq_tx_reserve(pfq_t *q, size_t len, int async)
+{
+	void *slot;
+	int n = pfq_tx_reserve_burst(q, len, &slot, 1, async);
+	return n == 1 ? slot : NULL;
+}
+
+
+int
+pfq_tx_commit(pfq_t *q, int n)
+{
+	if (unlikely(n < 0 || (size_t)n > q->tx_resv_num))
+		return Q_ERROR(q, "PFQ: Tx commit: bad number of slots");
+
+	if (n)
+		__pfq_tx_commit(q, q->tx_resv_queue, (size_t)n);
+
+	/* the slots not committed are released */
+
+	q->tx_resv_num = 0;
+	q->tx_resv_len = 0;
+	return Q_VALUE(q, n);
 }
 
 
@@ -1877,6 +2616,29 @@ pfq_send( pfq_t *q
 }
 
 
+int
+pfq_tx_pending(pfq_t *q, int async)
+{
+        struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
+        struct pfq_shared_tx_queue *tx;
+
+	if (unlikely(q->shm_addr == NULL))
+		return Q_ERROR(q, "PFQ: Tx pending: socket not enabled");
+
+	if (async != Q_NO_KTHREAD) {
+		if (async < 0 || async >= (int)q->tx_num_async)
+			return Q_ERROR(q, "PFQ: Tx pending: bad async queue");
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx_async[async];
+	}
+	else {
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx;
+	}
+
+	return Q_VALUE(q, (int)(__atomic_load_n(&tx->done.pending[0], __ATOMIC_ACQUIRE) +
+				__atomic_load_n(&tx->done.pending[1], __ATOMIC_ACQUIRE)));
+}
+
+
 int
 pfq_sync_queue(pfq_t *q, int queue)
 {
@@ -40,9 +40,14 @@ typedef char * pfq_iterator_t;
 struct pfq_net_queue
 {
 	pfq_iterator_t queue;		/* net queue */
-	size_t         len;		/* number of packets in the queue */
+	size_t         len;		/* number of packets in the queue (bytes, if packed) */
 	size_t         slot_size;
 	uint32_t       index;		/* current queue index */
+	const char *   zc_addr;		/* zero-copy Rx area (NULL if not enabled) */
+	unsigned int   flags;		/* Rx layout: Q_ENABLE_RX_PACKED/COMPACT */
+	unsigned int   lanes;		/* per-cpu Rx lanes (0 or 1 = single queue) */
+	size_t         lane_stride;	/* distance between two lanes, in bytes */
+	const size_t * lane_len;	/* bytes available in each lane */
 };
 
 
@@ -62,11 +67,31 @@ struct pfq_data_int
 	void * rx_queue_addr;
 	size_t rx_queue_size;
 
+	void * zc_addr;
+	size_t zc_size;
+
+	void * ring_addr;			/* group ring (NULL if not attached) */
+	size_t ring_size;
+	int    ring_gid;
+	int    ring_reader;			/* group ring: index of the reader (member slot) */
+	unsigned long ring_next;		/* group ring: index of the next packet to read */
+
+	void * flow_addr;			/* group flow table (NULL if not mapped) */
+	size_t flow_size;
+	int    flow_gid;
+
 	size_t rx_slots;
 	size_t rx_slot_size;
 
+	unsigned int rx_flags;
+	unsigned int rx_lanes;
+	unsigned long rx_stream_cons;		/* streaming Rx: slots released */
+	unsigned long rx_stream_next;		/* streaming Rx: slots returned by pfq_read */
+	size_t rx_lane_len[Q_MAX_RX_LANES];	/* bytes read from each lane (packed len, if single) */
+
         size_t tx_slots;
 	size_t tx_slot_size;
+	unsigned int tx_flags;			/* Tx layout: Q_ENABLE_TX_PACKED */
 
 	size_t tx_len;
 	size_t rx_len;
@@ -74,6 +99,10 @@ struct pfq_data_int
 	size_t tx_attempt;
 	size_t tx_num_async;
 
+	int    tx_resv_queue;			/* Tx reservations: socket queue (-1 = sync) */
+	size_t tx_resv_num;			/* Tx reservations: slots not committed yet */
+	size_t tx_resv_len;			/* Tx reservations: bytes of the slots */
+
 	const char * error;
 
 	int fd;
@@ -52,6 +52,23 @@ pfq_net_queue_init(struct pfq_net_queue *nq)
 	nq->len	      = 0;
 	nq->slot_size = 0;
 	nq->index     = 0;
+	nq->zc_addr   = NULL;
+	nq->flags     = 0;
+	nq->lanes     = 0;
+	nq->lane_stride = 0;
+	nq->lane_len  = NULL;
+}
+
+/*! Return an iterator to the first non-empty lane starting from the given one (NULL if none). */
+
+static inline
+pfq_iterator_t
+pfq_net_queue_lane(struct pfq_net_queue const *nq, unsigned int lane)
+{
+	for(; lane < nq->lanes; lane++)
+		if (nq->lane_len[lane])
+			return nq->queue + lane * nq->lane_stride;
+	return NULL;
 }
 
 /*! Return an iterator to the first slot of a non-empty queue. */
@@ -60,6 +77,10 @@ static inline
 pfq_iterator_t
 pfq_net_queue_begin(struct pfq_net_queue const *nq)
 {
+	if (unlikely(nq->lanes > 1)) {
+		pfq_iterator_t it = pfq_net_queue_lane(nq, 0);
+		return it ? it : nq->queue;
+	}
         return nq->queue;
 }
 
@@ -69,19 +90,45 @@ static inline
 pfq_iterator_t
 pfq_net_queue_end(struct pfq_net_queue const *nq)
 {
+	if (unlikely(nq->lanes > 1)) {
+		unsigned int lane = nq->lanes;
+		while (lane-- > 0)
+			if (nq->lane_len[lane])
+				return nq->queue + lane * nq->lane_stride + nq->lane_len[lane];
+		return nq->queue;
+	}
+	if (nq->flags & Q_ENABLE_RX_PACKED)
+		return nq->queue + nq->len;
         return nq->queue + nq->len * nq->slot_size;
 }
 
 /*! Return an iterator to the next slot. */
+/*!
+ * For packed queues the slot must be ready (see pfq_pkt_ready).
+ * With per-cpu lanes the iterator moves to the next non-empty lane
+ * at the end of the current one.
+ */
 
 static inline
 pfq_iterator_t
 pfq_net_queue_next(struct pfq_net_queue const *nq, pfq_iterator_t iter)
 {
-        return iter + nq->slot_size;
+	pfq_iterator_t next = iter + ((nq->flags & Q_ENABLE_RX_PACKED) ?
+		PFQ_PACKED_SLOT_SIZE(nq->flags, ((const struct pfq_pkthdr *)iter)->caplen) : nq->slot_size);
+
+	if (unlikely(nq->lanes > 1)) {
+		unsigned int lane = (unsigned int)((size_t)(iter - nq->queue) / nq->lane_stride);
+		if (next == nq->queue + lane * nq->lane_stride + nq->lane_len[lane]) {
+			pfq_iterator_t it = pfq_net_queue_lane(nq, lane + 1);
+			if (it)
+				return it;
+		}
+	}
+
+	return next;
 }
 
-/*! Return an iterator to the previous slot. */
+/*! Return an iterator to the previous slot (not available for packed queues or lanes). */
 
 static inline
 pfq_iterator_t
@@ -108,12 +155,54 @@ pfq_pkt_data(pfq_iterator_t iter)
         return (const char *)(iter + sizeof(struct pfq_pkthdr));
 }
 
+/*! Given an iterator of a compact queue, return a pointer to the packet header. */
+
+static inline
+const struct pfq_pkthdr_compact *
+pfq_pkt_compact_header(pfq_iterator_t iter)
+{
+        return (const struct pfq_pkthdr_compact *)iter;
+}
+
+/*! Given an iterator of a compact queue, return a pointer to the packet data. */
+
+static inline
+const char *
+pfq_pkt_compact_data(pfq_iterator_t iter)
+{
+        return (const char *)(iter + sizeof(struct pfq_pkthdr_compact));
+}
+
+/*! Given an iterator of a packed queue, return 1 if the slot is padding. */
+
+static inline
+int
+pfq_pkt_padding(pfq_iterator_t iter)
+{
+        return pfq_pkt_header(iter)->len == 0;
+}
+
+/*! Given an iterator of a zero-copy queue, return a pointer to the packet data. */
+/*!
+ * The data is either in the zero-copy area or stored inline in the slot.
+ */
+
+static inline
+const char *
+pfq_pkt_zc_data(struct pfq_net_queue const *nq, pfq_iterator_t iter)
+{
+        struct pfq_pkt_ref const *ref = (struct pfq_pkt_ref const *)pfq_pkt_data(iter);
+        return ref->off == PFQ_PKT_REF_INLINE ? (const char *)(ref+1) : nq->zc_addr + ref->off;
+}
+
 /*! Given an iterator, return 1 if the packet is available. */
 
 static inline
 int
 pfq_pkt_ready(struct pfq_net_queue const *nq, pfq_iterator_t iter)
 {
+	if (nq->flags & Q_ENABLE_RX_COMPACT)
+		return (int)(__atomic_load_n(&pfq_pkt_compact_header(iter)->commit, __ATOMIC_ACQUIRE) == nq->index);
         return (int)(__atomic_load_n(&pfq_pkt_header(iter)->info.commit, __ATOMIC_ACQUIRE) == nq->index);
 }
 
@@ -309,6 +398,44 @@ extern int pfq_group_id(pfq_t *q);
 extern int pfq_enable(pfq_t *q);
 
 
+/*! Enable the socket for zero-copy packets capture and transmission. */
+/*!
+ * Like pfq_enable, but Rx slots reference packets stored in the skb pools
+ * of the kernel module, mapped read-only in the process.
+ * Packets must be read with pfq_read_zerocopy and accessed by means of
+ * pfq_pkt_zc_data. A buffer is not given back to the pool when read: it
+ * stays held until its slot is written again, after the next swap of the
+ * queue (or until the socket is disabled), so the data must not be accessed
+ * past that. The buffers held by a socket are capped to max_pool_size / 2
+ * (module parameter): past that, packets are copied inline in the slots.
+ * The pools are shared: the mapped area also holds the packets of other sockets
+ * and groups. Hence zero-copy requires the rx_zerocopy module parameter and
+ * CAP_NET_ADMIN.
+ */
+
+extern int pfq_enable_zerocopy(pfq_t *q);
+
+
+/*! Enable the socket with the given Q_ENABLE_* flags. */
+/*!
+ * Q_ENABLE_RX_PACKED stores packets in variable-length slots: the length of
+ * the net queue is then expressed in bytes and the iterators walk the queue
+ * by means of the caplen of each header. Slots with len == 0 are padding
+ * (see pfq_pkt_padding) and must be skipped.
+ * Q_ENABLE_RX_COMPACT (with Q_ENABLE_RX_PACKED) replaces pfq_pkthdr with the
+ * smaller pfq_pkthdr_compact (see pfq_pkt_compact_header and pfq_pkt_compact_data).
+ * Q_ENABLE_RX_STREAM turns the Rx queue into a single ring with producer and
+ * consumer indexes: slots are given back to the kernel by the next read or by
+ * pfq_rx_release, and no double buffer is used (see pfq_rx_release).
+ * Q_ENABLE_TX_ZEROCOPY transmits the Tx slots without copying them into the
+ * socket buffers (see pfq_tx_pending).
+ * Q_ENABLE_TX_PACKED stores the Tx packets in variable-length slots, sized
+ * after their caplen: small frames no longer take a whole xmitlen slot.
+ */
+
+extern int pfq_enable_flags(pfq_t *q, unsigned int flags);
+
+
 /*! Disable the socket. */
 /*!
  * Release the shared memory, stop kernel threads.
@@ -341,6 +468,40 @@ extern int pfq_set_weight(pfq_t *q, int value);
 extern int pfq_get_weight(pfq_t const *q);
 
 
+/*! Set the Rx latency bound of the socket, in microseconds. */
+/*!
+ * Packets are delivered in batches: a batch is flushed as soon as its oldest
+ * packet is older than the tightest latency bound among the open sockets.
+ * 0 restores the default of the module (capt_latency parameter).
+ */
+
+extern int pfq_set_rx_latency(pfq_t *q, int usec);
+
+/*! Return the Rx latency bound of the socket (0 = module default). */
+
+extern int pfq_get_rx_latency(pfq_t const *q);
+
+
+/*! Specify the NUMA node of the socket queues. */
+/*!
+ * The Rx and Tx queues are allocated on the given node when the socket is
+ * enabled (HugePages are bound to it by pfq_enable). Q_NODE_DEVICE selects the
+ * node of the device the socket is bound to (Tx binding first, then the devices
+ * of its groups): bind the socket before enabling it. Q_NODE_ANY (default)
+ * leaves the placement to the kernel.
+ */
+
+extern int pfq_set_mem_node(pfq_t *q, int node);
+
+/*! Return the NUMA node of the socket queues. */
+/*!
+ * Once the socket is enabled, the node the queues landed on; before, the node
+ * they will be allocated on. Q_NODE_ANY if unknown.
+ */
+
+extern int pfq_get_mem_node(pfq_t const *q);
+
+
 /*! Specify the capture length of packets, in bytes. */
 /*!
  * Capture length must be set before the socket is enabled.
@@ -376,6 +537,22 @@ extern int pfq_set_rx_slots(pfq_t *q, size_t value);
 extern size_t pfq_get_rx_slots(pfq_t const *q);
 
 
+/*! Split the Rx queue into per-cpu lanes. */
+/*!
+ * Each lane is an independent queue of rx_slots/lanes slots, filled by the CPUs
+ * n % lanes, so that producers do not contend on a single queue index.
+ * pfq_read merges the lanes and the iterators walk all of them.
+ * Must be set before the socket is enabled; 0 or 1 selects the single queue.
+ */
+
+extern int pfq_set_rx_lanes(pfq_t *q, unsigned int lanes);
+
+
+/*! Return the number of per-cpu Rx lanes. */
+
+extern unsigned int pfq_get_rx_lanes(pfq_t const *q);
+
+
 /*! Return the size of a Rx slot, in bytes. */
 
 extern size_t pfq_get_rx_slot_size(pfq_t const *q);
@@ -467,6 +644,75 @@ extern int pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group
 extern int pfq_leave_group(pfq_t *q, int gid);
 
 
+/*! Create the single-copy ring of the given group. */
+/*!
+ * The packets that the group broadcasts (or copies) to the sockets attached to
+ * the ring are written only once, into a ring of 'slots' packets of at most
+ * 'caplen' bytes. Each reader has its own index and the slots are reclaimed as
+ * soon as the slowest reader releases them. With Q_RING_POLICY_BLOCK the slowest
+ * reader holds the ring (packets are lost when it is full); with Q_RING_POLICY_DROP
+ * the readers that lag behind are overrun and lose packets instead.
+ * The socket must have joined the group; the ring lives as long as the group.
+ */
+
+extern int pfq_group_ring_create(pfq_t *q, int gid, size_t slots, size_t caplen, int policy);
+
+
+/*! Attach the socket to the ring of the given group, as a reader. */
+/*!
+ * The ring is mapped in memory and the socket no longer receives in its own
+ * queue the packets broadcast by the group. A socket is attached to one ring at a time.
+ */
+
+extern int pfq_group_ring_attach(pfq_t *q, int gid);
+
+
+/*! Detach the socket from its group ring. */
+
+extern int pfq_group_ring_detach(pfq_t *q);
+
+
+/*! Read packets in place from the group ring. */
+/*!
+ * Same as pfq_read: the packets returned by the previous read are released.
+ * With Q_RING_POLICY_DROP a packet is valid as long as pfq_pkt_ready
+ * still returns true after it is processed.
+ */
+
+extern int pfq_group_ring_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
+
+
+/*! Return the number of packets of the group ring lost by this socket (overruns). */
+
+extern int pfq_group_ring_lost(pfq_t const *q, unsigned long *lost);
+
+
+/*! Create the flow table of the given group. */
+/*!
+ * The table tracks the IPv4 flows (both directions) of the packets that the
+ * computation of the group passes to the functions flow_count and flow_first:
+ * at most 'entries' flows (a power of 2), each entry being reused once its flow
+ * has been idle for 'timeout' msec. The socket must have joined the group; the
+ * table lives as long as the group.
+ */
+
+extern int pfq_group_flow_table_create(pfq_t *q, int gid, size_t entries, unsigned int timeout);
+
+
+/*! Map in memory (read-only) the flow table of the given group. */
+/*!
+ * Entries and counters are updated by the kernel while they are read, see struct
+ * pfq_shared_flow_table. A socket maps one table at a time.
+ */
+
+extern int pfq_group_flow_table_map(pfq_t *q, int gid, struct pfq_shared_flow_table const **table);
+
+
+/*! Unmap the flow table mapped by the socket. */
+
+extern int pfq_group_flow_table_unmap(pfq_t *q);
+
+
 /*! Return the mask of the joined groups. */
 /*!
  * Each socket can bind to multiple groups. Each bit of the mask represents
@@ -502,6 +748,26 @@ extern int pfq_set_group_computation_from_string(pfq_t *q, int gid, const char *
 extern int pfq_set_group_computation_from_file(pfq_t *q, int gid, const char *filepath);
 
 
+/*! Enable/disable the profiling of the computation of the given group. */
+/*!
+ * While enabled, each function of the computation counts the packets it
+ * evaluates, passes and drops; one packet every sample (per cpu) is also timed
+ * in cycles. A sample of 0 disables profiling, which costs nothing then.
+ */
+
+extern int pfq_set_group_lang_profile(pfq_t *q, int gid, int sample);
+
+
+/*! Return the profile of the computation of the given group. */
+/*!
+ * The profile is indexed as the functions of the computation descriptor. On
+ * input *size is the number of entries of node; on output, the number of
+ * functions of the computation. Nothing is copied if node is too small.
+ */
+
+extern int pfq_get_group_lang_profile(pfq_t const *q, int gid, struct pfq_lang_node_profile *node, size_t *size);
+
+
 /*! Specify a BPF program for the given group. */
 /*!
  * This function can be used to set a specific BPF filter for the group.
@@ -544,7 +810,8 @@ extern int pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */);
 
 /*! Read packets in place. */
 /*!
- * Wait for packets and return the number of packets available.
+ * Wait for packets and return the number of packets available
+ * (the number of bytes, for packed queues).
  * References to packets are stored into the 'pfq_net_queue' data structure.
  *
  * The memory of the socket queue is reset at the next read.
@@ -554,6 +821,25 @@ extern int pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */);
 extern int pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
 
 
+/*! Release the first 'count' packets returned by the last read. */
+/*!
+ * Available for sockets enabled with Q_ENABLE_RX_STREAM: the released slots
+ * are given back to the kernel at once, instead of at the next read.
+ * Packets are released in order; the released ones must not be accessed anymore.
+ */
+
+extern int pfq_rx_release(pfq_t *q, size_t count);
+
+
+/*! Read packets in place from a zero-copy socket. */
+/*!
+ * Same as pfq_read for sockets enabled with pfq_enable_zerocopy.
+ * The data of packets is returned by pfq_pkt_zc_data.
+ */
+
+extern int pfq_read_zerocopy(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
+
+
 /*! Receive packets in the given buffer. */
 /*!
  * Wait for packets and return the number of packets available.
@@ -594,6 +880,15 @@ extern int pfq_get_fd(pfq_t const *q);
 extern int pfq_get_stats(pfq_t const *q, struct pfq_stats *stats);
 
 
+/*! Return the Tx pacing statistics of the socket. */
+/*!
+ * Packets with a timestamp (see pfq_send_raw) are transmitted at that time by
+ * the Tx kthreads: the statistics report how many were transmitted and how late.
+ */
+
+extern int pfq_get_tx_pacing_stats(pfq_t const *q, struct pfq_tx_pacing_stats *stats);
+
+
 /*! Return the statistics of the given group. */
 
 extern int pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats);
@@ -605,13 +900,31 @@ extern int pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *
 
 
 /*! Transmit the packets in the queue. */
+/*!
+ * queue = 0 transmits the synchronous Tx queue. queue = n+1 rings the doorbell
+ * of the Tx kthread serving the async queue n, which sleeps when idle: this is
+ * done by pfq_send_raw when the kthread has armed the doorbell of the queue.
+ */
 
 extern int pfq_sync_queue(pfq_t *q, int queue);
 
 
+/*! Return the number of zero-copy Tx packets not yet completed by the driver. */
+/*!
+ * Sockets enabled with Q_ENABLE_TX_ZEROCOPY transmit the slots of the Tx queue
+ * without copying them: a half of the queue is reused only when the driver has
+ * completed all the packets it refers to (until then pfq_send_raw returns 0).
+ * async is the index of the async queue, or Q_NO_KTHREAD for the sync one.
+ */
+
+extern int pfq_tx_pending(pfq_t *q, int async);
+
+
 /*! Schedule packet transmission. */
 /*!
- * The packet is copied into a Tx queue.
+ * The packet is copied into a Tx queue. A non-zero nsec is the time of
+ * transmission (CLOCK_REALTIME, in nanoseconds), honoured by the Tx kthreads
+ * of async queues and ignored by the synchronous queue.
  */
 
 extern int pfq_send_raw(pfq_t *q, const void *ptr, size_t len, uint64_t nsec, unsigned int copies, int async);
@@ -637,6 +950,52 @@ int pfq_send_async(pfq_t *q, const void *ptr, size_t len, unsigned int copies, i
 }
 
 
+/*! Reserve a slot of the Tx queue, to build a packet of len bytes in place. */
+/*!
+ * Return the address where the packet is to be written, or NULL when the queue
+ * is full (or on error, see pfq_error). The packet is transmitted once
+ * committed (see pfq_tx_commit). async is the index of the async queue, or
+ * Q_NO_KTHREAD for the sync one. Slots reserved and not yet committed must
+ * belong to the same queue, and pfq_send_raw fails until they are committed.
+ */
+
+extern void *pfq_tx_reserve(pfq_t *q, size_t len, int async);
+
+
+/*! Reserve up to n slots of the Tx queue, to build packets of len bytes in place. */
+/*!
+ * The addresses of the slots are stored in slots. Return the number of slots
+ * reserved (0 when the queue is full), or -1 on error.
+ */
+
+extern int pfq_tx_reserve_burst(pfq_t *q, size_t len, void *slots[], int n, int async);
+
+
+/*! Publish the first n reserved slots. */
+/*!
+ * The slots are published with a single store: the packets are transmitted by
+ * the Tx kthread (async queue) or by pfq_sync_queue (sync queue). The slots
+ * reserved and not committed are released.
+ */
+
+extern int pfq_tx_commit(pfq_t *q, int n);
+
+
+/*! Return the header of a reserved slot. */
+/*!
+ * By default the packet is len bytes long (as reserved), with no timestamp
+ * and one copy: the header may be updated before the commit (caplen and len
+ * no larger than the reserved length). With Q_ENABLE_TX_PACKED the caplen
+ * sets the size of the slot and must not be changed.
+ */
+
+static inline
+struct pfq_pkthdr *pfq_tx_slot_header(void *slot)
+{
+	return (struct pfq_pkthdr *)slot - 1;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
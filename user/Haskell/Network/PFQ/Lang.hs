@@ -64,6 +64,11 @@ module Network.PFQ.Lang
     , NetPredicate
     , NetProperty
     , (>->)
+
+    -- * Profile
+
+    , NodeProfile(..)
+    , prettyProfile
     ) where
 
 
@@ -393,6 +398,35 @@ instance Pretty (Function f) where
         pretty (Kleisli a b) = pretty a ++ " >-> " ++ pretty b
 
 
+-- |Profile of a function of a computation, as collected by the kernel.
+
+data NodeProfile = NodeProfile {
+      npHit       ::  Integer               -- ^ packets evaluated
+    , npPass      ::  Integer               -- ^ packets passed
+    , npDrop      ::  Integer               -- ^ packets dropped
+    , npSamples   ::  Integer               -- ^ packets timed
+    , npCycles    ::  Integer               -- ^ cycles spent on timed packets
+    } deriving (Eq, Show)
+
+
+-- |Pretty print a computation, annotating each function with its profile.
+-- The profile is indexed as the serialized computation.
+
+prettyProfile :: NetFunction -> [NodeProfile] -> String
+prettyProfile comp prof = fst (prettyAt comp 0)
+    where prettyAt :: NetFunction -> Int -> (String, Int)
+          prettyAt (Kleisli a b) n = let (s1, n1) = prettyAt a n
+                                         (s2, n2) = prettyAt b n1
+                                     in (s1 ++ " >-> " ++ s2, n2)
+          prettyAt f n = (pretty f ++ annotate (drop n prof), snd (serialize f n))
+
+          annotate (p:_) = " {hit=" ++ show (npHit p) ++
+                           " pass=" ++ show (npPass p) ++
+                           " drop=" ++ show (npDrop p) ++
+                           (if npSamples p > 0 then " cycles=" ++ show (npCycles p `div` npSamples p) else "") ++ "}"
+          annotate [] = ""
+
+
 -- | Serializable class, a typeclass used to serialize computations.
 -- Transform a Function into a list of FunctionDescr.
 
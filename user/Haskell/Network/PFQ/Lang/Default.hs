@@ -83,6 +83,7 @@ module Network.PFQ.Lang.Default
     , udp_len
     , icmp_type
     , icmp_code
+    , flow_state
 
       -- * Combinators
 
@@ -208,6 +209,8 @@ module Network.PFQ.Lang.Default
     , dec
     , mark
     , put_state
+    , flow_count
+    , flow_first
 
     ) where
 
@@ -459,6 +462,12 @@ icmp_type = Property "icmp_type" () () () () () () () ()
 -- | Evaluate to the /code/ field of the ICMP header.
 icmp_code = Property "icmp_code" () () () () () () () ()
 
+-- | Evaluate to the state of the flow in the flow table of the group (1 = new, 2 = established, 3 = closed).
+-- Nothing if the flow is not tracked.
+--
+-- > flow_count >-> when (flow_state .== 2) steer_flow
+flow_state = Property "flow_state" () () () () () () () ()
+
 
 -- Predefined in-kernel computations:
 
@@ -763,6 +772,18 @@ mark n = Function "mark" n () () () () () () ()
 put_state :: Word32 -> NetFunction
 put_state n = Function "put_state" n () () () () () () ()
 
+-- | Account the packet to its flow, in the flow table of the group.
+--
+-- > ip >-> flow_count >-> steer_flow
+flow_count = Function "flow_count" () () () () () () () () :: NetFunction
+
+-- | Pass the first n packets of each flow (accounted as 'flow_count' does).
+-- The packets of the flows that are not tracked pass.
+--
+-- > tcp >-> flow_first 10 >-> steer_flow
+flow_first :: Int -> NetFunction
+flow_first n = Function "flow_first" n () () () () () () ()
+
 -- | Monadic version of 'is_l3_proto' predicate.
 --
 -- Predicates are used in conditional expressions, while monadic functions
@@ -62,6 +62,7 @@ struct pcap_conf_key pcap_conf_keys[] =
 ,	PCAP_CONF_KEY(pfq_tx_hw_queue)
 ,	PCAP_CONF_KEY(pfq_tx_idx_thread)
 ,	PCAP_CONF_KEY(pfq_vlan)
+,	PCAP_CONF_KEY(pfq_rx_packed)
 #endif
 };
 
@@ -85,6 +86,7 @@ pcap_config_default(pcap_t *handle)
 	,	.pfq_tx_hw_queue	= {-1, -1, -1, -1}
 	,	.pfq_tx_idx_thread	= { Q_NO_KTHREAD, Q_NO_KTHREAD, Q_NO_KTHREAD, Q_NO_KTHREAD }
 	,	.pfq_vlan		= {[0 ... PCAP_FANOUT_GROUP_DEFAULT] = NULL }
+	,	.pfq_rx_packed		= 0
 #endif
 	};
 }
@@ -429,6 +431,10 @@ pcap_parse_config(struct pcap_config *opt, const char *filename)
 				free (opt->pfq_vlan[index]);
 				opt->pfq_vlan[index] = strdup(pcap_string_trim(value));
 			} break;
+			case PCAP_CONF_KEY_pfq_rx_packed: {
+				pcap_warn_if(index, filename, tkey);
+				opt->pfq_rx_packed = atoi(value);
+			} break;
 #endif
 			case PCAP_CONF_KEY_error:
 			default: {
@@ -55,6 +55,7 @@
 #define PCAP_CONF_KEY_pfq_tx_hw_queue	6
 #define PCAP_CONF_KEY_pfq_tx_idx_thread	7
 #define PCAP_CONF_KEY_pfq_vlan		8
+#define PCAP_CONF_KEY_pfq_rx_packed	9
 #endif
 
 
@@ -101,6 +102,8 @@ struct pcap_config
 	int pfq_tx_idx_thread[4];
 
 	char *pfq_vlan [PCAP_FANOUT_GROUP_DEFAULT+1];
+
+	int pfq_rx_packed;	/* 0 = fixed slots, 1 = packed, 2 = packed with compact headers */
 #endif
 
 };
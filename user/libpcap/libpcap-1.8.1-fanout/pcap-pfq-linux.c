@@ -549,6 +549,9 @@ pfq_parse_env(struct pcap_config *opt)
 	if ((var = getenv("PFQ_TX_SYNC")))
 		opt->pfq_tx_sync = atoi(var);
 
+	if ((var = getenv("PFQ_RX_PACKED")))
+		opt->pfq_rx_packed = atoi(var);
+
 	if ((var = getenv("PFQ_VLAN")))
 		opt->pfq_vlan[PCAP_FANOUT_GROUP_DEFAULT] = var;
 
@@ -973,10 +976,12 @@ pfq_activate_linux(pcap_t *handle)
 	}
 
 	/*
-	 * Enable PFQ socket
+	 * Enable PFQ socket (possibly with packed Rx slots)
 	 */
 
-	if (pfq_enable(handlep->q) == -1) {
+	if (pfq_enable_flags(handlep->q, handle->opt.config.pfq_rx_packed == 0 ? 0 :
+					 handle->opt.config.pfq_rx_packed == 1 ? Q_ENABLE_RX_PACKED :
+					 Q_ENABLE_RX_PACKED|Q_ENABLE_RX_COMPACT) == -1) {
 		snprintf(handle->errbuf, PCAP_ERRBUF_SIZE, "%s", pfq_error(handlep->q));
 		goto fail;
 	}
@@ -1121,6 +1126,32 @@ pfq_read_linux(pcap_t *handle, int max_packets, pcap_handler callback, u_char *u
 
 		h = (struct pfq_pkthdr *)pfq_pkt_header(it);
 
+		if (nq->flags & Q_ENABLE_RX_PACKED) {
+
+			if (pfq_pkt_padding(it))
+				continue;
+
+			/* compact headers: no extended information */
+
+			if (nq->flags & Q_ENABLE_RX_COMPACT) {
+
+				struct pfq_pkthdr_compact const *c = pfq_pkt_compact_header(it);
+
+				pcap_h.ts.tv_sec  = c->tstamp.tv.sec;
+				pcap_h.ts.tv_usec = c->tstamp.tv.nsec / 1000;
+				pcap_h.caplen     = c->caplen;
+				pcap_h.len        = c->len;
+
+				memset(&pcap_h.info, 0, sizeof(struct pfq_pkthdr_info));
+
+				callback(user, (struct pcap_pkthdr *)&pcap_h, (const u_char *)pfq_pkt_compact_data(it));
+
+				handlep->packets_read++;
+				n--;
+				continue;
+			}
+		}
+
 		pcap_h.ts.tv_sec  = h->tstamp.tv.sec;
 		pcap_h.ts.tv_usec = h->tstamp.tv.nsec / 1000;
 		pcap_h.caplen     = h->caplen;
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * Group flow table.
+ *
+ * The flow table of the group of the socket is created (entries, timeout msec)
+ * and the flows of the packets read from dev are accounted by the computation
+ * (flow_count by default). At the end, the flows tracked in the mapped table are
+ * dumped, along with the packets of the flows that were not tracked.
+ */
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static const char *
+state_to_string(uint32_t state)
+{
+	switch(state)
+	{
+	case Q_FLOW_STATE_NEW:		return "new";
+	case Q_FLOW_STATE_ESTABLISHED:	return "established";
+	case Q_FLOW_STATE_CLOSED:	return "closed";
+	}
+	return "?";
+}
+
+
+static void
+dump(struct pfq_shared_flow_table const *table)
+{
+	char saddr[INET_ADDRSTRLEN], daddr[INET_ADDRSTRLEN];
+	size_t n, flows = 0;
+
+	for(n = 0; n < table->info.entries; n++)
+	{
+		struct pfq_flow_entry const *e = &table->entry[n];
+
+		if (__atomic_load_n(&e->key, __ATOMIC_ACQUIRE) == 0)
+			continue;
+
+		inet_ntop(AF_INET, &e->saddr, saddr, sizeof(saddr));
+		inet_ntop(AF_INET, &e->daddr, daddr, sizeof(daddr));
+
+		printf("%s:%d -> %s:%d proto %d %-11s packets %lu (replies %lu) bytes %lu duration %.3f sec\n",
+		       saddr, ntohs(e->sport), daddr, ntohs(e->dport), e->proto,
+		       state_to_string(__atomic_load_n(&e->state, __ATOMIC_RELAXED)),
+		       (unsigned long)e->packets, (unsigned long)e->replies, (unsigned long)e->bytes,
+		       (double)(uint32_t)(e->last - e->first) / table->info.hz);
+		flows++;
+	}
+
+	printf("flows: %zu/%zu - not tracked: %lu packets - evicted: %lu\n", flows, table->info.entries,
+	       table->stats.full, table->stats.evicted);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct pfq_shared_flow_table const *table;
+	struct pfq_net_queue nq;
+	double start;
+
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [seconds] [entries] [timeout] [computation]\n", argv[0]);
+                return 0;
+        }
+
+        int seconds = argc > 2 ? atoi(argv[2]) : 10;
+        size_t entries = argc > 3 ? (size_t)atol(argv[3]) : 1024;
+        unsigned int timeout = argc > 4 ? (unsigned int)atoi(argv[4]) : 30000;
+        const char *prog = argc > 5 ? argv[5] : "main = flow_count";
+        pfq_t *q;
+
+        q = pfq_open(64, 4096, 64, 1024);
+        if (q == NULL) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+        if (pfq_enable(q) < 0 ||
+            pfq_group_flow_table_create(q, pfq_group_id(q), entries, timeout) < 0 ||
+            pfq_group_flow_table_map(q, pfq_group_id(q), &table) < 0 ||
+            pfq_set_group_computation_from_string(q, pfq_group_id(q), prog) < 0 ||
+            pfq_bind(q, argv[1], Q_ANY_QUEUE) < 0) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+	printf("reading from %s (%s) for %d seconds...\n", argv[1], prog, seconds);
+
+	start = now();
+
+	while (now() - start < seconds)
+	{
+		if (pfq_read(q, &nq, 1000) < 0) {
+			printf("error: %s\n", pfq_error(q));
+			return -1;
+		}
+	}
+
+	dump(table);
+
+	pfq_close(q);
+        return 0;
+}
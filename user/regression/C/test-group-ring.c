@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * Broadcast fan-out to N readers of a single-copy group ring.
+ *
+ * All the readers join the same group: the packets are written once to the
+ * ring of the group, and each reader consumes them with its own index.
+ */
+
+#define MAX_READERS 16
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [readers] [drop] [seconds]\n", argv[0]);
+                return 0;
+        }
+
+        int readers = argc > 2 ? atoi(argv[2]) : 4;
+        int policy = argc > 3 && atoi(argv[3]) ? Q_RING_POLICY_DROP : Q_RING_POLICY_BLOCK;
+        int seconds = argc > 4 ? atoi(argv[4]) : 10;
+
+        unsigned long long count[MAX_READERS] = { 0 };
+        pfq_t *p[MAX_READERS];
+        int n, gid;
+
+        if (readers < 1 || readers > MAX_READERS) {
+                fprintf(stderr, "readers: 1 to %d\n", MAX_READERS);
+                return -1;
+        }
+
+        for(n = 0; n < readers; n++)
+        {
+                p[n] = pfq_open_group(Q_CLASS_DEFAULT, Q_POLICY_GROUP_RESTRICTED, 64, 1024, 64, 1024);
+                if (p[n] == NULL) {
+                        printf("error: %s\n", pfq_error(p[n]));
+                        return -1;
+                }
+        }
+
+        gid = pfq_group_id(p[0]);
+
+        for(n = 1; n < readers; n++)
+        {
+                if (pfq_leave_group(p[n], pfq_group_id(p[n])) < 0 ||
+                    pfq_join_group(p[n], gid, Q_CLASS_DEFAULT, Q_POLICY_GROUP_RESTRICTED) < 0) {
+                        printf("error: %s\n", pfq_error(p[n]));
+                        return -1;
+                }
+        }
+
+        if (pfq_group_ring_create(p[0], gid, 65536, 1514, policy) < 0) {
+                printf("error: %s\n", pfq_error(p[0]));
+                return -1;
+        }
+
+        for(n = 0; n < readers; n++)
+        {
+                if (pfq_enable(p[n]) < 0 ||
+                    pfq_group_ring_attach(p[n], gid) < 0) {
+                        printf("error: %s\n", pfq_error(p[n]));
+                        return -1;
+                }
+        }
+
+        if (pfq_bind(p[0], argv[1], Q_ANY_QUEUE) < 0) {
+                printf("error: %s\n", pfq_error(p[0]));
+                return -1;
+        }
+
+	printf("reading from %s: group %d, %d readers (%s policy)...\n", argv[1], gid, readers,
+	       policy == Q_RING_POLICY_DROP ? "drop" : "block");
+
+	double start = now(), last = start;
+
+	while (seconds == 0 || last - start < seconds) {
+
+		for(n = 0; n < readers; n++)
+		{
+			struct pfq_net_queue nq;
+			pfq_iterator_t it, it_e;
+
+			if (pfq_group_ring_read(p[n], &nq, 0) < 0) {
+				printf("error: %s\n", pfq_error(p[n]));
+				return -1;
+			}
+
+			it = pfq_net_queue_begin(&nq);
+			it_e = pfq_net_queue_end(&nq);
+
+			for(; it != it_e; it = pfq_net_queue_next(&nq, it))
+			{
+				while (!pfq_pkt_ready(&nq, it))
+					pfq_relax();
+				count[n]++;
+			}
+		}
+
+		last = now();
+        }
+
+	for(n = 0; n < readers; n++)
+	{
+		unsigned long lost = 0;
+		pfq_group_ring_lost(p[n], &lost);
+		printf("reader %d: %.0f pps (lost %lu)\n", n, count[n] / (last - start), lost);
+	}
+
+	for(n = 0; n < readers; n++)
+		pfq_close(p[n]);
+
+        return 0;
+}
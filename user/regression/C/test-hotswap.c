@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * Control-plane latency under traffic.
+ *
+ * While reading from dev, the computation of the group is swapped back and forth
+ * (every interval ms); the latency of each swap and the packets lost/dropped by
+ * the socket are reported. At the end, the open/close latency of N sockets is
+ * measured.
+ */
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int
+consume(pfq_t *q, unsigned long long *count)
+{
+	struct pfq_net_queue nq;
+	pfq_iterator_t it, it_e;
+
+	if (pfq_read(q, &nq, 1000) < 0)
+		return -1;
+
+	it = pfq_net_queue_begin(&nq);
+	it_e = pfq_net_queue_end(&nq);
+
+	for(; it != it_e; it = pfq_net_queue_next(&nq, it))
+	{
+		while (!pfq_pkt_ready(&nq, it))
+			pfq_relax();
+		(*count)++;
+	}
+
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [seconds] [interval_ms] [sockets]\n", argv[0]);
+                return 0;
+        }
+
+        int seconds = argc > 2 ? atoi(argv[2]) : 10;
+        int interval = argc > 3 ? atoi(argv[3]) : 100;
+        int sockets = argc > 4 ? atoi(argv[4]) : 16;
+
+        const char *prog[2] = { "main = unit", "main = steer_flow" };
+
+        unsigned long long count = 0;
+        double swap_max = 0, swap_sum = 0;
+        int swaps = 0, n;
+        pfq_t *q;
+
+        q = pfq_open(64, 4096, 64, 1024);
+        if (q == NULL) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+        if (pfq_enable(q) < 0 ||
+            pfq_bind(q, argv[1], Q_ANY_QUEUE) < 0) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+	printf("reading from %s: swapping computation every %d ms...\n", argv[1], interval);
+
+	double start = now(), last = start, next = start + interval / 1000.0;
+
+	while (last - start < seconds) {
+
+		if (consume(q, &count) < 0) {
+			printf("error: %s\n", pfq_error(q));
+			return -1;
+		}
+
+		last = now();
+
+		if (last >= next) {
+
+			double t0 = now(), t;
+
+			if (pfq_set_group_computation_from_string(q, pfq_group_id(q), prog[swaps & 1]) < 0) {
+				printf("error: %s\n", pfq_error(q));
+				return -1;
+			}
+
+			t = now() - t0;
+			swap_sum += t;
+			if (t > swap_max)
+				swap_max = t;
+
+			swaps++;
+			last = now();
+			next = last + interval / 1000.0;
+		}
+	}
+
+	struct pfq_stats stats, gstats;
+
+	if (pfq_get_stats(q, &stats) < 0 ||
+	    pfq_get_group_stats(q, pfq_group_id(q), &gstats) < 0) {
+		printf("error: %s\n", pfq_error(q));
+		return -1;
+	}
+
+	printf("swaps: %d, latency avg %.1f us, max %.1f us\n", swaps,
+	       swaps ? swap_sum * 1e6 / swaps : 0.0, swap_max * 1e6);
+	printf("read %llu packets (%.0f pps): socket recv %lu lost %lu drop %lu, group recv %lu drop %lu\n",
+	       count, count / (last - start), stats.recv, stats.lost, stats.drop, gstats.recv, gstats.drop);
+
+	pfq_close(q);
+
+	/* open/close latency */
+
+	if (sockets > 0) {
+
+		pfq_t *p[sockets];
+		double t0 = now(), t1;
+
+		for(n = 0; n < sockets; n++)
+		{
+			p[n] = pfq_open(64, 1024, 64, 1024);
+			if (p[n] == NULL || pfq_enable(p[n]) < 0) {
+				printf("error: %s\n", pfq_error(p[n]));
+				return -1;
+			}
+		}
+
+		t1 = now();
+
+		for(n = 0; n < sockets; n++)
+			pfq_close(p[n]);
+
+		printf("%d sockets: open %.1f us/socket, close %.1f us/socket\n", sockets,
+		       (t1 - t0) * 1e6 / sockets, (now() - t1) * 1e6 / sockets);
+	}
+
+        return 0;
+}
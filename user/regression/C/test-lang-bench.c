@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * pfq-lang micro-benchmark.
+ *
+ * Each computation is set for the group of the socket in turn, while a pcap mix
+ * is replayed at full speed on dev (e.g. tcpreplay --topspeed --loop=0). The
+ * rate of the packets processed by the group and read by the socket is reported
+ * for each computation.
+ */
+
+static const char *default_prog[] =
+{
+	"main = unit",
+	"main = ip >-> steer_flow",
+	"main = ip >-> udp >-> port 53 >-> steer_flow",
+	"main = tcp >-> no_frag >-> dst_port 80 >-> steer_flow",
+	"main = dst_port 80 >-> no_frag >-> tcp >-> steer_flow",
+	"main = filter (has_dst_port 80 .&&. is_tcp) >-> steer_flow",
+};
+
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int
+consume(pfq_t *q, unsigned long long *count)
+{
+	struct pfq_net_queue nq;
+	pfq_iterator_t it, it_e;
+
+	if (pfq_read(q, &nq, 1000) < 0)
+		return -1;
+
+	it = pfq_net_queue_begin(&nq);
+	it_e = pfq_net_queue_end(&nq);
+
+	for(; it != it_e; it = pfq_net_queue_next(&nq, it))
+	{
+		while (!pfq_pkt_ready(&nq, it))
+			pfq_relax();
+		(*count)++;
+	}
+
+	return 0;
+}
+
+
+static int
+run(pfq_t *q, const char *prog, int seconds)
+{
+	struct pfq_stats s0, s1;
+	unsigned long long count = 0;
+	double start, elapsed;
+
+	if (pfq_set_group_computation_from_string(q, pfq_group_id(q), prog) < 0 ||
+	    pfq_get_group_stats(q, pfq_group_id(q), &s0) < 0) {
+		printf("error: %s\n", pfq_error(q));
+		return -1;
+	}
+
+	start = now();
+
+	while ((elapsed = now() - start) < seconds)
+	{
+		if (consume(q, &count) < 0) {
+			printf("error: %s\n", pfq_error(q));
+			return -1;
+		}
+	}
+
+	if (pfq_get_group_stats(q, pfq_group_id(q), &s1) < 0) {
+		printf("error: %s\n", pfq_error(q));
+		return -1;
+	}
+
+	printf("%-56s group %.0f pps (drop %.0f pps) - read %.0f pps\n", prog,
+	       (s1.recv - s0.recv) / elapsed, (s1.drop - s0.drop) / elapsed, count / elapsed);
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	int n;
+
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [seconds] [computation...]\n", argv[0]);
+                return 0;
+        }
+
+        int seconds = argc > 2 ? atoi(argv[2]) : 10;
+        pfq_t *q;
+
+        q = pfq_open(64, 4096, 64, 1024);
+        if (q == NULL) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+        if (pfq_enable(q) < 0 ||
+            pfq_bind(q, argv[1], Q_ANY_QUEUE) < 0) {
+                printf("error: %s\n", pfq_error(q));
+                return -1;
+        }
+
+	if (argc > 3) {
+		for(n = 3; n < argc; n++)
+			if (run(q, argv[n], seconds) < 0)
+				return -1;
+	}
+	else {
+		for(n = 0; n < (int)(sizeof(default_prog)/sizeof(default_prog[0])); n++)
+			if (run(q, default_prog[n], seconds) < 0)
+				return -1;
+	}
+
+	pfq_close(q);
+        return 0;
+}
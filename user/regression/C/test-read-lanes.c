@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * Rx throughput of a single socket, with or without per-cpu lanes.
+ *
+ * Spread the Rx queues of the device over N cores (IRQ affinity) and
+ * compare the rate with 'lanes' = 0 and 'lanes' = N, for increasing N.
+ */
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [lanes] [seconds]\n", argv[0]);
+                return 0;
+        }
+
+        unsigned int lanes = argc > 2 ? atoi(argv[2]) : 0;
+        int seconds = argc > 3 ? atoi(argv[3]) : 10;
+
+        pfq_t *p = pfq_open(64, 65536, 64, 1024);
+        if (p == NULL) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        if (pfq_set_rx_lanes(p, lanes) < 0 ||
+            pfq_enable(p) < 0 ||
+            pfq_bind(p, argv[1], Q_ANY_QUEUE) < 0) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+	printf("reading from %s (lanes = %u)...\n", argv[1], lanes);
+
+	double start = now(), last = start;
+	unsigned long long total = 0, count = 0;
+
+	while (seconds == 0 || last - start < seconds) {
+
+                struct pfq_net_queue nq;
+		pfq_iterator_t it, it_e;
+
+		if (pfq_read(p, &nq, 1000000) < 0) {
+			printf("error: %s\n", pfq_error(p));
+			break;
+		}
+
+		it = pfq_net_queue_begin(&nq);
+		it_e = pfq_net_queue_end(&nq);
+
+		for(; it != it_e; it = pfq_net_queue_next(&nq, it))
+		{
+			while (!pfq_pkt_ready(&nq, it))
+				pfq_relax();
+			count++;
+		}
+
+		double t = now();
+		if (t - last >= 1.0) {
+			printf("%.0f pps\n", count / (t - last));
+			total += count;
+			count = 0;
+			last = t;
+		}
+        }
+
+	printf("average: %.0f pps\n", total / (last - start));
+
+        pfq_close(p);
+        return 0;
+}
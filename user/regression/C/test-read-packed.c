@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pfq/pfq.h>
+
+#define MIN(a,b) (a < b ? a : b)
+
+int
+main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [compact]\n", argv[0]);
+                return 0;
+        }
+
+        unsigned int flags = Q_ENABLE_RX_PACKED;
+        if (argc > 2 && strcmp(argv[2], "compact") == 0)
+                flags |= Q_ENABLE_RX_COMPACT;
+
+        pfq_t *p = pfq_open(1514, 4096, 64, 1024);
+        if (p == NULL) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        if (pfq_enable_flags(p, flags) < 0) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        if (pfq_bind(p, argv[1], Q_ANY_QUEUE) < 0) {
+		printf("error: %s\n", pfq_error(p));
+		return -1;
+        }
+
+        if (pfq_timestamping_enable(p, 1) < 0) {
+		printf("error: %s\n", pfq_error(p));
+		return -1;
+	}
+
+	printf("reading from %s (%s slots)...\n", argv[1], flags & Q_ENABLE_RX_COMPACT ? "compact" : "packed");
+
+	for(;;) {
+
+                struct pfq_net_queue nq;
+		pfq_iterator_t it, it_e;
+		size_t npkt = 0;
+
+		int bytes = pfq_read(p, &nq, 1000000);
+		if (bytes < 0) {
+			printf("error: %s\n", pfq_error(p));
+			break;
+		}
+
+		if (nq.len == 0) {
+			pfq_yield();
+			continue;
+		}
+
+		it = pfq_net_queue_begin(&nq);
+		it_e = pfq_net_queue_end(&nq);
+
+		for(; it != it_e; it = pfq_net_queue_next(&nq, it))
+		{
+			const struct pfq_pkthdr_compact *h;
+			const char *buff;
+			int x;
+
+			while (!pfq_pkt_ready(&nq, it))
+				pfq_yield();
+
+			if (pfq_pkt_padding(it))
+				continue;
+
+			/* caplen, len and tstamp are at the same offsets in both headers */
+
+			h = pfq_pkt_compact_header(it);
+			buff = flags & Q_ENABLE_RX_COMPACT ? pfq_pkt_compact_data(it) : pfq_pkt_data(it);
+
+			printf("caplen:%d len:%d tstamp: %u:%u -> ", h->caplen, h->len,
+                                        h->tstamp.tv.sec, h->tstamp.tv.nsec);
+
+			for(x=0; x < MIN(h->caplen, 34); x++)
+			{
+				printf("%2x ", (unsigned char)buff[x]);
+			}
+			printf("\n");
+			npkt++;
+		}
+
+		printf("queue: %zu bytes, %zu packets (%.0f packets/MB)\n", nq.len, npkt, npkt * 1048576.0 / nq.len);
+        }
+
+        pfq_close(p);
+        return 0;
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <pfq/pfq.hpp>
+
+using namespace pfq;
+
+/*
+ * Tx pacing accuracy.
+ *
+ * num packets are scheduled at the given rate (packets per second) by means of
+ * send_at, and transmitted by a PFQ kernel thread. At the end the lateness of
+ * the transmissions measured by the kernel is reported.
+ */
+
+/* Frame (98 bytes) */
+
+static const unsigned char ping[98] =
+{
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0, 0xbf, /* L`..UF.. */
+    0x97, 0xe2, 0xff, 0xae, 0x08, 0x00, 0x45, 0x00, /* ......E. */
+    0x00, 0x54, 0xb3, 0xf9, 0x40, 0x00, 0x40, 0x01, /* .T..@.@. */
+    0xf5, 0x32, 0xc0, 0xa8, 0x00, 0x02, 0xad, 0xc2, /* .2...... */
+    0x23, 0x10, 0x08, 0x00, 0xf2, 0xea, 0x42, 0x04, /* #.....B. */
+    0x00, 0x01, 0xfe, 0xeb, 0xfc, 0x52, 0x00, 0x00, /* .....R.. */
+    0x00, 0x00, 0x06, 0xfe, 0x02, 0x00, 0x00, 0x00, /* ........ */
+    0x00, 0x00, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, /* ........ */
+    0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, /* ........ */
+    0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, /* .. !"#$% */
+    0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, /* &'()*+,- */
+    0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, /* ./012345 */
+    0x36, 0x37                                      /* 67 */
+};
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    if (argc < 6)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev queue kthread num pps"));
+
+    const char *dev = argv[1];
+    int queue       = atoi(argv[2]);
+    int kthread     = atoi(argv[3]);
+    int64_t num     = atoll(argv[4]);
+    int64_t pps     = atoll(argv[5]);
+
+    if (kthread < 0 || pps <= 0)
+        throw std::runtime_error("pacing requires a Tx kthread and a positive rate");
+
+    pfq::socket q(64, 1024, 1024);
+
+    q.bind_tx(dev, queue, kthread);
+
+    q.enable();
+
+    auto gap   = std::chrono::nanoseconds(1000000000 / pps);
+    auto start = std::chrono::system_clock::now() + std::chrono::milliseconds(10);
+
+    std::cout << "sending " << num << " packets at " << pps << " pps..." << std::endl;
+
+    for(int64_t n = 0; n < num;)
+    {
+        if (q.send_at(pfq::const_buffer(reinterpret_cast<const char *>(ping), sizeof(ping)), start + gap * n, 1, 0))
+            n++;
+        else
+            std::this_thread::yield();
+    }
+
+    std::this_thread::sleep_until(start + gap * num + std::chrono::seconds(1));
+
+    auto stat   = q.stats();
+    auto pacing = q.tx_pacing_stats();
+
+    std::cout << "sent: " << stat.sent << " - fail: " << stat.fail << std::endl;
+    std::cout << "paced: " << pacing.paced << " - late: " << pacing.late
+              << " - avg lag: " << (pacing.paced ? pacing.lag / pacing.paced : 0) << " nsec" << std::endl;
+
+    for(int n = 0; n < Q_TX_PACING_BUCKETS; n++)
+    {
+        if (!pacing.hist[n])
+            continue;
+
+        if (n == Q_TX_PACING_BUCKETS - 1)
+            std::cout << "  lag >= " << (1 << (n - 1)) << " usec: " << pacing.hist[n] << std::endl;
+        else
+            std::cout << "  lag < " << (1 << n) << " usec: " << pacing.hist[n] << std::endl;
+    }
+
+    return 0;
+}
+catch(std::exception &e)
+{
+    std::cout << e.what() << std::endl;
+}
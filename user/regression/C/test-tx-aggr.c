@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <pfq/pfq.h>
+
+/*
+ * Tx aggregation.
+ *
+ * N sockets (1, 4 and 16 by default) transmit to the same device queue through
+ * the same Tx kthread, one sender thread per socket. The kthread serves the
+ * sockets in a single burst per device queue (see the tx_aggr module parameter):
+ * the aggregate rate (pps) is reported for each run.
+ */
+
+/* Frame (98 bytes) */
+
+static const unsigned char ping[98] =
+{
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0, 0xbf, /* L`..UF.. */
+        0x97, 0xe2, 0xff, 0xae, 0x08, 0x00, 0x45, 0x00, /* ......E. */
+        0x00, 0x54, 0xb3, 0xf9, 0x40, 0x00, 0x40, 0x01, /* .T..@.@. */
+        0xf5, 0x32, 0xc0, 0xa8, 0x00, 0x02, 0xad, 0xc2, /* .2...... */
+        0x23, 0x10, 0x08, 0x00, 0xf2, 0xea, 0x42, 0x04, /* #.....B. */
+        0x00, 0x01, 0xfe, 0xeb, 0xfc, 0x52, 0x00, 0x00, /* .....R.. */
+        0x00, 0x00, 0x06, 0xfe, 0x02, 0x00, 0x00, 0x00, /* ........ */
+        0x00, 0x00, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, /* ........ */
+        0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, /* ........ */
+        0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, /* .. !"#$% */
+        0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, /* &'()*+,- */
+        0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, /* ./012345 */
+        0x36, 0x37                                      /* 67 */
+};
+
+
+static volatile int stop;
+
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void *
+sender(void *arg)
+{
+	pfq_t *q = (pfq_t *)arg;
+
+	while (!stop)
+	{
+		if (pfq_send_async(q, ping, sizeof(ping), 1, 0) <= 0)
+			pfq_relax();
+	}
+
+	return NULL;
+}
+
+
+static int
+run(const char *dev, int queue, int kthread, int sockets, int seconds)
+{
+	pfq_t *q[sockets];
+	pthread_t th[sockets];
+	unsigned long sent = 0, fail = 0;
+	double start, elapsed;
+	int n;
+
+	for(n = 0; n < sockets; n++)
+	{
+		q[n] = pfq_open(64, 1024, 64, 4096);
+		if (q[n] == NULL) {
+			fprintf(stderr, "error: %s\n", pfq_error(q[n]));
+			return -1;
+		}
+
+		if (pfq_bind_tx(q[n], dev, queue, kthread) < 0 ||
+		    pfq_enable(q[n]) < 0) {
+			fprintf(stderr, "error: %s\n", pfq_error(q[n]));
+			return -1;
+		}
+	}
+
+	stop = 0;
+	start = now();
+
+	for(n = 0; n < sockets; n++)
+		pthread_create(&th[n], NULL, sender, q[n]);
+
+	while ((elapsed = now() - start) < seconds)
+		sleep(1);
+
+	stop = 1;
+
+	for(n = 0; n < sockets; n++)
+		pthread_join(th[n], NULL);
+
+	for(n = 0; n < sockets; n++)
+	{
+		struct pfq_stats stat;
+		if (pfq_get_stats(q[n], &stat) == 0) {
+			sent += stat.sent;
+			fail += stat.fail;
+		}
+
+		pfq_close(q[n]);
+	}
+
+	printf("%2d socket(s): sent %lu (%.0f pps) - fail %lu\n", sockets, sent, sent / elapsed, fail);
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	static const int default_sockets[] = { 1, 4, 16 };
+	int n;
+
+        if (argc < 5)
+        {
+                fprintf(stderr, "usage: %s dev queue kthread seconds [sockets...]\n", argv[0]);
+                return -1;
+        }
+
+        const char *dev = argv[1];
+        int queue   = atoi(argv[2]);
+        int kthread = atoi(argv[3]);
+        int seconds = atoi(argv[4]);
+
+	if (kthread < 0) {
+		fprintf(stderr, "Tx aggregation requires a Tx kthread\n");
+		return -1;
+	}
+
+	if (argc > 5) {
+		for(n = 5; n < argc; n++)
+			if (run(dev, queue, kthread, atoi(argv[n]), seconds) < 0)
+				return -1;
+	}
+	else {
+		for(n = 0; n < 3; n++)
+			if (run(dev, queue, kthread, default_sockets[n], seconds) < 0)
+				return -1;
+	}
+
+        return 0;
+}
@@ -116,6 +116,7 @@ namespace opt
     size_t seconds      = std::numeric_limits<size_t>::max();
     size_t loop         = 1;
     size_t preload      = 1;
+    size_t burst        = 0;
     unsigned int copies = 1;
 
     std::atomic_int nthreads;
@@ -127,6 +128,7 @@ namespace opt
     bool   rand_flow   = false;
     bool   interactive = false;
     bool   checksum    = false;
+    bool   packed      = false;
 
     double rate = 0;
 
@@ -267,6 +269,7 @@ namespace thread
                 throw std::runtime_error("context[" + std::to_string (m_id) + "]: device unspecified");
 
             m_async = kthread != std::vector<int>{-1};
+            m_queues = m_async ? static_cast<int>(m_bind.dev.front().queue.size()) : 1;
 
             auto q = pfq::socket(param::list, param::tx_slots{opt::slots});
 
@@ -297,7 +300,10 @@ namespace thread
 
         void operator()()
         {
-            m_pfq.enable();
+            if (opt::packed)
+                m_pfq.enable(Q_ENABLE_TX_PACKED);
+            else
+                m_pfq.enable();
 
             if (!m_packet)
                 throw std::runtime_error("pool of packets empty!");
@@ -309,6 +315,9 @@ namespace thread
                 throw std::runtime_error("pcap support disabled!");
 #endif
             }
+            else if (opt::burst > 0) {
+                inplace_generator();
+            }
             else if (opt::preload > 1) {
                 pool_generator();
             }
@@ -464,6 +473,90 @@ namespace thread
         }
 
 
+        // packets are built in the Tx slots (reserve/commit), without the copy of send
+        //
+
+        void inplace_generator()
+        {
+            std::cout << "generator  : in-place traffic started (bursts of " << opt::burst << " slots)..." << std::endl;
+
+            auto delta = std::chrono::nanoseconds(static_cast<uint64_t>(1000/opt::rate));
+            auto now   = std::chrono::system_clock::now();
+            auto len   = opt::len;
+
+            auto rc = opt::rate != 0.0;
+
+            uint32_t rand_mask = ((1ULL << opt::rand_depth)-1);
+
+            std::vector<char *> slots(opt::burst);
+
+            size_t idx = 0, pending = 0;
+            int queue = 0;
+
+            for(size_t n = 0; n < opt::npackets;)
+            {
+                if (rc)
+                    rate_control(now, delta, n);
+
+                if (opt::interactive)
+                    wait_keyboard();
+
+                auto want = static_cast<int>(std::min(opt::burst, opt::npackets - n));
+                auto num  = m_pfq.reserve(len, slots.data(), want, m_async ? queue : pfq::no_kthread);
+                if (num == 0)
+                {
+                    m_fail->fetch_add(1, std::memory_order_relaxed);
+                    if (!m_async) {
+                        m_pfq.sync_queue(0);
+                        pending = 0;
+                    }
+                    continue;
+                }
+
+                for(int i = 0; i < num; i++, n++)
+                {
+                    char *pkt = slots[static_cast<size_t>(i)];
+
+                    memcpy(pkt, m_packet.get() + (idx++ & (opt::preload-1)) * opt::len, len);
+
+                    auto ip = reinterpret_cast<iphdr *>(pkt + 14);
+
+                    if (opt::rand_src_ip && (n & (opt::rand_src_period-1)) == 0)
+                        ip->saddr = opt::src_ip | htonl(static_cast<uint32_t>(m_gen()) & rand_mask);
+
+                    if (opt::rand_dst_ip && (n & (opt::rand_dst_period-1)) == 0)
+                        ip->daddr = opt::dst_ip | htonl(static_cast<uint32_t>(m_gen()) & rand_mask);
+
+                    if (opt::checksum)
+                    {
+                        ip->check = 0;
+                        ip->check = in_cksum(reinterpret_cast<u_short *>(ip), 20);
+                    }
+                }
+
+                m_pfq.commit(num);
+
+                if (m_async) {
+                    queue = (queue + 1) % m_queues;
+                }
+                else if ((pending += static_cast<size_t>(num)) >= opt::queue_sync) {
+                    m_pfq.sync_queue(0);
+                    pending = 0;
+                }
+
+                m_sent->fetch_add(static_cast<unsigned long long>(num), std::memory_order_relaxed);
+                m_band->fetch_add(len * static_cast<size_t>(num), std::memory_order_relaxed);
+                m_gros->fetch_add((len+24) * static_cast<size_t>(num), std::memory_order_relaxed);
+
+                if (opt::stop.load(std::memory_order_relaxed))
+                    break;
+            }
+
+            if (!m_async && pending)
+                m_pfq.sync_queue(0);
+        }
+
+
 #ifdef HAVE_PCAP_H
         void pcap_generator()
         {
@@ -595,6 +688,7 @@ namespace thread
         std::unique_ptr<char[]> m_packet;
 
         bool m_async;
+        int  m_queues;
     };
 
 }
@@ -636,6 +730,8 @@ void usage(std::string name)
         "    --dst-mac MAC              Specify dest MAC address\n"
         "    --src-mac MAC              Specify source MAC address\n"
         " -P --preload INT              Preload INT packets (must be a power of 2)\n"
+        " -B --burst INT                Build packets in place, INT Tx slots at a time\n"
+        "    --packed                   Use variable-length Tx slots\n"
         "    --rate DOUBLE              Packet rate in Mpps\n"
         "    --interactive              Transmit a packet at time\n"
         " -S --queue-sync INT           Set queue sync value, used to Tx sync\n"
@@ -777,6 +873,17 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "-B", "--burst") )
+        {
+            if (++i == argc)
+            {
+                throw std::runtime_error("burst missing");
+            }
+
+            opt::burst = static_cast<size_t>(std::atoi(argv[i]));
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-s", "--slots") )
         {
             if (++i == argc)
@@ -935,6 +1042,12 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--packed") )
+        {
+            opt::packed = true;
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "--interactive") )
         {
             opt::interactive = true;